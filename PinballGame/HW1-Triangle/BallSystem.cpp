@@ -0,0 +1,290 @@
+#include "BallSystem.h"
+
+#include <algorithm>
+#include <cstring>
+#include <glm/simd/platform.h>
+
+namespace
+{
+	//The swept pass, then passes that push apart what it left overlapping
+	const int MAX_PASSES = 4;
+}
+
+BallSystem::BallSystem() : count(0), orderValid(true)
+{
+	memset(&stats, 0, sizeof(stats));
+}
+
+size_t BallSystem::Add(const glm::vec3 &position, const glm::vec3 &velocity, float radius)
+{
+	positionX.push_back(position.x);
+	positionY.push_back(position.y);
+	positionZ.push_back(position.z);
+	previousX.push_back(position.x);
+	previousY.push_back(position.y);
+	previousZ.push_back(position.z);
+	velocityX.push_back(velocity.x);
+	velocityY.push_back(velocity.y);
+	velocityZ.push_back(velocity.z);
+	angularX.push_back(0.0f);
+	angularY.push_back(0.0f);
+	angularZ.push_back(0.0f);
+	this->radius.push_back(radius);
+	//Same density for every ball, mass goes with the volume
+	inverseMass.push_back(1.0f / (radius * radius * radius));
+	order.push_back((uint32_t)count);
+	orderValid = false;
+	return count++;
+}
+
+void BallSystem::Remove(size_t index)
+{
+	size_t last = count - 1;
+	vector<float> *arrays[] = { &positionX, &positionY, &positionZ, &previousX, &previousY, &previousZ,
+		&velocityX, &velocityY, &velocityZ, &angularX, &angularY, &angularZ, &radius, &inverseMass };
+	for (vector<float> *values : arrays)
+	{
+		(*values)[index] = (*values)[last];
+		values->pop_back();
+	}
+	count--;
+	//The sorted order refers to indices that just moved, start it over
+	order.resize(count);
+	for (size_t i = 0; i < count; i++)
+		order[i] = (uint32_t)i;
+	orderValid = false;
+}
+
+void BallSystem::Clear()
+{
+	vector<float> *arrays[] = { &positionX, &positionY, &positionZ, &previousX, &previousY, &previousZ,
+		&velocityX, &velocityY, &velocityZ, &angularX, &angularY, &angularZ, &radius, &inverseMass };
+	for (vector<float> *values : arrays)
+		values->clear();
+	order.clear();
+	count = 0;
+	orderValid = true;
+}
+
+void BallSystem::SetPosition(size_t i, const glm::vec3 &position)
+{
+	positionX[i] = position.x;
+	positionY[i] = position.y;
+	positionZ[i] = position.z;
+}
+
+void BallSystem::SetVelocity(size_t i, const glm::vec3 &velocity)
+{
+	velocityX[i] = velocity.x;
+	velocityY[i] = velocity.y;
+	velocityZ[i] = velocity.z;
+}
+
+void BallSystem::SetAngularVelocity(size_t i, const glm::vec3 &angular)
+{
+	angularX[i] = angular.x;
+	angularY[i] = angular.y;
+	angularZ[i] = angular.z;
+}
+
+void BallSystem::Integrate(float dt, const glm::vec3 &gravity, float angularDamping)
+{
+	float damping = glm::max(0.0f, 1.0f - angularDamping * dt);
+
+	//Four balls at a time, the rest one by one (all of them without SSE2)
+	size_t wide = 0;
+#if GLM_ARCH & GLM_ARCH_SSE2_BIT
+	wide = count & ~(size_t)3;
+	const glm_vec4 step = _mm_set1_ps(dt);
+	const glm_vec4 gravityX = _mm_set1_ps(gravity.x * dt), gravityY = _mm_set1_ps(gravity.y * dt), gravityZ = _mm_set1_ps(gravity.z * dt);
+	const glm_vec4 spin = _mm_set1_ps(damping);
+	for (size_t i = 0; i < wide; i += 4)
+	{
+		glm_vec4 x = _mm_loadu_ps(&positionX[i]), y = _mm_loadu_ps(&positionY[i]), z = _mm_loadu_ps(&positionZ[i]);
+		_mm_storeu_ps(&previousX[i], x);
+		_mm_storeu_ps(&previousY[i], y);
+		_mm_storeu_ps(&previousZ[i], z);
+
+		glm_vec4 vx = _mm_add_ps(_mm_loadu_ps(&velocityX[i]), gravityX);
+		glm_vec4 vy = _mm_add_ps(_mm_loadu_ps(&velocityY[i]), gravityY);
+		glm_vec4 vz = _mm_add_ps(_mm_loadu_ps(&velocityZ[i]), gravityZ);
+		_mm_storeu_ps(&velocityX[i], vx);
+		_mm_storeu_ps(&velocityY[i], vy);
+		_mm_storeu_ps(&velocityZ[i], vz);
+		_mm_storeu_ps(&positionX[i], _mm_add_ps(x, _mm_mul_ps(vx, step)));
+		_mm_storeu_ps(&positionY[i], _mm_add_ps(y, _mm_mul_ps(vy, step)));
+		_mm_storeu_ps(&positionZ[i], _mm_add_ps(z, _mm_mul_ps(vz, step)));
+
+		_mm_storeu_ps(&angularX[i], _mm_mul_ps(_mm_loadu_ps(&angularX[i]), spin));
+		_mm_storeu_ps(&angularY[i], _mm_mul_ps(_mm_loadu_ps(&angularY[i]), spin));
+		_mm_storeu_ps(&angularZ[i], _mm_mul_ps(_mm_loadu_ps(&angularZ[i]), spin));
+	}
+#endif
+	for (size_t i = wide; i < count; i++)
+	{
+		previousX[i] = positionX[i];
+		previousY[i] = positionY[i];
+		previousZ[i] = positionZ[i];
+		velocityX[i] += gravity.x * dt;
+		velocityY[i] += gravity.y * dt;
+		velocityZ[i] += gravity.z * dt;
+		positionX[i] += velocityX[i] * dt;
+		positionY[i] += velocityY[i] * dt;
+		positionZ[i] += velocityZ[i] * dt;
+		angularX[i] *= damping;
+		angularY[i] *= damping;
+		angularZ[i] *= damping;
+	}
+}
+
+void BallSystem::CollideBalls(float restitution, float dt, const MoveFunction &move)
+{
+	stats.pairsTested = 0;
+	stats.contacts = 0;
+	if (count < 2)
+		return;
+
+	//Every contact moves its balls, which leaves the order stale for the rest of the pass, so a pair it brought
+	//together can be missed. Sorted again after each pass, only the balls the last pass moved are checked again.
+	sortOrder();
+	moved.assign(count, 0);
+	for (size_t i = 0; i < count; i++)
+	{
+		uint32_t a = order[i];
+		for (size_t j = i + 1; j < count && sweptLower(order[j]) <= sweptUpper(a); j++)
+		{
+			stats.pairsTested++;
+			uint32_t b = order[j];
+			float time;
+			if (!contactTime(a, b, time))
+				continue;
+			stats.contacts++;
+			resolveContact(a, b, time, restitution, dt, move);
+			moved[a] = moved[b] = 1;
+		}
+	}
+
+	for (int pass = 1; pass < MAX_PASSES && find(moved.begin(), moved.end(), 1) != moved.end(); pass++)
+	{
+		sortOrder();
+		movedBefore.swap(moved);
+		moved.assign(count, 0);
+		for (size_t i = 0; i < count; i++)
+		{
+			uint32_t a = order[i];
+			for (size_t j = i + 1; j < count && sweptLower(order[j]) <= sweptUpper(a); j++)
+			{
+				uint32_t b = order[j];
+				if (!movedBefore[a] && !movedBefore[b])
+					continue;
+				stats.pairsTested++;
+				glm::vec3 offset = Position(b) - Position(a);
+				float reach = radius[a] + radius[b];
+				if (glm::dot(offset, offset) >= reach * reach)
+					continue;
+				stats.contacts++;
+				pushApart(a, b, restitution, move);
+				moved[a] = moved[b] = 1;
+			}
+		}
+	}
+}
+
+void BallSystem::sortOrder()
+{
+	//Balls moved a little since the last sort, insertion sort only has to fix up a few neighbours
+	if (!orderValid)
+	{
+		sort(order.begin(), order.end(), [this](uint32_t a, uint32_t b) { return sweptLower(a) < sweptLower(b); });
+		orderValid = true;
+	}
+	for (size_t i = 1; i < count; i++)
+	{
+		uint32_t ball = order[i];
+		float lower = sweptLower(ball);
+		size_t j = i;
+		while (j > 0 && sweptLower(order[j - 1]) > lower)
+		{
+			order[j] = order[j - 1];
+			j--;
+		}
+		order[j] = ball;
+	}
+}
+
+bool BallSystem::contactTime(size_t a, size_t b, float &time) const
+{
+	//b relative to a, a sphere of both radii against a point
+	float reach = radius[a] + radius[b];
+	glm::vec3 start = PreviousPosition(b) - PreviousPosition(a);
+	glm::vec3 motion = Position(b) - Position(a) - start;
+	float gap = glm::dot(start, start) - reach * reach;
+	if (gap < 0.0f)
+	{
+		time = 0.0f;
+		return true;
+	}
+	float length = glm::dot(motion, motion);
+	float closing = glm::dot(start, motion);
+	if (closing >= 0.0f || length == 0.0f)
+		return false;
+	float discriminant = closing * closing - length * gap;
+	if (discriminant < 0.0f)
+		return false;
+	time = (-closing - sqrtf(discriminant)) / length;
+	return time <= 1.0f;
+}
+
+void BallSystem::resolveContact(size_t a, size_t b, float time, float restitution, float dt, const MoveFunction &move)
+{
+	//Already overlapped before the step
+	if (time == 0.0f)
+	{
+		pushApart(a, b, restitution, move);
+		return;
+	}
+
+	float weightA = inverseMass[a], weightB = inverseMass[b];
+	glm::vec3 contactA = glm::mix(PreviousPosition(a), Position(a), time);
+	glm::vec3 contactB = glm::mix(PreviousPosition(b), Position(b), time);
+	glm::vec3 offset = contactB - contactA;
+	float distance = glm::length(offset);
+	glm::vec3 normal = distance > 0.0f ? offset / distance : glm::vec3(0.0f, 1.0f, 0.0f);
+
+	glm::vec3 velocityA = Velocity(a), velocityB = Velocity(b);
+	float approach = glm::dot(velocityB - velocityA, normal);
+	if (approach < 0.0f)
+	{
+		float impulse = -(1.0f + restitution) * approach / (weightA + weightB);
+		velocityA -= normal * (impulse * weightA);
+		velocityB += normal * (impulse * weightB);
+		SetVelocity(a, velocityA);
+		SetVelocity(b, velocityB);
+	}
+
+	//From the contact on with the velocities after the bounce
+	SetPosition(a, move(a, contactA + velocityA * ((1.0f - time) * dt)));
+	SetPosition(b, move(b, contactB + velocityB * ((1.0f - time) * dt)));
+}
+
+void BallSystem::pushApart(size_t a, size_t b, float restitution, const MoveFunction &move)
+{
+	float weightA = inverseMass[a], weightB = inverseMass[b];
+	float reach = radius[a] + radius[b];
+	glm::vec3 offset = Position(b) - Position(a);
+	float distance = glm::length(offset);
+	glm::vec3 normal = distance > 0.0f ? offset / distance : glm::vec3(0.0f, 1.0f, 0.0f);
+
+	float approach = glm::dot(Velocity(b) - Velocity(a), normal);
+	if (approach < 0.0f)
+	{
+		float impulse = -(1.0f + restitution) * approach / (weightA + weightB);
+		SetVelocity(a, Velocity(a) - normal * (impulse * weightA));
+		SetVelocity(b, Velocity(b) + normal * (impulse * weightB));
+	}
+
+	//By the overlap, the lighter ball moves more
+	float share = glm::max(reach - distance, 0.0f) / (weightA + weightB);
+	SetPosition(a, move(a, Position(a) - normal * (share * weightA)));
+	SetPosition(b, move(b, Position(b) + normal * (share * weightB)));
+}
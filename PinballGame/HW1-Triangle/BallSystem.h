@@ -0,0 +1,87 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <vector>
+using namespace std;
+
+/// <summary>
+/// Every ball on the table, stored as structure of arrays: one array per component of position, velocity and angular
+/// velocity, plus radius and inverse mass. Integrate() advances four balls per SSE instruction (one at a time without
+/// SSE2) and keeps the positions before the step for interpolation. Ball against ball contacts are found by sort and
+/// sweep along the table's length over what each ball swept this step, from its previous position to its position: the
+/// balls stay sorted by the lower end of that extent (an insertion sort, nearly free since balls barely move between
+/// steps) and each ball only checks the balls whose extent starts before its own ends, so the cost grows with the
+/// number of balls plus the number of close pairs instead of with every pair. Pairs are tested swept like the table, at
+/// their time of impact, so two fast balls can't pass through each other within a step. Contacts move balls, so a few
+/// more passes, sorted again, push apart whatever the moved balls still overlap.
+/// </summary>
+class BallSystem
+{
+public:
+	BallSystem();
+
+	//Returns the ball's index. Indices stay valid until a ball is removed.
+	size_t Add(const glm::vec3 &position, const glm::vec3 &velocity, float radius);
+	//Moves the last ball into index
+	void Remove(size_t index);
+	void Clear();
+	size_t Count() const { return count; }
+
+	//Keeps the positions, then velocity += gravity dt and position += velocity dt. angularDamping is per second.
+	void Integrate(float dt, const glm::vec3 &gravity, float angularDamping);
+	//Where ball ends up moving in a straight line from its position towards target, so whatever is in the way can stop it
+	typedef function<glm::vec3(size_t ball, const glm::vec3 &target)> MoveFunction;
+
+	//Bounces the balls that met during the last step of dt seconds, and pushes apart the ones that already overlapped
+	//at its start or do after the bounces. Every change of position goes through move.
+	void CollideBalls(float restitution, float dt, const MoveFunction &move);
+
+	glm::vec3 Position(size_t i) const { return glm::vec3(positionX[i], positionY[i], positionZ[i]); }
+	glm::vec3 PreviousPosition(size_t i) const { return glm::vec3(previousX[i], previousY[i], previousZ[i]); }
+	//Between the position before the last step (0) and after it (1)
+	glm::vec3 Interpolated(size_t i, float alpha) const { return glm::mix(PreviousPosition(i), Position(i), alpha); }
+	glm::vec3 Velocity(size_t i) const { return glm::vec3(velocityX[i], velocityY[i], velocityZ[i]); }
+	glm::vec3 AngularVelocity(size_t i) const { return glm::vec3(angularX[i], angularY[i], angularZ[i]); }
+	float Radius(size_t i) const { return radius[i]; }
+
+	void SetPosition(size_t i, const glm::vec3 &position);
+	void SetVelocity(size_t i, const glm::vec3 &velocity);
+	void SetAngularVelocity(size_t i, const glm::vec3 &angular);
+
+	//What the last CollideBalls() did
+	struct Stats
+	{
+		unsigned int pairsTested;	// overlapping extents along the sweep axis, over every pass
+		unsigned int contacts;
+	};
+	const Stats& LastStats() const { return stats; }
+
+private:
+	//Extent along y of what the ball swept in the last step
+	float sweptLower(size_t i) const { return std::min(previousY[i], positionY[i]) - radius[i]; }
+	float sweptUpper(size_t i) const { return std::max(previousY[i], positionY[i]) + radius[i]; }
+	//Fraction of the step at which a and b first touch moving from their previous positions to their positions,
+	//0 if they already overlapped. False if they never do.
+	bool contactTime(size_t a, size_t b, float &time) const;
+	void resolveContact(size_t a, size_t b, float time, float restitution, float dt, const MoveFunction &move);
+	//Bounces a and b if they move towards each other and moves them apart until they only touch
+	void pushApart(size_t a, size_t b, float restitution, const MoveFunction &move);
+	//By sweptLower(), an insertion sort unless orderValid is false
+	void sortOrder();
+
+	size_t count;
+	vector<float> positionX, positionY, positionZ;
+	vector<float> previousX, previousY, previousZ;
+	vector<float> velocityX, velocityY, velocityZ;
+	vector<float> angularX, angularY, angularZ;
+	vector<float> radius;
+	vector<float> inverseMass;	// relative, a ball of radius 1 weighs 1
+
+	vector<uint32_t> order;		// balls sorted by sweptLower()
+	vector<uint8_t> moved, movedBefore;	// per ball, whether a contact moved it in this pass and in the one before
+	bool orderValid;
+	Stats stats;
+};
@@ -0,0 +1,70 @@
+#include "Bounds.h"
+
+#include <cmath>
+#include "Mesh.h"
+
+BoundingBox BoundingBox::Transformed(const glm::mat4 &transform) const
+{
+	if (Empty())
+		return *this;
+
+	//Arvo's method: move the center, the extents along each new axis are the absolute rotated extents
+	glm::vec3 center = glm::vec3(transform * glm::vec4(Center(), 1.0f));
+	glm::vec3 extents = Extents();
+	glm::vec3 newExtents(0.0f);
+	for (int axis = 0; axis < 3; axis++)
+		newExtents += glm::abs(glm::vec3(transform[axis])) * extents[axis];
+	return BoundingBox(center - newExtents, center + newExtents);
+}
+
+void BoundingSphere::Extend(const BoundingSphere &other)
+{
+	if (other.Empty())
+		return;
+	if (Empty())
+	{
+		*this = other;
+		return;
+	}
+
+	glm::vec3 offset = other.center - center;
+	float distance = glm::length(offset);
+	if (distance + other.radius <= radius)
+		return; //other is already inside
+	if (distance + radius <= other.radius)
+	{
+		*this = other;
+		return;
+	}
+
+	float newRadius = (distance + radius + other.radius) * 0.5f;
+	center += offset * ((newRadius - radius) / distance);
+	radius = newRadius;
+}
+
+BoundingSphere BoundingSphere::Transformed(const glm::mat4 &transform) const
+{
+	if (Empty())
+		return *this;
+	float scale = glm::max(glm::length(glm::vec3(transform[0])), glm::max(glm::length(glm::vec3(transform[1])), glm::length(glm::vec3(transform[2]))));
+	return BoundingSphere(glm::vec3(transform * glm::vec4(center, 1.0f)), radius * scale);
+}
+
+Bounds Bounds::FromVertices(const Vertex *vertices, size_t count)
+{
+	Bounds bounds;
+	for (size_t i = 0; i < count; i++)
+		bounds.box.Extend(vertices[i].Position);
+	if (bounds.box.Empty())
+		return bounds;
+
+	glm::vec3 center = bounds.box.Center();
+	float radiusSquared = 0.0f;
+	for (size_t i = 0; i < count; i++)
+	{
+		glm::vec3 offset = vertices[i].Position - center;
+		radiusSquared = glm::max(radiusSquared, glm::dot(offset, offset));
+	}
+	bounds.sphere = BoundingSphere(center, sqrtf(radiusSquared));
+	return bounds;
+}
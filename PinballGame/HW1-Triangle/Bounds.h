@@ -0,0 +1,74 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <cfloat>
+
+struct Vertex;
+
+//Axis aligned box, empty (min > max) until something is added
+struct BoundingBox
+{
+	glm::vec3 min;
+	glm::vec3 max;
+
+	BoundingBox() : min(FLT_MAX), max(-FLT_MAX) {}
+	BoundingBox(const glm::vec3 &min, const glm::vec3 &max) : min(min), max(max) {}
+
+	bool Empty() const { return min.x > max.x; }
+	glm::vec3 Center() const { return (min + max) * 0.5f; }
+	glm::vec3 Extents() const { return (max - min) * 0.5f; }
+
+	void Extend(const glm::vec3 &point)
+	{
+		min = glm::min(min, point);
+		max = glm::max(max, point);
+	}
+	void Extend(const BoundingBox &other)
+	{
+		if (other.Empty())
+			return;
+		min = glm::min(min, other.min);
+		max = glm::max(max, other.max);
+	}
+
+	//The box around this box after transform, still axis aligned
+	BoundingBox Transformed(const glm::mat4 &transform) const;
+};
+
+struct BoundingSphere
+{
+	glm::vec3 center;
+	float radius;	// negative while empty
+
+	BoundingSphere() : center(0.0f), radius(-1.0f) {}
+	BoundingSphere(const glm::vec3 &center, float radius) : center(center), radius(radius) {}
+
+	bool Empty() const { return radius < 0.0f; }
+
+	//Grows to the smallest sphere around both spheres
+	void Extend(const BoundingSphere &other);
+
+	//Scales the radius by the largest axis scale of transform
+	BoundingSphere Transformed(const glm::mat4 &transform) const;
+};
+
+/// <summary>
+/// Box and sphere around a mesh or object in its own space. The box is the tighter fit for the mostly flat,
+/// axis aligned table parts, the sphere is cheaper to move around and test.
+/// </summary>
+struct Bounds
+{
+	BoundingBox box;
+	BoundingSphere sphere;
+
+	bool Empty() const { return box.Empty(); }
+
+	void Extend(const Bounds &other)
+	{
+		box.Extend(other.box);
+		sphere.Extend(other.sphere);
+	}
+
+	//Box around the positions and a sphere centered in the box that reaches the farthest vertex
+	static Bounds FromVertices(const Vertex *vertices, size_t count);
+};
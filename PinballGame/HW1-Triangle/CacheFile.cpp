@@ -0,0 +1,42 @@
+#include "CacheFile.h"
+
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+
+uint64_t Fnv1a(const void *data, size_t count, uint64_t hash)
+{
+	const unsigned char *bytes = (const unsigned char*)data;
+	for (size_t i = 0; i < count; i++)
+	{
+		hash ^= bytes[i];
+		hash *= 1099511628211ull;
+	}
+	return hash;
+}
+
+bool WriteCacheFile(const string &path, const char *errorTag, const function<void(ostream &out)> &write)
+{
+	string tempPath = path + ".tmp";
+	{
+		ofstream out(tempPath, ios::binary | ios::trunc);
+		if (!out)
+			return false;
+		write(out);
+		if (!out)
+		{
+			out.close();
+			remove(tempPath.c_str());
+			return false;
+		}
+	}
+
+	remove(path.c_str());
+	if (rename(tempPath.c_str(), path.c_str()) != 0)
+	{
+		cout << "ERROR::" << errorTag << ":: could not write " << path << endl;
+		remove(tempPath.c_str());
+		return false;
+	}
+	return true;
+}
@@ -0,0 +1,20 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <ostream>
+#include <string>
+using namespace std;
+
+/*
+ * Helpers shared by the on-disk caches (MeshCache, ShaderCache, CollisionBvh, Lightmap)
+ */
+
+const uint64_t FNV1A_OFFSET_BASIS = 14695981039346656037ull;
+
+//64 bit FNV-1a of count bytes. Pass the previous result as hash to key several pieces together.
+uint64_t Fnv1a(const void *data, size_t count, uint64_t hash = FNV1A_OFFSET_BASIS);
+
+//Writes path through a temporary file that only replaces it once write() left the stream good, so a crash never leaves
+//a half written cache behind. errorTag names the cache in the "ERROR::<errorTag>::" line printed if the swap fails.
+bool WriteCacheFile(const string &path, const char *errorTag, const function<void(ostream &out)> &write);
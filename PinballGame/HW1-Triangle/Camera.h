@@ -108,6 +108,15 @@ public:
 		updateCameraVectors();
 	}
 
+	// Places the camera directly, for scripted camera paths
+	void SetPose(glm::vec3 position, float yaw, float pitch)
+	{
+		Position = position;
+		Yaw = yaw;
+		Pitch = pitch;
+		updateCameraVectors();
+	}
+
 	// Processes input received from a mouse scroll-wheel event. Only requires input on the vertical wheel-axis
 	void ProcessMouseScroll(float yoffset)
 	{
@@ -0,0 +1,84 @@
+#include "CameraPath.h"
+
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+CameraPath CameraPath::Default()
+{
+	CameraPath path;
+	path.Add({ 0.0f, glm::vec3(0.0f, 0.0f, 3.0f), -90.0f, 0.0f });
+	path.Add({ 2.0f, glm::vec3(-1.5f, 0.5f, 2.5f), -60.0f, -10.0f });
+	path.Add({ 4.0f, glm::vec3(0.0f, 1.5f, 1.5f), -90.0f, -40.0f });
+	path.Add({ 6.0f, glm::vec3(1.5f, 0.5f, 2.5f), -120.0f, -10.0f });
+	path.Add({ 8.0f, glm::vec3(0.0f, -0.5f, 4.0f), -90.0f, 5.0f });
+	path.Add({ 10.0f, glm::vec3(0.0f, 0.0f, 3.0f), -90.0f, 0.0f });
+	return path;
+}
+
+bool CameraPath::Load(const string &path)
+{
+	ifstream file(path);
+	if (!file)
+	{
+		cout << "ERROR::CAMERA_PATH::FILE_NOT_FOUND " << path << endl;
+		return false;
+	}
+
+	vector<Keyframe> loaded;
+	string line;
+	while (getline(file, line))
+	{
+		if (line.empty() || line[0] == '#')
+			continue;
+		istringstream fields(line);
+		Keyframe keyframe;
+		if (!(fields >> keyframe.time >> keyframe.position.x >> keyframe.position.y >> keyframe.position.z >> keyframe.yaw >> keyframe.pitch))
+			continue;
+		if (!loaded.empty() && keyframe.time <= loaded.back().time)
+		{
+			cout << "ERROR::CAMERA_PATH::TIME_NOT_INCREASING " << path << ": " << line << endl;
+			return false;
+		}
+		loaded.push_back(keyframe);
+	}
+	if (loaded.size() < 2)
+	{
+		cout << "ERROR::CAMERA_PATH::TOO_FEW_KEYFRAMES " << path << endl;
+		return false;
+	}
+	keyframes.swap(loaded);
+	return true;
+}
+
+void CameraPath::Apply(Camera &camera, float time) const
+{
+	if (keyframes.empty())
+		return;
+	if (time <= keyframes.front().time || keyframes.size() == 1)
+	{
+		camera.SetPose(keyframes.front().position, keyframes.front().yaw, keyframes.front().pitch);
+		return;
+	}
+	if (time >= keyframes.back().time)
+	{
+		camera.SetPose(keyframes.back().position, keyframes.back().yaw, keyframes.back().pitch);
+		return;
+	}
+
+	size_t next = 1;
+	while (keyframes[next].time < time)
+		next++;
+	const Keyframe &a = keyframes[next - 1];
+	const Keyframe &b = keyframes[next];
+	//The ends repeat their own keyframe as the missing neighbour
+	const glm::vec3 &before = keyframes[next >= 2 ? next - 2 : next - 1].position;
+	const glm::vec3 &after = keyframes[next + 1 < keyframes.size() ? next + 1 : next].position;
+
+	float t = (time - a.time) / (b.time - a.time);
+	float t2 = t * t, t3 = t2 * t;
+	glm::vec3 position = 0.5f * ((2.0f * a.position) + (b.position - before) * t +
+		(2.0f * before - 5.0f * a.position + 4.0f * b.position - after) * t2 +
+		(3.0f * a.position - before - 3.0f * b.position + after) * t3);
+	camera.SetPose(position, glm::mix(a.yaw, b.yaw, t), glm::mix(a.pitch, b.pitch, t));
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <string>
+#include <vector>
+#include "Camera.h"
+using namespace std;
+
+/// <summary>
+/// Scripted camera flight for benchmark runs: keyframes of position, yaw and pitch at given times, positions
+/// interpolated along a Catmull-Rom spline and the angles linearly, so every run sees exactly the same frames.
+/// Text files hold one keyframe per line, "time x y z yaw pitch", blank lines and lines starting with # are skipped.
+/// </summary>
+class CameraPath
+{
+public:
+	struct Keyframe
+	{
+		float time;		// seconds, increasing
+		glm::vec3 position;
+		float yaw;
+		float pitch;
+	};
+
+	//A sweep around the front of the table, close up over the playfield and back
+	static CameraPath Default();
+
+	//False (and an error) if the file can't be read or has fewer than two keyframes
+	bool Load(const string &path);
+
+	void Add(const Keyframe &keyframe) { keyframes.push_back(keyframe); }
+
+	//Puts the camera where the path is at time, holding the ends
+	void Apply(Camera &camera, float time) const;
+
+	float Duration() const { return keyframes.empty() ? 0.0f : keyframes.back().time; }
+
+private:
+	vector<Keyframe> keyframes;
+};
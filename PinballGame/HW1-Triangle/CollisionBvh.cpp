@@ -0,0 +1,466 @@
+#include "CollisionBvh.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <glm/simd/platform.h>
+#include "CacheFile.h"
+
+namespace
+{
+	const char BVH_CACHE_MAGIC[4] = { 'P', 'B', 'V', 'H' };
+	const uint32_t BVH_CACHE_VERSION = 1;
+
+	const int SAH_BINS = 16;
+	const float TRAVERSAL_COST = 1.0f;	// relative to one triangle test
+	const uint32_t LEAF_TRIANGLES = 2;	// always a leaf at this size
+	const uint32_t MAX_LEAF_TRIANGLES = 8;	// never a leaf above it, unless the triangles can't be told apart
+	const int MAX_STACK = 256;
+
+	/*
+	 * Cache file "<model>.bvh" (little endian):
+	 *   BvhCacheHeader
+	 *   CollisionBvh::Node nodes[nodeCount]
+	 *   uint32 triangleIds[triangleCount]
+	 */
+	struct BvhCacheHeader
+	{
+		char magic[4];		// "PBVH"
+		uint32_t version;	// BVH_CACHE_VERSION
+		uint64_t key;		// hash of the triangles the tree was built over
+		uint32_t nodeCount;
+		uint32_t triangleCount;
+	};
+
+	float surfaceArea(const BoundingBox &box)
+	{
+		if (box.Empty())
+			return 0.0f;
+		glm::vec3 size = box.max - box.min;
+		return 2.0f * (size.x * size.y + size.y * size.z + size.z * size.x);
+	}
+
+	//Binary tree of the top down build, before it's collapsed into 4 wide nodes
+	struct BuildNode
+	{
+		BoundingBox box;
+		int left, right;	// -1 for leaves
+		uint32_t first, count;	// into the build order, for leaves
+	};
+
+	struct Builder
+	{
+		vector<BoundingBox> boxes;		// per triangle
+		vector<glm::vec3> centroids;
+		vector<uint32_t> order;			// triangle indices, leaves are runs of it
+		vector<BuildNode> nodes;
+
+		int build(uint32_t first, uint32_t count)
+		{
+			BuildNode node;
+			node.left = node.right = -1;
+			node.first = first;
+			node.count = count;
+			BoundingBox centroidBox;
+			for (uint32_t i = first; i < first + count; i++)
+			{
+				node.box.Extend(boxes[order[i]]);
+				centroidBox.Extend(centroids[order[i]]);
+			}
+			int index = (int)nodes.size();
+			nodes.push_back(node);
+			if (count <= LEAF_TRIANGLES)
+				return index;
+
+			//Best binned split over all three axes
+			float bestCost = FLT_MAX;
+			int bestAxis = -1, bestBin = 0;
+			glm::vec3 extent = centroidBox.max - centroidBox.min;
+			for (int axis = 0; axis < 3; axis++)
+			{
+				if (extent[axis] <= 0.0f)
+					continue;
+				BoundingBox binBoxes[SAH_BINS];
+				uint32_t binCounts[SAH_BINS] = {};
+				float scale = SAH_BINS / extent[axis];
+				for (uint32_t i = first; i < first + count; i++)
+				{
+					int bin = std::min(SAH_BINS - 1, (int)((centroids[order[i]][axis] - centroidBox.min[axis]) * scale));
+					binBoxes[bin].Extend(boxes[order[i]]);
+					binCounts[bin]++;
+				}
+				//Sweep from the right for the right sides' areas, then from the left
+				float rightAreas[SAH_BINS];
+				BoundingBox right;
+				uint32_t rightCount = 0;
+				uint32_t rightCounts[SAH_BINS];
+				for (int bin = SAH_BINS - 1; bin > 0; bin--)
+				{
+					right.Extend(binBoxes[bin]);
+					rightCount += binCounts[bin];
+					rightAreas[bin] = surfaceArea(right);
+					rightCounts[bin] = rightCount;
+				}
+				BoundingBox left;
+				uint32_t leftCount = 0;
+				for (int bin = 0; bin < SAH_BINS - 1; bin++)
+				{
+					left.Extend(binBoxes[bin]);
+					leftCount += binCounts[bin];
+					if (leftCount == 0 || rightCounts[bin + 1] == 0)
+						continue;
+					float cost = surfaceArea(left) * leftCount + rightAreas[bin + 1] * rightCounts[bin + 1];
+					if (cost < bestCost)
+					{
+						bestCost = cost;
+						bestAxis = axis;
+						bestBin = bin;
+					}
+				}
+			}
+
+			uint32_t middle;
+			if (bestAxis < 0)
+			{
+				//Every centroid in one spot, nothing to tell them apart by. Split by count so leaves stay small.
+				if (count <= MAX_LEAF_TRIANGLES)
+					return index;
+				middle = first + count / 2;
+			}
+			else
+			{
+				float area = surfaceArea(node.box);
+				float splitCost = TRAVERSAL_COST + (area > 0.0f ? bestCost / area : 0.0f);
+				if (splitCost >= (float)count && count <= MAX_LEAF_TRIANGLES)
+					return index;
+
+				float scale = SAH_BINS / extent[bestAxis];
+				float minimum = centroidBox.min[bestAxis];
+				uint32_t *begin = order.data() + first;
+				uint32_t *split = std::partition(begin, begin + count, [&](uint32_t triangle)
+				{
+					return std::min(SAH_BINS - 1, (int)((centroids[triangle][bestAxis] - minimum) * scale)) <= bestBin;
+				});
+				middle = first + (uint32_t)(split - begin);
+			}
+
+			int left = build(first, middle - first);
+			int right = build(middle, first + count - middle);
+			nodes[index].left = left;
+			nodes[index].right = right;
+			return index;
+		}
+	};
+
+	//Turns the binary subtree at binary into one 4 wide node (and its children), returns the node's index
+	uint32_t collapse(const Builder &builder, int binary, vector<CollisionBvh::Node> &nodes, unsigned int depth, unsigned int &maxDepth)
+	{
+		//Open up the largest inner children until there are four
+		int children[CollisionBvh::WIDTH] = { builder.nodes[binary].left, builder.nodes[binary].right };
+		int used = 2;
+		while (used < CollisionBvh::WIDTH)
+		{
+			int largest = -1;
+			float largestArea = -1.0f;
+			for (int i = 0; i < used; i++)
+			{
+				const BuildNode &child = builder.nodes[children[i]];
+				float area = surfaceArea(child.box);
+				if (child.left >= 0 && area > largestArea)
+				{
+					largest = i;
+					largestArea = area;
+				}
+			}
+			if (largest < 0)
+				break;
+			const BuildNode &opened = builder.nodes[children[largest]];
+			children[largest] = opened.left;
+			children[used++] = opened.right;
+		}
+
+		uint32_t index = (uint32_t)nodes.size();
+		nodes.push_back(CollisionBvh::Node());
+		memset(&nodes[index], 0, sizeof(CollisionBvh::Node));
+		maxDepth = std::max(maxDepth, depth);
+		for (int i = 0; i < used; i++)
+		{
+			const BuildNode &child = builder.nodes[children[i]];
+			uint32_t reference = child.left < 0 ? child.first : collapse(builder, children[i], nodes, depth + 1, maxDepth);
+			//Recursing grew the vector, take the reference again
+			CollisionBvh::Node &node = nodes[index];
+			node.minX[i] = child.box.min.x;
+			node.minY[i] = child.box.min.y;
+			node.minZ[i] = child.box.min.z;
+			node.maxX[i] = child.box.max.x;
+			node.maxY[i] = child.box.max.y;
+			node.maxZ[i] = child.box.max.z;
+			node.child[i] = reference;
+			node.count[i] = child.left < 0 ? child.count : 0;
+		}
+		nodes[index].used = (uint32_t)used;
+		return index;
+	}
+
+	//Tiny components would make the slab test divide by zero, this keeps the sign and a finite inverse
+	float safeInverse(float value)
+	{
+		const float TINY = 1e-20f;
+		if (fabs(value) < TINY)
+			value = value < 0.0f ? -TINY : TINY;
+		return 1.0f / value;
+	}
+}
+
+CollisionBvh::CollisionBvh() : mesh(nullptr)
+{
+	memset(&stats, 0, sizeof(stats));
+}
+
+#pragma region Build
+void CollisionBvh::Build(const CollisionMesh &mesh, const string &cachePath)
+{
+	chrono::high_resolution_clock::time_point start = chrono::high_resolution_clock::now();
+	this->mesh = &mesh;
+	nodes.clear();
+	triangles.clear();
+	triangleIds.clear();
+	memset(&stats, 0, sizeof(stats));
+	const vector<CollisionTriangle> &source = mesh.Triangles();
+	if (source.empty())
+		return;
+
+	uint64_t key = Fnv1a(&BVH_CACHE_VERSION, sizeof(BVH_CACHE_VERSION));
+	key = Fnv1a(source.data(), source.size() * sizeof(CollisionTriangle), key);
+
+	stats.cached = !cachePath.empty() && readCache(cachePath, key);
+	if (!stats.cached)
+	{
+		Builder builder;
+		builder.boxes.resize(source.size());
+		builder.centroids.resize(source.size());
+		builder.order.resize(source.size());
+		for (size_t i = 0; i < source.size(); i++)
+		{
+			const CollisionTriangle &triangle = source[i];
+			BoundingBox box(triangle.a, triangle.a);
+			box.Extend(triangle.a + triangle.edge1);
+			box.Extend(triangle.a + triangle.edge2);
+			builder.boxes[i] = box;
+			builder.centroids[i] = box.Center();
+			builder.order[i] = (uint32_t)i;
+		}
+		builder.nodes.reserve(source.size() * 2);
+		builder.build(0, (uint32_t)source.size());
+
+		if (builder.nodes[0].left < 0)
+		{
+			//Small enough for one leaf, the root still has to be a node
+			Node root;
+			memset(&root, 0, sizeof(root));
+			const BuildNode &leaf = builder.nodes[0];
+			root.minX[0] = leaf.box.min.x;
+			root.minY[0] = leaf.box.min.y;
+			root.minZ[0] = leaf.box.min.z;
+			root.maxX[0] = leaf.box.max.x;
+			root.maxY[0] = leaf.box.max.y;
+			root.maxZ[0] = leaf.box.max.z;
+			root.child[0] = 0;
+			root.count[0] = leaf.count;
+			root.used = 1;
+			nodes.push_back(root);
+			stats.depth = 1;
+		}
+		else
+			collapse(builder, 0, nodes, 1, stats.depth);
+		triangleIds = move(builder.order);
+
+		if (!cachePath.empty())
+			writeCache(cachePath, key);
+	}
+
+	//The triangles themselves come from the mesh, in leaf order so a leaf reads one run of memory
+	triangles.resize(triangleIds.size());
+	for (size_t i = 0; i < triangleIds.size(); i++)
+		triangles[i] = source[triangleIds[i]];
+
+	stats.nodes = (unsigned int)nodes.size();
+	for (size_t n = 0; n < nodes.size(); n++)
+		for (uint32_t i = 0; i < nodes[n].used; i++)
+			stats.leaves += nodes[n].count[i] > 0 ? 1 : 0;
+	stats.buildMs = chrono::duration<double, milli>(chrono::high_resolution_clock::now() - start).count();
+}
+
+bool CollisionBvh::readCache(const string &path, uint64_t key)
+{
+	ifstream in(path, ios::binary);
+	if (!in)
+		return false;
+	BvhCacheHeader header;
+	in.read((char*)&header, sizeof(header));
+	if (!in || memcmp(header.magic, BVH_CACHE_MAGIC, sizeof(header.magic)) != 0 || header.version != BVH_CACHE_VERSION ||
+		header.key != key || header.triangleCount != mesh->TriangleCount() || header.nodeCount == 0)
+		return false;
+
+	nodes.resize(header.nodeCount);
+	triangleIds.resize(header.triangleCount);
+	in.read((char*)nodes.data(), nodes.size() * sizeof(Node));
+	in.read((char*)triangleIds.data(), triangleIds.size() * sizeof(uint32_t));
+	if (!in)
+	{
+		nodes.clear();
+		triangleIds.clear();
+		return false;
+	}
+
+	//A damaged file must not send the traversal out of bounds
+	bool valid = true;
+	for (size_t i = 0; i < triangleIds.size() && valid; i++)
+		valid = triangleIds[i] < header.triangleCount;
+	for (size_t n = 0; n < nodes.size() && valid; n++)
+	{
+		valid = nodes[n].used >= 1 && nodes[n].used <= WIDTH;
+		for (uint32_t i = 0; i < nodes[n].used && valid; i++)
+			valid = nodes[n].count[i] > 0 ? (uint64_t)nodes[n].child[i] + nodes[n].count[i] <= header.triangleCount :
+				nodes[n].child[i] > n && nodes[n].child[i] < nodes.size();
+	}
+	if (!valid)
+	{
+		nodes.clear();
+		triangleIds.clear();
+		return false;
+	}
+
+	//Depth isn't stored, it's only for the stats
+	vector<unsigned int> depths(nodes.size(), 1);
+	for (size_t n = 0; n < nodes.size(); n++)
+	{
+		stats.depth = std::max(stats.depth, depths[n]);
+		for (uint32_t i = 0; i < nodes[n].used; i++)
+			if (nodes[n].count[i] == 0)
+				depths[nodes[n].child[i]] = depths[n] + 1;
+	}
+	return true;
+}
+
+void CollisionBvh::writeCache(const string &path, uint64_t key) const
+{
+	BvhCacheHeader header;
+	memcpy(header.magic, BVH_CACHE_MAGIC, sizeof(header.magic));
+	header.version = BVH_CACHE_VERSION;
+	header.key = key;
+	header.nodeCount = (uint32_t)nodes.size();
+	header.triangleCount = (uint32_t)triangleIds.size();
+
+	WriteCacheFile(path, "COLLISION_BVH", [&](ostream &out)
+	{
+		out.write((const char*)&header, sizeof(header));
+		out.write((const char*)nodes.data(), nodes.size() * sizeof(Node));
+		out.write((const char*)triangleIds.data(), triangleIds.size() * sizeof(uint32_t));
+	});
+}
+#pragma endregion
+
+#pragma region Queries
+bool CollisionBvh::Sweep(const glm::vec3 &center, const glm::vec3 &motion, float radius, SweepHit &hit) const
+{
+	if (nodes.empty())
+		return false;
+
+	//The segment against the children's boxes grown by the radius, which holds everything the sphere can touch
+#if GLM_ARCH & GLM_ARCH_SSE2_BIT
+	const glm_vec4 originX = _mm_set1_ps(center.x), originY = _mm_set1_ps(center.y), originZ = _mm_set1_ps(center.z);
+	const glm_vec4 inverseX = _mm_set1_ps(safeInverse(motion.x));
+	const glm_vec4 inverseY = _mm_set1_ps(safeInverse(motion.y));
+	const glm_vec4 inverseZ = _mm_set1_ps(safeInverse(motion.z));
+	const glm_vec4 grow = _mm_set1_ps(radius);
+	const glm_vec4 zero = _mm_setzero_ps();
+#else
+	const glm::vec3 inverse(safeInverse(motion.x), safeInverse(motion.y), safeInverse(motion.z));
+#endif
+
+	struct Entry
+	{
+		uint32_t child;
+		uint32_t count;
+		float time;		// where the segment enters the child's box
+	};
+	Entry stack[MAX_STACK];
+	int top = 0;
+	stack[top++] = { 0, 0, 0.0f };
+
+	bool found = false;
+	while (top > 0)
+	{
+		Entry entry = stack[--top];
+		if (entry.time > hit.time)
+			continue;
+		if (entry.count > 0)
+		{
+			for (uint32_t i = entry.child; i < entry.child + entry.count; i++)
+				if (CollisionMesh::SweepTriangle(triangles[i], center, motion, radius, hit))
+				{
+					hit.triangle = triangleIds[i];
+					found = true;
+				}
+			continue;
+		}
+
+		const Node &node = nodes[entry.child];
+		float times[WIDTH];
+#if GLM_ARCH & GLM_ARCH_SSE2_BIT
+		glm_vec4 nearX = _mm_mul_ps(_mm_sub_ps(_mm_sub_ps(_mm_loadu_ps(node.minX), grow), originX), inverseX);
+		glm_vec4 farX = _mm_mul_ps(_mm_sub_ps(_mm_add_ps(_mm_loadu_ps(node.maxX), grow), originX), inverseX);
+		glm_vec4 nearY = _mm_mul_ps(_mm_sub_ps(_mm_sub_ps(_mm_loadu_ps(node.minY), grow), originY), inverseY);
+		glm_vec4 farY = _mm_mul_ps(_mm_sub_ps(_mm_add_ps(_mm_loadu_ps(node.maxY), grow), originY), inverseY);
+		glm_vec4 nearZ = _mm_mul_ps(_mm_sub_ps(_mm_sub_ps(_mm_loadu_ps(node.minZ), grow), originZ), inverseZ);
+		glm_vec4 farZ = _mm_mul_ps(_mm_sub_ps(_mm_add_ps(_mm_loadu_ps(node.maxZ), grow), originZ), inverseZ);
+		glm_vec4 enter = _mm_max_ps(_mm_max_ps(_mm_min_ps(nearX, farX), _mm_min_ps(nearY, farY)), _mm_max_ps(_mm_min_ps(nearZ, farZ), zero));
+		glm_vec4 leave = _mm_min_ps(_mm_min_ps(_mm_max_ps(nearX, farX), _mm_max_ps(nearY, farY)),
+			_mm_min_ps(_mm_max_ps(nearZ, farZ), _mm_set1_ps(hit.time)));
+		int mask = _mm_movemask_ps(_mm_cmple_ps(enter, leave)) & ((1 << node.used) - 1);
+		_mm_storeu_ps(times, enter);
+#else
+		int mask = 0;
+		for (uint32_t c = 0; c < node.used; c++)
+		{
+			float nearX = (node.minX[c] - radius - center.x) * inverse.x, farX = (node.maxX[c] + radius - center.x) * inverse.x;
+			float nearY = (node.minY[c] - radius - center.y) * inverse.y, farY = (node.maxY[c] + radius - center.y) * inverse.y;
+			float nearZ = (node.minZ[c] - radius - center.z) * inverse.z, farZ = (node.maxZ[c] + radius - center.z) * inverse.z;
+			float enter = std::max(std::max(std::min(nearX, farX), std::min(nearY, farY)), std::max(std::min(nearZ, farZ), 0.0f));
+			float leave = std::min(std::min(std::max(nearX, farX), std::max(nearY, farY)), std::min(std::max(nearZ, farZ), hit.time));
+			times[c] = enter;
+			if (enter <= leave)
+				mask |= 1 << c;
+		}
+#endif
+		if (!mask)
+			continue;
+
+		//Push the farthest first so the nearest child comes off the stack next
+		int order[WIDTH], hits = 0;
+		for (int i = 0; i < WIDTH; i++)
+			if (mask & (1 << i))
+			{
+				int slot = hits++;
+				while (slot > 0 && times[order[slot - 1]] < times[i])
+				{
+					order[slot] = order[slot - 1];
+					slot--;
+				}
+				order[slot] = i;
+			}
+		for (int i = 0; i < hits && top < MAX_STACK; i++)
+			stack[top++] = { node.child[order[i]], node.count[order[i]], times[order[i]] };
+	}
+	return found;
+}
+#pragma endregion
+
+void CollisionBvh::PrintStats(ostream &out) const
+{
+	out << "COLLISION BVH:: " << triangles.size() << " triangles, " << stats.nodes << " nodes, " << stats.leaves << " leaves, depth "
+		<< stats.depth << ", " << (stats.cached ? "loaded" : "built") << " in " << stats.buildMs << " ms" << endl;
+}
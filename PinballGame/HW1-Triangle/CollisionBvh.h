@@ -0,0 +1,66 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+#include "CollisionMesh.h"
+using namespace std;
+
+/// <summary>
+/// Bounding volume hierarchy over a CollisionMesh, so a sweep only tests the triangles near the ball.
+/// Built top down with the surface area heuristic (binned), then collapsed into 4 wide nodes whose child boxes are
+/// stored axis by axis: one SSE slab test checks the swept sphere's segment against all four boxes (grown by the radius)
+/// at once. Children are visited nearest first and skipped once an earlier contact is known.
+/// The tree is cached next to the model it was built for and only rebuilt when the triangles change.
+/// </summary>
+class CollisionBvh
+{
+public:
+	static const int WIDTH = 4;
+
+	CollisionBvh();
+
+	//Builds over the triangles of mesh, which must outlive the tree, or loads it from cachePath if it was built from the
+	//same triangles. An empty cachePath never caches.
+	void Build(const CollisionMesh &mesh, const string &cachePath = "");
+
+	//Same contract as CollisionMesh::Sweep, hit.triangle is the mesh's index
+	bool Sweep(const glm::vec3 &center, const glm::vec3 &motion, float radius, SweepHit &hit) const;
+
+	bool Empty() const { return nodes.empty(); }
+
+	struct Stats
+	{
+		bool cached;
+		unsigned int nodes;
+		unsigned int leaves;
+		unsigned int depth;		// of the 4 wide tree
+		double buildMs;			// or load
+	};
+	const Stats& GetStats() const { return stats; }
+	void PrintStats(ostream &out) const;
+
+	//Child boxes as four lanes per bound. A child with count > 0 is a leaf of count triangles starting at child,
+	//otherwise child is the index of the node. Only the first used children are filled in.
+	struct Node
+	{
+		float minX[WIDTH], minY[WIDTH], minZ[WIDTH];
+		float maxX[WIDTH], maxY[WIDTH], maxZ[WIDTH];
+		uint32_t child[WIDTH];
+		uint32_t count[WIDTH];
+		uint32_t used;
+		uint32_t padding[3];
+	};
+
+private:
+	bool readCache(const string &path, uint64_t key);
+	void writeCache(const string &path, uint64_t key) const;
+
+	const CollisionMesh *mesh;
+	vector<Node> nodes;					// 0 is the root
+	vector<CollisionTriangle> triangles;	// the mesh's, in leaf order
+	vector<uint32_t> triangleIds;		// mesh index of each
+	Stats stats;
+};
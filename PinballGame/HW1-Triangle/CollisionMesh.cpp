@@ -0,0 +1,261 @@
+#include "CollisionMesh.h"
+
+#include <cmath>
+
+namespace
+{
+	//Degenerate triangles have no plane, and slivers thinner than this don't stop anything
+	const float MIN_DOUBLE_AREA = 1e-12f;
+
+	//Entry of a t^2 + b t + c = 0, the smaller root, if it lies in [0, limit). Starting inside (the smaller root is
+	//negative) is no entry, the overlap test before deals with real contacts at the start.
+	bool lowestRoot(float a, float b, float c, float limit, float &root)
+	{
+		if (fabs(a) < 1e-12f)
+			return false;
+		float determinant = b * b - 4.0f * a * c;
+		if (determinant < 0.0f)
+			return false;
+		float sqrtD = sqrtf(determinant);
+		float first = (-b - sqrtD) / (2.0f * a);
+		float second = (-b + sqrtD) / (2.0f * a);
+		if (first > second)
+		{
+			float swap = first;
+			first = second;
+			second = swap;
+		}
+		if (first < 0.0f || first >= limit)
+			return false;
+		root = first;
+		return true;
+	}
+
+	//Closest point of the triangle to p (Ericson, Real-Time Collision Detection 5.1.5) and which feature it lies on
+	glm::vec3 closestPoint(const CollisionTriangle &triangle, const glm::vec3 &p, ContactFeature &feature)
+	{
+		const glm::vec3 &a = triangle.a;
+		glm::vec3 b = a + triangle.edge1, c = a + triangle.edge2;
+		glm::vec3 ab = triangle.edge1, ac = triangle.edge2, ap = p - a;
+		float d1 = glm::dot(ab, ap), d2 = glm::dot(ac, ap);
+		feature = CONTACT_VERTEX;
+		if (d1 <= 0.0f && d2 <= 0.0f)
+			return a;
+
+		glm::vec3 bp = p - b;
+		float d3 = glm::dot(ab, bp), d4 = glm::dot(ac, bp);
+		if (d3 >= 0.0f && d4 <= d3)
+			return b;
+
+		glm::vec3 cp = p - c;
+		float d5 = glm::dot(ab, cp), d6 = glm::dot(ac, cp);
+		if (d6 >= 0.0f && d5 <= d6)
+			return c;
+
+		feature = CONTACT_EDGE;
+		float vc = d1 * d4 - d3 * d2;
+		if (vc <= 0.0f && d1 >= 0.0f && d3 <= 0.0f)
+			return a + ab * (d1 / (d1 - d3));
+		float vb = d5 * d2 - d1 * d6;
+		if (vb <= 0.0f && d2 >= 0.0f && d6 <= 0.0f)
+			return a + ac * (d2 / (d2 - d6));
+		float va = d3 * d6 - d5 * d4;
+		if (va <= 0.0f && (d4 - d3) >= 0.0f && (d5 - d6) >= 0.0f)
+			return b + (c - b) * ((d4 - d3) / ((d4 - d3) + (d5 - d6)));
+
+		feature = CONTACT_FACE;
+		float denominator = 1.0f / (va + vb + vc);
+		return a + ab * (vb * denominator) + ac * (vc * denominator);
+	}
+
+	//Sphere center moving along center + t motion against the cylinder of radius around the edge from start to start + edge
+	bool sweepEdge(const glm::vec3 &start, const glm::vec3 &edge, const glm::vec3 &center, const glm::vec3 &motion,
+		float radiusSquared, float &time, glm::vec3 &point)
+	{
+		glm::vec3 base = start - center;
+		float edgeSquared = glm::dot(edge, edge);
+		float edgeDotMotion = glm::dot(edge, motion);
+		float edgeDotBase = glm::dot(edge, base);
+
+		float a = edgeSquared * -glm::dot(motion, motion) + edgeDotMotion * edgeDotMotion;
+		float b = edgeSquared * 2.0f * glm::dot(motion, base) - 2.0f * edgeDotMotion * edgeDotBase;
+		float c = edgeSquared * (radiusSquared - glm::dot(base, base)) + edgeDotBase * edgeDotBase;
+		float root;
+		if (!lowestRoot(a, b, c, time, root))
+			return false;
+		//Only the part of the cylinder between the corners, past them the corner spheres take over
+		float along = (edgeDotMotion * root - edgeDotBase) / edgeSquared;
+		if (along < 0.0f || along > 1.0f)
+			return false;
+		time = root;
+		point = start + edge * along;
+		return true;
+	}
+
+	bool sweepVertex(const glm::vec3 &vertex, const glm::vec3 &center, const glm::vec3 &motion, float radiusSquared,
+		float &time)
+	{
+		glm::vec3 offset = center - vertex;
+		float root;
+		if (!lowestRoot(glm::dot(motion, motion), 2.0f * glm::dot(motion, offset), glm::dot(offset, offset) - radiusSquared, time, root))
+			return false;
+		time = root;
+		return true;
+	}
+}
+
+void CollisionMesh::Add(const vector<Mesh> &meshes, const glm::mat4 &transform)
+{
+	for (size_t m = 0; m < meshes.size(); m++)
+	{
+		const vector<Vertex> &vertices = meshes[m].vertices;
+		const vector<unsigned int> &indices = meshes[m].indices;
+		for (size_t i = 0; i + 2 < indices.size(); i += 3)
+		{
+			glm::vec3 a = glm::vec3(transform * glm::vec4(vertices[indices[i]].Position, 1.0f));
+			glm::vec3 b = glm::vec3(transform * glm::vec4(vertices[indices[i + 1]].Position, 1.0f));
+			glm::vec3 c = glm::vec3(transform * glm::vec4(vertices[indices[i + 2]].Position, 1.0f));
+
+			CollisionTriangle triangle;
+			triangle.a = a;
+			triangle.edge1 = b - a;
+			triangle.edge2 = c - a;
+			glm::vec3 normal = glm::cross(triangle.edge1, triangle.edge2);
+			float doubleArea = glm::length(normal);
+			if (doubleArea < MIN_DOUBLE_AREA)
+				continue;
+			triangle.normal = normal / doubleArea;
+			//The centroid's sphere isn't the smallest, but it's close enough for a reject and cheap to build
+			triangle.center = (a + b + c) / 3.0f;
+			triangle.radius = sqrtf(glm::max(glm::max(glm::dot(a - triangle.center, a - triangle.center),
+				glm::dot(b - triangle.center, b - triangle.center)), glm::dot(c - triangle.center, c - triangle.center)));
+			triangles.push_back(triangle);
+			box.Extend(a);
+			box.Extend(b);
+			box.Extend(c);
+		}
+	}
+}
+
+void CollisionMesh::Clear()
+{
+	triangles.clear();
+	box = BoundingBox();
+}
+
+bool CollisionMesh::Sweep(const glm::vec3 &center, const glm::vec3 &motion, float radius, SweepHit &hit) const
+{
+	bool found = false;
+	for (size_t i = 0; i < triangles.size(); i++)
+	{
+		if (SweepTriangle(triangles[i], center, motion, radius, hit))
+		{
+			hit.triangle = (unsigned int)i;
+			found = true;
+		}
+	}
+	return found;
+}
+
+bool CollisionMesh::SweepTriangle(const CollisionTriangle &triangle, const glm::vec3 &center, const glm::vec3 &motion,
+	float radius, SweepHit &hit)
+{
+	//Quick reject: the segment never comes within radius of the triangle's bounding sphere
+	glm::vec3 toCenter = triangle.center - center;
+	float motionSquared = glm::dot(motion, motion);
+	float along = motionSquared > 0.0f ? glm::clamp(glm::dot(toCenter, motion) / motionSquared, 0.0f, 1.0f) : 0.0f;
+	glm::vec3 gap = toCenter - motion * along;
+	float reach = triangle.radius + radius;
+	if (glm::dot(gap, gap) > reach * reach)
+		return false;
+
+	//Both sides collide, work on the side the sphere starts on
+	glm::vec3 normal = triangle.normal;
+	float distance = glm::dot(normal, center - triangle.a);
+	if (distance < 0.0f)
+	{
+		normal = -normal;
+		distance = -distance;
+	}
+	float approach = -glm::dot(normal, motion);	// towards the plane is positive
+	if (distance > radius && (approach <= 0.0f || distance - radius >= approach * hit.time))
+		return false;
+
+	float radiusSquared = radius * radius;
+	if (distance <= radius)
+	{
+		//Touching the plane already, touching the triangle too if its closest point is within reach
+		ContactFeature feature;
+		glm::vec3 closest = closestPoint(triangle, center, feature);
+		glm::vec3 offset = center - closest;
+		float offsetSquared = glm::dot(offset, offset);
+		if (offsetSquared < radiusSquared)
+		{
+			//Moving out of it is no contact, the resolver already separated them
+			glm::vec3 out = offsetSquared > 1e-12f ? offset / sqrtf(offsetSquared) : normal;
+			if (glm::dot(out, motion) >= 0.0f)
+				return false;
+			hit.time = 0.0f;
+			hit.point = closest;
+			hit.normal = out;
+			hit.feature = feature;
+			return true;
+		}
+	}
+	else
+	{
+		//Where the sphere meets the plane, a hit if that point lies inside the triangle. Nothing else can come earlier.
+		float time = (distance - radius) / approach;
+		glm::vec3 onPlane = center + motion * time - normal * radius;
+		glm::vec3 local = onPlane - triangle.a;
+		float d00 = glm::dot(triangle.edge1, triangle.edge1), d01 = glm::dot(triangle.edge1, triangle.edge2);
+		float d11 = glm::dot(triangle.edge2, triangle.edge2);
+		float d20 = glm::dot(local, triangle.edge1), d21 = glm::dot(local, triangle.edge2);
+		float denominator = d00 * d11 - d01 * d01;
+		float v = (d11 * d20 - d01 * d21) / denominator;
+		float w = (d00 * d21 - d01 * d20) / denominator;
+		if (v >= 0.0f && w >= 0.0f && v + w <= 1.0f)
+		{
+			hit.time = time;
+			hit.point = onPlane;
+			hit.normal = normal;
+			hit.feature = CONTACT_FACE;
+			return true;
+		}
+	}
+
+	//Otherwise it can only hit the border first: the earliest of the three edges and three corners
+	glm::vec3 b = triangle.a + triangle.edge1, c = triangle.a + triangle.edge2;
+	float time = hit.time;
+	glm::vec3 point;
+	ContactFeature feature = CONTACT_FACE;
+	if (sweepVertex(triangle.a, center, motion, radiusSquared, time))
+	{
+		point = triangle.a;
+		feature = CONTACT_VERTEX;
+	}
+	if (sweepVertex(b, center, motion, radiusSquared, time))
+	{
+		point = b;
+		feature = CONTACT_VERTEX;
+	}
+	if (sweepVertex(c, center, motion, radiusSquared, time))
+	{
+		point = c;
+		feature = CONTACT_VERTEX;
+	}
+	if (sweepEdge(triangle.a, triangle.edge1, center, motion, radiusSquared, time, point))
+		feature = CONTACT_EDGE;
+	if (sweepEdge(b, c - b, center, motion, radiusSquared, time, point))
+		feature = CONTACT_EDGE;
+	if (sweepEdge(c, -triangle.edge2, center, motion, radiusSquared, time, point))
+		feature = CONTACT_EDGE;
+	if (feature == CONTACT_FACE)
+		return false;
+
+	hit.time = time;
+	hit.point = point;
+	hit.normal = (center + motion * time - point) / radius;
+	hit.feature = feature;
+	return true;
+}
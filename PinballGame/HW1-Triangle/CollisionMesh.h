@@ -0,0 +1,72 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <cfloat>
+#include <vector>
+#include "Bounds.h"
+#include "Mesh.h"
+using namespace std;
+
+//What part of a triangle a swept sphere touched first
+enum ContactFeature
+{
+	CONTACT_FACE = 0,
+	CONTACT_EDGE = 1,
+	CONTACT_VERTEX = 2,
+};
+
+//First contact of a swept sphere. Queries only report contacts earlier than time, so one hit can be carried through
+//any number of triangles and ends up with the earliest.
+struct SweepHit
+{
+	float time;			// fraction of the motion at first contact, 0 if the sphere started out touching
+	glm::vec3 point;	// on the triangle
+	glm::vec3 normal;	// from point towards the sphere's center at time, unit length
+	ContactFeature feature;
+	unsigned int triangle;
+
+	SweepHit() : time(1.0f), point(0.0f), normal(0.0f), feature(CONTACT_FACE), triangle(0) {}
+	bool Hit() const { return time < 1.0f; }
+};
+
+//A triangle as the sweep wants it, with its plane and a sphere around it for the quick reject
+struct CollisionTriangle
+{
+	glm::vec3 a;
+	glm::vec3 edge1;	// b - a
+	glm::vec3 edge2;	// c - a
+	glm::vec3 normal;	// unit, either side collides
+	glm::vec3 center;	// of the bounding sphere
+	float radius;
+};
+
+/// <summary>
+/// Triangles of the static table in world space, for continuous collision of the ball. Sweep() moves a sphere along a
+/// straight line and finds where it first touches a triangle: its face, one of its edges (a cylinder of the sphere's radius
+/// around the edge) or one of its corners (a sphere around the corner), solved exactly rather than by sampling, so a fast
+/// ball can't step over a rail thinner than its travel per step. A sphere already touching reports time 0 and the
+/// direction out of the triangle. Queries touch no heap and no shared state, any thread may run them.
+/// </summary>
+class CollisionMesh
+{
+public:
+	//Adds the triangles of meshes, moved by transform. Degenerate triangles are skipped.
+	void Add(const vector<Mesh> &meshes, const glm::mat4 &transform = glm::mat4(1.0f));
+	void Clear();
+
+	//Sphere of radius at center moving by motion, against every triangle. True if hit got an earlier contact.
+	bool Sweep(const glm::vec3 &center, const glm::vec3 &motion, float radius, SweepHit &hit) const;
+
+	//Sweep against one triangle, same contract
+	static bool SweepTriangle(const CollisionTriangle &triangle, const glm::vec3 &center, const glm::vec3 &motion,
+		float radius, SweepHit &hit);
+
+	size_t TriangleCount() const { return triangles.size(); }
+	const CollisionTriangle& Triangle(size_t index) const { return triangles[index]; }
+	const vector<CollisionTriangle>& Triangles() const { return triangles; }
+	const BoundingBox& Box() const { return box; }
+
+private:
+	vector<CollisionTriangle> triangles;
+	BoundingBox box;
+};
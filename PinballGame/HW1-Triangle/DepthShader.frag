@@ -0,0 +1,6 @@
+#version 330 core
+// Depth pre-pass, colors are masked and only the depth is kept
+
+void main()
+{
+}
@@ -0,0 +1,34 @@
+#version 330 core
+// permutations, see ShaderDefines:
+//   INSTANCED  the model matrix comes per instance from the InstanceBuffer
+// Depth pre-pass (RenderQueue), reads positions only from the GeometryBuffer's position VAO
+layout (location = 0) in vec3 aPos;
+#ifdef INSTANCED
+// per instance (InstanceBuffer), the model matrix takes locations 5-8
+layout (location = 5) in mat4 aModel;
+#endif
+
+// per frame camera, shared by every program (FrameUniforms)
+layout (std140) uniform Camera
+{
+	mat4 projection;
+	mat4 view;
+	vec3 viewPos;
+};
+
+#ifndef INSTANCED
+uniform mat4 model;
+#endif
+
+// must come out bit for bit the same as VertexShader.vert's, or the GL_EQUAL test of the opaque pass drops pixels
+invariant gl_Position;
+
+void main()
+{
+#ifdef INSTANCED
+	mat4 world = aModel;
+#else
+	mat4 world = model;
+#endif
+	gl_Position = projection * view * world * vec4(aPos, 1.0);
+}
@@ -0,0 +1,37 @@
+#include "FixedTimestep.h"
+
+#include <cstring>
+
+FixedTimestep::FixedTimestep(double rate, int maxSteps) : stepTime(1.0 / rate), maxSteps(maxSteps), accumulator(0.0)
+{
+	memset(&stats, 0, sizeof(stats));
+}
+
+int FixedTimestep::Advance(double frameSeconds)
+{
+	if (frameSeconds < 0.0)
+		frameSeconds = 0.0;
+	accumulator += frameSeconds;
+	int steps = (int)(accumulator / stepTime);
+	if (steps > maxSteps)
+	{
+		//Keep the fraction of a step so the interpolation doesn't jump, lose everything beyond it
+		double kept = accumulator - steps * stepTime;
+		stats.droppedSeconds += (steps - maxSteps) * stepTime;
+		stats.clampedFrames++;
+		steps = maxSteps;
+		accumulator = kept + steps * stepTime;
+	}
+	accumulator -= steps * stepTime;
+
+	stats.frames++;
+	stats.steps += steps;
+	return steps;
+}
+
+void FixedTimestep::PrintStats(ostream &out) const
+{
+	out << "FIXED TIMESTEP:: " << Rate() << " Hz, " << stats.steps << " steps over " << stats.frames << " frames ("
+		<< (stats.frames ? (double)stats.steps / stats.frames : 0.0) << " per frame), " << stats.clampedFrames
+		<< " frames clamped to " << maxSteps << " steps, " << stats.droppedSeconds * 1000.0 << " ms dropped" << endl;
+}
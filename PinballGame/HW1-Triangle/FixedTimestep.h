@@ -0,0 +1,45 @@
+#pragma once
+
+#include <ostream>
+using namespace std;
+
+/// <summary>
+/// Runs a simulation at a fixed rate however fast the frames come. Advance() adds a frame's time to an accumulator and
+/// returns how many whole steps of StepTime() to take; the time left over is Alpha(), how far the rendered frame sits
+/// between the last two simulated states. A frame that would need more than maxSteps steps (a hitch, a breakpoint, a
+/// machine that can't keep up) takes maxSteps and drops the rest of its time instead of carrying it over, so one slow
+/// frame can't make the next one slower still (the spiral of death). The game runs slow for that frame instead.
+/// </summary>
+class FixedTimestep
+{
+public:
+	//rate in steps per second
+	explicit FixedTimestep(double rate = 1000.0, int maxSteps = 64);
+
+	//Number of steps to take for a frame of frameSeconds
+	int Advance(double frameSeconds);
+
+	double StepTime() const { return stepTime; }
+	double Rate() const { return 1.0 / stepTime; }
+	//0 is the state before the last step, 1 the state after it
+	float Alpha() const { return (float)(accumulator / stepTime); }
+
+	//Empties the accumulator, e.g. after loading
+	void Reset() { accumulator = 0.0; }
+
+	struct Stats
+	{
+		unsigned int frames;
+		unsigned int steps;
+		unsigned int clampedFrames;	// frames that hit maxSteps
+		double droppedSeconds;		// simulation time those frames lost
+	};
+	const Stats& GetStats() const { return stats; }
+	void PrintStats(ostream &out) const;
+
+private:
+	double stepTime;
+	int maxSteps;
+	double accumulator;
+	Stats stats;
+};
@@ -1,68 +1,117 @@
 #version 330 core
+// permutations, see ShaderDefines:
+//   MAX_CLUSTER_LIGHTS  most point lights shaded per fragment, the rest of a crowded cluster is dropped
+//   SPOT_LIGHT          adds the camera's flashlight
+//   NORMAL_MAP          normals from material.normal through the tangent frame (VertexShader.vert NORMAL_MAP)
+//   LIGHTMAP            diffuse and ambient of the static lights come from the baked lightmap (Lightmap), only their
+//                       specular and the other lights are shaded per fragment (VertexShader.vert LIGHTMAP)
+#ifndef MAX_CLUSTER_LIGHTS
+#define MAX_CLUSTER_LIGHTS 256
+#endif
+
 out vec4 FragColor;
 
 struct Material {
     sampler2D diffuse;
     sampler2D specular;
+#ifdef NORMAL_MAP
+    sampler2D normal;
+#endif
     float shininess;
 }; 
 
+// the light structs live in a std140 block, every vec3 is paired with a float
+// so the layout matches the C++ mirrors in FrameUniforms.h
 struct DirLight {
     vec3 direction;
-	
     vec3 ambient;
     vec3 diffuse;
     vec3 specular;
 };
 
+// point lights come from a texture buffer, four texels each (LightClusters)
 struct PointLight {
     vec3 position;
-    
     float constant;
-    float linear;
-    float quadratic;
-	
     vec3 ambient;
+    float linear;
     vec3 diffuse;
+    float quadratic;
     vec3 specular;
+    float range;
 };
 
 struct SpotLight {
     vec3 position;
-    vec3 direction;
     float cutOff;
+    vec3 direction;
     float outerCutOff;
-  
+    vec3 ambient;
     float constant;
+    vec3 diffuse;
     float linear;
+    vec3 specular;
     float quadratic;
-  
-    vec3 ambient;
-    vec3 diffuse;
-    vec3 specular;       
 };
 
-#define NR_POINT_LIGHTS 4
-
 in vec3 FragPos;
 in vec3 Normal;
 in vec2 TexCoords;
+in vec4 Tint;
+in float Emissive;
+#ifdef NORMAL_MAP
+in mat3 TBN;
+#endif
+#ifdef LIGHTMAP
+in vec2 LightmapCoords;
+#endif
+
+// per frame camera and lights, shared by every program (FrameUniforms)
+layout (std140) uniform Camera
+{
+	mat4 projection;
+	mat4 view;
+	vec3 viewPos;
+};
+
+layout (std140) uniform Lights
+{
+	DirLight dirLight;
+	SpotLight spotLight;
+	uvec4 clusterSize;	// clusters along x, y, z and the number of lights
+	vec4 clusterScale;	// x, y: clusters per pixel, z, w: log(depth) * z + w gives the depth slice
+};
+
+// clustered point lights: every cluster has an offset and count into the index list, which points into the lights
+uniform samplerBuffer pointLightData;
+uniform usamplerBuffer clusterLights;
+uniform usamplerBuffer clusterLightIndices;
 
-uniform vec3 viewPos;
-uniform DirLight dirLight;
-uniform PointLight pointLights[NR_POINT_LIGHTS];
-uniform SpotLight spotLight;
 uniform Material material;
 
+#ifdef LIGHTMAP
+// rgb: light of the static lights arriving here, a: ambient occlusion
+uniform sampler2D lightmap;
+// the static point lights are the first ones in the light list, the lightmap already has their diffuse and ambient
+uniform int bakedPointLights;
+#endif
+
 // function prototypes
 vec3 CalcDirLight(DirLight light, vec3 normal, vec3 viewDir);
 vec3 CalcPointLight(PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir);
+float CalcSpecular(vec3 lightDir, vec3 normal, vec3 viewDir);
 vec3 CalcSpotLight(SpotLight light, vec3 normal, vec3 fragPos, vec3 viewDir);
+PointLight FetchPointLight(int index);
+uvec2 FetchCluster();
 
 void main()
 {    
     // properties
+#ifdef NORMAL_MAP
+    vec3 norm = normalize(TBN * (texture(material.normal, TexCoords).rgb * 2.0 - 1.0));
+#else
     vec3 norm = normalize(Normal);
+#endif
     vec3 viewDir = normalize(viewPos - FragPos);
     
     // == =====================================================
@@ -72,13 +121,42 @@ void main()
     // this fragment's final color.
     // == =====================================================
     // phase 1: directional lighting
+#ifdef LIGHTMAP
+    // baked lights: one fetch for all their diffuse and ambient light, specular still depends on the view
+    vec4 baked = texture(lightmap, LightmapCoords);
+    vec3 specularColor = vec3(texture(material.specular, TexCoords));
+    vec3 result = baked.rgb * vec3(texture(material.diffuse, TexCoords));
+    result += dirLight.specular * CalcSpecular(normalize(-dirLight.direction), norm, viewDir) * specularColor;
+#else
     vec3 result = CalcDirLight(dirLight, norm, viewDir);
-    // phase 2: point lights
-    for(int i = 0; i < NR_POINT_LIGHTS; i++)
-        result += CalcPointLight(pointLights[i], norm, FragPos, viewDir);    
+#endif
+    // phase 2: point lights, only the ones binned into this fragment's cluster
+    uvec2 cluster = FetchCluster();
+    uint lightCount = min(cluster.y, uint(MAX_CLUSTER_LIGHTS));
+    for(uint i = 0u; i < lightCount; i++)
+    {
+        int index = int(texelFetch(clusterLightIndices, int(cluster.x + i)).r);
+        PointLight light = FetchPointLight(index);
+#ifdef LIGHTMAP
+        if (index < bakedPointLights)
+        {
+            float distance = length(light.position - FragPos);
+            float attenuation = 1.0 / (light.constant + light.linear * distance + light.quadratic * (distance * distance));
+            result += light.specular * CalcSpecular(normalize(light.position - FragPos), norm, viewDir) * attenuation * specularColor;
+            continue;
+        }
+        // the lights that aren't baked get their ambient darkened by the baked occlusion
+        light.ambient *= baked.a;
+#endif
+        result += CalcPointLight(light, norm, FragPos, viewDir);
+    }
     // phase 3: spot light
-   // result += CalcSpotLight(spotLight, norm, FragPos, viewDir);    
+#ifdef SPOT_LIGHT
+    result += CalcSpotLight(spotLight, norm, FragPos, viewDir);
+#endif
     
+    // instance tint and glow, 1 and 0 for regular draws
+    result = result * Tint.rgb + Tint.rgb * Emissive;
     FragColor = vec4(result, 1.0);
 }
 
@@ -98,6 +176,13 @@ vec3 CalcDirLight(DirLight light, vec3 normal, vec3 viewDir)
     return (ambient + diffuse + specular);
 }
 
+// phong specular factor for light arriving from lightDir
+float CalcSpecular(vec3 lightDir, vec3 normal, vec3 viewDir)
+{
+    vec3 reflectDir = reflect(-lightDir, normal);
+    return pow(max(dot(viewDir, reflectDir), 0.0), material.shininess);
+}
+
 // calculates the color when using a point light.
 vec3 CalcPointLight(PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir)
 {
@@ -144,4 +229,23 @@ vec3 CalcSpotLight(SpotLight light, vec3 normal, vec3 fragPos, vec3 viewDir)
     diffuse *= attenuation * intensity;
     specular *= attenuation * intensity;
     return (ambient + diffuse + specular);
+}
+
+// offset and count of this fragment's cluster in the light index list
+uvec2 FetchCluster()
+{
+    float depth = -(view * vec4(FragPos, 1.0)).z;
+    uvec3 cluster = uvec3(uvec2(gl_FragCoord.xy * clusterScale.xy), uint(max(log(depth) * clusterScale.z + clusterScale.w, 0.0)));
+    cluster = min(cluster, clusterSize.xyz - 1u);
+    return texelFetch(clusterLights, int(cluster.x + clusterSize.x * (cluster.y + clusterSize.y * cluster.z))).rg;
+}
+
+// unpacks one light, the texels are laid out like the struct
+PointLight FetchPointLight(int index)
+{
+    vec4 texel0 = texelFetch(pointLightData, index * 4);
+    vec4 texel1 = texelFetch(pointLightData, index * 4 + 1);
+    vec4 texel2 = texelFetch(pointLightData, index * 4 + 2);
+    vec4 texel3 = texelFetch(pointLightData, index * 4 + 3);
+    return PointLight(texel0.xyz, texel0.w, texel1.xyz, texel1.w, texel2.xyz, texel2.w, texel3.xyz, texel3.w);
 }
\ No newline at end of file
@@ -0,0 +1,146 @@
+#include "FrameTimings.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+
+namespace
+{
+	double elapsedMs(chrono::high_resolution_clock::time_point from, chrono::high_resolution_clock::time_point to)
+	{
+		return chrono::duration<double, milli>(to - from).count();
+	}
+
+	//Nearest rank percentile of an already sorted column
+	double percentile(const vector<double> &sorted, double fraction)
+	{
+		if (sorted.empty())
+			return 0.0;
+		size_t rank = (size_t)(fraction * (sorted.size() - 1) + 0.5);
+		return sorted[min(rank, sorted.size() - 1)];
+	}
+
+	void printColumn(ostream &out, const char *name, vector<double> values)
+	{
+		sort(values.begin(), values.end());
+		double sum = 0.0;
+		for (size_t i = 0; i < values.size(); i++)
+			sum += values[i];
+		char line[160];
+		snprintf(line, sizeof(line), "  %-6s mean %7.3f  p50 %7.3f  p95 %7.3f  p99 %7.3f  max %7.3f ms", name,
+			values.empty() ? 0.0 : sum / values.size(), percentile(values, 0.5), percentile(values, 0.95),
+			percentile(values, 0.99), values.empty() ? 0.0 : values.back());
+		out << line << endl;
+	}
+}
+
+FrameTimings::FrameTimings() : inFrame(false)
+{
+	glGenQueries(QUERY_LATENCY * 2, &queries[0][0]);
+	for (int i = 0; i < QUERY_LATENCY; i++)
+		queryFrame[i] = -1;
+}
+
+void FrameTimings::BeginFrame()
+{
+	chrono::high_resolution_clock::time_point now = chrono::high_resolution_clock::now();
+	if (!frames.empty())
+		frames.back().frameMs = elapsedMs(frameStart, now);
+	frameStart = now;
+
+	Frame frame = { (unsigned int)frames.size(), 0.0, 0.0, 0.0 };
+	frames.push_back(frame);
+
+	//The slot's last frame was QUERY_LATENCY frames ago, its result is normally there by now
+	int slot = frame.frame % QUERY_LATENCY;
+	collect(slot);
+	glQueryCounter(queries[slot][0], GL_TIMESTAMP);
+	queryFrame[slot] = (int)frame.frame;
+	queryStart[slot] = now;
+	inFrame = true;
+}
+
+void FrameTimings::EndFrame()
+{
+	if (!inFrame)
+		return;
+	glQueryCounter(queries[frames.back().frame % QUERY_LATENCY][1], GL_TIMESTAMP);
+	frames.back().cpuMs = elapsedMs(frameStart, chrono::high_resolution_clock::now());
+	inFrame = false;
+}
+
+void FrameTimings::Finish()
+{
+	EndFrame();
+	glFinish();
+	if (!frames.empty() && frames.back().frameMs == 0.0)
+		frames.back().frameMs = elapsedMs(frameStart, chrono::high_resolution_clock::now());
+	for (int i = 0; i < QUERY_LATENCY; i++)
+		collect(i);
+}
+
+void FrameTimings::collect(int slot)
+{
+	if (queryFrame[slot] < 0)
+		return;
+	GLuint64 begin = 0, end = 0;
+	glGetQueryObjectui64v(queries[slot][0], GL_QUERY_RESULT, &begin);
+	glGetQueryObjectui64v(queries[slot][1], GL_QUERY_RESULT, &end);
+	//The commands can't have taken longer than it's been since they were issued. Software renderers sometimes
+	//report garbage for the first query, that shouldn't end up in the averages.
+	double gpuMs = end >= begin ? (end - begin) / 1.0e6 : -1.0;
+	frames[queryFrame[slot]].gpuMs = gpuMs >= 0.0 && gpuMs <= elapsedMs(queryStart[slot], chrono::high_resolution_clock::now()) ? gpuMs : -1.0;
+	queryFrame[slot] = -1;
+}
+
+bool FrameTimings::Write(const string &path) const
+{
+	ofstream file(path);
+	if (!file)
+	{
+		cout << "ERROR::FRAME_TIMINGS::COULD_NOT_WRITE " << path << endl;
+		return false;
+	}
+
+	bool json = path.size() >= 5 && path.compare(path.size() - 5, 5, ".json") == 0;
+	char line[128];
+	if (json)
+		file << "{\n\t\"frames\": [\n";
+	else
+		file << "frame,cpu_ms,gpu_ms,frame_ms\n";
+	for (size_t i = 0; i < frames.size(); i++)
+	{
+		const Frame &frame = frames[i];
+		if (json)
+			snprintf(line, sizeof(line), "\t\t{ \"frame\": %u, \"cpuMs\": %.4f, \"gpuMs\": %.4f, \"frameMs\": %.4f }%s\n",
+				frame.frame, frame.cpuMs, frame.gpuMs, frame.frameMs, i + 1 < frames.size() ? "," : "");
+		else
+			snprintf(line, sizeof(line), "%u,%.4f,%.4f,%.4f\n", frame.frame, frame.cpuMs, frame.gpuMs, frame.frameMs);
+		file << line;
+	}
+	if (json)
+		file << "\t]\n}\n";
+	return true;
+}
+
+void FrameTimings::PrintSummary(ostream &out) const
+{
+	vector<double> cpu, gpu, total;
+	for (size_t i = 0; i < frames.size(); i++)
+	{
+		cpu.push_back(frames[i].cpuMs);
+		if (frames[i].gpuMs >= 0.0)
+			gpu.push_back(frames[i].gpuMs);
+		total.push_back(frames[i].frameMs);
+	}
+	out << "FRAME TIMINGS:: " << frames.size() << " frames" << endl;
+	printColumn(out, "cpu", cpu);
+	printColumn(out, "gpu", gpu);
+	printColumn(out, "frame", total);
+}
+
+void FrameTimings::Release()
+{
+	glDeleteQueries(QUERY_LATENCY * 2, &queries[0][0]);
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <chrono>
+#include <ostream>
+#include <string>
+#include <vector>
+using namespace std;
+
+/// <summary>
+/// Per frame CPU and GPU times for benchmark runs. BeginFrame()/EndFrame() bracket one frame's rendering: the CPU side is
+/// the wall clock between them, the GPU side the difference of two GL_TIMESTAMP queries (timestamps, unlike
+/// GL_TIME_ELAPSED, don't get in the way of the Profiler's queries inside the frame). Queries are kept in a small ring
+/// and read back QUERY_LATENCY frames later, so measuring never waits on the GPU. Finish() collects the last ones.
+/// </summary>
+class FrameTimings
+{
+public:
+	static const int QUERY_LATENCY = 4;
+
+	struct Frame
+	{
+		unsigned int frame;
+		double cpuMs;	// BeginFrame to EndFrame on this thread
+		double gpuMs;	// GPU time between the two points, -1 if the driver's timer gave nothing believable
+		double frameMs;	// BeginFrame to the next BeginFrame (or Finish), what the frame cost in the end
+	};
+
+	FrameTimings();
+
+	void BeginFrame();
+	void EndFrame();
+
+	//Waits for the outstanding queries
+	void Finish();
+
+	const vector<Frame>& Frames() const { return frames; }
+
+	//CSV, or JSON if path ends in .json
+	bool Write(const string &path) const;
+
+	//Mean, median, 95th/99th percentile and worst frame of each column, frames without a GPU time are left out of that one
+	void PrintSummary(ostream &out) const;
+
+	//Deletes the queries, needs the context
+	void Release();
+
+private:
+	FrameTimings(const FrameTimings&) = delete;
+	FrameTimings& operator=(const FrameTimings&) = delete;
+
+	//Reads the GPU time of the frame that used slot into its record
+	void collect(int slot);
+
+	GLuint queries[QUERY_LATENCY][2];	// timestamps at BeginFrame and EndFrame
+	int queryFrame[QUERY_LATENCY];	// frame whose time the slot holds, -1 if none
+	chrono::high_resolution_clock::time_point queryStart[QUERY_LATENCY];
+	vector<Frame> frames;
+	chrono::high_resolution_clock::time_point frameStart;
+	bool inFrame;
+};
@@ -0,0 +1,89 @@
+#include "FrameUniforms.h"
+
+#include <cstring>
+
+//std140 sizes of the blocks, the shaders read garbage if these drift
+static_assert(sizeof(CameraBlock) == 144, "Camera block doesn't match std140");
+static_assert(sizeof(ClusterBlock) == 32, "Cluster block doesn't match std140");
+static_assert(sizeof(LightsBlock) == 64 + 80 + 32, "Lights block doesn't match std140");
+
+FrameUniforms::FrameUniforms() : UBO(0)
+{
+	memset(&camera, 0, sizeof(camera));
+	memset(&lights, 0, sizeof(lights));
+
+	//glBindBufferRange offsets have to be a multiple of the driver's alignment (often 256)
+	GLint alignment = 256;
+	glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+	if (alignment < 1)
+		alignment = 256;
+	lightsOffset = (sizeof(CameraBlock) + alignment - 1) / alignment * alignment;
+	staging.resize(lightsOffset + sizeof(LightsBlock), 0);
+
+	glGenBuffers(1, &UBO);
+	glBindBuffer(GL_UNIFORM_BUFFER, UBO);
+	glBufferData(GL_UNIFORM_BUFFER, staging.size(), staging.data(), GL_STREAM_DRAW);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+	glBindBufferRange(GL_UNIFORM_BUFFER, CAMERA_BINDING, UBO, 0, sizeof(CameraBlock));
+	glBindBufferRange(GL_UNIFORM_BUFFER, LIGHTS_BINDING, UBO, lightsOffset, sizeof(LightsBlock));
+}
+
+void FrameUniforms::Attach(const Shader &shader) const
+{
+	shader.Wait();
+	//GLSL 330 has no binding = qualifier, so the block indices are wired up here
+	GLuint cameraBlock = glGetUniformBlockIndex(shader.ID, "Camera");
+	if (cameraBlock != GL_INVALID_INDEX)
+		glUniformBlockBinding(shader.ID, cameraBlock, CAMERA_BINDING);
+	GLuint lightsBlock = glGetUniformBlockIndex(shader.ID, "Lights");
+	if (lightsBlock != GL_INVALID_INDEX)
+		glUniformBlockBinding(shader.ID, lightsBlock, LIGHTS_BINDING);
+}
+
+void FrameUniforms::SetCamera(const glm::mat4 &projection, const glm::mat4 &view, const glm::vec3 &position)
+{
+	camera.projection = projection;
+	camera.view = view;
+	camera.viewPos = position;
+}
+
+void FrameUniforms::SetDirLight(const glm::vec3 &direction, const glm::vec3 &ambient, const glm::vec3 &diffuse, const glm::vec3 &specular)
+{
+	lights.dirLight.direction = direction;
+	lights.dirLight.ambient = ambient;
+	lights.dirLight.diffuse = diffuse;
+	lights.dirLight.specular = specular;
+}
+
+void FrameUniforms::SetSpotLight(const Shader::LightSettings &settings, const glm::vec3 &direction, float cutOff, float outerCutOff)
+{
+	SpotLightBlock &light = lights.spotLight;
+	light.position = settings.position;
+	light.direction = direction;
+	light.cutOff = cutOff;
+	light.outerCutOff = outerCutOff;
+	light.ambient = settings.ambient;
+	light.diffuse = settings.diffuse;
+	light.specular = settings.specular;
+	light.constant = settings.constant;
+	light.linear = settings.linear;
+	light.quadratic = settings.quadratic;
+}
+
+void FrameUniforms::Upload()
+{
+	memcpy(staging.data(), &camera, sizeof(camera));
+	memcpy(staging.data() + lightsOffset, &lights, sizeof(lights));
+
+	//Respecifying the whole store orphans last frame's copy, so there's no wait on draws still reading it
+	glBindBuffer(GL_UNIFORM_BUFFER, UBO);
+	glBufferData(GL_UNIFORM_BUFFER, staging.size(), staging.data(), GL_STREAM_DRAW);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+
+void FrameUniforms::Release()
+{
+	glDeleteBuffers(1, &UBO);
+	UBO = 0;
+}
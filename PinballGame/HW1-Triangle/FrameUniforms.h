@@ -0,0 +1,93 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <vector>
+#include "LightClusters.h"
+#include "Shader.h"
+using namespace std;
+
+//std140 mirrors of the uniform blocks in the shaders. Every vec3 is followed by a float so the
+//C++ layout has no hidden padding, the GLSL structs are declared in the same member order.
+
+// layout (std140) uniform Camera
+struct CameraBlock
+{
+	glm::mat4 projection;
+	glm::mat4 view;
+	glm::vec3 viewPos;
+	float padding;
+};
+
+struct DirLightBlock
+{
+	glm::vec3 direction;
+	float padding0;
+	glm::vec3 ambient;
+	float padding1;
+	glm::vec3 diffuse;
+	float padding2;
+	glm::vec3 specular;
+	float padding3;
+};
+
+struct SpotLightBlock
+{
+	glm::vec3 position;
+	float cutOff;
+	glm::vec3 direction;
+	float outerCutOff;
+	glm::vec3 ambient;
+	float constant;
+	glm::vec3 diffuse;
+	float linear;
+	glm::vec3 specular;
+	float quadratic;
+};
+
+// layout (std140) uniform Lights. The point lights are in texture buffers, see LightClusters.
+struct LightsBlock
+{
+	DirLightBlock dirLight;
+	SpotLightBlock spotLight;
+	ClusterBlock clusters;
+};
+
+/// <summary>
+/// Per frame camera and light state for every program, in one uniform buffer.
+/// Fill the blocks during the frame, Upload() sends both with a single buffer update and every program
+/// that was Attach()ed reads them through its binding points, no glUniform* calls per shader.
+/// </summary>
+class FrameUniforms
+{
+public:
+	static const GLuint CAMERA_BINDING = 0;
+	static const GLuint LIGHTS_BINDING = 1;
+
+	CameraBlock camera;
+	LightsBlock lights;
+
+	FrameUniforms();
+
+	//Points the program's Camera and Lights blocks (if it has them) at our binding points
+	void Attach(const Shader &shader) const;
+
+	void SetCamera(const glm::mat4 &projection, const glm::mat4 &view, const glm::vec3 &position);
+	void SetDirLight(const glm::vec3 &direction, const glm::vec3 &ambient, const glm::vec3 &diffuse, const glm::vec3 &specular);
+	void SetSpotLight(const Shader::LightSettings &settings, const glm::vec3 &direction, float cutOff, float outerCutOff);
+	void SetClusters(const ClusterBlock &clusters) { lights.clusters = clusters; }
+
+	//Sends both blocks to the GPU, once per frame before drawing
+	void Upload();
+
+	//Deletes the buffer, needs the context
+	void Release();
+
+private:
+	FrameUniforms(const FrameUniforms&) = delete;
+	FrameUniforms& operator=(const FrameUniforms&) = delete;
+
+	unsigned int UBO;
+	size_t lightsOffset;			// the lights block starts at the next GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT after the camera
+	vector<unsigned char> staging;	// both blocks laid out like the buffer
+};
@@ -0,0 +1,141 @@
+#include "Frustum.h"
+
+#include <cmath>
+#include <glm/simd/platform.h>
+
+Frustum::Frustum(const glm::mat4 &viewProjection)
+{
+	//Rows of the matrix, glm stores columns
+	glm::vec4 rows[4];
+	for (int r = 0; r < 4; r++)
+		rows[r] = glm::vec4(viewProjection[0][r], viewProjection[1][r], viewProjection[2][r], viewProjection[3][r]);
+
+	planes[0] = rows[3] + rows[0];	// left
+	planes[1] = rows[3] - rows[0];	// right
+	planes[2] = rows[3] + rows[1];	// bottom
+	planes[3] = rows[3] - rows[1];	// top
+	planes[4] = rows[3] + rows[2];	// near
+	planes[5] = rows[3] - rows[2];	// far
+	for (int p = 0; p < 6; p++)
+		planes[p] /= glm::length(glm::vec3(planes[p]));
+}
+
+bool Frustum::Intersects(const BoundingBox &box) const
+{
+	glm::vec3 center = box.Center();
+	glm::vec3 extents = box.Extents();
+	for (int p = 0; p < 6; p++)
+	{
+		glm::vec3 normal(planes[p]);
+		float distance = glm::dot(normal, center) + planes[p].w;
+		float radius = glm::dot(glm::abs(normal), extents);
+		if (distance + radius < 0.0f)
+			return false;
+	}
+	return true;
+}
+
+bool Frustum::Intersects(const BoundingSphere &sphere) const
+{
+	for (int p = 0; p < 6; p++)
+		if (glm::dot(glm::vec3(planes[p]), sphere.center) + planes[p].w < -sphere.radius)
+			return false;
+	return true;
+}
+
+FrustumCuller::FrustumCuller() : count(0)
+{
+	stats.tested = stats.visible = stats.culled = 0;
+}
+
+void FrustumCuller::Begin(const Frustum &frustum)
+{
+	this->frustum = frustum;
+	count = 0;
+	centerX.clear(); centerY.clear(); centerZ.clear();
+	extentX.clear(); extentY.clear(); extentZ.clear();
+}
+
+size_t FrustumCuller::Add(const BoundingBox &box)
+{
+	glm::vec3 center = box.Center();
+	glm::vec3 extents = box.Extents();
+	if (box.Empty())
+	{
+		//Nothing to draw, but don't let the inverted box pass or fail by accident
+		center = glm::vec3(0.0f);
+		extents = glm::vec3(-1.0f);
+	}
+	centerX.push_back(center.x); centerY.push_back(center.y); centerZ.push_back(center.z);
+	extentX.push_back(extents.x); extentY.push_back(extents.y); extentZ.push_back(extents.z);
+	return count++;
+}
+
+void FrustumCuller::Cull()
+{
+	//Pad to whole groups of four, the padding boxes are never asked about
+	size_t padded = (count + 3) & ~(size_t)3;
+	centerX.resize(padded, 0.0f); centerY.resize(padded, 0.0f); centerZ.resize(padded, 0.0f);
+	extentX.resize(padded, 0.0f); extentY.resize(padded, 0.0f); extentZ.resize(padded, 0.0f);
+	visible.assign(padded, 0);
+
+#if GLM_ARCH & GLM_ARCH_SSE2_BIT
+	//Plane components broadcast once, the normal's absolute value gives the box's projected radius
+	glm_vec4 planeX[6], planeY[6], planeZ[6], planeW[6];
+	glm_vec4 absX[6], absY[6], absZ[6];
+	for (int p = 0; p < 6; p++)
+	{
+		planeX[p] = _mm_set1_ps(frustum.planes[p].x);
+		planeY[p] = _mm_set1_ps(frustum.planes[p].y);
+		planeZ[p] = _mm_set1_ps(frustum.planes[p].z);
+		planeW[p] = _mm_set1_ps(frustum.planes[p].w);
+		absX[p] = _mm_set1_ps(fabsf(frustum.planes[p].x));
+		absY[p] = _mm_set1_ps(fabsf(frustum.planes[p].y));
+		absZ[p] = _mm_set1_ps(fabsf(frustum.planes[p].z));
+	}
+	glm_vec4 zero = _mm_setzero_ps();
+
+	for (size_t i = 0; i < padded; i += 4)
+	{
+		glm_vec4 cx = _mm_loadu_ps(&centerX[i]), cy = _mm_loadu_ps(&centerY[i]), cz = _mm_loadu_ps(&centerZ[i]);
+		glm_vec4 ex = _mm_loadu_ps(&extentX[i]), ey = _mm_loadu_ps(&extentY[i]), ez = _mm_loadu_ps(&extentZ[i]);
+
+		//All four boxes start inside, every plane they are completely behind knocks them out
+		glm_vec4 inside = _mm_cmpge_ps(ex, zero);
+		for (int p = 0; p < 6; p++)
+		{
+			glm_vec4 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(cx, planeX[p]), _mm_mul_ps(cy, planeY[p])),
+				_mm_add_ps(_mm_mul_ps(cz, planeZ[p]), planeW[p]));
+			glm_vec4 radius = _mm_add_ps(_mm_add_ps(_mm_mul_ps(ex, absX[p]), _mm_mul_ps(ey, absY[p])), _mm_mul_ps(ez, absZ[p]));
+			inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(distance, radius), zero));
+			if (_mm_movemask_ps(inside) == 0)
+				break;
+		}
+
+		int mask = _mm_movemask_ps(inside);
+		visible[i] = mask & 1;
+		visible[i + 1] = (mask >> 1) & 1;
+		visible[i + 2] = (mask >> 2) & 1;
+		visible[i + 3] = (mask >> 3) & 1;
+	}
+#else
+	for (size_t i = 0; i < count; i++)
+	{
+		bool inside = extentX[i] >= 0.0f;
+		for (int p = 0; p < 6 && inside; p++)
+		{
+			const glm::vec4 &plane = frustum.planes[p];
+			float distance = centerX[i] * plane.x + centerY[i] * plane.y + centerZ[i] * plane.z + plane.w;
+			float radius = extentX[i] * fabsf(plane.x) + extentY[i] * fabsf(plane.y) + extentZ[i] * fabsf(plane.z);
+			inside = distance + radius >= 0.0f;
+		}
+		visible[i] = inside ? 1 : 0;
+	}
+#endif
+
+	stats.tested = (unsigned int)count;
+	stats.visible = 0;
+	for (size_t i = 0; i < count; i++)
+		stats.visible += visible[i];
+	stats.culled = stats.tested - stats.visible;
+}
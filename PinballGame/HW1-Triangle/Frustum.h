@@ -0,0 +1,63 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <cstdint>
+#include <vector>
+#include "Bounds.h"
+using namespace std;
+
+/// <summary>
+/// The six planes of a view frustum, pointing inwards and normalized (xyz normal, w distance).
+/// </summary>
+struct Frustum
+{
+	glm::vec4 planes[6];	// left, right, bottom, top, near, far
+
+	Frustum() {}
+	//Extracts the planes from a projection * view matrix (Gribb/Hartmann)
+	explicit Frustum(const glm::mat4 &viewProjection);
+
+	//Scalar tests, for the odd single check. Batches go through FrustumCuller.
+	bool Intersects(const BoundingBox &box) const;
+	bool Intersects(const BoundingSphere &sphere) const;
+};
+
+/// <summary>
+/// Tests a frame's worth of world space boxes against a frustum at once.
+/// Boxes are kept as structure of arrays (center and extents per axis) so Cull() can test four boxes per
+/// SSE step against each plane; the loop falls back to plain floats where glm has no SIMD support.
+/// </summary>
+class FrustumCuller
+{
+public:
+	struct Stats
+	{
+		unsigned int tested;
+		unsigned int visible;
+		unsigned int culled;
+	};
+
+	FrustumCuller();
+
+	//Forgets the last frame's boxes and starts collecting against frustum
+	void Begin(const Frustum &frustum);
+
+	//Queues a world space box, returns its index for Visible()
+	size_t Add(const BoundingBox &box);
+
+	//Tests every box added since Begin()
+	void Cull();
+
+	bool Visible(size_t index) const { return visible[index] != 0; }
+	size_t Count() const { return count; }
+	const Stats& LastStats() const { return stats; }
+
+private:
+	Frustum frustum;
+	size_t count;
+	//Per axis centers and extents, padded to a multiple of 4
+	vector<float> centerX, centerY, centerZ;
+	vector<float> extentX, extentY, extentZ;
+	vector<uint8_t> visible;
+	Stats stats;
+};
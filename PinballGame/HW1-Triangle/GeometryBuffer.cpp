@@ -0,0 +1,199 @@
+#include "GeometryBuffer.h"
+
+#include <cstring>
+#include "Mesh.h"
+
+vector<unique_ptr<GeometryBuffer>> GeometryBuffer::shared;
+
+namespace
+{
+	unsigned int boundVertexArray = 0;
+}
+
+void BindVertexArray(unsigned int vertexArray)
+{
+	if (vertexArray == boundVertexArray)
+		return;
+	glBindVertexArray(vertexArray);
+	boundVertexArray = vertexArray;
+}
+
+GeometryBuffer::GeometryBuffer(const VertexLayout &layout, size_t vertexCapacity, size_t indexBytesCapacity)
+	: layout(layout), vertexCount(0), vertexCapacity(vertexCapacity), indexBytes(0), indexBytesCapacity(indexBytesCapacity)
+{
+	glGenVertexArrays(1, &VAO);
+	glGenVertexArrays(1, &positionVAO);
+	glGenBuffers(1, &VBO);
+	glGenBuffers(1, &positionVBO);
+	glGenBuffers(1, &EBO);
+
+	glBindBuffer(GL_ARRAY_BUFFER, VBO);
+	glBufferData(GL_ARRAY_BUFFER, vertexCapacity * layout.Stride(), nullptr, GL_STATIC_DRAW);
+	glBindBuffer(GL_ARRAY_BUFFER, positionVBO);
+	glBufferData(GL_ARRAY_BUFFER, vertexCapacity * sizeof(glm::vec3), nullptr, GL_STATIC_DRAW);
+	pointVertexArrays();
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexBytesCapacity, nullptr, GL_STATIC_DRAW);
+}
+
+GeometryRange GeometryBuffer::Allocate(const Vertex *vertices, size_t count, const unsigned int *indices, size_t indexCount)
+{
+	GeometryRange range;
+	range.baseVertex = (GLint)vertexCount;
+	range.indexCount = (GLsizei)indexCount;
+	range.indexType = count <= 0xFFFF ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+
+	//32 bit index ranges have to start 4 byte aligned, 16 bit ones get the same for simplicity
+	size_t indexSize = range.indexType == GL_UNSIGNED_SHORT ? sizeof(unsigned short) : sizeof(unsigned int);
+	range.indexOffset = (indexBytes + 3) & ~(size_t)3;
+
+	//The element buffer binding is VAO state, so everything below happens with ours bound
+	BindVertexArray(VAO);
+	glBindBuffer(GL_ARRAY_BUFFER, VBO);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+
+	GLsizei stride = layout.Stride();
+	bool grown = false;
+	if (vertexCount + count > vertexCapacity)
+	{
+		size_t capacity = vertexCapacity * 2 > vertexCount + count ? vertexCapacity * 2 : vertexCount + count;
+		grow(GL_ARRAY_BUFFER, VBO, vertexCount * stride, capacity * stride);
+		grow(GL_ARRAY_BUFFER, positionVBO, vertexCount * sizeof(glm::vec3), capacity * sizeof(glm::vec3));
+		vertexCapacity = capacity;
+		grown = true;
+	}
+	size_t indexEnd = range.indexOffset + indexCount * indexSize;
+	if (indexEnd > indexBytesCapacity)
+	{
+		size_t capacity = indexBytesCapacity * 2 > indexEnd ? indexBytesCapacity * 2 : indexEnd;
+		grow(GL_ELEMENT_ARRAY_BUFFER, EBO, indexBytes, capacity);
+		indexBytesCapacity = capacity;
+		grown = true;
+	}
+	//The attribute pointers and element buffer bindings captured the old buffers
+	if (grown)
+		pointVertexArrays();
+
+	glBindBuffer(GL_ARRAY_BUFFER, positionVBO);
+	write(GL_ARRAY_BUFFER, vertexCount * sizeof(glm::vec3), count * sizeof(glm::vec3), [&](unsigned char *destination)
+	{
+		for (size_t i = 0; i < count; i++)
+			memcpy(destination + i * sizeof(glm::vec3), &vertices[i].Position, sizeof(glm::vec3));
+	});
+	glBindBuffer(GL_ARRAY_BUFFER, VBO);
+	write(GL_ARRAY_BUFFER, vertexCount * stride, count * stride, [&](unsigned char *destination)
+	{
+		layout.Pack(vertices, count, destination);
+	});
+	write(GL_ELEMENT_ARRAY_BUFFER, range.indexOffset, indexCount * indexSize, [&](unsigned char *destination)
+	{
+		if (range.indexType == GL_UNSIGNED_INT)
+		{
+			memcpy(destination, indices, indexCount * sizeof(unsigned int));
+			return;
+		}
+		unsigned short *shortIndices = (unsigned short*)destination;
+		for (size_t i = 0; i < indexCount; i++)
+			shortIndices[i] = (unsigned short)indices[i];
+	});
+
+	vertexCount += count;
+	indexBytes = indexEnd;
+	return range;
+}
+
+void GeometryBuffer::Bind() const
+{
+	BindVertexArray(VAO);
+}
+
+void GeometryBuffer::Draw(const GeometryRange &range) const
+{
+	BindVertexArray(VAO);
+	glDrawElementsBaseVertex(GL_TRIANGLES, range.indexCount, range.indexType, range.Indices(), range.baseVertex);
+}
+
+void GeometryBuffer::BindPositions() const
+{
+	BindVertexArray(positionVAO);
+}
+
+void GeometryBuffer::Release()
+{
+	if (boundVertexArray == VAO || boundVertexArray == positionVAO)
+		BindVertexArray(0);
+	glDeleteVertexArrays(1, &VAO);
+	glDeleteVertexArrays(1, &positionVAO);
+	glDeleteBuffers(1, &VBO);
+	glDeleteBuffers(1, &positionVBO);
+	glDeleteBuffers(1, &EBO);
+	VAO = VBO = EBO = 0;
+	positionVAO = positionVBO = 0;
+	vertexCount = vertexCapacity = 0;
+	indexBytes = indexBytesCapacity = 0;
+}
+
+GeometryBuffer& GeometryBuffer::ForLayout(const VertexLayout &layout)
+{
+	for (size_t i = 0; i < shared.size(); i++)
+		if (shared[i]->Layout() == layout)
+			return *shared[i];
+	shared.push_back(unique_ptr<GeometryBuffer>(new GeometryBuffer(layout)));
+	return *shared.back();
+}
+
+void GeometryBuffer::ReleaseAll()
+{
+	for (size_t i = 0; i < shared.size(); i++)
+		shared[i]->Release();
+	shared.clear();
+}
+
+void GeometryBuffer::grow(GLenum target, unsigned int &buffer, size_t usedBytes, size_t newSize)
+{
+	//Copy on the GPU, the old contents never come back to the CPU
+	unsigned int grown;
+	glGenBuffers(1, &grown);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, grown);
+	glBufferData(GL_COPY_WRITE_BUFFER, newSize, nullptr, GL_STATIC_DRAW);
+	if (usedBytes > 0)
+	{
+		glBindBuffer(GL_COPY_READ_BUFFER, buffer);
+		glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, usedBytes);
+		glBindBuffer(GL_COPY_READ_BUFFER, 0);
+	}
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+	glDeleteBuffers(1, &buffer);
+	buffer = grown;
+	glBindBuffer(target, buffer);
+}
+
+void GeometryBuffer::pointVertexArrays()
+{
+	BindVertexArray(positionVAO);
+	glBindBuffer(GL_ARRAY_BUFFER, positionVBO);
+	glEnableVertexAttribArray(0);
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), (void*)0);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+
+	BindVertexArray(VAO);
+	glBindBuffer(GL_ARRAY_BUFFER, VBO);
+	layout.Apply();
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+}
+
+void GeometryBuffer::write(GLenum target, size_t offset, size_t size, const function<void(unsigned char*)> &fill)
+{
+	if (size == 0)
+		return;
+	//Nothing has drawn from the new range yet, so the mapping doesn't need to wait for the GPU
+	void *mapped = glMapBufferRange(target, offset, size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+	if (mapped)
+	{
+		fill((unsigned char*)mapped);
+		glUnmapBuffer(target);
+		return;
+	}
+	vector<unsigned char> staging(size);
+	fill(staging.data());
+	glBufferSubData(target, offset, size, staging.data());
+}
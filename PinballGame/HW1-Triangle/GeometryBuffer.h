@@ -0,0 +1,88 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <functional>
+#include <memory>
+#include <vector>
+#include "VertexFormat.h"
+using namespace std;
+
+struct Vertex;
+
+//Where a mesh lives inside a GeometryBuffer
+struct GeometryRange
+{
+	GLint baseVertex;		// added to every index, so 16 bit indices keep working deep into the buffer
+	size_t indexOffset;		// byte offset of the first index in the element buffer
+	GLsizei indexCount;
+	GLenum indexType;		// GL_UNSIGNED_SHORT when the mesh has at most 65535 vertices
+
+	GeometryRange() : baseVertex(0), indexOffset(0), indexCount(0), indexType(GL_UNSIGNED_INT) {}
+
+	//The offset as glDrawElements* wants it
+	const void* Indices() const { return (const void*)indexOffset; }
+};
+
+/// <summary>
+/// One big vertex buffer and one big index buffer behind a single VAO that static meshes are suballocated from.
+/// Meshes only remember their GeometryRange and draw with base vertex/first index offsets, so drawing a whole
+/// table binds one VAO instead of one per mesh. Every vertex in a buffer uses the same VertexLayout,
+/// ForLayout() hands out one shared buffer per layout. Buffers grow by copying on the GPU, ranges stay valid.
+/// Positions are also kept tightly packed in a buffer of their own behind a second VAO (attribute 0 only, same
+/// indices), so depth only passes fetch 12 bytes per vertex instead of the whole vertex.
+/// </summary>
+class GeometryBuffer
+{
+public:
+	explicit GeometryBuffer(const VertexLayout &layout, size_t vertexCapacity = 64 * 1024, size_t indexBytesCapacity = 1024 * 1024);
+
+	//Packs the vertices into the layout and appends them and the indices. GL thread only.
+	GeometryRange Allocate(const Vertex *vertices, size_t vertexCount, const unsigned int *indices, size_t indexCount);
+
+	//Binds the VAO unless it already is
+	void Bind() const;
+
+	//Binds and draws one range
+	void Draw(const GeometryRange &range) const;
+
+	//Binds the position only VAO unless it already is, ranges draw from it the same way
+	void BindPositions() const;
+
+	//Deletes the GL objects, needs the context so call it before glfwTerminate()
+	void Release();
+
+	const VertexLayout& Layout() const { return layout; }
+	unsigned int VertexArray() const { return VAO; }
+	unsigned int PositionArray() const { return positionVAO; }
+	size_t VertexCount() const { return vertexCount; }
+	size_t IndexBytes() const { return indexBytes; }
+
+	//The shared buffer for all static meshes with this layout
+	static GeometryBuffer& ForLayout(const VertexLayout &layout);
+
+	//Releases every shared buffer
+	static void ReleaseAll();
+
+private:
+	GeometryBuffer(const GeometryBuffer&) = delete;
+	GeometryBuffer& operator=(const GeometryBuffer&) = delete;
+
+	//Moves the contents of buffer into a new one of newSize bytes and binds that to target
+	void grow(GLenum target, unsigned int &buffer, size_t usedBytes, size_t newSize);
+	//Points both VAOs at the current buffers, leaves VAO bound with VBO and EBO
+	void pointVertexArrays();
+	//Lets fill write size bytes at offset of the buffer bound to target, through a mapping where possible
+	void write(GLenum target, size_t offset, size_t size, const function<void(unsigned char*)> &fill);
+
+	VertexLayout layout;
+	unsigned int VAO, VBO, EBO;
+	unsigned int positionVAO, positionVBO;
+	size_t vertexCount, vertexCapacity;
+	size_t indexBytes, indexBytesCapacity;
+
+	static vector<unique_ptr<GeometryBuffer>> shared;
+};
+
+//glBindVertexArray that remembers the binding, so redundant binds are skipped.
+//Use it for every VAO bind, otherwise GeometryBuffer::Bind() may think its VAO is still bound.
+void BindVertexArray(unsigned int vertexArray);
@@ -0,0 +1,122 @@
+#include "HeadlessContext.h"
+
+#include <iostream>
+using namespace std;
+
+#ifdef __linux__
+namespace
+{
+	void* eglLoader(const char *name)
+	{
+		return (void*)eglGetProcAddress(name);
+	}
+}
+
+HeadlessContext::HeadlessContext() : display(EGL_NO_DISPLAY), surface(EGL_NO_SURFACE), context(EGL_NO_CONTEXT)
+{
+}
+
+bool HeadlessContext::Create()
+{
+	display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+	if (display == EGL_NO_DISPLAY || !eglInitialize(display, NULL, NULL))
+	{
+		cout << "ERROR::HEADLESS::NO_EGL_DISPLAY" << endl;
+		return false;
+	}
+
+	const EGLint configAttributes[] = {
+		EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+		EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+		EGL_RED_SIZE, 8, EGL_GREEN_SIZE, 8, EGL_BLUE_SIZE, 8,
+		EGL_NONE };
+	EGLConfig config = NULL;
+	EGLint configs = 0;
+	eglChooseConfig(display, configAttributes, &config, 1, &configs);
+
+	const EGLint contextAttributes[] = {
+		EGL_CONTEXT_MAJOR_VERSION, 3,
+		EGL_CONTEXT_MINOR_VERSION, 3,
+		EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+		EGL_NONE };
+	eglBindAPI(EGL_OPENGL_API);
+	//Surfaceless displays have no pbuffer configs, the context then goes current without any surface (EGL_KHR_surfaceless_context)
+	context = eglCreateContext(display, configs > 0 ? config : NULL, EGL_NO_CONTEXT, contextAttributes);
+	if (context == EGL_NO_CONTEXT)
+	{
+		cout << "ERROR::HEADLESS::CONTEXT_CREATION_FAILED 0x" << hex << eglGetError() << dec << endl;
+		return false;
+	}
+	if (configs > 0)
+	{
+		const EGLint surfaceAttributes[] = { EGL_WIDTH, 1, EGL_HEIGHT, 1, EGL_NONE };
+		surface = eglCreatePbufferSurface(display, config, surfaceAttributes);
+	}
+	if (!eglMakeCurrent(display, surface, surface, context))
+	{
+		cout << "ERROR::HEADLESS::MAKE_CURRENT_FAILED 0x" << hex << eglGetError() << dec << endl;
+		return false;
+	}
+	return true;
+}
+
+GLADloadproc HeadlessContext::Loader()
+{
+	return (GLADloadproc)eglLoader;
+}
+
+void HeadlessContext::Release()
+{
+	if (display == EGL_NO_DISPLAY)
+		return;
+	eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+	if (context != EGL_NO_CONTEXT)
+		eglDestroyContext(display, context);
+	if (surface != EGL_NO_SURFACE)
+		eglDestroySurface(display, surface);
+	eglTerminate(display);
+	display = EGL_NO_DISPLAY;
+	surface = EGL_NO_SURFACE;
+	context = EGL_NO_CONTEXT;
+}
+#else
+HeadlessContext::HeadlessContext() : window(NULL)
+{
+}
+
+bool HeadlessContext::Create()
+{
+	glfwInit();
+	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+	glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+	glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+
+	//The window is never shown, its size doesn't matter
+	window = glfwCreateWindow(1, 1, "Barry's Engine (headless)", NULL, NULL);
+	if (window == NULL)
+	{
+		cout << "ERROR::HEADLESS::CONTEXT_CREATION_FAILED" << endl;
+		glfwTerminate();
+		return false;
+	}
+	glfwMakeContextCurrent(window);
+	//No vsync, frames should take as long as the rendering does
+	glfwSwapInterval(0);
+	return true;
+}
+
+GLADloadproc HeadlessContext::Loader()
+{
+	return (GLADloadproc)glfwGetProcAddress;
+}
+
+void HeadlessContext::Release()
+{
+	if (window == NULL)
+		return;
+	glfwDestroyWindow(window);
+	glfwTerminate();
+	window = NULL;
+}
+#endif
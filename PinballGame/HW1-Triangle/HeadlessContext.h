@@ -0,0 +1,40 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+
+#ifdef __linux__
+#include <EGL/egl.h>
+#endif
+
+/// <summary>
+/// A GL 3.3 core context nobody sees, for benchmark runs without a desktop. On Linux it is an EGL pbuffer context, which
+/// Mesa's llvmpipe provides without a GPU or a display server (EGL_PLATFORM=surfaceless if there is no X or Wayland).
+/// Everywhere else it is a hidden GLFW window. Draw into a RenderTarget, the context's own surface is tiny or not shown.
+/// </summary>
+class HeadlessContext
+{
+public:
+	HeadlessContext();
+
+	//Creates the context and makes it current, false if the platform can't give us one
+	bool Create();
+
+	//For gladLoadGLLoader and friends, only valid after Create()
+	static GLADloadproc Loader();
+
+	//Destroys the context, call after every GL resource is released
+	void Release();
+
+private:
+	HeadlessContext(const HeadlessContext&) = delete;
+	HeadlessContext& operator=(const HeadlessContext&) = delete;
+
+#ifdef __linux__
+	EGLDisplay display;
+	EGLSurface surface;
+	EGLContext context;
+#else
+	GLFWwindow *window;
+#endif
+};
@@ -0,0 +1,112 @@
+#include "InstanceBuffer.h"
+
+#include <unordered_map>
+
+namespace
+{
+	//Which instance each VAO's instance attributes currently point at. The buffer name never changes
+	//(growing respecifies the same buffer), so this only goes stale when the buffer is released.
+	unordered_map<unsigned int, size_t> pointedAt;
+
+	bool HasBaseInstance()
+	{
+		return GLAD_GL_VERSION_4_2 && glDrawElementsInstancedBaseVertexBaseInstance != nullptr;
+	}
+}
+
+InstanceBuffer::InstanceBuffer(size_t capacity) : capacity(capacity)
+{
+	glGenBuffers(1, &VBO);
+	glBindBuffer(GL_ARRAY_BUFFER, VBO);
+	glBufferData(GL_ARRAY_BUFFER, capacity * sizeof(InstanceData), nullptr, GL_STREAM_DRAW);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+size_t InstanceBuffer::Add(const InstanceData *data, size_t count)
+{
+	size_t first = instances.size();
+	instances.insert(instances.end(), data, data + count);
+	return first;
+}
+
+void InstanceBuffer::Upload()
+{
+	if (instances.empty())
+		return;
+	if (instances.size() > capacity)
+		capacity = instances.size() * 2;
+
+	//Respecifying the store orphans last frame's instances instead of waiting for the GPU to finish with them
+	glBindBuffer(GL_ARRAY_BUFFER, VBO);
+	glBufferData(GL_ARRAY_BUFFER, capacity * sizeof(InstanceData), nullptr, GL_STREAM_DRAW);
+	glBufferSubData(GL_ARRAY_BUFFER, 0, instances.size() * sizeof(InstanceData), instances.data());
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void InstanceBuffer::Draw(const GeometryBuffer &geometry, const GeometryRange &range, size_t first, size_t count, bool positionsOnly)
+{
+	if (count == 0)
+		return;
+	unsigned int vertexArray = positionsOnly ? geometry.PositionArray() : geometry.VertexArray();
+	if (positionsOnly)
+		geometry.BindPositions();
+	else
+		geometry.Bind();
+
+	if (HasBaseInstance())
+	{
+		//GL 4.2: the attributes stay at instance 0 and the draw offsets them
+		pointAttributes(vertexArray, 0);
+		glDrawElementsInstancedBaseVertexBaseInstance(GL_TRIANGLES, range.indexCount, range.indexType, range.Indices(),
+			(GLsizei)count, range.baseVertex, (GLuint)first);
+	}
+	else
+	{
+		pointAttributes(vertexArray, first);
+		glDrawElementsInstancedBaseVertex(GL_TRIANGLES, range.indexCount, range.indexType, range.Indices(),
+			(GLsizei)count, range.baseVertex);
+	}
+}
+
+void InstanceBuffer::Release()
+{
+	glDeleteBuffers(1, &VBO);
+	VBO = 0;
+	pointedAt.clear();
+}
+
+void InstanceBuffer::pointAttributes(unsigned int vertexArray, size_t first)
+{
+	unordered_map<unsigned int, size_t>::iterator found = pointedAt.find(vertexArray);
+	if (found != pointedAt.end() && found->second == first)
+		return;
+	pointedAt[vertexArray] = first;
+
+	size_t base = first * sizeof(InstanceData);
+	GLsizei stride = sizeof(InstanceData);
+	glBindBuffer(GL_ARRAY_BUFFER, VBO);
+	// model matrix, a mat4 attribute takes one location per column
+	for (GLuint column = 0; column < 4; column++)
+	{
+		GLuint location = FIRST_ATTRIBUTE + column;
+		glEnableVertexAttribArray(location);
+		glVertexAttribPointer(location, 4, GL_FLOAT, GL_FALSE, stride, (void*)(base + offsetof(InstanceData, model) + column * sizeof(glm::vec4)));
+		glVertexAttribDivisor(location, 1);
+	}
+	// tint
+	glEnableVertexAttribArray(FIRST_ATTRIBUTE + 4);
+	glVertexAttribPointer(FIRST_ATTRIBUTE + 4, 4, GL_FLOAT, GL_FALSE, stride, (void*)(base + offsetof(InstanceData, tint)));
+	glVertexAttribDivisor(FIRST_ATTRIBUTE + 4, 1);
+	// emissive intensity
+	glEnableVertexAttribArray(FIRST_ATTRIBUTE + 5);
+	glVertexAttribPointer(FIRST_ATTRIBUTE + 5, 1, GL_FLOAT, GL_FALSE, stride, (void*)(base + offsetof(InstanceData, emissive)));
+	glVertexAttribDivisor(FIRST_ATTRIBUTE + 5, 1);
+	// normal matrix, a mat3 takes one location per column
+	for (GLuint column = 0; column < 3; column++)
+	{
+		GLuint location = FIRST_ATTRIBUTE + 6 + column;
+		glEnableVertexAttribArray(location);
+		glVertexAttribPointer(location, 3, GL_FLOAT, GL_FALSE, stride, (void*)(base + offsetof(InstanceData, normal) + column * sizeof(glm::vec3)));
+		glVertexAttribDivisor(location, 1);
+	}
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <vector>
+#include "GeometryBuffer.h"
+#include "Transform.h"
+using namespace std;
+
+//Per instance attributes, read by the INSTANCED shader permutations at locations 5-13
+struct InstanceData
+{
+	glm::mat4 model;	// locations 5-8, one per column
+	glm::vec4 tint;		// location 9, multiplies the lit color
+	float emissive;		// location 10, added on top of the lighting
+	glm::mat3 normal;	// locations 11-13, the model's normal matrix
+	float padding[2];
+
+	//Computes the normal matrix, build these once and keep them while the instance doesn't move
+	InstanceData(const glm::mat4 &model = glm::mat4(1.0f), const glm::vec4 &tint = glm::vec4(1.0f), float emissive = 0.0f)
+		: model(model), tint(tint), emissive(emissive), normal(Transform::NormalMatrix(model))
+	{
+		padding[0] = padding[1] = 0.0f;
+	}
+	//Takes the normal matrix transform already has
+	InstanceData(const Transform &transform, const glm::vec4 &tint = glm::vec4(1.0f), float emissive = 0.0f)
+		: model(transform.Model()), tint(tint), emissive(emissive), normal(transform.Normal())
+	{
+		padding[0] = padding[1] = 0.0f;
+	}
+};
+static_assert(sizeof(InstanceData) == 128, "InstanceData should stay tightly packed, the attribute offsets depend on it");
+
+/// <summary>
+/// Streams the frame's per instance data for instanced draws.
+/// Batches Add() their instances while the frame is being submitted, Upload() sends all of them with one buffer update,
+/// and Draw() renders a mesh once per instance of a batch in a single draw call, so hundreds of identical posts or
+/// bumpers cost one draw per mesh instead of one per copy.
+/// The instance attributes are attached to the geometry VAO with divisor 1. Non instanced shaders don't declare them,
+/// so they keep drawing from the same VAO as before.
+/// </summary>
+class InstanceBuffer
+{
+public:
+	static const GLuint FIRST_ATTRIBUTE = 5;
+
+	explicit InstanceBuffer(size_t capacity = 1024);
+
+	//Queues instances for this frame, returns the index of the first one to pass to Draw()
+	size_t Add(const InstanceData *instances, size_t count);
+	size_t Add(const vector<InstanceData> &instances) { return Add(instances.data(), instances.size()); }
+
+	//Sends everything added since the last Clear(), before the first Draw() of the frame
+	void Upload();
+
+	//Draws count instances of range starting at instance first. positionsOnly draws from the geometry's position
+	//only VAO, for depth only passes.
+	void Draw(const GeometryBuffer &geometry, const GeometryRange &range, size_t first, size_t count, bool positionsOnly = false);
+
+	//Forgets this frame's instances
+	void Clear() { instances.clear(); }
+
+	size_t Count() const { return instances.size(); }
+	const InstanceData& Get(size_t index) const { return instances[index]; }
+
+	//Deletes the buffer, needs the context
+	void Release();
+
+private:
+	InstanceBuffer(const InstanceBuffer&) = delete;
+	InstanceBuffer& operator=(const InstanceBuffer&) = delete;
+
+	//Points the instance attributes of vertexArray (which must be bound) at instance first of our buffer
+	void pointAttributes(unsigned int vertexArray, size_t first);
+
+	unsigned int VBO;
+	size_t capacity;	// instances the GL buffer holds
+	vector<InstanceData> instances;
+};
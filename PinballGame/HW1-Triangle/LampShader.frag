@@ -1,8 +1,11 @@
 #version 330 core
 out vec4 FragColor;
 
+in vec4 Tint;
+in float Emissive;
+
 uniform vec3 color;
 void main()
 {
-    FragColor = vec4(color, 1.0); // set all 4 vector values to 1.0
+    FragColor = vec4(color * Tint.rgb * (1.0 + Emissive), 1.0); // tint and emissive are 1 and 0 unless instanced
 }
\ No newline at end of file
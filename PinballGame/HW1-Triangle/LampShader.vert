@@ -1,11 +1,38 @@
 #version 330 core
+// permutations, see ShaderDefines:
+//   INSTANCED  transform, tint and emissive come per instance from the InstanceBuffer
 layout (location = 0) in vec3 aPos;
+#ifdef INSTANCED
+// per instance (InstanceBuffer), the model matrix takes locations 5-8
+layout (location = 5) in mat4 aModel;
+layout (location = 9) in vec4 aTint;
+layout (location = 10) in float aEmissive;
+#endif
 
+// per frame camera, shared by every program (FrameUniforms)
+layout (std140) uniform Camera
+{
+	mat4 projection;
+	mat4 view;
+	vec3 viewPos;
+};
+
+#ifndef INSTANCED
 uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+#endif
+
+out vec4 Tint;
+out float Emissive;
 
 void main()
 {
+#ifdef INSTANCED
+	gl_Position = projection * view * aModel * vec4(aPos, 1.0);
+	Tint = aTint;
+	Emissive = aEmissive;
+#else
 	gl_Position = projection * view * model * vec4(aPos, 1.0);
-}
\ No newline at end of file
+	Tint = vec4(1.0);
+	Emissive = 0.0;
+#endif
+}
@@ -0,0 +1,250 @@
+#include "LightClusters.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+#include <glm/simd/platform.h>
+#include "ThreadPool.h"
+
+namespace
+{
+	const unsigned int CLUSTERS_PER_SLICE = LightClusters::CLUSTERS_X * LightClusters::CLUSTERS_Y;
+	const unsigned int CLUSTER_COUNT = CLUSTERS_PER_SLICE * LightClusters::CLUSTERS_Z;
+	static_assert(LightClusters::CLUSTERS_X % 4 == 0, "Slices are binned four clusters at a time");
+	static_assert(CLUSTERS_PER_SLICE <= 0x10000, "Clusters in a slice are packed into 16 bits");
+	static_assert(LightClusters::MAX_LIGHTS <= 0x10000, "Light indices are 16 bit");
+}
+
+LightClusters::LightClusters() : boxProjection(0.0f), boxNear(0.0f), boxFar(0.0f)
+{
+	memset(&block, 0, sizeof(block));
+	memset(&stats, 0, sizeof(stats));
+	slices.resize(CLUSTERS_Z);
+	clusters.assign(CLUSTER_COUNT, glm::uvec2(0));
+
+	glGenBuffers(3, buffers);
+	glGenTextures(3, textures);
+	const GLenum formats[3] = { GL_RGBA32F, GL_RG32UI, GL_R16UI };
+	for (int i = 0; i < 3; i++)
+	{
+		glBindBuffer(GL_TEXTURE_BUFFER, buffers[i]);
+		glBufferData(GL_TEXTURE_BUFFER, 16, nullptr, GL_STREAM_DRAW);
+		glBindTexture(GL_TEXTURE_BUFFER, textures[i]);
+		glTexBuffer(GL_TEXTURE_BUFFER, formats[i], buffers[i]);
+	}
+	glBindTexture(GL_TEXTURE_BUFFER, 0);
+	glBindBuffer(GL_TEXTURE_BUFFER, 0);
+}
+
+void LightClusters::Attach(const Shader &shader) const
+{
+	glUseProgram(shader.ID);
+	shader.setInt("pointLightData", LIGHT_DATA_UNIT);
+	shader.setInt("clusterLights", CLUSTER_UNIT);
+	shader.setInt("clusterLightIndices", LIGHT_INDEX_UNIT);
+}
+
+float LightClusters::Range(const Shader::LightSettings &settings)
+{
+	glm::vec3 brightest = glm::max(settings.ambient, glm::max(settings.diffuse, settings.specular));
+	float intensity = glm::max(brightest.x, glm::max(brightest.y, brightest.z));
+	//Solve constant + linear * d + quadratic * d^2 = 256 * intensity for d
+	float target = 256.0f * intensity - settings.constant;
+	if (target <= 0.0f)
+		return 0.0f;
+	if (settings.quadratic > 0.0f)
+		return (-settings.linear + sqrtf(settings.linear * settings.linear + 4.0f * settings.quadratic * target)) / (2.0f * settings.quadratic);
+	if (settings.linear > 0.0f)
+		return target / settings.linear;
+	return FLT_MAX;
+}
+
+bool LightClusters::Add(const Shader::LightSettings &settings)
+{
+	if (lights.size() >= MAX_LIGHTS)
+		return false;
+	LightData light;
+	light.position = settings.position;
+	light.constant = settings.constant;
+	light.ambient = settings.ambient;
+	light.linear = settings.linear;
+	light.diffuse = settings.diffuse;
+	light.quadratic = settings.quadratic;
+	light.specular = settings.specular;
+	light.range = Range(settings);
+	lights.push_back(light);
+	return true;
+}
+
+void LightClusters::buildClusterBoxes(const glm::mat4 &projection, float nearPlane, float farPlane)
+{
+	boxProjection = projection;
+	boxNear = nearPlane;
+	boxFar = farPlane;
+	boxMinX.resize(CLUSTER_COUNT); boxMinY.resize(CLUSTER_COUNT); boxMinZ.resize(CLUSTER_COUNT);
+	boxMaxX.resize(CLUSTER_COUNT); boxMaxY.resize(CLUSTER_COUNT); boxMaxZ.resize(CLUSTER_COUNT);
+
+	//A view space point at depth d lands on ndc = (P00 * x + P20 * z) / d, so x = d * (ndc + P20) / P00 (z = -d)
+	float ratio = farPlane / nearPlane;
+	for (unsigned int z = 0; z < CLUSTERS_Z; z++)
+	{
+		float depthNear = nearPlane * powf(ratio, (float)z / CLUSTERS_Z);
+		float depthFar = nearPlane * powf(ratio, (float)(z + 1) / CLUSTERS_Z);
+		for (unsigned int y = 0; y < CLUSTERS_Y; y++)
+		{
+			float ndcY0 = -1.0f + 2.0f * y / CLUSTERS_Y + projection[2][1];
+			float ndcY1 = -1.0f + 2.0f * (y + 1) / CLUSTERS_Y + projection[2][1];
+			for (unsigned int x = 0; x < CLUSTERS_X; x++)
+			{
+				float ndcX0 = -1.0f + 2.0f * x / CLUSTERS_X + projection[2][0];
+				float ndcX1 = -1.0f + 2.0f * (x + 1) / CLUSTERS_X + projection[2][0];
+				size_t i = x + CLUSTERS_X * (y + CLUSTERS_Y * z);
+				boxMinX[i] = glm::min(depthNear * ndcX0, depthFar * ndcX0) / projection[0][0];
+				boxMaxX[i] = glm::max(depthNear * ndcX1, depthFar * ndcX1) / projection[0][0];
+				boxMinY[i] = glm::min(depthNear * ndcY0, depthFar * ndcY0) / projection[1][1];
+				boxMaxY[i] = glm::max(depthNear * ndcY1, depthFar * ndcY1) / projection[1][1];
+				boxMinZ[i] = -depthFar;
+				boxMaxZ[i] = -depthNear;
+			}
+		}
+	}
+}
+
+void LightClusters::Build(const glm::mat4 &projection, const glm::mat4 &view, float nearPlane, float farPlane, int width, int height)
+{
+	if (projection != boxProjection || nearPlane != boxNear || farPlane != boxFar)
+		buildClusterBoxes(projection, nearPlane, farPlane);
+
+	float logRatio = logf(farPlane / nearPlane);
+	block.size = glm::uvec4(CLUSTERS_X, CLUSTERS_Y, CLUSTERS_Z, (unsigned int)lights.size());
+	block.scale = glm::vec4((float)CLUSTERS_X / glm::max(width, 1), (float)CLUSTERS_Y / glm::max(height, 1),
+		CLUSTERS_Z / logRatio, -(float)CLUSTERS_Z * logf(nearPlane) / logRatio);
+
+	//Lights to view space, and the range of slices each one reaches
+	viewLights.resize(lights.size());
+	lightSlices.resize(lights.size());
+	for (size_t i = 0; i < lights.size(); i++)
+	{
+		glm::vec3 center = glm::vec3(view * glm::vec4(lights[i].position, 1.0f));
+		float range = lights[i].range;
+		viewLights[i] = glm::vec4(center, range);
+
+		float depth = -center.z;
+		if (range <= 0.0f || depth + range < nearPlane || depth - range > farPlane)
+		{
+			lightSlices[i] = glm::uvec2(1, 0); //reaches nothing
+			continue;
+		}
+		float first = logf(glm::max(depth - range, nearPlane)) * block.scale.z + block.scale.w;
+		float last = logf(glm::min(depth + range, farPlane)) * block.scale.z + block.scale.w;
+		lightSlices[i] = glm::uvec2((unsigned int)glm::clamp(first, 0.0f, CLUSTERS_Z - 1.0f), (unsigned int)glm::clamp(last, 0.0f, CLUSTERS_Z - 1.0f));
+	}
+
+	ThreadPool::Shared().ParallelFor(CLUSTERS_Z, [this](size_t slice) { binSlice((unsigned int)slice); });
+
+	//Stitch the slices' lists together, in slice order so a cluster's lights stay contiguous
+	indices.clear();
+	memset(&stats, 0, sizeof(stats));
+	stats.lights = (unsigned int)lights.size();
+	for (unsigned int z = 0; z < CLUSTERS_Z; z++)
+	{
+		const SliceBins &bins = slices[z];
+		uint32_t offset = (uint32_t)indices.size();
+		for (unsigned int c = 0; c < CLUSTERS_PER_SLICE; c++)
+		{
+			clusters[z * CLUSTERS_PER_SLICE + c] = glm::uvec2(offset, bins.counts[c]);
+			offset += bins.counts[c];
+			if (bins.counts[c] > 0)
+				stats.occupiedClusters++;
+			stats.maxPerCluster = glm::max(stats.maxPerCluster, bins.counts[c]);
+		}
+		indices.insert(indices.end(), bins.indices.begin(), bins.indices.end());
+	}
+	stats.indices = (unsigned int)indices.size();
+}
+
+void LightClusters::binSlice(unsigned int slice)
+{
+	SliceBins &bins = slices[slice];
+	bins.pairs.clear();
+	size_t base = slice * CLUSTERS_PER_SLICE;
+
+	for (size_t light = 0; light < viewLights.size(); light++)
+	{
+		if (slice < lightSlices[light].x || slice > lightSlices[light].y)
+			continue;
+		const glm::vec4 &sphere = viewLights[light];
+		float rangeSquared = sphere.w * sphere.w;
+
+#if GLM_ARCH & GLM_ARCH_SSE2_BIT
+		//Squared distance from the sphere center to four boxes at once, zero on the axes where the center is inside
+		glm_vec4 centerX = _mm_set1_ps(sphere.x), centerY = _mm_set1_ps(sphere.y), centerZ = _mm_set1_ps(sphere.z);
+		glm_vec4 radiusSquared = _mm_set1_ps(rangeSquared);
+		glm_vec4 zero = _mm_setzero_ps();
+		for (unsigned int c = 0; c < CLUSTERS_PER_SLICE; c += 4)
+		{
+			size_t i = base + c;
+			glm_vec4 dx = _mm_add_ps(_mm_max_ps(_mm_sub_ps(_mm_loadu_ps(&boxMinX[i]), centerX), zero), _mm_max_ps(_mm_sub_ps(centerX, _mm_loadu_ps(&boxMaxX[i])), zero));
+			glm_vec4 dy = _mm_add_ps(_mm_max_ps(_mm_sub_ps(_mm_loadu_ps(&boxMinY[i]), centerY), zero), _mm_max_ps(_mm_sub_ps(centerY, _mm_loadu_ps(&boxMaxY[i])), zero));
+			glm_vec4 dz = _mm_add_ps(_mm_max_ps(_mm_sub_ps(_mm_loadu_ps(&boxMinZ[i]), centerZ), zero), _mm_max_ps(_mm_sub_ps(centerZ, _mm_loadu_ps(&boxMaxZ[i])), zero));
+			glm_vec4 distanceSquared = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+			int mask = _mm_movemask_ps(_mm_cmple_ps(distanceSquared, radiusSquared));
+			for (unsigned int lane = 0; mask; lane++, mask >>= 1)
+				if (mask & 1)
+					bins.pairs.push_back((uint32_t)(c + lane) << 16 | (uint32_t)light);
+		}
+#else
+		for (unsigned int c = 0; c < CLUSTERS_PER_SLICE; c++)
+		{
+			size_t i = base + c;
+			float dx = glm::max(boxMinX[i] - sphere.x, 0.0f) + glm::max(sphere.x - boxMaxX[i], 0.0f);
+			float dy = glm::max(boxMinY[i] - sphere.y, 0.0f) + glm::max(sphere.y - boxMaxY[i], 0.0f);
+			float dz = glm::max(boxMinZ[i] - sphere.z, 0.0f) + glm::max(sphere.z - boxMaxZ[i], 0.0f);
+			if (dx * dx + dy * dy + dz * dz <= rangeSquared)
+				bins.pairs.push_back((uint32_t)c << 16 | (uint32_t)light);
+		}
+#endif
+	}
+
+	//Counting sort by cluster, lights stay in the order they were added
+	bins.counts.assign(CLUSTERS_PER_SLICE, 0);
+	for (size_t i = 0; i < bins.pairs.size(); i++)
+		bins.counts[bins.pairs[i] >> 16]++;
+	uint32_t start[CLUSTERS_PER_SLICE];
+	uint32_t offset = 0;
+	for (unsigned int c = 0; c < CLUSTERS_PER_SLICE; c++)
+	{
+		start[c] = offset;
+		offset += bins.counts[c];
+	}
+	bins.indices.resize(bins.pairs.size());
+	for (size_t i = 0; i < bins.pairs.size(); i++)
+		bins.indices[start[bins.pairs[i] >> 16]++] = (uint16_t)(bins.pairs[i] & 0xFFFF);
+}
+
+void LightClusters::Upload()
+{
+	//Orphaning each store, like the other per frame buffers. Never empty, GL doesn't like zero sized texture buffers.
+	const void *data[3] = { lights.data(), clusters.data(), indices.data() };
+	size_t sizes[3] = { lights.size() * sizeof(LightData), clusters.size() * sizeof(glm::uvec2), indices.size() * sizeof(uint16_t) };
+	const GLint units[3] = { LIGHT_DATA_UNIT, CLUSTER_UNIT, LIGHT_INDEX_UNIT };
+	for (int i = 0; i < 3; i++)
+	{
+		glBindBuffer(GL_TEXTURE_BUFFER, buffers[i]);
+		if (sizes[i] > 0)
+			glBufferData(GL_TEXTURE_BUFFER, sizes[i], data[i], GL_STREAM_DRAW);
+		glActiveTexture(GL_TEXTURE0 + units[i]);
+		glBindTexture(GL_TEXTURE_BUFFER, textures[i]);
+	}
+	glBindBuffer(GL_TEXTURE_BUFFER, 0);
+	glActiveTexture(GL_TEXTURE0);
+}
+
+void LightClusters::Release()
+{
+	glDeleteTextures(3, textures);
+	glDeleteBuffers(3, buffers);
+	memset(textures, 0, sizeof(textures));
+	memset(buffers, 0, sizeof(buffers));
+}
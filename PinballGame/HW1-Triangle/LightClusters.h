@@ -0,0 +1,130 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <cstdint>
+#include <vector>
+#include "Shader.h"
+using namespace std;
+
+// std140 part of the Lights block that tells the fragment shader how to find its cluster, see FrameUniforms
+struct ClusterBlock
+{
+	glm::uvec4 size;	// clusters along x, y, z and the number of lights
+	glm::vec4 scale;	// x, y: clusters per pixel, z, w: log(depth) * z + w gives the depth slice
+};
+
+/// <summary>
+/// Clustered forward shading: the view frustum is split into a grid of clusters (screen tiles, each cut into
+/// exponentially deeper slices) and every frame the point lights are binned into the clusters their range touches.
+/// The fragment shader looks up its cluster and only shades the lights listed there, so the cost per pixel follows the
+/// lights that reach it, not how many the table has.
+/// Binning runs one depth slice per job on the ThreadPool, each job testing light spheres against four cluster boxes per
+/// SSE step. The results go to the shaders as three texture buffers (GL 3.3 has no storage buffers): the lights,
+/// an offset and count per cluster, and the light indices all clusters' ranges point into.
+/// </summary>
+class LightClusters
+{
+public:
+	static const unsigned int CLUSTERS_X = 16;
+	static const unsigned int CLUSTERS_Y = 16;
+	static const unsigned int CLUSTERS_Z = 24;
+	static const unsigned int MAX_LIGHTS = 4096;
+
+	//Texture units the buffers stay bound to, above the ones materials use
+	static const GLint LIGHT_DATA_UNIT = 13;
+	static const GLint CLUSTER_UNIT = 14;
+	static const GLint LIGHT_INDEX_UNIT = 15;
+
+	//What the last Build() produced
+	struct Stats
+	{
+		unsigned int lights;
+		unsigned int indices;			// light references over all clusters
+		unsigned int occupiedClusters;	// clusters with at least one light
+		unsigned int maxPerCluster;
+	};
+
+	LightClusters();
+
+	//Points the program's light samplers at our texture units, once after linking
+	void Attach(const Shader &shader) const;
+
+	//Forgets last frame's lights
+	void Clear() { lights.clear(); }
+
+	//Adds a point light, its range is where the attenuation drops under 1/256 of the brightest color.
+	//Returns false once MAX_LIGHTS are in.
+	bool Add(const Shader::LightSettings &settings);
+
+	//Bins the lights against this frame's camera. near and far must be the projection's, width and height the framebuffer's.
+	void Build(const glm::mat4 &projection, const glm::mat4 &view, float nearPlane, float farPlane, int width, int height);
+
+	//Sends the lights and cluster lists to the texture buffers and binds them to their units
+	void Upload();
+
+	const ClusterBlock& Block() const { return block; }
+	const Stats& LastStats() const { return stats; }
+	size_t LightCount() const { return lights.size(); }
+
+	//Per cluster (x + CLUSTERS_X * (y + CLUSTERS_Y * z)) offset into Indices() and light count, after Build()
+	const vector<glm::uvec2>& Clusters() const { return clusters; }
+	const vector<uint16_t>& Indices() const { return indices; }
+
+	//Deletes the buffers and textures, needs the context
+	void Release();
+
+	//Distance at which the light's attenuated brightest color falls under 1/256
+	static float Range(const Shader::LightSettings &settings);
+
+private:
+	LightClusters(const LightClusters&) = delete;
+	LightClusters& operator=(const LightClusters&) = delete;
+
+	//View space boxes of every cluster, redone when the projection changes
+	void buildClusterBoxes(const glm::mat4 &projection, float nearPlane, float farPlane);
+	//Bins the lights into one depth slice, runs on the workers
+	void binSlice(unsigned int slice);
+
+	//What the shader reads for one light, four RGBA32F texels
+	struct LightData
+	{
+		glm::vec3 position;
+		float constant;
+		glm::vec3 ambient;
+		float linear;
+		glm::vec3 diffuse;
+		float quadratic;
+		glm::vec3 specular;
+		float range;
+	};
+
+	vector<LightData> lights;
+
+	//Cluster boxes as structure of arrays, x runs fastest so four neighbouring tiles share one SSE register
+	vector<float> boxMinX, boxMinY, boxMinZ, boxMaxX, boxMaxY, boxMaxZ;
+	glm::mat4 boxProjection;
+	float boxNear, boxFar;
+
+	//Lights in view space and the slices they span, filled before the slices are binned
+	vector<glm::vec4> viewLights;		// xyz center, w range
+	vector<glm::uvec2> lightSlices;		// first and last slice
+
+	//Per slice results, merged into clusters and indices afterwards
+	struct SliceBins
+	{
+		vector<uint32_t> pairs;			// cluster in slice << 16 | light
+		vector<uint32_t> counts;		// per cluster in the slice
+		vector<uint16_t> indices;		// sorted by cluster
+	};
+	vector<SliceBins> slices;
+
+	vector<glm::uvec2> clusters;
+	vector<uint16_t> indices;
+	ClusterBlock block;
+	Stats stats;
+
+	//Texture buffers: lights (RGBA32F), clusters (RG32UI), indices (R16UI)
+	GLuint buffers[3];
+	GLuint textures[3];
+};
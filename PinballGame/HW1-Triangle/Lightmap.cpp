@@ -0,0 +1,816 @@
+#include "Lightmap.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <tuple>
+#include <unordered_map>
+#include <glm/gtc/packing.hpp>
+#include "CacheFile.h"
+
+namespace
+{
+	const char LIGHTMAP_CACHE_MAGIC[4] = { 'P', 'B', 'L', 'M' };
+	const uint32_t LIGHTMAP_CACHE_VERSION = 1;
+
+	//Neighbouring triangles join a chart while they face within about 30 degrees of its first triangle
+	const float CHART_NORMAL_COS = 0.85f;
+	//Part of the atlas the charts are scaled to cover before packing, shrunk by PACK_SHRINK until they fit.
+	//PACK_SHRINK^MAX_PACK_ATTEMPTS is about 1/1000 of the starting scale, past that the atlas is simply too small.
+	const float ATLAS_FILL = 0.8f;
+	const float PACK_SHRINK = 0.9f;
+	const int MAX_PACK_ATTEMPTS = 64;
+	//Texels whose center is at most this far outside a triangle (in texels) still sample it, so edges aren't cut off
+	const float TEXEL_REACH = 0.75f;
+	const int MAX_LEAF_TRIANGLES = 4;
+	const float PI = 3.14159265358979f;
+
+	/*
+	 * Cache file "<model>.lightmap" (little endian):
+	 *   LightmapCacheHeader
+	 *   uint32 vertexCount, indexCount per mesh
+	 *   per mesh: uint32 remap[vertexCount], vec2 coords[vertexCount], uint32 indices[indexCount]
+	 *   uint16 texels[size * size * 4], RGBA half floats
+	 */
+	struct LightmapCacheHeader
+	{
+		char magic[4];		// "PBLM"
+		uint32_t version;	// LIGHTMAP_CACHE_VERSION
+		uint64_t key;		// hash of the geometry, lights and settings the texels were baked from
+		uint32_t size;
+		uint32_t meshCount;
+		uint32_t charts;
+		float coverage;
+	};
+
+	//One mesh after unwrapping: every new vertex as the index of the vertex it was split from, its lightmap coords,
+	//and the indices rewritten to the new vertices (same triangles in the same order)
+	struct UnwrappedMesh
+	{
+		vector<uint32_t> remap;
+		vector<glm::vec2> coords;
+		vector<unsigned int> indices;
+	};
+
+	struct Chart
+	{
+		size_t mesh;
+		vector<uint32_t> triangles;	// index of the first index / 3
+		glm::vec3 axisU, axisV;		// the plane the chart is projected onto
+		glm::vec2 min, max;			// projected extent in object space units
+		int x, y, width, height;	// place in the atlas in texels, padding included
+	};
+
+	//What a texel of the atlas sees, filled in by rasterizing the triangles in lightmap space
+	struct TexelSample
+	{
+		glm::vec3 position;
+		glm::vec3 normal;
+		float distance;		// of the texel center inside its triangle in texels, -FLT_MAX if no triangle reaches it
+	};
+
+	double MillisecondsSince(chrono::high_resolution_clock::time_point start)
+	{
+		return chrono::duration<double, milli>(chrono::high_resolution_clock::now() - start).count();
+	}
+
+	uint64_t CacheKey(const vector<MeshData> &meshes, const StaticLights &lights, const LightmapSettings &settings)
+	{
+		uint64_t key = FNV1A_OFFSET_BASIS;
+		key = Fnv1a(&LIGHTMAP_CACHE_VERSION, sizeof(LIGHTMAP_CACHE_VERSION), key);
+		key = Fnv1a(&settings.size, sizeof(settings.size), key);
+		key = Fnv1a(&settings.padding, sizeof(settings.padding), key);
+		key = Fnv1a(&settings.aoRays, sizeof(settings.aoRays), key);
+		key = Fnv1a(&settings.aoDistance, sizeof(settings.aoDistance), key);
+		key = Fnv1a(&lights.sun, sizeof(lights.sun), key);
+		for (size_t i = 0; i < lights.points.size(); i++)
+		{
+			//Everything but the name
+			const Shader::LightSettings &light = lights.points[i];
+			key = Fnv1a(&light.position, sizeof(light.position), key);
+			key = Fnv1a(&light.ambient, sizeof(light.ambient), key);
+			key = Fnv1a(&light.diffuse, sizeof(light.diffuse), key);
+			key = Fnv1a(&light.constant, sizeof(light.constant), key);
+			key = Fnv1a(&light.linear, sizeof(light.linear), key);
+			key = Fnv1a(&light.quadratic, sizeof(light.quadratic), key);
+		}
+		for (size_t i = 0; i < meshes.size(); i++)
+		{
+			key = Fnv1a(meshes[i].vertices.data(), meshes[i].vertices.size() * sizeof(Vertex), key);
+			key = Fnv1a(meshes[i].indices.data(), meshes[i].indices.size() * sizeof(unsigned int), key);
+		}
+		return key;
+	}
+
+	float Cross(const glm::vec2 &a, const glm::vec2 &b)
+	{
+		return a.x * b.y - a.y * b.x;
+	}
+
+	//Small fast generator for the ambient occlusion rays, seeded per texel so bakes are reproducible
+	float NextRandom(uint32_t &state)
+	{
+		state ^= state << 13;
+		state ^= state >> 17;
+		state ^= state << 5;
+		return (state >> 8) * (1.0f / 16777216.0f);
+	}
+}
+
+#pragma region Triangle BVH
+namespace
+{
+	/// <summary>
+	/// Bounding volume hierarchy over the object's own triangles for the shadow and occlusion rays.
+	/// Only answers whether anything is in the way, so the first hit ends a ray. Median split on the longest axis.
+	/// </summary>
+	class TriangleBvh
+	{
+	public:
+		void Build(const vector<MeshData> &meshes)
+		{
+			vector<glm::vec3> corners;
+			for (size_t m = 0; m < meshes.size(); m++)
+				for (size_t i = 0; i + 2 < meshes[m].indices.size(); i += 3)
+					for (int k = 0; k < 3; k++)
+						corners.push_back(meshes[m].vertices[meshes[m].indices[i + k]].Position);
+
+			size_t count = corners.size() / 3;
+			vector<uint32_t> order(count);
+			vector<glm::vec3> centroids(count);
+			for (size_t i = 0; i < count; i++)
+			{
+				order[i] = (uint32_t)i;
+				centroids[i] = (corners[i * 3] + corners[i * 3 + 1] + corners[i * 3 + 2]) / 3.0f;
+			}
+
+			nodes.clear();
+			nodes.reserve(count * 2);
+			nodes.push_back(Node());
+			build(0, 0, (uint32_t)count, order, centroids, corners);
+
+			//Leaves point into the triangles in tree order
+			triangles.resize(corners.size());
+			for (size_t i = 0; i < count; i++)
+				for (int k = 0; k < 3; k++)
+					triangles[i * 3 + k] = corners[order[i] * 3 + k];
+		}
+
+		//Diagonal of everything, for scaling ray offsets
+		float Extent() const { return nodes.empty() ? 0.0f : glm::length(nodes[0].max - nodes[0].min); }
+
+		bool Occluded(const glm::vec3 &origin, const glm::vec3 &direction, float maxDistance) const
+		{
+			if (nodes.empty())
+				return false;
+			glm::vec3 inverse;
+			for (int i = 0; i < 3; i++)
+				inverse[i] = direction[i] != 0.0f ? 1.0f / direction[i] : 1e30f;
+
+			uint32_t stack[64];
+			int top = 0;
+			stack[top++] = 0;
+			while (top > 0)
+			{
+				const Node &node = nodes[stack[--top]];
+				if (!hitsBox(node, origin, inverse, maxDistance))
+					continue;
+				if (node.count == 0)
+				{
+					stack[top++] = node.first;
+					stack[top++] = node.first + 1;
+					continue;
+				}
+				for (uint32_t i = node.first; i < node.first + node.count; i++)
+					if (hitsTriangle(i, origin, direction, maxDistance))
+						return true;
+			}
+			return false;
+		}
+
+	private:
+		struct Node
+		{
+			glm::vec3 min;
+			uint32_t first;		// first triangle of a leaf, or the left child (the right one follows it)
+			glm::vec3 max;
+			uint32_t count;		// triangles of a leaf, 0 for inner nodes
+		};
+
+		void build(uint32_t index, uint32_t first, uint32_t count, vector<uint32_t> &order,
+			const vector<glm::vec3> &centroids, const vector<glm::vec3> &corners)
+		{
+			glm::vec3 boxMin(FLT_MAX), boxMax(-FLT_MAX), centerMin(FLT_MAX), centerMax(-FLT_MAX);
+			for (uint32_t i = first; i < first + count; i++)
+			{
+				for (int k = 0; k < 3; k++)
+				{
+					boxMin = glm::min(boxMin, corners[order[i] * 3 + k]);
+					boxMax = glm::max(boxMax, corners[order[i] * 3 + k]);
+				}
+				centerMin = glm::min(centerMin, centroids[order[i]]);
+				centerMax = glm::max(centerMax, centroids[order[i]]);
+			}
+			nodes[index].min = boxMin;
+			nodes[index].max = boxMax;
+
+			glm::vec3 spread = centerMax - centerMin;
+			int axis = spread.x > spread.y ? (spread.x > spread.z ? 0 : 2) : (spread.y > spread.z ? 1 : 2);
+			if (count <= (uint32_t)MAX_LEAF_TRIANGLES || spread[axis] <= 0.0f)
+			{
+				nodes[index].first = first;
+				nodes[index].count = count;
+				return;
+			}
+
+			uint32_t half = count / 2;
+			nth_element(order.begin() + first, order.begin() + first + half, order.begin() + first + count,
+				[&centroids, axis](uint32_t a, uint32_t b) { return centroids[a][axis] < centroids[b][axis]; });
+
+			uint32_t left = (uint32_t)nodes.size();
+			nodes.push_back(Node());
+			nodes.push_back(Node());
+			nodes[index].first = left;
+			nodes[index].count = 0;
+			build(left, first, half, order, centroids, corners);
+			build(left + 1, first + half, count - half, order, centroids, corners);
+		}
+
+		bool hitsBox(const Node &node, const glm::vec3 &origin, const glm::vec3 &inverse, float maxDistance) const
+		{
+			glm::vec3 t0 = (node.min - origin) * inverse;
+			glm::vec3 t1 = (node.max - origin) * inverse;
+			glm::vec3 closest = glm::min(t0, t1), farthest = glm::max(t0, t1);
+			float enter = std::max(std::max(closest.x, closest.y), std::max(closest.z, 0.0f));
+			float leave = std::min(std::min(farthest.x, farthest.y), std::min(farthest.z, maxDistance));
+			return enter <= leave;
+		}
+
+		//Moller-Trumbore, both sides count
+		bool hitsTriangle(uint32_t triangle, const glm::vec3 &origin, const glm::vec3 &direction, float maxDistance) const
+		{
+			const glm::vec3 &a = triangles[triangle * 3];
+			glm::vec3 edge1 = triangles[triangle * 3 + 1] - a;
+			glm::vec3 edge2 = triangles[triangle * 3 + 2] - a;
+			glm::vec3 p = glm::cross(direction, edge2);
+			float determinant = glm::dot(edge1, p);
+			if (fabsf(determinant) < 1e-12f)
+				return false;
+			float inverseDeterminant = 1.0f / determinant;
+			glm::vec3 s = origin - a;
+			float u = glm::dot(s, p) * inverseDeterminant;
+			if (u < 0.0f || u > 1.0f)
+				return false;
+			glm::vec3 q = glm::cross(s, edge1);
+			float v = glm::dot(direction, q) * inverseDeterminant;
+			if (v < 0.0f || u + v > 1.0f)
+				return false;
+			float t = glm::dot(edge2, q) * inverseDeterminant;
+			return t > 0.0f && t < maxDistance;
+		}
+
+		vector<Node> nodes;
+		vector<glm::vec3> triangles;	// three corners each, in leaf order
+	};
+}
+#pragma endregion
+
+#pragma region Unwrap
+namespace
+{
+	//Grows charts over the triangles of every mesh, chartOf gets the chart of each triangle
+	vector<Chart> BuildCharts(const vector<MeshData> &meshes, vector<vector<int>> &chartOf)
+	{
+		vector<Chart> charts;
+		chartOf.assign(meshes.size(), vector<int>());
+		for (size_t m = 0; m < meshes.size(); m++)
+		{
+			const MeshData &mesh = meshes[m];
+			size_t triangleCount = mesh.indices.size() / 3;
+
+			//Vertices split for texture coords or hard normals still share their edges by position
+			vector<uint32_t> welded(mesh.vertices.size());
+			map<tuple<float, float, float>, uint32_t> positions;
+			for (size_t i = 0; i < mesh.vertices.size(); i++)
+			{
+				const glm::vec3 &p = mesh.vertices[i].Position;
+				welded[i] = positions.insert(make_pair(make_tuple(p.x, p.y, p.z), (uint32_t)positions.size())).first->second;
+			}
+
+			unordered_map<uint64_t, vector<uint32_t>> edgeTriangles;
+			vector<glm::vec3> faceNormals(triangleCount);
+			for (size_t t = 0; t < triangleCount; t++)
+			{
+				const glm::vec3 &a = mesh.vertices[mesh.indices[t * 3]].Position;
+				glm::vec3 normal = glm::cross(mesh.vertices[mesh.indices[t * 3 + 1]].Position - a, mesh.vertices[mesh.indices[t * 3 + 2]].Position - a);
+				float length = glm::length(normal);
+				faceNormals[t] = length > 0.0f ? normal / length : glm::vec3(0.0f);
+				for (int k = 0; k < 3; k++)
+				{
+					uint64_t a = welded[mesh.indices[t * 3 + k]], b = welded[mesh.indices[t * 3 + (k + 1) % 3]];
+					edgeTriangles[std::min(a, b) << 32 | std::max(a, b)].push_back((uint32_t)t);
+				}
+			}
+
+			vector<int> &chartOfTriangle = chartOf[m];
+			chartOfTriangle.assign(triangleCount, -1);
+			vector<uint32_t> open;
+			for (size_t seed = 0; seed < triangleCount; seed++)
+			{
+				if (chartOfTriangle[seed] >= 0)
+					continue;
+				Chart chart;
+				chart.mesh = m;
+				glm::vec3 normal = faceNormals[seed] != glm::vec3(0.0f) ? faceNormals[seed] : glm::vec3(0.0f, 0.0f, 1.0f);
+				chartOfTriangle[seed] = (int)charts.size();
+				open.push_back((uint32_t)seed);
+				while (!open.empty())
+				{
+					uint32_t t = open.back();
+					open.pop_back();
+					chart.triangles.push_back(t);
+					for (int k = 0; k < 3; k++)
+					{
+						uint64_t a = welded[mesh.indices[t * 3 + k]], b = welded[mesh.indices[t * 3 + (k + 1) % 3]];
+						const vector<uint32_t> &neighbours = edgeTriangles[std::min(a, b) << 32 | std::max(a, b)];
+						for (size_t n = 0; n < neighbours.size(); n++)
+						{
+							uint32_t neighbour = neighbours[n];
+							//Degenerate triangles cover no texels, they go wherever they touch
+							if (chartOfTriangle[neighbour] < 0 &&
+								(faceNormals[neighbour] == glm::vec3(0.0f) || glm::dot(faceNormals[neighbour], normal) >= CHART_NORMAL_COS))
+							{
+								chartOfTriangle[neighbour] = (int)charts.size();
+								open.push_back(neighbour);
+							}
+						}
+					}
+				}
+
+				//Project onto the plane of the first triangle
+				glm::vec3 up = fabsf(normal.y) < 0.99f ? glm::vec3(0.0f, 1.0f, 0.0f) : glm::vec3(1.0f, 0.0f, 0.0f);
+				chart.axisU = glm::normalize(glm::cross(up, normal));
+				chart.axisV = glm::cross(normal, chart.axisU);
+				chart.min = glm::vec2(FLT_MAX);
+				chart.max = glm::vec2(-FLT_MAX);
+				for (size_t i = 0; i < chart.triangles.size(); i++)
+					for (int k = 0; k < 3; k++)
+					{
+						const glm::vec3 &p = mesh.vertices[mesh.indices[chart.triangles[i] * 3 + k]].Position;
+						glm::vec2 projected(glm::dot(p, chart.axisU), glm::dot(p, chart.axisV));
+						chart.min = glm::min(chart.min, projected);
+						chart.max = glm::max(chart.max, projected);
+					}
+				charts.push_back(move(chart));
+			}
+		}
+		return charts;
+	}
+
+	//Shelf packs the charts in order at scale texels per unit, false if they don't fit
+	bool PackCharts(vector<Chart> &charts, const vector<size_t> &order, float scale, const LightmapSettings &settings)
+	{
+		int x = 0, y = 0, shelfHeight = 0;
+		for (size_t i = 0; i < order.size(); i++)
+		{
+			Chart &chart = charts[order[i]];
+			//One texel more than the extent so the border texel centers still land on the chart
+			chart.width = (int)ceilf((chart.max.x - chart.min.x) * scale) + 1 + 2 * settings.padding;
+			chart.height = (int)ceilf((chart.max.y - chart.min.y) * scale) + 1 + 2 * settings.padding;
+			if (chart.width > settings.size)
+				return false;
+			if (x + chart.width > settings.size)
+			{
+				x = 0;
+				y += shelfHeight;
+				shelfHeight = 0;
+			}
+			if (y + chart.height > settings.size)
+				return false;
+			chart.x = x;
+			chart.y = y;
+			x += chart.width;
+			shelfHeight = std::max(shelfHeight, chart.height);
+		}
+		return true;
+	}
+
+	//False if the charts don't fit the atlas at any scale
+	bool Unwrap(const vector<MeshData> &meshes, const LightmapSettings &settings, unsigned int &chartCount, vector<UnwrappedMesh> &unwrapped)
+	{
+		vector<vector<int>> chartOf;
+		vector<Chart> charts = BuildCharts(meshes, chartOf);
+		chartCount = (unsigned int)charts.size();
+		//However small the scale, every chart takes a texel plus its padding on each side
+		size_t minimumTexels = (size_t)(1 + 2 * settings.padding) * (1 + 2 * settings.padding);
+		if (charts.size() * minimumTexels > (size_t)settings.size * settings.size)
+			return false;
+
+		//Tallest charts first, then start from a scale that roughly fills the atlas and shrink until everything fits
+		vector<size_t> order(charts.size());
+		float area = 0.0f;
+		for (size_t i = 0; i < charts.size(); i++)
+		{
+			order[i] = i;
+			area += (charts[i].max.x - charts[i].min.x) * (charts[i].max.y - charts[i].min.y);
+		}
+		sort(order.begin(), order.end(), [&charts](size_t a, size_t b) { return charts[a].max.y - charts[a].min.y > charts[b].max.y - charts[b].min.y; });
+		float scale = area > 0.0f ? sqrtf(ATLAS_FILL * settings.size * settings.size / area) : 1.0f;
+		int attempts = 1;
+		while (!PackCharts(charts, order, scale, settings))
+		{
+			if (attempts++ == MAX_PACK_ATTEMPTS)
+				return false;
+			scale *= PACK_SHRINK;
+		}
+
+		//Every vertex gets a copy per chart it's used in, in order of first use so the vertex fetch order survives
+		unwrapped.assign(meshes.size(), UnwrappedMesh());
+		for (size_t m = 0; m < meshes.size(); m++)
+		{
+			const MeshData &mesh = meshes[m];
+			UnwrappedMesh &out = unwrapped[m];
+			unordered_map<uint64_t, uint32_t> copies;
+			out.indices.reserve(mesh.indices.size());
+			for (size_t i = 0; i < mesh.indices.size(); i++)
+			{
+				uint32_t original = mesh.indices[i];
+				const Chart &chart = charts[chartOf[m][i / 3]];
+				uint64_t key = (uint64_t)chartOf[m][i / 3] << 32 | original;
+				unordered_map<uint64_t, uint32_t>::iterator found = copies.find(key);
+				if (found == copies.end())
+				{
+					found = copies.insert(make_pair(key, (uint32_t)out.remap.size())).first;
+					const glm::vec3 &p = mesh.vertices[original].Position;
+					glm::vec2 local(glm::dot(p, chart.axisU) - chart.min.x, glm::dot(p, chart.axisV) - chart.min.y);
+					glm::vec2 texel = glm::vec2(chart.x + settings.padding, chart.y + settings.padding) + 0.5f + local * scale;
+					out.remap.push_back(original);
+					out.coords.push_back(texel / (float)settings.size);
+				}
+				out.indices.push_back(found->second);
+			}
+		}
+		return true;
+	}
+
+	void ApplyUnwrap(vector<MeshData> &meshes, vector<UnwrappedMesh> &unwrapped)
+	{
+		for (size_t m = 0; m < meshes.size(); m++)
+		{
+			vector<Vertex> vertices(unwrapped[m].remap.size());
+			for (size_t i = 0; i < vertices.size(); i++)
+			{
+				vertices[i] = meshes[m].vertices[unwrapped[m].remap[i]];
+				vertices[i].LightmapCoords = unwrapped[m].coords[i];
+			}
+			meshes[m].vertices = move(vertices);
+			meshes[m].indices = move(unwrapped[m].indices);
+		}
+	}
+}
+#pragma endregion
+
+#pragma region Bake
+namespace
+{
+	//Finds the surface point behind every texel, texels closest to the inside of a triangle win
+	void Rasterize(const vector<MeshData> &meshes, int size, vector<TexelSample> &samples)
+	{
+		TexelSample empty;
+		empty.distance = -FLT_MAX;
+		samples.assign((size_t)size * size, empty);
+		for (size_t m = 0; m < meshes.size(); m++)
+		{
+			const MeshData &mesh = meshes[m];
+			for (size_t i = 0; i + 2 < mesh.indices.size(); i += 3)
+			{
+				const Vertex *corners[3] = { &mesh.vertices[mesh.indices[i]], &mesh.vertices[mesh.indices[i + 1]], &mesh.vertices[mesh.indices[i + 2]] };
+				glm::vec2 uv[3];
+				for (int k = 0; k < 3; k++)
+					uv[k] = corners[k]->LightmapCoords * (float)size;
+				float area = Cross(uv[1] - uv[0], uv[2] - uv[0]);
+				if (fabsf(area) < 1e-8f)
+					continue;
+				//Distance to the edge opposite corner k is its barycentric weight times the height over that edge
+				float heights[3];
+				for (int k = 0; k < 3; k++)
+					heights[k] = fabsf(area) / glm::length(uv[(k + 2) % 3] - uv[(k + 1) % 3]);
+				glm::vec3 faceNormal = glm::normalize(glm::cross(corners[1]->Position - corners[0]->Position, corners[2]->Position - corners[0]->Position));
+
+				glm::vec2 low = glm::min(uv[0], glm::min(uv[1], uv[2])) - TEXEL_REACH;
+				glm::vec2 high = glm::max(uv[0], glm::max(uv[1], uv[2])) + TEXEL_REACH;
+				int firstX = std::max((int)floorf(low.x), 0), lastX = std::min((int)ceilf(high.x), size - 1);
+				int firstY = std::max((int)floorf(low.y), 0), lastY = std::min((int)ceilf(high.y), size - 1);
+				for (int y = firstY; y <= lastY; y++)
+					for (int x = firstX; x <= lastX; x++)
+					{
+						glm::vec2 center(x + 0.5f, y + 0.5f);
+						glm::vec3 weights(Cross(uv[1] - center, uv[2] - center), Cross(uv[2] - center, uv[0] - center), Cross(uv[0] - center, uv[1] - center));
+						weights /= area;
+						float distance = std::min(weights.x * heights[0], std::min(weights.y * heights[1], weights.z * heights[2]));
+						TexelSample &sample = samples[(size_t)y * size + x];
+						if (distance < -TEXEL_REACH || distance <= sample.distance)
+							continue;
+						//Texels just outside take the closest point of the triangle
+						weights = glm::max(weights, 0.0f);
+						weights /= weights.x + weights.y + weights.z;
+						sample.position = weights.x * corners[0]->Position + weights.y * corners[1]->Position + weights.z * corners[2]->Position;
+						glm::vec3 normal = weights.x * corners[0]->Normal + weights.y * corners[1]->Normal + weights.z * corners[2]->Normal;
+						sample.normal = glm::dot(normal, normal) > 0.0f ? glm::normalize(normal) : faceNormal;
+						sample.distance = distance;
+					}
+			}
+		}
+	}
+
+	//Diffuse and ambient light of the static lights arriving at one texel, the ambient occlusion in w
+	glm::vec4 Gather(const TexelSample &sample, const TriangleBvh &bvh, const StaticLights &lights, const LightmapSettings &settings,
+		float bias, uint32_t seed)
+	{
+		glm::vec3 origin = sample.position + sample.normal * bias;
+		const glm::vec3 &normal = sample.normal;
+
+		//Cosine weighted rays over the hemisphere, the fraction that gets out is how much ambient light arrives
+		float ambientOcclusion = 1.0f;
+		if (settings.aoRays > 0)
+		{
+			glm::vec3 up = fabsf(normal.y) < 0.99f ? glm::vec3(0.0f, 1.0f, 0.0f) : glm::vec3(1.0f, 0.0f, 0.0f);
+			glm::vec3 tangent = glm::normalize(glm::cross(up, normal));
+			glm::vec3 bitangent = glm::cross(normal, tangent);
+			int open = 0;
+			for (int i = 0; i < settings.aoRays; i++)
+			{
+				float radius = sqrtf(NextRandom(seed));
+				float angle = 2.0f * PI * NextRandom(seed);
+				glm::vec3 direction = tangent * (radius * cosf(angle)) + bitangent * (radius * sinf(angle)) + normal * sqrtf(std::max(1.0f - radius * radius, 0.0f));
+				if (!bvh.Occluded(origin, direction, settings.aoDistance))
+					open++;
+			}
+			ambientOcclusion = (float)open / settings.aoRays;
+		}
+
+		//Same terms as CalcDirLight/CalcPointLight in FragmentShader.frag, without the albedo and with shadows
+		glm::vec3 light = lights.sun.ambient * ambientOcclusion;
+		glm::vec3 toSun = -glm::normalize(lights.sun.direction);
+		float sunFacing = glm::dot(normal, toSun);
+		if (sunFacing > 0.0f && !bvh.Occluded(origin, toSun, FLT_MAX))
+			light += lights.sun.diffuse * sunFacing;
+
+		for (size_t i = 0; i < lights.points.size(); i++)
+		{
+			const Shader::LightSettings &point = lights.points[i];
+			glm::vec3 toLight = point.position - sample.position;
+			float distance = glm::length(toLight);
+			float attenuation = 1.0f / (point.constant + point.linear * distance + point.quadratic * distance * distance);
+			light += point.ambient * attenuation * ambientOcclusion;
+			if (distance <= 0.0f)
+				continue;
+			toLight /= distance;
+			float facing = glm::dot(normal, toLight);
+			if (facing > 0.0f && !bvh.Occluded(origin, toLight, distance - bias))
+				light += point.diffuse * facing * attenuation;
+		}
+		return glm::vec4(light, ambientOcclusion);
+	}
+
+	//Grows the charts into their padding one texel per pass, so filtering at chart borders doesn't pull in black
+	void Dilate(vector<glm::vec4> &lighting, vector<char> &covered, int size, int passes)
+	{
+		for (int pass = 0; pass < passes; pass++)
+		{
+			vector<glm::vec4> grown = lighting;
+			vector<char> grownCovered = covered;
+			for (int y = 0; y < size; y++)
+				for (int x = 0; x < size; x++)
+				{
+					size_t texel = (size_t)y * size + x;
+					if (covered[texel])
+						continue;
+					glm::vec4 sum(0.0f);
+					int count = 0;
+					for (int dy = -1; dy <= 1; dy++)
+						for (int dx = -1; dx <= 1; dx++)
+						{
+							int nx = x + dx, ny = y + dy;
+							if (nx < 0 || ny < 0 || nx >= size || ny >= size || !covered[(size_t)ny * size + nx])
+								continue;
+							sum += lighting[(size_t)ny * size + nx];
+							count++;
+						}
+					if (count > 0)
+					{
+						grown[texel] = sum / (float)count;
+						grownCovered[texel] = 1;
+					}
+				}
+			lighting.swap(grown);
+			covered.swap(grownCovered);
+		}
+	}
+}
+#pragma endregion
+
+#pragma region Cache
+namespace
+{
+	bool ReadCache(const string &path, uint64_t key, const LightmapSettings &settings, const vector<MeshData> &meshes,
+		vector<UnwrappedMesh> &unwrapped, vector<uint16_t> &texels, LightmapCacheHeader &header)
+	{
+		ifstream in(path, ios::binary);
+		if (!in)
+			return false;
+		in.read((char*)&header, sizeof(header));
+		if (!in || memcmp(header.magic, LIGHTMAP_CACHE_MAGIC, sizeof(header.magic)) != 0 || header.version != LIGHTMAP_CACHE_VERSION ||
+			header.key != key || header.size != (uint32_t)settings.size || header.meshCount != meshes.size())
+			return false;
+
+		vector<uint32_t> counts(meshes.size() * 2);
+		in.read((char*)counts.data(), counts.size() * sizeof(uint32_t));
+		if (!in)
+			return false;
+		unwrapped.assign(meshes.size(), UnwrappedMesh());
+		for (size_t m = 0; m < meshes.size(); m++)
+		{
+			//Splitting only ever makes one vertex per index, and never changes the triangles
+			uint32_t vertexCount = counts[m * 2], indexCount = counts[m * 2 + 1];
+			if (indexCount != meshes[m].indices.size() || vertexCount > indexCount)
+				return false;
+			UnwrappedMesh &mesh = unwrapped[m];
+			mesh.remap.resize(vertexCount);
+			mesh.coords.resize(vertexCount);
+			mesh.indices.resize(indexCount);
+			in.read((char*)mesh.remap.data(), vertexCount * sizeof(uint32_t));
+			in.read((char*)mesh.coords.data(), vertexCount * sizeof(glm::vec2));
+			in.read((char*)mesh.indices.data(), indexCount * sizeof(unsigned int));
+			if (!in)
+				return false;
+			for (size_t i = 0; i < vertexCount; i++)
+				if (mesh.remap[i] >= meshes[m].vertices.size())
+					return false;
+			for (size_t i = 0; i < indexCount; i++)
+				if (mesh.indices[i] >= vertexCount)
+					return false;
+		}
+
+		texels.resize((size_t)settings.size * settings.size * 4);
+		in.read((char*)texels.data(), texels.size() * sizeof(uint16_t));
+		return (bool)in;
+	}
+
+	void WriteCache(const string &path, const LightmapCacheHeader &header, const vector<UnwrappedMesh> &unwrapped, const vector<uint16_t> &texels)
+	{
+		WriteCacheFile(path, "LIGHTMAP", [&](ostream &out)
+		{
+			out.write((const char*)&header, sizeof(header));
+			for (size_t m = 0; m < unwrapped.size(); m++)
+			{
+				uint32_t counts[2] = { (uint32_t)unwrapped[m].remap.size(), (uint32_t)unwrapped[m].indices.size() };
+				out.write((const char*)counts, sizeof(counts));
+			}
+			for (size_t m = 0; m < unwrapped.size(); m++)
+			{
+				out.write((const char*)unwrapped[m].remap.data(), unwrapped[m].remap.size() * sizeof(uint32_t));
+				out.write((const char*)unwrapped[m].coords.data(), unwrapped[m].coords.size() * sizeof(glm::vec2));
+				out.write((const char*)unwrapped[m].indices.data(), unwrapped[m].indices.size() * sizeof(unsigned int));
+			}
+			out.write((const char*)texels.data(), texels.size() * sizeof(uint16_t));
+		});
+	}
+}
+#pragma endregion
+
+Lightmap::Lightmap() : size(0), texture(0)
+{
+	memset(&stats, 0, sizeof(stats));
+}
+
+bool Lightmap::Bake(const string &cachePath, vector<MeshData> &meshes, const StaticLights &lights, const LightmapSettings &settings, ThreadPool &pool)
+{
+	chrono::high_resolution_clock::time_point start = chrono::high_resolution_clock::now();
+	memset(&stats, 0, sizeof(stats));
+	size_t vertexCount = 0, indexCount = 0;
+	for (size_t m = 0; m < meshes.size(); m++)
+	{
+		vertexCount += meshes[m].vertices.size();
+		indexCount += meshes[m].indices.size();
+	}
+	if (indexCount < 3 || settings.size <= 0)
+		return false;
+
+	//The unwrap is what the texels belong to, so both come from the cache or neither
+	uint64_t key = CacheKey(meshes, lights, settings);
+	vector<UnwrappedMesh> unwrapped;
+	LightmapCacheHeader header;
+	if (ReadCache(cachePath, key, settings, meshes, unwrapped, texels, header))
+	{
+		ApplyUnwrap(meshes, unwrapped);
+		size = settings.size;
+		stats.cached = true;
+		stats.charts = header.charts;
+		stats.coverage = header.coverage;
+		for (size_t m = 0; m < meshes.size(); m++)
+			stats.splitVertices += (unsigned int)meshes[m].vertices.size();
+		stats.splitVertices -= (unsigned int)vertexCount;
+		stats.unwrapMs = MillisecondsSince(start);
+		return true;
+	}
+
+	//1. Second uv set
+	if (!Unwrap(meshes, settings, stats.charts, unwrapped))
+	{
+		cout << "ERROR::LIGHTMAP:: " << stats.charts << " charts don't fit a " << settings.size << "x" << settings.size
+			<< " atlas, not baking " << cachePath << endl;
+		return false;
+	}
+	TriangleBvh bvh;
+	bvh.Build(meshes);
+	//Keep a copy for the cache, applying moves the indices out
+	vector<UnwrappedMesh> cached = unwrapped;
+	ApplyUnwrap(meshes, unwrapped);
+	for (size_t m = 0; m < meshes.size(); m++)
+		stats.splitVertices += (unsigned int)meshes[m].vertices.size();
+	stats.splitVertices -= (unsigned int)vertexCount;
+	stats.unwrapMs = MillisecondsSince(start);
+
+	//2. Light every covered texel, one atlas row per job
+	chrono::high_resolution_clock::time_point bakeStart = chrono::high_resolution_clock::now();
+	int atlasSize = settings.size;
+	vector<TexelSample> samples;
+	Rasterize(meshes, atlasSize, samples);
+	vector<glm::vec4> lighting((size_t)atlasSize * atlasSize, glm::vec4(0.0f));
+	vector<char> covered((size_t)atlasSize * atlasSize, 0);
+	float bias = std::max(bvh.Extent() * 1e-4f, 1e-5f);
+	pool.ParallelFor((size_t)atlasSize, [&](size_t row)
+	{
+		for (int x = 0; x < atlasSize; x++)
+		{
+			size_t texel = row * atlasSize + x;
+			if (samples[texel].distance == -FLT_MAX)
+				continue;
+			lighting[texel] = Gather(samples[texel], bvh, lights, settings, bias, (uint32_t)texel * 2654435761u + 1u);
+			covered[texel] = 1;
+		}
+	});
+	size_t coveredTexels = 0;
+	for (size_t i = 0; i < covered.size(); i++)
+		coveredTexels += covered[i];
+	stats.coverage = (double)coveredTexels / covered.size();
+	Dilate(lighting, covered, atlasSize, settings.padding);
+
+	texels.resize(lighting.size() * 4);
+	for (size_t i = 0; i < lighting.size(); i++)
+		for (int c = 0; c < 4; c++)
+			texels[i * 4 + c] = glm::packHalf1x16(lighting[i][c]);
+	size = atlasSize;
+	stats.bakeMs = MillisecondsSince(bakeStart);
+
+	memcpy(header.magic, LIGHTMAP_CACHE_MAGIC, sizeof(header.magic));
+	header.version = LIGHTMAP_CACHE_VERSION;
+	header.key = key;
+	header.size = (uint32_t)atlasSize;
+	header.meshCount = (uint32_t)meshes.size();
+	header.charts = stats.charts;
+	header.coverage = (float)stats.coverage;
+	WriteCache(cachePath, header, cached, texels);
+	return true;
+}
+
+void Lightmap::Upload()
+{
+	if (size <= 0 || texels.empty())
+		return;
+	glGenTextures(1, &texture);
+	glBindTexture(GL_TEXTURE_2D, texture);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, size, size, 0, GL_RGBA, GL_HALF_FLOAT, texels.data());
+	//Charts are padded for bilinear filtering only, mipmaps would blend them into each other
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	vector<uint16_t>().swap(texels);
+}
+
+void Lightmap::PrintStats(const string &name, ostream &out) const
+{
+	out << "LIGHTMAP:: " << name << ": " << size << "x" << size << " atlas, " << stats.charts << " charts, "
+		<< stats.splitVertices << " vertices split, " << (int)(stats.coverage * 100.0 + 0.5) << "% covered, ";
+	if (stats.cached)
+		out << "loaded from cache in " << stats.unwrapMs << " ms" << endl;
+	else
+		out << "unwrapped in " << stats.unwrapMs << " ms, baked in " << stats.bakeMs << " ms" << endl;
+}
+
+void Lightmap::Release()
+{
+	if (texture != 0)
+		glDeleteTextures(1, &texture);
+	texture = 0;
+	size = 0;
+	vector<uint16_t>().swap(texels);
+}
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+#include "Mesh.h"
+#include "Shader.h"
+#include "ThreadPool.h"
+using namespace std;
+
+//The scene's directional light, FrameUniforms::SetDirLight takes the same values
+struct DirectionalLight
+{
+	glm::vec3 direction;
+	glm::vec3 ambient;
+	glm::vec3 diffuse;
+	glm::vec3 specular;
+};
+
+//Lights that never move. Their diffuse and ambient terms are what a Lightmap bakes, specular stays per pixel.
+struct StaticLights
+{
+	DirectionalLight sun;
+	vector<Shader::LightSettings> points;	// go into the LightClusters first, the LIGHTMAP shaders skip their diffuse by index
+};
+
+struct LightmapSettings
+{
+	int size;			// atlas width and height in texels
+	int padding;		// empty texels around every chart, so bilinear filtering never reads another chart
+	int aoRays;			// hemisphere rays per texel for the ambient occlusion
+	float aoDistance;	// occluders further away than this (object space) don't darken the ambient light
+
+	LightmapSettings(int size = 512, int padding = 2, int aoRays = 16, float aoDistance = 0.5f)
+		: size(size), padding(padding), aoRays(aoRays), aoDistance(aoDistance) {}
+};
+
+/// <summary>
+/// Baked lighting of one object that never moves, in object space (the object's transform has to stay identity).
+/// Bake() gives the meshes a second uv set: triangles are grown into charts of roughly the same facing, every chart is
+/// projected onto its plane and the charts are shelf packed into one square atlas. Vertices on chart borders are split,
+/// the triangle order (and with it the MeshOptimizer's work) stays the same. Then every covered texel gathers the
+/// diffuse and ambient light of the StaticLights on the ThreadPool, with shadow rays and ambient occlusion traced against
+/// the object's own triangles: rgb is the light arriving at the texel (times the albedo in the shader), a is the
+/// ambient occlusion, for the lights that aren't baked. Charts are dilated into their padding afterwards.
+/// The unwrap and the texels are cached next to the model and only rebaked when the geometry, lights or settings change.
+/// </summary>
+class Lightmap
+{
+public:
+	Lightmap();
+
+	//Unwraps and bakes meshes, or loads both from cachePath. Replaces the vertices and indices of meshes with the
+	//lightmapped ones. Touches no GL state, see Upload(). Returns false if there was nothing to bake or the charts
+	//don't fit the atlas, the meshes are left as they were then.
+	bool Bake(const string &cachePath, vector<MeshData> &meshes, const StaticLights &lights,
+		const LightmapSettings &settings = LightmapSettings(), ThreadPool &pool = ThreadPool::Shared());
+
+	//Creates the texture from the baked texels and frees them. GL thread only.
+	void Upload();
+
+	//0 until Upload()
+	unsigned int Texture() const { return texture; }
+	bool Baked() const { return size > 0; }
+
+	struct Stats
+	{
+		bool cached;			// loaded from the cache instead of baked
+		unsigned int charts;
+		unsigned int splitVertices;	// vertices added on chart borders
+		double coverage;		// fraction of the atlas covered by triangles
+		double unwrapMs;
+		double bakeMs;
+	};
+	const Stats& GetStats() const { return stats; }
+	void PrintStats(const string &name, ostream &out) const;
+
+	//Deletes the texture, needs the context. Objects copy their lightmap around, only release it once.
+	void Release();
+
+private:
+	int size;
+	vector<uint16_t> texels;	// RGBA half floats, size * size of them, until Upload()
+	unsigned int texture;
+	Stats stats;
+};
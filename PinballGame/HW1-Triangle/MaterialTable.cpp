@@ -0,0 +1,48 @@
+#include "MaterialTable.h"
+
+#include "Mesh.h"
+
+MaterialTable::MaterialTable()
+{
+	//Meshes without textures all share material 0
+	materials.push_back(Material());
+	byTextures[vector<unsigned int>()] = 0;
+}
+
+unsigned int MaterialTable::Register(const vector<Texture> &textures)
+{
+	vector<unsigned int> ids(textures.size());
+	for (size_t i = 0; i < textures.size(); i++)
+		ids[i] = textures[i].id;
+
+	map<vector<unsigned int>, unsigned int>::iterator found = byTextures.find(ids);
+	if (found != byTextures.end())
+		return found->second;
+
+	//Same naming convention the shaders use: material.texture_diffuseN, material.texture_specularN, ...
+	Material material;
+	material.textures = ids;
+	unsigned int diffuseNr = 1;
+	unsigned int specularNr = 1;
+	for (size_t i = 0; i < textures.size(); i++)
+	{
+		const string &name = textures[i].type;
+		string number;
+		if (name == "texture_diffuse")
+			number = to_string(diffuseNr++);
+		else if (name == "texture_specular")
+			number = to_string(specularNr++);
+		material.samplers.push_back(UniformId("material.").Append(name).Append(number));
+	}
+
+	unsigned int id = (unsigned int)materials.size();
+	materials.push_back(material);
+	byTextures[ids] = id;
+	return id;
+}
+
+MaterialTable& MaterialTable::Shared()
+{
+	static MaterialTable table;
+	return table;
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <map>
+#include <vector>
+#include "Shader.h"
+using namespace std;
+
+struct Texture;
+
+//A set of textures and the sampler uniforms they are bound to, texture i goes to unit i
+struct Material
+{
+	vector<unsigned int> textures;
+	vector<UniformId> samplers;		// material.texture_diffuse1, material.texture_specular1, ...
+};
+
+/// <summary>
+/// Interns the texture sets of meshes so each distinct set gets a small id.
+/// The render queue sorts by that id and only rebinds textures when it changes, and the sampler names are
+/// hashed once here instead of being rebuilt as strings for every mesh every frame. Id 0 is the empty material.
+/// </summary>
+class MaterialTable
+{
+public:
+	MaterialTable();
+
+	//Returns the id of the material for these textures, registering it the first time. GL thread only.
+	unsigned int Register(const vector<Texture> &textures);
+
+	const Material& Get(unsigned int id) const { return materials[id]; }
+	size_t Count() const { return materials.size(); }
+
+	static MaterialTable& Shared();
+
+private:
+	MaterialTable(const MaterialTable&) = delete;
+	MaterialTable& operator=(const MaterialTable&) = delete;
+
+	vector<Material> materials;
+	map<vector<unsigned int>, unsigned int> byTextures;
+};
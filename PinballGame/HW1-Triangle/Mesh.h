@@ -4,7 +4,11 @@
 #include <glm/gtc/matrix_transform.hpp>
 #include <string>
 #include <vector>
+#include "Bounds.h"
+#include "GeometryBuffer.h"
+#include "MaterialTable.h"
 #include "Shader.h"
+#include "VertexFormat.h"
 using namespace std;
 using namespace glm;
 
@@ -19,6 +23,8 @@ struct Vertex {
 	glm::vec3 Tangent;
 	// bitangent
 	glm::vec3 Bitangent;
+	// second uv set, into the object's lightmap atlas (Lightmap). 0 for meshes that aren't baked
+	glm::vec2 LightmapCoords;
 };
 
 struct Texture {
@@ -26,6 +32,14 @@ struct Texture {
 	string type;
 	string path;
 };
+
+// CPU side data of a mesh that hasn't been turned into GL buffers yet
+struct MeshData {
+	vector<Vertex> vertices;
+	vector<unsigned int> indices;
+	vector<Texture> textures;
+	Bounds bounds;
+};
 class Mesh
 {
 public:
@@ -33,73 +47,64 @@ public:
 	vector<Vertex> vertices;
 	vector<unsigned int> indices;
 	vector<Texture> textures;
+	VertexLayout layout;	// how the vertices are stored on the GPU, picked from the textures and whether the mesh is lightmapped
+	GeometryRange range;	// where the vertices and indices live in the shared geometry buffer of the layout
+	unsigned int material;	// the textures as a MaterialTable id, what the render queue sorts by
+	Bounds bounds;			// in object space
 
 	//Functions
-	Mesh(vector<Vertex> vertices, vector<unsigned int> indices, vector<Texture> textures)
+	// lightmapped meshes also upload the LightmapCoords of their vertices
+	Mesh(vector<Vertex> vertices, vector<unsigned int> indices, vector<Texture> textures, const Bounds &bounds = Bounds(), bool lightmapped = false)
 	{
-		this->vertices = vertices;
-		this->indices = indices;
-		this->textures = textures;
+		this->vertices = move(vertices);
+		this->indices = move(indices);
+		this->textures = move(textures);
+		layout = VertexLayout::ForTextures(this->textures);
+		layout.lightmapped = lightmapped;
+		// bounds normally come from the import, only compute them if they didn't
+		this->bounds = bounds.Empty() ? Bounds::FromVertices(this->vertices.data(), this->vertices.size()) : bounds;
 
-		setupMesh();
+		setupMesh(this->vertices.data(), this->indices.data());
+	}
+	// Builds a mesh from vertex/index data that lives elsewhere (e.g. a memory mapped mesh cache).
+	// The data is uploaded to the GPU straight from the given pointers.
+	Mesh(const Vertex *vertexData, size_t vertexCount, const unsigned int *indexData, size_t indexCount, vector<Texture> textures,
+		const Bounds &bounds = Bounds())
+		: vertices(vertexData, vertexData + vertexCount), indices(indexData, indexData + indexCount), textures(textures),
+		layout(VertexLayout::ForTextures(textures)),
+		bounds(bounds.Empty() ? Bounds::FromVertices(vertexData, vertexCount) : bounds)
+	{
+		setupMesh(vertexData, indexData);
 	}
-	void Draw(Shader shader)
+	void Draw(const Shader &shader) const
 	{
-		unsigned int diffuseNr = 1;
-		unsigned int specularNr = 1;
-		for (size_t i = 0; i < textures.size(); i++)
+		// texture i goes to unit i, the sampler names were hashed once when the material was registered
+		const Material &textureSet = MaterialTable::Shared().Get(material);
+		for (size_t i = 0; i < textureSet.textures.size(); i++)
 		{
 			glActiveTexture(GL_TEXTURE0 + i); //Activate texture unit
-			//Retrieve texture number
-			string number;
-			string name = textures[i].type;
-			if (name == "texture_diffuse")
-				number = to_string(diffuseNr++);
-			else if (name == "texture_specular")
-				number = std::to_string(specularNr++);
-
-			shader.setFloat(("material." + name + number).c_str(), i);
-			glBindTexture(GL_TEXTURE_2D, textures[i].id);
+			shader.setInt(textureSet.samplers[i], i);
+			glBindTexture(GL_TEXTURE_2D, textureSet.textures[i]);
 		}
 		glActiveTexture(GL_TEXTURE0);
 
-		// draw mesh
-		glBindVertexArray(VAO);
-		glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0);
-		glBindVertexArray(0);
+		// draw mesh, the VAO is shared with every other mesh of the same layout so it usually is bound already
+		geometry->Draw(range);
 	}
 
+	GeometryBuffer& Geometry() const { return *geometry; }
+
 private:
 	//Render data
-	unsigned int VAO, VBO, EBO;
+	GeometryBuffer *geometry;
 
 	//Funcitons
-	void setupMesh()
+	void setupMesh(const Vertex *vertexData, const unsigned int *indexData)
 	{
-		glGenVertexArrays(1, &VAO);
-		glGenBuffers(1, &VBO);
-		glGenBuffers(1, &EBO);
-
-		glBindVertexArray(VAO);
-		glBindBuffer(GL_ARRAY_BUFFER, VBO);
-
-		glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), &vertices[0], GL_STATIC_DRAW);
-
-		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-		glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int),
-			&indices[0], GL_STATIC_DRAW);
-
-		// vertex positions
-		glEnableVertexAttribArray(0);
-		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
-		// vertex normals
-		glEnableVertexAttribArray(1);
-		glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Normal));
-		// vertex texture coords
-		glEnableVertexAttribArray(2);
-		glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, TexCoords));
-
-		glBindVertexArray(0);
+		// static geometry is suballocated from one big buffer per layout instead of getting its own VAO/VBO/EBO
+		geometry = &GeometryBuffer::ForLayout(layout);
+		range = geometry->Allocate(vertexData, vertices.size(), indexData, indices.size());
+		material = MaterialTable::Shared().Register(textures);
 	}
 };
 
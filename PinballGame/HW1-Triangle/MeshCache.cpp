@@ -0,0 +1,292 @@
+#include "MeshCache.h"
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#include "CacheFile.h"
+
+#pragma region MappedFile
+MappedFile::MappedFile() : data(nullptr), size(0)
+#ifdef _WIN32
+	, fileHandle(INVALID_HANDLE_VALUE), mappingHandle(NULL)
+#else
+	, fileDescriptor(-1)
+#endif
+{
+}
+
+MappedFile::~MappedFile()
+{
+	Close();
+}
+
+bool MappedFile::Open(const string &path)
+{
+	Close();
+#ifdef _WIN32
+	fileHandle = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (fileHandle == INVALID_HANDLE_VALUE)
+		return false;
+
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(fileHandle, &fileSize) || fileSize.QuadPart == 0)
+	{
+		Close();
+		return false;
+	}
+
+	mappingHandle = CreateFileMappingA(fileHandle, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (mappingHandle == NULL)
+	{
+		Close();
+		return false;
+	}
+
+	data = (const unsigned char*)MapViewOfFile(mappingHandle, FILE_MAP_READ, 0, 0, 0);
+	if (data == nullptr)
+	{
+		Close();
+		return false;
+	}
+	size = (size_t)fileSize.QuadPart;
+#else
+	fileDescriptor = open(path.c_str(), O_RDONLY);
+	if (fileDescriptor < 0)
+		return false;
+
+	struct stat info;
+	if (fstat(fileDescriptor, &info) != 0 || info.st_size == 0)
+	{
+		Close();
+		return false;
+	}
+
+	void* mapped = mmap(nullptr, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fileDescriptor, 0);
+	if (mapped == MAP_FAILED)
+	{
+		Close();
+		return false;
+	}
+	data = (const unsigned char*)mapped;
+	size = (size_t)info.st_size;
+#endif
+	return true;
+}
+
+void MappedFile::Close()
+{
+#ifdef _WIN32
+	if (data)
+		UnmapViewOfFile(data);
+	if (mappingHandle != NULL)
+		CloseHandle(mappingHandle);
+	if (fileHandle != INVALID_HANDLE_VALUE)
+		CloseHandle(fileHandle);
+	mappingHandle = NULL;
+	fileHandle = INVALID_HANDLE_VALUE;
+#else
+	if (data)
+		munmap((void*)data, size);
+	if (fileDescriptor >= 0)
+		close(fileDescriptor);
+	fileDescriptor = -1;
+#endif
+	data = nullptr;
+	size = 0;
+}
+#pragma endregion
+
+#pragma region MeshCache
+namespace
+{
+	const char MESH_CACHE_MAGIC[4] = { 'P', 'B', 'M', 'C' };
+
+	size_t AlignUp(size_t value)
+	{
+		return (value + 15) & ~(size_t)15;
+	}
+
+	// Checks that [offset, offset + length) lies inside the mapped file
+	bool InRange(const MappedFile &file, uint64_t offset, uint64_t length)
+	{
+		return offset <= file.Size() && length <= file.Size() - offset;
+	}
+
+	void WritePadding(ostream &out, size_t &position)
+	{
+		static const char zeros[16] = {};
+		size_t aligned = AlignUp(position);
+		out.write(zeros, aligned - position);
+		position = aligned;
+	}
+}
+
+string MeshCache::CachePath(const string &sourcePath)
+{
+	return sourcePath + ".meshcache";
+}
+
+bool MeshCache::HashFile(const string &path, uint64_t &hash)
+{
+	MappedFile source;
+	if (!source.Open(path))
+		return false;
+
+	hash = Fnv1a(source.Data(), source.Size());
+	return true;
+}
+
+bool MeshCache::Read(const string &sourcePath, MappedFile &file, vector<CachedMesh> &meshes)
+{
+	meshes.clear();
+
+	uint64_t sourceHash;
+	if (!HashFile(sourcePath, sourceHash))
+		return false;
+	if (!file.Open(CachePath(sourcePath)))
+		return false;
+
+	//Validate the header before trusting anything else in the file
+	if (file.Size() < sizeof(MeshCacheHeader))
+		return false;
+	MeshCacheHeader header;
+	memcpy(&header, file.Data(), sizeof(header));
+	if (memcmp(header.magic, MESH_CACHE_MAGIC, sizeof(header.magic)) != 0 ||
+		header.version != MESH_CACHE_VERSION ||
+		header.vertexStride != sizeof(Vertex) ||
+		header.sourceHash != sourceHash)
+		return false;
+	if (!InRange(file, sizeof(MeshCacheHeader), (uint64_t)header.meshCount * sizeof(MeshCacheEntry)))
+		return false;
+
+	const MeshCacheEntry* entries = (const MeshCacheEntry*)(file.Data() + sizeof(MeshCacheHeader));
+	for (uint32_t i = 0; i < header.meshCount; i++)
+	{
+		const MeshCacheEntry &entry = entries[i];
+		if (!InRange(file, entry.vertexOffset, (uint64_t)entry.vertexCount * sizeof(Vertex)) ||
+			!InRange(file, entry.indexOffset, (uint64_t)entry.indexCount * sizeof(unsigned int)))
+		{
+			meshes.clear();
+			return false;
+		}
+
+		CachedMesh mesh;
+		mesh.vertices = (const Vertex*)(file.Data() + entry.vertexOffset);
+		mesh.vertexCount = entry.vertexCount;
+		mesh.indices = (const unsigned int*)(file.Data() + entry.indexOffset);
+		mesh.indexCount = entry.indexCount;
+		mesh.bounds.box = BoundingBox(glm::vec3(entry.boxMin[0], entry.boxMin[1], entry.boxMin[2]), glm::vec3(entry.boxMax[0], entry.boxMax[1], entry.boxMax[2]));
+		mesh.bounds.sphere = BoundingSphere(glm::vec3(entry.sphere[0], entry.sphere[1], entry.sphere[2]), entry.sphere[3]);
+
+		//Texture records are variable length: two lengths followed by the characters
+		uint64_t offset = entry.textureOffset;
+		for (uint32_t t = 0; t < entry.textureCount; t++)
+		{
+			uint32_t lengths[2];
+			if (!InRange(file, offset, sizeof(lengths)))
+			{
+				meshes.clear();
+				return false;
+			}
+			memcpy(lengths, file.Data() + offset, sizeof(lengths));
+			offset += sizeof(lengths);
+			if (!InRange(file, offset, (uint64_t)lengths[0] + lengths[1]))
+			{
+				meshes.clear();
+				return false;
+			}
+
+			Texture texture;
+			texture.id = 0;
+			texture.type.assign((const char*)file.Data() + offset, lengths[0]);
+			texture.path.assign((const char*)file.Data() + offset + lengths[0], lengths[1]);
+			offset += lengths[0] + lengths[1];
+			mesh.textures.push_back(texture);
+		}
+		meshes.push_back(mesh);
+	}
+	return true;
+}
+
+bool MeshCache::Write(const string &sourcePath, const vector<MeshData> &meshes)
+{
+	MeshCacheHeader header;
+	memcpy(header.magic, MESH_CACHE_MAGIC, sizeof(header.magic));
+	header.version = MESH_CACHE_VERSION;
+	header.meshCount = (uint32_t)meshes.size();
+	header.vertexStride = sizeof(Vertex);
+	if (!HashFile(sourcePath, header.sourceHash))
+		return false;
+
+	//Lay out every blob first so the entry table can be written up front
+	vector<MeshCacheEntry> entries(meshes.size());
+	size_t position = AlignUp(sizeof(MeshCacheHeader) + entries.size() * sizeof(MeshCacheEntry));
+	for (size_t i = 0; i < meshes.size(); i++)
+	{
+		const MeshData &mesh = meshes[i];
+		MeshCacheEntry &entry = entries[i];
+		entry.vertexCount = (uint32_t)mesh.vertices.size();
+		entry.indexCount = (uint32_t)mesh.indices.size();
+		entry.textureCount = (uint32_t)mesh.textures.size();
+		entry.padding = 0;
+		memcpy(entry.boxMin, &mesh.bounds.box.min, sizeof(entry.boxMin));
+		memcpy(entry.boxMax, &mesh.bounds.box.max, sizeof(entry.boxMax));
+		memcpy(entry.sphere, &mesh.bounds.sphere.center, 3 * sizeof(float));
+		entry.sphere[3] = mesh.bounds.sphere.radius;
+
+		entry.vertexOffset = position;
+		position = AlignUp(position + mesh.vertices.size() * sizeof(Vertex));
+		entry.indexOffset = position;
+		position = AlignUp(position + mesh.indices.size() * sizeof(unsigned int));
+		entry.textureOffset = position;
+		for (size_t t = 0; t < mesh.textures.size(); t++)
+			position += 2 * sizeof(uint32_t) + mesh.textures[t].type.size() + mesh.textures[t].path.size();
+		position = AlignUp(position);
+	}
+
+	//Written to a temporary file and swapped in at the end so a crash never leaves a half written cache behind
+	return WriteCacheFile(CachePath(sourcePath), "MESHCACHE", [&](ostream &out)
+	{
+		position = 0;
+		out.write((const char*)&header, sizeof(header));
+		out.write((const char*)entries.data(), entries.size() * sizeof(MeshCacheEntry));
+		position += sizeof(header) + entries.size() * sizeof(MeshCacheEntry);
+		WritePadding(out, position);
+
+		for (size_t i = 0; i < meshes.size(); i++)
+		{
+			const MeshData &mesh = meshes[i];
+			out.write((const char*)mesh.vertices.data(), mesh.vertices.size() * sizeof(Vertex));
+			position += mesh.vertices.size() * sizeof(Vertex);
+			WritePadding(out, position);
+
+			out.write((const char*)mesh.indices.data(), mesh.indices.size() * sizeof(unsigned int));
+			position += mesh.indices.size() * sizeof(unsigned int);
+			WritePadding(out, position);
+
+			for (size_t t = 0; t < mesh.textures.size(); t++)
+			{
+				const Texture &texture = mesh.textures[t];
+				uint32_t lengths[2] = { (uint32_t)texture.type.size(), (uint32_t)texture.path.size() };
+				out.write((const char*)lengths, sizeof(lengths));
+				out.write(texture.type.data(), texture.type.size());
+				out.write(texture.path.data(), texture.path.size());
+				position += sizeof(lengths) + texture.type.size() + texture.path.size();
+			}
+			WritePadding(out, position);
+		}
+	});
+}
+#pragma endregion
@@ -0,0 +1,104 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "Mesh.h"
+using namespace std;
+
+/// <summary>
+/// A read-only view of a whole file mapped into the address space.
+/// The pointer returned by Data() stays valid until Close() or destruction.
+/// </summary>
+class MappedFile
+{
+public:
+	MappedFile();
+	~MappedFile();
+
+	bool Open(const string &path);
+	void Close();
+
+	const unsigned char* Data() const { return data; }
+	size_t Size() const { return size; }
+
+private:
+	//Mappings own OS handles, so they can't be copied around
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	const unsigned char* data;
+	size_t size;
+#ifdef _WIN32
+	void* fileHandle;
+	void* mappingHandle;
+#else
+	int fileDescriptor;
+#endif
+};
+
+/*
+ * Compiled mesh cache
+ *
+ * Importing an .obj through Assimp is by far the slowest part of startup, so the first import of a model
+ * writes a "<model>.meshcache" file next to it. Later runs map that file and hand the vertex/index blobs
+ * straight to the GL buffers without any parsing.
+ *
+ * Layout (all little endian, blobs aligned to 16 bytes):
+ *   MeshCacheHeader
+ *   MeshCacheEntry[meshCount]
+ *   per mesh: Vertex[vertexCount], unsigned int[indexCount], texture records
+ * A texture record is { uint32 typeLength, uint32 pathLength, type chars, path chars }.
+ */
+const uint32_t MESH_CACHE_VERSION = 5;
+
+struct MeshCacheHeader
+{
+	char magic[4];			// "PBMC"
+	uint32_t version;		// MESH_CACHE_VERSION, bumped whenever the layout or import settings change
+	uint64_t sourceHash;	// FNV-1a hash of the source model file
+	uint32_t meshCount;
+	uint32_t vertexStride;	// sizeof(Vertex) when the file was written
+};
+
+struct MeshCacheEntry
+{
+	uint64_t vertexOffset;
+	uint64_t indexOffset;
+	uint64_t textureOffset;
+	uint32_t vertexCount;
+	uint32_t indexCount;
+	uint32_t textureCount;
+	uint32_t padding;
+	float boxMin[3];		// object space bounds computed at import
+	float boxMax[3];
+	float sphere[4];		// center xyz, radius
+};
+
+/// <summary>
+/// One cached mesh. The vertex and index pointers point into the mapped cache file.
+/// </summary>
+struct CachedMesh
+{
+	const Vertex* vertices;
+	uint32_t vertexCount;
+	const unsigned int* indices;
+	uint32_t indexCount;
+	vector<Texture> textures; // only type and path are filled in
+	Bounds bounds;
+};
+
+namespace MeshCache
+{
+	// Returns the path of the cache file belonging to a model file
+	string CachePath(const string &sourcePath);
+
+	// Hashes the source model so stale caches are detected. Returns false if the file can't be read.
+	bool HashFile(const string &path, uint64_t &hash);
+
+	// Maps the cache of sourcePath into file and fills meshes. Fails if there is no cache or it is stale/corrupt.
+	bool Read(const string &sourcePath, MappedFile &file, vector<CachedMesh> &meshes);
+
+	// Writes the cache for sourcePath from freshly imported meshes
+	bool Write(const string &sourcePath, const vector<MeshData> &meshes);
+}
@@ -0,0 +1,383 @@
+#include "MeshOptimizer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <sstream>
+
+string MeshOptimizationStats::ToString() const
+{
+	stringstream out;
+	out << triangleCount << " triangles, ";
+	if (degenerateTriangles > 0)
+		out << degenerateTriangles << " degenerate dropped, ";
+	out << vertexCount << " vertices, ACMR " << fixed << setprecision(3)
+		<< acmrBefore << " -> " << acmrAfter << " (FIFO " << MeshOptimizer::STATS_CACHE_SIZE << "), "
+		<< overdrawClusters << " overdraw clusters, " << (shortIndices ? "16" : "32") << "-bit indices";
+	return out.str();
+}
+
+#pragma region Cache simulation
+namespace
+{
+	//FIFO post-transform cache: a vertex is a hit if it was one of the last cacheSize misses
+	class FifoCache
+	{
+	public:
+		FifoCache(size_t vertexCount, unsigned int cacheSize) : timestamps(vertexCount, 0), cacheSize(cacheSize), time(cacheSize + 1) {}
+
+		//Returns true on a miss
+		bool Touch(unsigned int vertex)
+		{
+			if (time - timestamps[vertex] > cacheSize)
+			{
+				timestamps[vertex] = time++;
+				return true;
+			}
+			return false;
+		}
+
+		void Flush() { time += cacheSize + 1; }
+
+	private:
+		vector<unsigned int> timestamps;
+		unsigned int cacheSize;
+		unsigned int time;
+	};
+}
+
+float MeshOptimizer::ComputeACMR(const vector<unsigned int> &indices, size_t vertexCount, unsigned int cacheSize)
+{
+	size_t triangleCount = indices.size() / 3;
+	if (triangleCount == 0)
+		return 0.0f;
+
+	FifoCache cache(vertexCount, cacheSize);
+	size_t misses = 0;
+	for (size_t i = 0; i < triangleCount * 3; i++)
+		misses += cache.Touch(indices[i]);
+	return (float)misses / triangleCount;
+}
+#pragma endregion
+
+size_t MeshOptimizer::RemoveDegenerateTriangles(vector<unsigned int> &indices)
+{
+	size_t triangleCount = indices.size() / 3;
+	size_t kept = 0;
+	for (size_t t = 0; t < triangleCount; t++)
+	{
+		unsigned int a = indices[t * 3], b = indices[t * 3 + 1], c = indices[t * 3 + 2];
+		if (a == b || b == c || c == a)
+			continue;
+		indices[kept * 3] = a;
+		indices[kept * 3 + 1] = b;
+		indices[kept * 3 + 2] = c;
+		kept++;
+	}
+	indices.resize(kept * 3);
+	return triangleCount - kept;
+}
+
+#pragma region Vertex cache (Forsyth)
+namespace
+{
+	//Tuning values from Tom Forsyth's "Linear-Speed Vertex Cache Optimisation"
+	const int FORSYTH_CACHE_SIZE = 32;
+	const float CACHE_DECAY_POWER = 1.5f;
+	const float LAST_TRIANGLE_SCORE = 0.75f;
+	const float VALENCE_BOOST_SCALE = 2.0f;
+	const float VALENCE_BOOST_POWER = 0.5f;
+	const int MAX_VALENCE_TABLE = 32;
+
+	struct ScoreTables
+	{
+		float cache[FORSYTH_CACHE_SIZE];
+		float valence[MAX_VALENCE_TABLE];
+
+		ScoreTables()
+		{
+			for (int i = 0; i < FORSYTH_CACHE_SIZE; i++)
+			{
+				//The last triangle's vertices get a fixed score so the next triangle doesn't just reuse the same edge
+				if (i < 3)
+					cache[i] = LAST_TRIANGLE_SCORE;
+				else
+					cache[i] = powf(1.0f - (float)(i - 3) / (FORSYTH_CACHE_SIZE - 3), CACHE_DECAY_POWER);
+			}
+			//Vertices with few triangles left are boosted so they get finished off instead of lingering
+			for (int i = 0; i < MAX_VALENCE_TABLE; i++)
+				valence[i] = i == 0 ? 0.0f : VALENCE_BOOST_SCALE * powf((float)i, -VALENCE_BOOST_POWER);
+		}
+
+		float Score(int cachePosition, unsigned int remaining) const
+		{
+			if (remaining == 0)
+				return -1.0f; //nothing left to gain from this vertex
+			float score = cachePosition >= 0 ? cache[cachePosition] : 0.0f;
+			if (remaining < MAX_VALENCE_TABLE)
+				score += valence[remaining];
+			else
+				score += VALENCE_BOOST_SCALE * powf((float)remaining, -VALENCE_BOOST_POWER);
+			return score;
+		}
+	};
+}
+
+void MeshOptimizer::OptimizeVertexCache(vector<unsigned int> &indices, size_t vertexCount)
+{
+	static const ScoreTables tables;
+	size_t triangleCount = indices.size() / 3;
+	if (triangleCount == 0)
+		return;
+
+	//Triangle adjacency per vertex in one flat array. remaining[v] is how many of vertex v's triangles are still unemitted,
+	//and those always sit at the front of its slice of adjacency.
+	vector<unsigned int> remaining(vertexCount, 0);
+	for (size_t i = 0; i < triangleCount * 3; i++)
+		remaining[indices[i]]++;
+	vector<unsigned int> adjacencyStart(vertexCount + 1, 0);
+	for (size_t v = 0; v < vertexCount; v++)
+		adjacencyStart[v + 1] = adjacencyStart[v] + remaining[v];
+	vector<unsigned int> adjacency(triangleCount * 3);
+	{
+		vector<unsigned int> fill(adjacencyStart.begin(), adjacencyStart.end() - 1);
+		for (size_t t = 0; t < triangleCount; t++)
+			for (int c = 0; c < 3; c++)
+				adjacency[fill[indices[t * 3 + c]]++] = (unsigned int)t;
+	}
+
+	vector<int> cachePosition(vertexCount, -1);
+	vector<float> vertexScore(vertexCount);
+	for (size_t v = 0; v < vertexCount; v++)
+		vertexScore[v] = tables.Score(-1, remaining[v]);
+
+	vector<float> triangleScore(triangleCount);
+	vector<bool> emitted(triangleCount, false);
+	for (size_t t = 0; t < triangleCount; t++)
+		triangleScore[t] = vertexScore[indices[t * 3]] + vertexScore[indices[t * 3 + 1]] + vertexScore[indices[t * 3 + 2]];
+
+	vector<unsigned int> output;
+	output.reserve(indices.size());
+	unsigned int cache[FORSYTH_CACHE_SIZE + 3];
+	int cacheCount = 0;
+	size_t scanCursor = 0;	// fallback when no cached vertex has triangles left
+	int bestTriangle = -1;
+
+	for (size_t emittedCount = 0; emittedCount < triangleCount; emittedCount++)
+	{
+		if (bestTriangle < 0)
+		{
+			//Nothing in the cache to continue from, take the first triangle that's left
+			while (emitted[scanCursor])
+				scanCursor++;
+			bestTriangle = (int)scanCursor;
+		}
+
+		const unsigned int *triangle = &indices[bestTriangle * 3];
+		output.insert(output.end(), triangle, triangle + 3);
+		emitted[bestTriangle] = true;
+
+		//Remove the triangle from its vertices' remaining lists
+		for (int c = 0; c < 3; c++)
+		{
+			unsigned int v = triangle[c];
+			unsigned int *list = &adjacency[adjacencyStart[v]];
+			for (unsigned int i = 0; i < remaining[v]; i++)
+			{
+				if (list[i] == (unsigned int)bestTriangle)
+				{
+					swap(list[i], list[remaining[v] - 1]);
+					break;
+				}
+			}
+			remaining[v]--;
+		}
+
+		//The triangle's vertices move to the front of the cache (once each, a degenerate triangle repeats one),
+		//everything else shifts back
+		unsigned int newCache[FORSYTH_CACHE_SIZE + 3];
+		int newCount = 0;
+		for (int c = 0; c < 3; c++)
+			if (find(newCache, newCache + newCount, triangle[c]) == newCache + newCount)
+				newCache[newCount++] = triangle[c];
+		for (int i = 0; i < cacheCount; i++)
+		{
+			unsigned int v = cache[i];
+			if (v != triangle[0] && v != triangle[1] && v != triangle[2])
+				newCache[newCount++] = v;
+		}
+
+		//Rescore everything that was or is in the cache and find the best triangle touching it
+		for (int i = 0; i < newCount; i++)
+		{
+			unsigned int v = newCache[i];
+			cachePosition[v] = i < FORSYTH_CACHE_SIZE ? i : -1;
+			float score = tables.Score(cachePosition[v], remaining[v]);
+			float delta = score - vertexScore[v];
+			vertexScore[v] = score;
+			const unsigned int *list = &adjacency[adjacencyStart[v]];
+			for (unsigned int j = 0; j < remaining[v]; j++)
+				triangleScore[list[j]] += delta;
+		}
+
+		bestTriangle = -1;
+		float bestScore = -1.0f;
+		cacheCount = newCount < FORSYTH_CACHE_SIZE ? newCount : FORSYTH_CACHE_SIZE;
+		for (int i = 0; i < cacheCount; i++)
+		{
+			cache[i] = newCache[i];
+			unsigned int v = cache[i];
+			const unsigned int *list = &adjacency[adjacencyStart[v]];
+			for (unsigned int j = 0; j < remaining[v]; j++)
+			{
+				if (triangleScore[list[j]] > bestScore)
+				{
+					bestScore = triangleScore[list[j]];
+					bestTriangle = (int)list[j];
+				}
+			}
+		}
+	}
+
+	indices.swap(output);
+}
+#pragma endregion
+
+#pragma region Overdraw
+size_t MeshOptimizer::OptimizeOverdraw(vector<unsigned int> &indices, const vector<Vertex> &vertices, float threshold)
+{
+	size_t triangleCount = indices.size() / 3;
+	if (triangleCount == 0)
+		return 0;
+
+	//1. Hard boundaries: triangles where all three vertices miss the cache. Cutting there costs nothing.
+	vector<unsigned int> clusterStarts;
+	{
+		FifoCache cache(vertices.size(), STATS_CACHE_SIZE);
+		for (size_t t = 0; t < triangleCount; t++)
+		{
+			int misses = cache.Touch(indices[t * 3]) + cache.Touch(indices[t * 3 + 1]) + cache.Touch(indices[t * 3 + 2]);
+			if (t == 0 || misses == 3)
+				clusterStarts.push_back((unsigned int)t);
+		}
+	}
+
+	//2. Soft boundaries: inside each hard cluster, cut wherever the cluster so far already reuses the cache
+	//nearly as well as the whole cluster does. Starting over there only costs the threshold.
+	vector<unsigned int> softStarts;
+	for (size_t c = 0; c < clusterStarts.size(); c++)
+	{
+		size_t begin = clusterStarts[c];
+		size_t end = c + 1 < clusterStarts.size() ? clusterStarts[c + 1] : triangleCount;
+
+		vector<unsigned int> cluster(indices.begin() + begin * 3, indices.begin() + end * 3);
+		float clusterACMR = ComputeACMR(cluster, vertices.size());
+
+		FifoCache cache(vertices.size(), STATS_CACHE_SIZE);
+		size_t misses = 0;
+		size_t start = begin;
+		softStarts.push_back((unsigned int)begin);
+		for (size_t t = begin; t < end; t++)
+		{
+			misses += cache.Touch(indices[t * 3]) + cache.Touch(indices[t * 3 + 1]) + cache.Touch(indices[t * 3 + 2]);
+			size_t triangles = t + 1 - start;
+			//Tiny clusters aren't worth it, they just add boundaries
+			if (t + 1 < end && triangles >= 64 && (float)misses / triangles <= clusterACMR * threshold)
+			{
+				softStarts.push_back((unsigned int)(t + 1));
+				start = t + 1;
+				misses = 0;
+				cache.Flush();
+			}
+		}
+	}
+
+	//3. Sort clusters so the ones facing outwards from the mesh centroid come first
+	glm::vec3 meshCentroid(0.0f);
+	float meshArea = 0.0f;
+	struct Cluster
+	{
+		unsigned int begin;
+		unsigned int end;
+		float sortKey;
+	};
+	vector<Cluster> clusters(softStarts.size());
+	vector<glm::vec3> clusterCentroids(softStarts.size());
+	vector<glm::vec3> clusterNormals(softStarts.size());
+	for (size_t c = 0; c < softStarts.size(); c++)
+	{
+		clusters[c].begin = softStarts[c];
+		clusters[c].end = c + 1 < softStarts.size() ? softStarts[c + 1] : (unsigned int)triangleCount;
+
+		glm::vec3 centroid(0.0f), normal(0.0f);
+		float area = 0.0f;
+		for (unsigned int t = clusters[c].begin; t < clusters[c].end; t++)
+		{
+			const glm::vec3 &a = vertices[indices[t * 3]].Position;
+			const glm::vec3 &b = vertices[indices[t * 3 + 1]].Position;
+			const glm::vec3 &d = vertices[indices[t * 3 + 2]].Position;
+			glm::vec3 areaNormal = glm::cross(b - a, d - a);	// length is twice the area
+			float triangleArea = glm::length(areaNormal);
+			centroid += (a + b + d) * (triangleArea / 3.0f);
+			normal += areaNormal;
+			area += triangleArea;
+		}
+		meshCentroid += centroid;
+		meshArea += area;
+		clusterCentroids[c] = area > 0.0f ? centroid / area : vertices[indices[clusters[c].begin * 3]].Position;
+		clusterNormals[c] = glm::length(normal) > 0.0f ? glm::normalize(normal) : glm::vec3(0.0f);
+	}
+	if (meshArea > 0.0f)
+		meshCentroid /= meshArea;
+	for (size_t c = 0; c < clusters.size(); c++)
+		clusters[c].sortKey = glm::dot(clusterCentroids[c] - meshCentroid, clusterNormals[c]);
+
+	stable_sort(clusters.begin(), clusters.end(), [](const Cluster &a, const Cluster &b) { return a.sortKey > b.sortKey; });
+
+	vector<unsigned int> output;
+	output.reserve(indices.size());
+	for (size_t c = 0; c < clusters.size(); c++)
+		output.insert(output.end(), indices.begin() + clusters[c].begin * 3, indices.begin() + clusters[c].end * 3);
+	indices.swap(output);
+	return clusters.size();
+}
+#pragma endregion
+
+#pragma region Vertex fetch
+void MeshOptimizer::OptimizeVertexFetch(vector<Vertex> &vertices, vector<unsigned int> &indices)
+{
+	const unsigned int UNUSED = 0xFFFFFFFFu;
+	vector<unsigned int> remap(vertices.size(), UNUSED);
+	vector<Vertex> reordered;
+	reordered.reserve(vertices.size());
+
+	for (size_t i = 0; i < indices.size(); i++)
+	{
+		unsigned int &target = remap[indices[i]];
+		if (target == UNUSED)
+		{
+			target = (unsigned int)reordered.size();
+			reordered.push_back(vertices[indices[i]]);
+		}
+		indices[i] = target;
+	}
+	vertices.swap(reordered);
+}
+#pragma endregion
+
+MeshOptimizationStats MeshOptimizer::Optimize(MeshData &mesh)
+{
+	MeshOptimizationStats stats;
+	stats.degenerateTriangles = RemoveDegenerateTriangles(mesh.indices);
+	stats.triangleCount = mesh.indices.size() / 3;
+	stats.acmrBefore = ComputeACMR(mesh.indices, mesh.vertices.size());
+
+	OptimizeVertexCache(mesh.indices, mesh.vertices.size());
+	stats.overdrawClusters = OptimizeOverdraw(mesh.indices, mesh.vertices);
+	OptimizeVertexFetch(mesh.vertices, mesh.indices);
+
+	stats.vertexCount = mesh.vertices.size();
+	stats.acmrAfter = ComputeACMR(mesh.indices, mesh.vertices.size());
+	stats.shortIndices = mesh.vertices.size() <= 0xFFFF;
+	return stats;
+}
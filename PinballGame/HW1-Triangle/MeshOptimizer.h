@@ -0,0 +1,50 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include "Mesh.h"
+using namespace std;
+
+/// <summary>
+/// What the import time optimization did to one mesh.
+/// ACMR (average cache miss ratio) is vertex shader invocations per triangle with a simulated FIFO post-transform cache:
+/// 3.0 means no reuse at all, ~0.5-0.7 is about the best a regular mesh can reach.
+/// </summary>
+struct MeshOptimizationStats
+{
+	size_t triangleCount;
+	size_t degenerateTriangles;	// dropped before optimizing
+	size_t vertexCount;
+	float acmrBefore;
+	float acmrAfter;
+	size_t overdrawClusters;
+	bool shortIndices;
+
+	string ToString() const;
+};
+
+namespace MeshOptimizer
+{
+	//Size of the FIFO cache ACMR statistics are simulated with, roughly what current GPUs reuse
+	const unsigned int STATS_CACHE_SIZE = 16;
+
+	//Vertex shader invocations per triangle with a FIFO post-transform cache of cacheSize entries
+	float ComputeACMR(const vector<unsigned int> &indices, size_t vertexCount, unsigned int cacheSize = STATS_CACHE_SIZE);
+
+	//Drops triangles that use the same vertex twice, they draw nothing. Returns how many were dropped.
+	size_t RemoveDegenerateTriangles(vector<unsigned int> &indices);
+
+	//Reorders triangles for post-transform cache locality (Forsyth's linear speed vertex cache optimization)
+	void OptimizeVertexCache(vector<unsigned int> &indices, size_t vertexCount);
+
+	//Splits cache optimized triangles into clusters and orders those from the outside in (Tipsify style), so
+	//surfaces facing away from the middle of the mesh - the ones most likely to be in front - get drawn first.
+	//threshold is how much ACMR may be given up for the sake of finer clusters. Returns the cluster count.
+	size_t OptimizeOverdraw(vector<unsigned int> &indices, const vector<Vertex> &vertices, float threshold = 1.05f);
+
+	//Renumbers vertices in the order the triangles first use them, so vertex fetch walks memory forward. Drops unused vertices.
+	void OptimizeVertexFetch(vector<Vertex> &vertices, vector<unsigned int> &indices);
+
+	//Runs all of the above on a freshly imported mesh
+	MeshOptimizationStats Optimize(MeshData &mesh);
+}
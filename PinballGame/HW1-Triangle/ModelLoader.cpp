@@ -0,0 +1,21 @@
+#include "ModelLoader.h"
+
+vector<Object> LoadModels(const vector<string> &paths, ThreadPool &pool, const function<void(vector<Object>&)> &beforeUpload)
+{
+	vector<Object> objects(paths.size());
+
+	//1. Parse every model (or map its mesh cache) in parallel
+	pool.ParallelFor(paths.size(), [&objects, &paths](size_t i)
+	{
+		objects[i].Import(paths[i]);
+	});
+
+	if (beforeUpload)
+		beforeUpload(objects);
+
+	//2. Create the GL objects here on the context thread. Textures keep decoding in the background, see TextureStreamer.
+	for (size_t i = 0; i < objects.size(); i++)
+		objects[i].Upload();
+
+	return objects;
+}
@@ -0,0 +1,18 @@
+#pragma once
+
+#include <functional>
+#include <string>
+#include <vector>
+#include "Object.h"
+#include "ThreadPool.h"
+using namespace std;
+
+/// <summary>
+/// Loads several models at once. Parsing and vertex conversion for all of them run on the worker pool at the
+/// same time, only the GL buffer creation happens on the calling thread. Textures stream in afterwards.
+/// Must be called from the thread that owns the GL context. Objects come back in the order of paths.
+/// beforeUpload, if given, sees the imported objects before any GL buffers exist, for work that changes their vertices
+/// (Object::BakeLightmap). It runs on the calling thread.
+/// </summary>
+vector<Object> LoadModels(const vector<string> &paths, ThreadPool &pool = ThreadPool::Shared(),
+	const function<void(vector<Object>&)> &beforeUpload = nullptr);
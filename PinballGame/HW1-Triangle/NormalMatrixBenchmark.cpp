@@ -0,0 +1,139 @@
+#include "NormalMatrixBenchmark.h"
+
+#include <chrono>
+#include <glm/gtc/matrix_transform.hpp>
+#include "InstanceBuffer.h"
+
+namespace
+{
+	//A slightly different matrix per pass or instance, so the work can't be shared between them
+	glm::mat4 benchmarkModel(const Object &object, int repeat)
+	{
+		return glm::rotate(object.transform.Model(), repeat * 0.001f, glm::vec3(0.0f, 1.0f, 0.0f));
+	}
+
+	//Draws every mesh repeats times, one draw each with uniforms, or as one draw of repeats instances when instances is set.
+	//instances holds instancesPerObject per object, the object's draws start at its first one whatever repeats is.
+	NormalMatrixBenchmark::Timing timePasses(Shader &shader, const vector<Object> &objects, int repeats, InstanceBuffer *instances, int instancesPerObject)
+	{
+		shader.StartPipelineProgram();
+		GLuint query;
+		glGenQueries(1, &query);
+
+		glFinish();
+		chrono::high_resolution_clock::time_point start = chrono::high_resolution_clock::now();
+		glBeginQuery(GL_TIME_ELAPSED, query);
+		for (size_t o = 0; o < objects.size(); o++)
+		{
+			const vector<Mesh> &meshes = objects[o].meshes;
+			if (instances)
+			{
+				size_t firstInstance = o * instancesPerObject;
+				for (size_t m = 0; m < meshes.size(); m++)
+				{
+					meshes[m].Geometry().Bind();
+					instances->Draw(meshes[m].Geometry(), meshes[m].range, firstInstance, repeats);
+				}
+				continue;
+			}
+			for (int r = 0; r < repeats; r++)
+			{
+				glm::mat4 model = benchmarkModel(objects[o], r);
+				shader.setMat4(MODEL_UNIFORM, model);
+				shader.setMat3(NORMAL_MATRIX_UNIFORM, Transform::NormalMatrix(model));
+				for (size_t m = 0; m < meshes.size(); m++)
+				{
+					meshes[m].Geometry().Bind();
+					meshes[m].Geometry().Draw(meshes[m].range);
+				}
+			}
+		}
+		glEndQuery(GL_TIME_ELAPSED);
+		glFinish();
+
+		NormalMatrixBenchmark::Timing timing;
+		timing.wallMs = chrono::duration<double, milli>(chrono::high_resolution_clock::now() - start).count();
+		GLuint64 elapsed = 0;
+		glGetQueryObjectui64v(query, GL_QUERY_RESULT, &elapsed);
+		timing.gpuMs = elapsed / 1.0e6;
+		glDeleteQueries(1, &query);
+		return timing;
+	}
+
+	void printTiming(const char *name, const NormalMatrixBenchmark::Timing &timing, double vertices, ostream &out)
+	{
+		out << "  " << name << timing.gpuMs << " ms GPU, " << timing.wallMs << " ms wall, "
+			<< timing.wallMs * 1.0e6 / vertices << " ns/vertex (wall)" << endl;
+	}
+}
+
+NormalMatrixBenchmark::Result NormalMatrixBenchmark::Run(const vector<Object> &objects, FrameUniforms &frameUniforms, const LightClusters &lightClusters, int repeats)
+{
+	Result result;
+	result.repeats = repeats;
+	result.vertices = 0;
+	for (size_t o = 0; o < objects.size(); o++)
+		for (size_t m = 0; m < objects[o].meshes.size(); m++)
+			result.vertices += objects[o].meshes[m].range.indexCount;
+
+	ShaderDefines inverse = ShaderDefines().Define("INVERSE_NORMAL_MATRIX");
+	Shader inverseShader("VertexShader.vert", "FragmentShader.frag", inverse);
+	Shader uniformShader("VertexShader.vert", "FragmentShader.frag");
+	Shader instancedInverseShader("VertexShader.vert", "FragmentShader.frag", ShaderDefines(inverse).Define("INSTANCED"));
+	Shader instancedShader("VertexShader.vert", "FragmentShader.frag", ShaderDefines().Define("INSTANCED"));
+	frameUniforms.Attach(inverseShader);
+	frameUniforms.Attach(uniformShader);
+	frameUniforms.Attach(instancedInverseShader);
+	frameUniforms.Attach(instancedShader);
+	lightClusters.Attach(inverseShader);
+	lightClusters.Attach(uniformShader);
+	lightClusters.Attach(instancedInverseShader);
+	lightClusters.Attach(instancedShader);
+	glm::vec3 eye(0.0f, 0.0f, 3.0f);
+	frameUniforms.SetCamera(glm::perspective(glm::radians(45.0f), 1.0f, 0.1f, 100.0f), glm::lookAt(eye, glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f)), eye);
+	frameUniforms.Upload();
+
+	//Every object's instances, normal matrices computed here as the engine does it
+	InstanceBuffer instances(objects.size() * repeats);
+	for (size_t o = 0; o < objects.size(); o++)
+		for (int r = 0; r < repeats; r++)
+		{
+			InstanceData instance(benchmarkModel(objects[o], r));
+			instances.Add(&instance, 1);
+		}
+	instances.Upload();
+
+	glEnable(GL_RASTERIZER_DISCARD);
+	//One untimed pass each, so shader compilation on first use isn't measured
+	timePasses(inverseShader, objects, 1, nullptr, 0);
+	timePasses(uniformShader, objects, 1, nullptr, 0);
+	timePasses(instancedInverseShader, objects, 1, &instances, repeats);
+	timePasses(instancedShader, objects, 1, &instances, repeats);
+	result.inverse = timePasses(inverseShader, objects, repeats, nullptr, 0);
+	result.uniform = timePasses(uniformShader, objects, repeats, nullptr, 0);
+	result.instancedInverse = timePasses(instancedInverseShader, objects, repeats, &instances, repeats);
+	result.instancedAttribute = timePasses(instancedShader, objects, repeats, &instances, repeats);
+	glDisable(GL_RASTERIZER_DISCARD);
+
+	glUseProgram(0);
+	BindVertexArray(0);
+	instances.Release();
+	glDeleteProgram(inverseShader.ID);
+	glDeleteProgram(uniformShader.ID);
+	glDeleteProgram(instancedInverseShader.ID);
+	glDeleteProgram(instancedShader.ID);
+	return result;
+}
+
+void NormalMatrixBenchmark::Print(const Result &result, ostream &out)
+{
+	double vertices = (double)result.vertices * result.repeats;
+	out << "NORMAL MATRIX BENCHMARK:: " << (const char*)glGetString(GL_RENDERER) << ", " << result.vertices << " vertices x "
+		<< result.repeats << ", rasterizer discarded" << endl;
+	printTiming("uniform model, inverse() per vertex:  ", result.inverse, vertices, out);
+	printTiming("uniform model, CPU normalMatrix:      ", result.uniform, vertices, out);
+	printTiming("instanced, inverse() per vertex:      ", result.instancedInverse, vertices, out);
+	printTiming("instanced, CPU normal matrix:         ", result.instancedAttribute, vertices, out);
+	out << "  speedup (wall): uniform " << result.inverse.wallMs / result.uniform.wallMs << "x, instanced "
+		<< result.instancedInverse.wallMs / result.instancedAttribute.wallMs << "x" << endl;
+}
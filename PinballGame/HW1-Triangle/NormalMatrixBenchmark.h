@@ -0,0 +1,39 @@
+#pragma once
+
+#include <ostream>
+#include <vector>
+#include "FrameUniforms.h"
+#include "LightClusters.h"
+#include "Object.h"
+using namespace std;
+
+/// <summary>
+/// Vertex stage cost of the per vertex inverse() the lighting shaders used to do, against the normal matrix computed on
+/// the CPU (Transform). Both the uniform and the instanced permutation of VertexShader.vert are measured, each with and
+/// without INVERSE_NORMAL_MATRIX. The objects are drawn with rasterization discarded, so the vertex shader is
+/// the only stage doing work. Run it on a software renderer (LIBGL_ALWAYS_SOFTWARE=1 on Mesa, llvmpipe) to see the
+/// cost without a GPU hiding it; software renderers may not implement GL_TIME_ELAPSED, the wall clock still works.
+/// </summary>
+namespace NormalMatrixBenchmark
+{
+	struct Timing
+	{
+		double gpuMs;	// GL_TIME_ELAPSED over all repeats
+		double wallMs;	// glFinish to glFinish
+	};
+
+	struct Result
+	{
+		size_t vertices;	// index count of one pass over all objects
+		int repeats;		// passes, or instances per draw for the instanced path
+		Timing inverse;				// uniform model, inverse() per vertex
+		Timing uniform;				// uniform model and normalMatrix
+		Timing instancedInverse;	// model per instance, inverse() per vertex
+		Timing instancedAttribute;	// model and normal matrix per instance
+	};
+
+	//Needs the context, leaves the default program, VAO and rasterizer state behind
+	Result Run(const vector<Object> &objects, FrameUniforms &frameUniforms, const LightClusters &lightClusters, int repeats = 200);
+
+	void Print(const Result &result, ostream &out);
+}
@@ -6,49 +6,69 @@
 #include <assimp/Importer.hpp>
 #include <assimp/scene.h>
 #include <assimp/postprocess.h>
-#include "stb_image.h"
 
+#include "Frustum.h"
+#include "Lightmap.h"
 #include "Mesh.h"
+#include "MeshCache.h"
+#include "MeshOptimizer.h"
+#include "RenderQueue.h"
 #include "Shader.h"
+#include "TextureCache.h"
+#include "TextureLoader.h"
+#include "Transform.h"
 
+#include <cstring>
 #include <string>
 #include <fstream>
 #include <sstream>
 #include <iostream>
 #include <map>
+#include <memory>
 #include <vector>
 using namespace std;
 
-unsigned int TextureFromFile(const char *path, const string &directory, bool gamma = false);
-
 class Object
 {
 public:
 	/*  Model Data */
-	vector<Texture> textures_loaded;	// stores all the textures loaded so far, optimization to make sure textures aren't loaded more than once.
+	vector<Texture> textures_loaded;	// every texture this object holds a reference to in the shared TextureCache.
 	vector<Mesh> meshes;
 	string directory;
 	bool gammaCorrection;
 	glm::vec3 position;
+	Bounds bounds;		// around all meshes, in object space. Known after Import().
+	Transform transform;	// model matrix and its normal matrix, change it with transform.Set()
+	Lightmap lightmap;		// baked static lighting, only for objects that got BakeLightmap() between Import() and Upload()
 	/*  Functions   */
+	// empty object, fill it with Import() followed by Upload().
+	Object() : gammaCorrection(false), position(0.0f) {}
+
 	// constructor, expects a filepath to a 3D model.
-	Object(string const &path, bool gamma = false) : gammaCorrection(gamma)
+	Object(string const &path, bool gamma = false) : gammaCorrection(gamma), position(0.0f)
 	{
-		loadModel(path);
+		Import(path);
+		Upload();
 	}
 
-	// draws the model, and thus all its meshes
-	void Draw(Shader shader)
+	// CPU half of loading a model: parses the file (or maps its mesh cache) and converts the vertices.
+	// touches no GL state so it can run on a worker thread, see ModelLoader.
+	void Import(string const &path)
 	{
-		for (unsigned int i = 0; i < meshes.size(); i++)
-			meshes[i].Draw(shader);
-	}
+		// retrieve the directory path of the filepath
+		directory = path.substr(0, path.find_last_of('/'));
+		sourcePath = path;
+
+		// try the compiled mesh cache first, it is only used while it matches the source file
+		pendingCache = make_shared<MappedFile>();
+		if (MeshCache::Read(path, *pendingCache, pendingCachedMeshes))
+		{
+			for (size_t i = 0; i < pendingCachedMeshes.size(); i++)
+				bounds.Extend(pendingCachedMeshes[i].bounds);
+			return;
+		}
+		pendingCache.reset();
 
-private:
-	/*  Functions   */
-	// loads a model with supported ASSIMP extensions from file and stores the resulting meshes in the meshes vector.
-	void loadModel(string const &path)
-	{
 		// read file via ASSIMP
 		Assimp::Importer importer;
 		const aiScene* scene = importer.ReadFile(path, aiProcess_Triangulate | aiProcess_FlipUVs | aiProcess_CalcTangentSpace);
@@ -58,13 +78,121 @@ private:
 			cout << "ERROR::ASSIMP:: " << importer.GetErrorString() << endl;
 			return;
 		}
-		// retrieve the directory path of the filepath
-		directory = path.substr(0, path.find_last_of('/'));
 
 		// process ASSIMP's root node recursively
 		processNode(scene->mRootNode, scene);
+		for (size_t i = 0; i < pendingMeshes.size(); i++)
+			bounds.Extend(pendingMeshes[i].bounds);
+
+		// compile the imported meshes so the next launch doesn't have to parse the model again
+		MeshCache::Write(path, pendingMeshes);
+	}
+
+	// bakes the static lights into a lightmap for this object, which then must never move. Runs after Import() and before
+	// Upload() since it splits vertices for the second uv set. The result is cached in "<model>.lightmap".
+	void BakeLightmap(const StaticLights &lights, const LightmapSettings &settings = LightmapSettings())
+	{
+		// the unwrap rewrites the vertices, so meshes straight out of the mesh cache become regular imports
+		for (size_t i = 0; i < pendingCachedMeshes.size(); i++)
+		{
+			const CachedMesh &cached = pendingCachedMeshes[i];
+			MeshData data;
+			data.vertices.assign(cached.vertices, cached.vertices + cached.vertexCount);
+			data.indices.assign(cached.indices, cached.indices + cached.indexCount);
+			data.textures = cached.textures;
+			data.bounds = cached.bounds;
+			pendingMeshes.push_back(move(data));
+		}
+		pendingCachedMeshes.clear();
+		pendingCache.reset();
+
+		if (lightmap.Bake(sourcePath + ".lightmap", pendingMeshes, lights, settings))
+			lightmap.PrintStats(sourcePath, cout);
+	}
+
+	// GL half of loading a model: creates the mesh buffers and requests the textures. Must run on the context thread.
+	// the textures themselves are decoded and streamed in the background by the TextureStreamer.
+	void Upload()
+	{
+		for (size_t i = 0; i < pendingMeshes.size(); i++)
+		{
+			MeshData &data = pendingMeshes[i];
+			meshes.push_back(Mesh(move(data.vertices), move(data.indices), uploadTextures(data.textures), data.bounds, lightmap.Baked()));
+		}
+		for (size_t i = 0; i < pendingCachedMeshes.size(); i++)
+		{
+			// the vertex and index blobs are uploaded straight out of the mapping
+			const CachedMesh &cached = pendingCachedMeshes[i];
+			meshes.push_back(Mesh(cached.vertices, cached.vertexCount, cached.indices, cached.indexCount, uploadTextures(cached.textures), cached.bounds));
+		}
+
+		pendingMeshes.clear();
+		pendingCachedMeshes.clear();
+		pendingCache.reset();
+		lightmap.Upload();
+	}
+
+	// gives back this object's references on its textures and deletes its lightmap. Objects are copied around freely,
+	// so only call this on one copy, once the object isn't drawn anymore.
+	void ReleaseTextures()
+	{
+		for (size_t i = 0; i < textures_loaded.size(); i++)
+			TextureCache::Shared().Release(textures_loaded[i].id);
+		textures_loaded.clear();
+		lightmap.Release();
+	}
+
+	// draws the model, and thus all its meshes
+	void Draw(const Shader &shader)
+	{
+		for (unsigned int i = 0; i < meshes.size(); i++)
+			meshes[i].Draw(shader);
+	}
+
+	// queues all meshes for drawing at transform, the queue decides the order
+	void Submit(RenderQueue &queue, RenderPass pass, const Shader &shader) const
+	{
+		for (size_t i = 0; i < meshes.size(); i++)
+			queue.Submit(pass, shader, meshes[i].Geometry(), meshes[i].range, meshes[i].material, transform);
+	}
+
+	// adds the world space boxes of the object and then of each mesh to culler, returns the index of the first
+	size_t AddBounds(FrustumCuller &culler) const
+	{
+		size_t first = culler.Add(bounds.box.Transformed(transform.Model()));
+		for (size_t i = 0; i < meshes.size(); i++)
+			culler.Add(meshes[i].bounds.box.Transformed(transform.Model()));
+		return first;
+	}
+
+	// like Submit, but skips the object or single meshes that culler found outside the frustum.
+	// first is what AddBounds returned since the transform last changed.
+	void Submit(RenderQueue &queue, RenderPass pass, const Shader &shader, const FrustumCuller &culler, size_t first) const
+	{
+		if (!culler.Visible(first))
+			return;
+		for (size_t i = 0; i < meshes.size(); i++)
+			if (culler.Visible(first + 1 + i))
+				queue.Submit(pass, shader, meshes[i].Geometry(), meshes[i].range, meshes[i].material, transform);
 	}
 
+	// queues all meshes once for count instances added to instances at first, one draw per mesh no matter how many copies.
+	// shader has to be one of the instanced variants.
+	void SubmitInstanced(RenderQueue &queue, RenderPass pass, const Shader &shader, InstanceBuffer &instances, size_t first, size_t count) const
+	{
+		for (size_t i = 0; i < meshes.size(); i++)
+			queue.SubmitInstanced(pass, shader, meshes[i].Geometry(), meshes[i].range, meshes[i].material, instances, first, count);
+	}
+
+private:
+	string sourcePath;
+
+	/*  Import results waiting for Upload()  */
+	vector<MeshData> pendingMeshes;
+	vector<CachedMesh> pendingCachedMeshes;
+	shared_ptr<MappedFile> pendingCache;	// keeps the mesh cache mapped until its blobs are uploaded
+
+	/*  Functions   */
 	// processes a node in a recursive fashion. Processes each individual mesh located at the node and repeats this process on its children nodes (if any).
 	void processNode(aiNode *node, const aiScene *scene)
 	{
@@ -74,7 +202,7 @@ private:
 			// the node object only contains indices to index the actual objects in the scene. 
 			// the scene contains all the data, node is just to keep stuff organized (like relations between nodes).
 			aiMesh* mesh = scene->mMeshes[node->mMeshes[i]];
-			meshes.push_back(processMesh(mesh, scene));
+			pendingMeshes.push_back(processMesh(mesh, scene));
 		}
 		// after we've processed all of the meshes (if any) we then recursively process each of the children nodes
 		for (unsigned int i = 0; i < node->mNumChildren; i++)
@@ -84,12 +212,13 @@ private:
 		//AveragePosition();
 	}
 
-	Mesh processMesh(aiMesh *mesh, const aiScene *scene)
+	MeshData processMesh(aiMesh *mesh, const aiScene *scene)
 	{
 		// data to fill
-		vector<Vertex> vertices;
-		vector<unsigned int> indices;
-		vector<Texture> textures;
+		MeshData data;
+		vector<Vertex> &vertices = data.vertices;
+		vector<unsigned int> &indices = data.indices;
+		vector<Texture> &textures = data.textures;
 
 		// Walk through each of the mesh's vertices
 		for (unsigned int i = 0; i < mesh->mNumVertices; i++)
@@ -128,6 +257,8 @@ private:
 			vector.y = mesh->mBitangents[i].y;
 			vector.z = mesh->mBitangents[i].z;
 			vertex.Bitangent = vector;
+			// lightmap coords only exist once the object is baked
+			vertex.LightmapCoords = glm::vec2(0.0f);
 			vertices.push_back(vertex);
 		}
 		// now wak through each of the mesh's faces (a face is a mesh its triangle) and retrieve the corresponding vertex indices.
@@ -138,6 +269,12 @@ private:
 			for (unsigned int j = 0; j < face.mNumIndices; j++)
 				indices.push_back(face.mIndices[j]);
 		}
+		// reorder for the post-transform cache, overdraw and vertex fetch. this runs once per import,
+		// the mesh cache stores the optimized result.
+		MeshOptimizationStats stats = MeshOptimizer::Optimize(data);
+		cout << ("MESH OPTIMIZER:: " + directory + " '" + mesh->mName.C_Str() + "': " + stats.ToString() + "\n") << flush;
+		// bounds for culling, stored in the mesh cache along with the vertices
+		data.bounds = Bounds::FromVertices(vertices.data(), vertices.size());
 		// process materials
 		aiMaterial* material = scene->mMaterials[mesh->mMaterialIndex];
 		// we assume a convention for sampler names in the shaders. Each diffuse texture should be named
@@ -160,12 +297,12 @@ private:
 		std::vector<Texture> heightMaps = loadMaterialTextures(material, aiTextureType_AMBIENT, "texture_height");
 		textures.insert(textures.end(), heightMaps.begin(), heightMaps.end());
 
-		// return a mesh object created from the extracted mesh data
-		return Mesh(vertices, indices, textures);
+		// return the extracted mesh data, the GL buffers get created in Upload()
+		return data;
 	}
 
-	// checks all material textures of a given type and loads the textures if they're not loaded yet.
-	// the required info is returned as a Texture struct.
+	// collects all material textures of a given type. only the type and path are filled in here,
+	// the textures themselves are loaded in Upload().
 	vector<Texture> loadMaterialTextures(aiMaterial *mat, aiTextureType type, string typeName)
 	{
 		vector<Texture> textures;
@@ -173,30 +310,36 @@ private:
 		{
 			aiString str;
 			mat->GetTexture(type, i, &str);
-			// check if texture was loaded before and if so, continue to next iteration: skip loading a new texture
-			bool skip = false;
-			for (unsigned int j = 0; j < textures_loaded.size(); j++)
-			{
-				if (std::strcmp(textures_loaded[j].path.data(), str.C_Str()) == 0)
-				{
-					textures.push_back(textures_loaded[j]);
-					skip = true; // a texture with the same filepath has already been loaded, continue to next one. (optimization)
-					break;
-				}
-			}
-			if (!skip)
-			{   // if texture hasn't been loaded already, load it
-				Texture texture;
-				texture.id = TextureFromFile(str.C_Str(), this->directory);
-				texture.type = typeName;
-				texture.path = str.C_Str();
-				textures.push_back(texture);
-				textures_loaded.push_back(texture);  // store it as texture loaded for entire model, to ensure we won't unnecesery load duplicate textures.
-			}
+			Texture texture;
+			texture.id = 0;
+			texture.type = typeName;
+			texture.path = str.C_Str();
+			textures.push_back(texture);
 		}
 		return textures;
 	}
 
+	// loads the textures of one mesh if they're not loaded yet. the required info is returned as Texture structs.
+	vector<Texture> uploadTextures(const vector<Texture> &wanted)
+	{
+		vector<Texture> textures;
+		for (size_t i = 0; i < wanted.size(); i++)
+			textures.push_back(loadTexture(wanted[i].path.c_str(), wanted[i].type));
+		return textures;
+	}
+
+	// loads a single texture relative to the model directory, unless it was loaded before.
+	Texture loadTexture(const char *path, const string &typeName)
+	{
+		// the process wide texture cache makes sure every file is only loaded once, no matter how many objects use it
+		Texture texture;
+		texture.id = TextureCache::Shared().Acquire(directory + '/' + path, TextureParams(false, true, gammaCorrection));
+		texture.type = typeName;
+		texture.path = path;
+		textures_loaded.push_back(texture);  // remember the reference so ReleaseTextures() can give it back
+		return texture;
+	}
+
 	void AveragePosition()
 	{
 		if (meshes.size() < 1) return;
@@ -210,48 +353,7 @@ private:
 		}
 		position.x = position.x / totalVerts;
 		position.y = position.y / totalVerts;
-		position.z = position.y / totalVerts;
+		position.z = position.z / totalVerts;
 	}
 };
 
-
-unsigned int TextureFromFile(const char *path, const string &directory, bool gamma)
-{
-	string filename = string(path);
-	filename = directory + '/' + filename;
-
-	unsigned int textureID;
-	glGenTextures(1, &textureID);
-
-	int width, height, nrComponents;
-	unsigned char *data = stbi_load(filename.c_str(), &width, &height, &nrComponents, 0);
-	if (data)
-	{
-		GLenum format;
-		if (nrComponents == 1)
-			format = GL_RED;
-		else if (nrComponents == 3)
-			format = GL_RGB;
-		else if (nrComponents == 4)
-			format = GL_RGBA;
-
-		glBindTexture(GL_TEXTURE_2D, textureID);
-		glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
-		glGenerateMipmap(GL_TEXTURE_2D);
-
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-		stbi_image_free(data);
-	}
-	else
-	{
-		std::cout << "Texture failed to load at path: " << path << std::endl;
-		stbi_image_free(data);
-	}
-
-	return textureID;
-}
-
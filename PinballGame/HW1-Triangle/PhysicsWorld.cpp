@@ -0,0 +1,386 @@
+#include "PhysicsWorld.h"
+
+#include <glm/gtc/matrix_transform.hpp>
+#include <algorithm>
+#include <cstdio>
+#include <random>
+
+namespace
+{
+	const int MAX_BOUNCES = 4;			// contacts a ball resolves per step, then it stays where the last one left it
+	const float CONTACT_SKIN = 0.001f;	// of the radius, kept between a ball and what it touched
+	const float LOST_MARGIN = 10.0f;	// radii below or beside the static geometry's box before a ball counts as gone
+
+	//Where a ball moved to hit ends up: out of whatever it started inside of, then the skin off the surface
+	glm::vec3 ContactPosition(const glm::vec3 &center, float radius, const SweepHit &hit)
+	{
+		float depth = radius - glm::dot(center - hit.point, hit.normal);
+		return center + hit.normal * (glm::max(depth, 0.0f) + radius * CONTACT_SKIN);
+	}
+}
+
+PhysicsWorld::PhysicsWorld() : broadphase(BROADPHASE_BVH)
+{
+	stats.steps = 0;
+	stats.totalMs = 0.0;
+	stats.bounces = 0;
+	stats.ballContacts = 0;
+	stats.lostBalls = 0;
+}
+
+size_t PhysicsWorld::AddFlipper(const glm::vec3 &pivot, const glm::vec3 &axis, float upAngle)
+{
+	Flipper flipper = { pivot, glm::normalize(axis), upAngle, 0.0f, 0.0f, false };
+	flippers.push_back(flipper);
+	previousAngles.push_back(0.0f);
+	flipperGeometry.push_back(CollisionMesh());
+	flipperReach.push_back(0.0f);
+	return flippers.size() - 1;
+}
+
+void PhysicsWorld::Simulate(int steps, float dt)
+{
+	if (steps <= 0)
+		return;
+	//One clock read per frame rather than per step, a step is too short to time on its own
+	chrono::high_resolution_clock::time_point start = chrono::high_resolution_clock::now();
+	for (int i = 0; i < steps; i++)
+		Step(dt);
+	stats.totalMs += chrono::duration<double, milli>(chrono::high_resolution_clock::now() - start).count();
+}
+
+void PhysicsWorld::Step(float dt)
+{
+	stepFlippers(dt);
+	stepBalls(dt);
+	stats.steps++;
+}
+
+void PhysicsWorld::stepFlippers(float dt)
+{
+	const FlipperSettings &settings = flipperSettings;
+	for (size_t i = 0; i < flippers.size(); i++)
+	{
+		Flipper &flipper = flippers[i];
+		previousAngles[i] = flipper.angle;
+
+		//Work in the swing's own direction, 0 is down and range is up
+		float range = glm::abs(flipper.upAngle);
+		float direction = flipper.upAngle < 0.0f ? -1.0f : 1.0f;
+		float swing = flipper.angle * direction;
+		float speed = flipper.angularVelocity;
+
+		speed += (flipper.pressed ? settings.upAcceleration : -settings.downAcceleration) * dt;
+		speed = glm::clamp(speed, -settings.maxSpeed, settings.maxSpeed);
+		swing += speed * dt;
+		//Both stops are dead, the flipper stays where it hits them
+		if (swing >= range)
+		{
+			swing = range;
+			speed = 0.0f;
+		}
+		else if (swing <= 0.0f)
+		{
+			swing = 0.0f;
+			speed = 0.0f;
+		}
+
+		flipper.angle = swing * direction;
+		flipper.angularVelocity = speed;
+	}
+}
+
+void PhysicsWorld::stepBalls(float dt)
+{
+	if (balls.Count() == 0)
+		return;
+	balls.Integrate(dt, ballSettings.gravity, ballSettings.angularDamping);
+	//Integrate() moved every ball as if nothing were in the way, sweep those moves and fix the ones that hit.
+	//Then the balls against each other, whatever that moves is swept against the table again.
+	for (size_t i = 0; i < balls.Count(); i++)
+		collideBall(i, dt);
+	balls.CollideBalls(ballSettings.ballRestitution, dt, [this](size_t ball, const glm::vec3 &target) { return moveBall(ball, target); });
+	stats.ballContacts += balls.LastStats().contacts;
+
+	const BoundingBox &box = staticGeometry.Box();
+	if (box.Empty())
+		return;
+	for (size_t i = balls.Count(); i-- > 0;)
+	{
+		//Above the table is fine, balls dropped in from there fall back onto it
+		glm::vec3 position = balls.Position(i);
+		float margin = balls.Radius(i) * LOST_MARGIN;
+		if (glm::any(glm::lessThan(position, box.min - margin)) || position.x > box.max.x + margin || position.y > box.max.y + margin)
+		{
+			balls.Remove(i);
+			stats.lostBalls++;
+		}
+	}
+}
+
+void PhysicsWorld::collideBall(size_t ball, float dt)
+{
+	glm::vec3 position = balls.PreviousPosition(ball);
+	glm::vec3 motion = balls.Position(ball) - position;
+	glm::vec3 velocity = balls.Velocity(ball);
+	glm::vec3 angular = balls.AngularVelocity(ball);
+	float radius = balls.Radius(ball);
+	float elapsed = 0.0f;	// of the step, up to where position is
+	bool touched = false;
+	for (int i = 0; i < MAX_BOUNCES; i++)
+	{
+		SweepHit hit;
+		glm::vec3 surfaceVelocity(0.0f);
+		Sweep(position, motion, radius, hit);
+		sweepFlippers(position, motion, radius, elapsed, hit, surfaceVelocity);
+		if (!hit.Hit())
+		{
+			position += motion;
+			break;
+		}
+		touched = true;
+		stats.bounces++;
+
+		//Started inside, say a flipper swung into it: out first, then the bounce takes the flipper's speed
+		position = ContactPosition(position + motion * hit.time, radius, hit);
+		bounce(hit.normal, surfaceVelocity, radius, velocity, angular);
+
+		elapsed += (1.0f - elapsed) * hit.time;
+		motion = velocity * (dt * (1.0f - elapsed));
+	}
+	//Untouched balls already are where Integrate() put them
+	if (!touched)
+		return;
+	balls.SetPosition(ball, position);
+	balls.SetVelocity(ball, velocity);
+	balls.SetAngularVelocity(ball, angular);
+}
+
+glm::vec3 PhysicsWorld::moveBall(size_t ball, const glm::vec3 &target) const
+{
+	glm::vec3 position = balls.Position(ball);
+	glm::vec3 motion = target - position;
+	float radius = balls.Radius(ball);
+	SweepHit hit;
+	glm::vec3 surfaceVelocity(0.0f);
+	Sweep(position, motion, radius, hit);
+	//At the end of the step, the flippers stand at their current angle
+	sweepFlippers(position, motion, radius, 1.0f, hit, surfaceVelocity);
+	if (!hit.Hit())
+		return target;
+	//The ball keeps its velocity, the next step bounces it off what stopped it here
+	return ContactPosition(position + motion * hit.time, radius, hit);
+}
+
+bool PhysicsWorld::sweepFlippers(const glm::vec3 &center, const glm::vec3 &motion, float radius, float elapsed,
+	SweepHit &hit, glm::vec3 &surfaceVelocity) const
+{
+	bool found = false;
+	for (size_t i = 0; i < flippers.size(); i++)
+	{
+		const CollisionMesh &geometry = flipperGeometry[i];
+		if (geometry.TriangleCount() == 0)
+			continue;
+		//Far from the flipper's whole swing, whatever its angle
+		const Flipper &flipper = flippers[i];
+		glm::vec3 toPivot = flipper.pivot - center;
+		float along = glm::clamp(glm::dot(toPivot, motion) / glm::max(glm::dot(motion, motion), 1e-20f), 0.0f, 1.0f);
+		float reach = flipperReach[i] + radius;
+		glm::vec3 closest = toPivot - motion * along;
+		if (glm::dot(closest, closest) > reach * reach)
+			continue;
+
+		//In the flipper's own frame the flipper stands still and the ball moves from where it was relative to the
+		//flipper at the start to where it is at the end, the flipper's turn becomes part of the ball's motion
+		float before = glm::mix(previousAngles[i], flipper.angle, elapsed);
+		float after = flipper.angle;
+		glm::mat3 undoBefore(glm::rotate(glm::mat4(1.0f), -before, flipper.axis));
+		glm::mat3 undoAfter(glm::rotate(glm::mat4(1.0f), -after, flipper.axis));
+		glm::vec3 start = undoBefore * (center - flipper.pivot) + flipper.pivot;
+		glm::vec3 end = undoAfter * (center + motion - flipper.pivot) + flipper.pivot;
+		SweepHit local = hit;
+		if (!geometry.Sweep(start, end - start, radius, local))
+			continue;
+
+		//Back to world space at the angle of the contact
+		glm::mat3 turn(glm::rotate(glm::mat4(1.0f), glm::mix(before, after, local.time), flipper.axis));
+		hit = local;
+		hit.point = turn * (local.point - flipper.pivot) + flipper.pivot;
+		hit.normal = turn * local.normal;
+		float spin = flipper.angularVelocity * (flipper.upAngle < 0.0f ? -1.0f : 1.0f);
+		surfaceVelocity = glm::cross(flipper.axis * spin, hit.point - flipper.pivot);
+		found = true;
+	}
+	return found;
+}
+
+void PhysicsWorld::bounce(const glm::vec3 &normal, const glm::vec3 &surfaceVelocity, float radius, glm::vec3 &velocity,
+	glm::vec3 &angular)
+{
+	const BallSettings &settings = ballSettings;
+	glm::vec3 relative = velocity - surfaceVelocity;
+	float approach = glm::dot(relative, normal);
+	if (approach >= 0.0f)
+		return;
+	float restitution = -approach < settings.restingSpeed ? 0.0f : settings.restitution;
+	relative -= normal * ((1.0f + restitution) * approach);
+
+	//The ball's surface slides over the contact at its tangential velocity plus its spin. Stopping that slip on a solid
+	//sphere takes 2/7 of it off the center (the rest comes from the spin), friction allows at most friction * normal impulse.
+	glm::vec3 slip = relative - normal * glm::dot(relative, normal) + glm::cross(angular, -normal * radius);
+	float slipSpeed = glm::length(slip);
+	if (slipSpeed > 0.0f)
+	{
+		float change = std::min(slipSpeed * (2.0f / 7.0f), settings.friction * (1.0f + restitution) * -approach);
+		glm::vec3 direction = slip / slipSpeed;
+		relative -= direction * change;
+		angular += glm::cross(normal, direction) * (change * 2.5f / radius);
+	}
+	velocity = relative + surfaceVelocity;
+}
+
+void PhysicsWorld::SpawnBalls(size_t count, float radius)
+{
+	const BoundingBox &box = staticGeometry.Box();
+	if (box.Empty() || count == 0)
+		return;
+	//Middle 80% of the table, 3 radii apart
+	glm::vec3 low = glm::mix(box.min, box.max, 0.1f);
+	glm::vec3 high = glm::mix(box.min, box.max, 0.9f);
+	float spacing = radius * 3.0f;
+	size_t columns = std::max((size_t)1, (size_t)((high.x - low.x) / spacing));
+	size_t rows = std::max((size_t)1, (size_t)((high.y - low.y) / spacing));
+	mt19937 random(4321);
+	uniform_real_distribution<float> jitter(-1.0f, 1.0f);
+	//Carries on from the balls already there, so spawning more doesn't stack them on the first ones
+	for (size_t i = balls.Count(), last = balls.Count() + count; i < last; i++)
+	{
+		size_t column = i % columns, row = (i / columns) % rows, layer = i / (columns * rows);
+		glm::vec3 position(low.x + (column + 0.5f) * spacing, low.y + (row + 0.5f) * spacing, box.max.z + radius * 2.0f + layer * spacing);
+		glm::vec3 velocity = glm::vec3(jitter(random), jitter(random), 0.0f) * (radius * 10.0f);
+		balls.Add(position, velocity, radius);
+	}
+}
+
+void PhysicsWorld::BenchmarkBalls(const vector<size_t> &counts, float radius, ostream &out)
+{
+	//Long enough for the balls to land and spread out, then timed
+	const int SETTLE_STEPS = 500;
+	const int TIMED_STEPS = 1000;
+	const float DT = 0.001f;
+	if (staticGeometry.Box().Empty())
+		return;
+	BallSystem kept = balls;
+	Stats keptStats = stats;
+	out << "BALL BENCHMARK:: " << BROADPHASE_NAMES[broadphase] << ", radius " << radius << ", " << TIMED_STEPS << " steps of " << DT * 1000.0f << " ms" << endl;
+	for (size_t count : counts)
+	{
+		balls.Clear();
+		SpawnBalls(count, radius);
+		for (int i = 0; i < SETTLE_STEPS; i++)
+			Step(DT);
+		unsigned int bounces = stats.bounces, contacts = stats.ballContacts;
+		chrono::high_resolution_clock::time_point start = chrono::high_resolution_clock::now();
+		for (int i = 0; i < TIMED_STEPS; i++)
+			Step(DT);
+		double us = chrono::duration<double, micro>(chrono::high_resolution_clock::now() - start).count() / TIMED_STEPS;
+		char line[200];
+		snprintf(line, sizeof(line), "  %6zu balls %6zu left %10.2f us per step %8.3f us per ball, %u bounces %u ball contacts per step",
+			count, balls.Count(), us, us / std::max(balls.Count(), (size_t)1),
+			(stats.bounces - bounces) / TIMED_STEPS, (stats.ballContacts - contacts) / TIMED_STEPS);
+		out << line << endl;
+	}
+	balls = kept;
+	stats = keptStats;
+}
+
+void PhysicsWorld::BuildCollision(const string &cachePath)
+{
+	staticBvh.Build(staticGeometry, cachePath);
+	staticGrid.Build(staticGeometry);
+	for (size_t i = 0; i < flippers.size(); i++)
+	{
+		float reach = 0.0f;
+		for (const CollisionTriangle &triangle : flipperGeometry[i].Triangles())
+			reach = std::max(reach, glm::length(triangle.center - flippers[i].pivot) + triangle.radius);
+		flipperReach[i] = reach;
+	}
+}
+
+bool PhysicsWorld::Sweep(const glm::vec3 &center, const glm::vec3 &motion, float radius, SweepHit &hit) const
+{
+	if (broadphase == BROADPHASE_BVH && !staticBvh.Empty())
+		return staticBvh.Sweep(center, motion, radius, hit);
+	if (broadphase == BROADPHASE_GRID && !staticGrid.Empty())
+		return staticGrid.Sweep(center, motion, radius, hit);
+	return staticGeometry.Sweep(center, motion, radius, hit);
+}
+
+void PhysicsWorld::BenchmarkCollision(float radius, float maxTravel, ostream &out)
+{
+	//The same sweeps for all of them, made up front. Fixed seed so runs compare.
+	const size_t QUERIES = 200000;
+	const size_t BRUTE_FORCE_QUERIES = 2000;	// the loop over every triangle is too slow for all of them
+	const BoundingBox &box = staticGeometry.Box();
+	if (box.Empty())
+		return;
+	mt19937 random(1234);
+	uniform_real_distribution<float> unit(0.0f, 1.0f);
+	vector<glm::vec3> starts(QUERIES), motions(QUERIES);
+	for (size_t i = 0; i < QUERIES; i++)
+	{
+		starts[i] = box.min + (box.max - box.min) * glm::vec3(unit(random), unit(random), unit(random));
+		glm::vec3 direction = glm::vec3(unit(random), unit(random), unit(random)) * 2.0f - 1.0f;
+		float length = glm::length(direction);
+		motions[i] = length > 0.0f ? direction / length * maxTravel * unit(random) : glm::vec3(0.0f);
+	}
+
+	//Brute force first, it is what the others are checked against
+	Broadphase selected = broadphase;
+	vector<SweepHit> reference(BRUTE_FORCE_QUERIES);
+	vector<SweepHit> hits(QUERIES);
+	out << "COLLISION BENCHMARK:: " << staticGeometry.TriangleCount() << " triangles, radius " << radius << ", travel up to " << maxTravel << endl;
+	for (int mode = BROADPHASE_COUNT - 1; mode >= 0; mode--)
+	{
+		broadphase = (Broadphase)mode;
+		size_t queries = mode == BROADPHASE_NONE ? std::min(BRUTE_FORCE_QUERIES, QUERIES) : QUERIES;
+		chrono::high_resolution_clock::time_point start = chrono::high_resolution_clock::now();
+		for (size_t i = 0; i < queries; i++)
+		{
+			hits[i] = SweepHit();
+			Sweep(starts[i], motions[i], radius, hits[i]);
+		}
+		double seconds = chrono::duration<double>(chrono::high_resolution_clock::now() - start).count();
+
+		size_t hitCount = 0, mismatches = 0;
+		for (size_t i = 0; i < BRUTE_FORCE_QUERIES; i++)
+		{
+			if (mode == BROADPHASE_NONE)
+				reference[i] = hits[i];
+			hitCount += hits[i].Hit() ? 1 : 0;
+			//Ties between triangles may pick another one, the time has to agree
+			mismatches += hits[i].Hit() != reference[i].Hit() || fabs(hits[i].time - reference[i].time) > 1e-5f ? 1 : 0;
+		}
+		char line[200];
+		snprintf(line, sizeof(line), "  %-15s %10.0f queries/s, %zu of the first %zu sweeps hit, %zu disagree with brute force",
+			BROADPHASE_NAMES[mode], queries / std::max(seconds, 1e-9), hitCount, BRUTE_FORCE_QUERIES, mismatches);
+		out << line << endl;
+	}
+	broadphase = selected;
+}
+
+glm::mat4 PhysicsWorld::FlipperTransform(size_t flipper, float alpha) const
+{
+	const Flipper &current = flippers[flipper];
+	float angle = glm::mix(previousAngles[flipper], current.angle, alpha);
+	glm::mat4 model = glm::translate(glm::mat4(1.0f), current.pivot);
+	model = glm::rotate(model, angle, current.axis);
+	return glm::translate(model, -current.pivot);
+}
+
+void PhysicsWorld::PrintStats(ostream &out) const
+{
+	out << "PHYSICS:: " << stats.steps << " steps in " << stats.totalMs << " ms, "
+		<< (stats.steps ? stats.totalMs * 1000.0 / stats.steps : 0.0) << " us per step, " << balls.Count() << " balls, " << stats.bounces << " bounces, "
+		<< stats.ballContacts << " ball contacts, " << stats.lostBalls << " balls lost" << endl;
+}
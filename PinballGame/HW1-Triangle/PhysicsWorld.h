@@ -0,0 +1,154 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <chrono>
+#include <ostream>
+#include <string>
+#include <vector>
+#include "BallSystem.h"
+#include "CollisionBvh.h"
+#include "CollisionMesh.h"
+#include "PlayfieldGrid.h"
+using namespace std;
+
+//What narrows a sweep down to the triangles near the ball
+enum Broadphase
+{
+	BROADPHASE_BVH = 0,		// 3D tree, CollisionBvh
+	BROADPHASE_GRID = 1,	// 2D grid over the playfield, PlayfieldGrid
+	BROADPHASE_NONE = 2,	// every triangle, for reference
+	BROADPHASE_COUNT
+};
+const char *const BROADPHASE_NAMES[] = { "BVH", "playfield grid", "none" };
+
+//A flipper swings about axis through pivot, between angle 0 (the pose it was modeled in) and upAngle
+struct Flipper
+{
+	glm::vec3 pivot;
+	glm::vec3 axis;
+	float upAngle;			// radians, the sign picks the direction it swings up in
+	float angle;
+	float angularVelocity;	// radians per second, towards upAngle is positive
+	bool pressed;
+};
+
+struct FlipperSettings
+{
+	float upAcceleration;	// radians per second squared while pressed
+	float downAcceleration;	// the return spring, while released
+	float maxSpeed;			// radians per second
+
+	//A full swing of ~60 degrees takes about 30 ms up and 60 ms back down
+	FlipperSettings(float upAcceleration = 4000.0f, float downAcceleration = 1000.0f, float maxSpeed = 40.0f)
+		: upAcceleration(upAcceleration), downAcceleration(downAcceleration), maxSpeed(maxSpeed) {}
+};
+
+//Lengths in world units per second, the defaults are for a table modeled in meters
+struct BallSettings
+{
+	glm::vec3 gravity;		// along the tilted table, world units per second squared
+	float restitution;		// bounce off the table and the flippers
+	float ballRestitution;	// bounce off another ball
+	float friction;			// Coulomb coefficient at the contact, what makes a ball roll
+	float restingSpeed;		// slower impacts don't bounce at all, keeps a resting ball from jittering
+	float angularDamping;	// per second, rolling resistance
+
+	//A 6.5 degree playfield, y runs up the table and +z faces the player
+	BallSettings(const glm::vec3 &gravity = glm::vec3(0.0f, -1.11f, -9.75f), float restitution = 0.5f,
+		float ballRestitution = 0.9f, float friction = 0.2f, float restingSpeed = 0.05f, float angularDamping = 0.1f)
+		: gravity(gravity), restitution(restitution), ballRestitution(ballRestitution), friction(friction),
+		restingSpeed(restingSpeed), angularDamping(angularDamping) {}
+};
+
+/// <summary>
+/// The simulated part of the table, stepped by a FixedTimestep. Everything that moves keeps its state after the last
+/// step and before it, so rendering can interpolate with the timestep's Alpha() instead of showing the newest state
+/// (which is up to a step ahead of the frame's time and would judder against the frame rate).
+/// Steps are meant to run at 1-2 kHz, so one must cost microseconds: no allocation, no GL, state in flat arrays.
+/// </summary>
+class PhysicsWorld
+{
+public:
+	PhysicsWorld();
+
+	//Returns the flipper's index
+	size_t AddFlipper(const glm::vec3 &pivot, const glm::vec3 &axis, float upAngle);
+	void SetFlipper(size_t flipper, bool pressed) { flippers[flipper].pressed = pressed; }
+	const Flipper& GetFlipper(size_t flipper) const { return flippers[flipper]; }
+	size_t FlipperCount() const { return flippers.size(); }
+
+	FlipperSettings flipperSettings;
+	BallSettings ballSettings;
+
+	//Triangles of a flipper in the pose it was modeled in, in world space. Fill it before BuildCollision().
+	CollisionMesh& FlipperGeometry(size_t flipper) { return flipperGeometry[flipper]; }
+
+	//Balls are added and removed directly, Step() drops the ones that leave the table
+	BallSystem& Balls() { return balls; }
+	const BallSystem& Balls() const { return balls; }
+	//Adds count balls in a grid over the table above the static geometry, after the balls already on it and layered
+	//if they don't fit in one.
+	//Fixed seed for the small random velocities they start with, so runs compare.
+	void SpawnBalls(size_t count, float radius);
+
+	//Triangles of everything that never moves, in world space. Fill it once after loading, then BuildCollision().
+	CollisionMesh& StaticGeometry() { return staticGeometry; }
+	const CollisionMesh& StaticGeometry() const { return staticGeometry; }
+	//Builds both broadphases over the static geometry, the tree is loaded from cachePath if it's there
+	void BuildCollision(const string &cachePath);
+	const CollisionBvh& StaticBvh() const { return staticBvh; }
+	const PlayfieldGrid& StaticGrid() const { return staticGrid; }
+
+	//Which one Sweep() goes through, can change at any time
+	void SetBroadphase(Broadphase broadphase) { this->broadphase = broadphase; }
+	Broadphase GetBroadphase() const { return broadphase; }
+
+	//First contact of a sphere moving through the static geometry, see CollisionMesh::Sweep
+	bool Sweep(const glm::vec3 &center, const glm::vec3 &motion, float radius, SweepHit &hit) const;
+
+	//Times the same random sweeps of radius, up to maxTravel long, through every broadphase and checks that they
+	//find the same contacts as the loop over every triangle
+	void BenchmarkCollision(float radius, float maxTravel, ostream &out);
+	//Times steps with each number of balls of radius on the table, the ones already there are put back after
+	void BenchmarkBalls(const vector<size_t> &counts, float radius, ostream &out);
+
+	//Takes steps steps of dt seconds each
+	void Simulate(int steps, float dt);
+	void Step(float dt);
+
+	//Model matrix of a flipper at alpha between the state before the last step (0) and after it (1)
+	glm::mat4 FlipperTransform(size_t flipper, float alpha) const;
+
+	struct Stats
+	{
+		unsigned int steps;
+		double totalMs;		// spent in Simulate()
+		unsigned int bounces;		// ball against the table or a flipper
+		unsigned int ballContacts;	// ball against ball
+		unsigned int lostBalls;		// left the table
+	};
+	const Stats& GetStats() const { return stats; }
+	void PrintStats(ostream &out) const;
+
+private:
+	void stepFlippers(float dt);
+	void stepBalls(float dt);
+	void collideBall(size_t ball, float dt);
+	//Moves ball straight towards target, stopping at the table or a flipper
+	glm::vec3 moveBall(size_t ball, const glm::vec3 &target) const;
+	bool sweepFlippers(const glm::vec3 &center, const glm::vec3 &motion, float radius, float elapsed, SweepHit &hit,
+		glm::vec3 &surfaceVelocity) const;
+	void bounce(const glm::vec3 &normal, const glm::vec3 &surfaceVelocity, float radius, glm::vec3 &velocity,
+		glm::vec3 &angular);
+
+	vector<Flipper> flippers;
+	vector<float> previousAngles;	// flipper angles before the last step
+	vector<CollisionMesh> flipperGeometry;
+	vector<float> flipperReach;		// farthest any flipper triangle gets from the pivot
+	BallSystem balls;
+	CollisionMesh staticGeometry;
+	CollisionBvh staticBvh;
+	PlayfieldGrid staticGrid;
+	Broadphase broadphase;
+	Stats stats;
+};
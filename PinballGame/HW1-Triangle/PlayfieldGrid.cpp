@@ -0,0 +1,139 @@
+#include "PlayfieldGrid.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+
+PlayfieldGrid::PlayfieldGrid() : origin(0.0f), inverseCellSize(1.0f), columns(0), rows(0)
+{
+	memset(&stats, 0, sizeof(stats));
+}
+
+void PlayfieldGrid::Build(const CollisionMesh &mesh, float cellSize)
+{
+	chrono::high_resolution_clock::time_point start = chrono::high_resolution_clock::now();
+	cellStart.clear();
+	entries.clear();
+	triangles.clear();
+	triangleIds.clear();
+	memset(&stats, 0, sizeof(stats));
+	columns = rows = 0;
+	const BoundingBox &box = mesh.Box();
+	if (box.Empty())
+		return;
+
+	//Footprint of the whole table, one cell per TRIANGLES_PER_CELL triangles if they were spread evenly
+	glm::vec2 size = glm::max(glm::vec2(box.max - box.min), glm::vec2(1e-6f));
+	if (cellSize <= 0.0f)
+		cellSize = sqrtf(size.x * size.y * TRIANGLES_PER_CELL / (float)mesh.TriangleCount());
+	cellSize = std::max(cellSize, std::max(size.x, size.y) / MAX_CELLS_PER_AXIS);
+	origin = glm::vec2(box.min);
+	inverseCellSize = 1.0f / cellSize;
+	columns = std::max(1, (int)ceilf(size.x * inverseCellSize));
+	rows = std::max(1, (int)ceilf(size.y * inverseCellSize));
+
+	//Cell ranges of every footprint, then a counting sort of the references into the cells
+	struct Footprint
+	{
+		int firstColumn, firstRow, lastColumn, lastRow;
+	};
+	vector<Footprint> footprints(mesh.TriangleCount());
+	cellStart.assign((size_t)columns * rows + 1, 0);
+	for (size_t i = 0; i < mesh.TriangleCount(); i++)
+	{
+		const CollisionTriangle &triangle = mesh.Triangle(i);
+		glm::vec2 a(triangle.a), b = a + glm::vec2(triangle.edge1), c = a + glm::vec2(triangle.edge2);
+		Footprint &footprint = footprints[i];
+		cellRange(glm::min(glm::min(a, b), c), glm::max(glm::max(a, b), c), footprint.firstColumn, footprint.firstRow,
+			footprint.lastColumn, footprint.lastRow);
+		for (int row = footprint.firstRow; row <= footprint.lastRow; row++)
+			for (int column = footprint.firstColumn; column <= footprint.lastColumn; column++)
+				cellStart[(size_t)row * columns + column + 1]++;
+	}
+	for (size_t cell = 0; cell < (size_t)columns * rows; cell++)
+	{
+		stats.maxPerCell = std::max(stats.maxPerCell, cellStart[cell + 1]);
+		cellStart[cell + 1] += cellStart[cell];
+	}
+
+	//Triangles in the order of their first cell
+	vector<uint32_t> order(mesh.TriangleCount());
+	for (size_t i = 0; i < order.size(); i++)
+		order[i] = (uint32_t)i;
+	stable_sort(order.begin(), order.end(), [&](uint32_t left, uint32_t right)
+	{
+		const Footprint &l = footprints[left], &r = footprints[right];
+		return l.firstRow != r.firstRow ? l.firstRow < r.firstRow : l.firstColumn < r.firstColumn;
+	});
+	triangles.resize(order.size());
+	triangleIds = order;
+	for (size_t i = 0; i < order.size(); i++)
+		triangles[i] = mesh.Triangle(order[i]);
+
+	entries.resize(cellStart.back());
+	vector<uint32_t> filled(cellStart.begin(), cellStart.end() - 1);
+	for (size_t i = 0; i < order.size(); i++)
+	{
+		const Footprint &footprint = footprints[order[i]];
+		Entry entry = { (uint32_t)i, (uint16_t)footprint.firstColumn, (uint16_t)footprint.firstRow };
+		for (int row = footprint.firstRow; row <= footprint.lastRow; row++)
+			for (int column = footprint.firstColumn; column <= footprint.lastColumn; column++)
+				entries[filled[(size_t)row * columns + column]++] = entry;
+	}
+
+	stats.columns = (unsigned int)columns;
+	stats.rows = (unsigned int)rows;
+	stats.entries = (unsigned int)entries.size();
+	stats.cellSize = cellSize;
+	stats.buildMs = chrono::duration<double, milli>(chrono::high_resolution_clock::now() - start).count();
+}
+
+void PlayfieldGrid::cellRange(const glm::vec2 &min, const glm::vec2 &max, int &firstColumn, int &firstRow, int &lastColumn, int &lastRow) const
+{
+	firstColumn = glm::clamp((int)floorf((min.x - origin.x) * inverseCellSize), 0, columns - 1);
+	firstRow = glm::clamp((int)floorf((min.y - origin.y) * inverseCellSize), 0, rows - 1);
+	lastColumn = glm::clamp((int)floorf((max.x - origin.x) * inverseCellSize), 0, columns - 1);
+	lastRow = glm::clamp((int)floorf((max.y - origin.y) * inverseCellSize), 0, rows - 1);
+}
+
+bool PlayfieldGrid::Sweep(const glm::vec3 &center, const glm::vec3 &motion, float radius, SweepHit &hit) const
+{
+	if (entries.empty())
+		return false;
+
+	//Footprint of the swept sphere, nothing to do if it misses the grid
+	glm::vec2 start(center), end = start + glm::vec2(motion) * hit.time;
+	glm::vec2 min = glm::min(start, end) - radius, max = glm::max(start, end) + radius;
+	glm::vec2 gridMax = origin + glm::vec2((float)columns, (float)rows) / inverseCellSize;
+	if (max.x < origin.x || max.y < origin.y || min.x > gridMax.x || min.y > gridMax.y)
+		return false;
+	int firstColumn, firstRow, lastColumn, lastRow;
+	cellRange(min, max, firstColumn, firstRow, lastColumn, lastRow);
+
+	bool found = false;
+	for (int row = firstRow; row <= lastRow; row++)
+		for (int column = firstColumn; column <= lastColumn; column++)
+		{
+			size_t cell = (size_t)row * columns + column;
+			for (uint32_t i = cellStart[cell]; i < cellStart[cell + 1]; i++)
+			{
+				//Only in the first cell both the triangle and the query cover
+				const Entry &entry = entries[i];
+				if (std::max((int)entry.column, firstColumn) != column || std::max((int)entry.row, firstRow) != row)
+					continue;
+				if (CollisionMesh::SweepTriangle(triangles[entry.triangle], center, motion, radius, hit))
+				{
+					hit.triangle = triangleIds[entry.triangle];
+					found = true;
+				}
+			}
+		}
+	return found;
+}
+
+void PlayfieldGrid::PrintStats(ostream &out) const
+{
+	out << "PLAYFIELD GRID:: " << stats.columns << "x" << stats.rows << " cells of " << stats.cellSize << ", " << stats.entries
+		<< " triangle references, at most " << stats.maxPerCell << " in one cell, built in " << stats.buildMs << " ms" << endl;
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <cstdint>
+#include <ostream>
+#include <vector>
+#include "CollisionMesh.h"
+using namespace std;
+
+/// <summary>
+/// Broadphase for a table that is mostly one plane: a uniform grid over the playfield (the xy plane, the table faces +z)
+/// where every cell lists the triangles whose footprint overlaps it. A sweep only looks at the cells under its own
+/// footprint, which for a ball moving a centimeter per step is one to four cells. Cells are stored back to back
+/// (start offsets plus one entry array) and the triangles are copied in the order of their first cell, so neighbouring
+/// cells read neighbouring memory. A triangle spanning several cells is only tested in the first of them the query
+/// covers, which needs no per query scratch: queries stay const and allocation free.
+/// </summary>
+class PlayfieldGrid
+{
+public:
+	static const int TRIANGLES_PER_CELL = 4;	// what the automatic cell size aims for
+	static const int MAX_CELLS_PER_AXIS = 4096;
+
+	PlayfieldGrid();
+
+	//Buckets the triangles of mesh, which must outlive the grid. cellSize 0 picks one from the triangle density.
+	void Build(const CollisionMesh &mesh, float cellSize = 0.0f);
+
+	//Same contract as CollisionMesh::Sweep, hit.triangle is the mesh's index
+	bool Sweep(const glm::vec3 &center, const glm::vec3 &motion, float radius, SweepHit &hit) const;
+
+	bool Empty() const { return entries.empty(); }
+
+	struct Stats
+	{
+		unsigned int columns, rows;
+		unsigned int entries;		// triangle references over all cells
+		unsigned int maxPerCell;
+		float cellSize;
+		double buildMs;
+	};
+	const Stats& GetStats() const { return stats; }
+	void PrintStats(ostream &out) const;
+
+private:
+	//A triangle in a cell, with the first cell of its footprint for the duplicate check
+	struct Entry
+	{
+		uint32_t triangle;	// into triangles
+		uint16_t column;
+		uint16_t row;
+	};
+
+	void cellRange(const glm::vec2 &min, const glm::vec2 &max, int &firstColumn, int &firstRow, int &lastColumn, int &lastRow) const;
+
+	glm::vec2 origin;
+	float inverseCellSize;
+	int columns, rows;
+	vector<uint32_t> cellStart;		// columns * rows + 1 offsets into entries, row major
+	vector<Entry> entries;
+	vector<CollisionTriangle> triangles;	// the mesh's, ordered by first cell
+	vector<uint32_t> triangleIds;		// mesh index of each
+	Stats stats;
+};
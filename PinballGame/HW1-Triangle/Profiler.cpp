@@ -0,0 +1,312 @@
+#include "Profiler.h"
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+Profiler& Profiler::Shared()
+{
+	static Profiler profiler;
+	return profiler;
+}
+
+Profiler::Profiler() : origin(chrono::high_resolution_clock::now()), currentFrame(-1), frameCount(0), openGpuSection(-1),
+	averagedFrames(0), captureFrames(0), droppedQueries(0)
+{
+	for (int i = 0; i < FRAME_LATENCY; i++)
+	{
+		frames[i].pending = false;
+		frames[i].startUs = frames[i].endUs = 0;
+		frames[i].queriesUsed = 0;
+	}
+	track("Frame", 0);
+}
+
+#pragma region Recording
+void Profiler::BeginFrame()
+{
+	if (currentFrame >= 0)
+		EndFrame();
+
+	//The slot's previous frame was issued FRAME_LATENCY frames ago, its queries are normally done by now
+	int slot = frameCount % FRAME_LATENCY;
+	FrameRecord &frame = frames[slot];
+	if (frame.pending)
+		resolve(frame);
+
+	frame.pending = true;
+	frame.startUs = nowUs();
+	frame.endUs = frame.startUs;
+	frame.sections.clear();
+	frame.queriesUsed = 0;
+	currentFrame = slot;
+	frameCount++;
+	openSections.clear();
+	openGpuSection = -1;
+}
+
+void Profiler::EndFrame()
+{
+	if (currentFrame < 0)
+		return;
+	//Sections left open end with the frame
+	if (!openSections.empty())
+		End(openSections.front());
+	frames[currentFrame].endUs = nowUs();
+	currentFrame = -1;
+}
+
+void Profiler::Flush()
+{
+	if (currentFrame >= 0)
+		EndFrame();
+	glFinish();
+	//Oldest first, the slot after the newest frame
+	for (int i = 0; i < FRAME_LATENCY; i++)
+	{
+		FrameRecord &frame = frames[(frameCount + i) % FRAME_LATENCY];
+		if (frame.pending)
+			resolve(frame);
+	}
+}
+
+int Profiler::Begin(const char *name, bool gpu)
+{
+	if (currentFrame < 0)
+		return -1;
+	FrameRecord &frame = frames[currentFrame];
+
+	Section section;
+	section.depth = (int)openSections.size();
+	section.track = track(name, section.depth);
+	section.query = -1;
+	section.gpuMs = -1.0;
+	int index = (int)frame.sections.size();
+
+	if (gpu && openGpuSection < 0)
+	{
+		if (frame.queriesUsed == frame.queries.size())
+		{
+			GLuint query;
+			glGenQueries(1, &query);
+			frame.queries.push_back(query);
+		}
+		section.query = (int)frame.queriesUsed++;
+		glBeginQuery(GL_TIME_ELAPSED, frame.queries[section.query]);
+		openGpuSection = index;
+	}
+
+	section.startUs = nowUs();
+	section.endUs = section.startUs;
+	frame.sections.push_back(section);
+	openSections.push_back(index);
+	return index;
+}
+
+void Profiler::End(int section)
+{
+	if (currentFrame < 0 || section < 0)
+		return;
+	bool open = false;
+	for (size_t i = 0; i < openSections.size() && !open; i++)
+		open = openSections[i] == section;
+	if (!open)
+		return;
+
+	//Anything opened inside it and not closed yet ends here too
+	FrameRecord &frame = frames[currentFrame];
+	int64_t now = nowUs();
+	int closed;
+	do
+	{
+		closed = openSections.back();
+		openSections.pop_back();
+		frame.sections[closed].endUs = now;
+		if (closed == openGpuSection)
+		{
+			glEndQuery(GL_TIME_ELAPSED);
+			openGpuSection = -1;
+		}
+	} while (closed != section);
+}
+
+int64_t Profiler::nowUs() const
+{
+	return chrono::duration_cast<chrono::microseconds>(chrono::high_resolution_clock::now() - origin).count();
+}
+
+int Profiler::track(const char *name, int depth)
+{
+	for (size_t i = 0; i < tracks.size(); i++)
+		if (tracks[i].name == name || strcmp(tracks[i].name, name) == 0)
+			return (int)i;
+
+	Track added;
+	added.name = name;
+	added.depth = depth;
+	//-1 marks frames from before the section existed, they don't count towards its average
+	for (int i = 0; i < AVERAGE_FRAMES; i++)
+		added.cpuMs[i] = added.gpuMs[i] = -1.0;
+	tracks.push_back(added);
+	Average average = { name, depth, 0.0, -1.0 };
+	averages.push_back(average);
+	return (int)tracks.size() - 1;
+}
+#pragma endregion
+
+#pragma region Read back
+void Profiler::resolve(FrameRecord &frame)
+{
+	int64_t now = nowUs();
+	for (size_t i = 0; i < frame.sections.size(); i++)
+	{
+		Section &section = frame.sections[i];
+		if (section.query < 0)
+			continue;
+		GLuint query = frame.queries[section.query];
+		GLuint available = GL_FALSE;
+		glGetQueryObjectuiv(query, GL_QUERY_RESULT_AVAILABLE, &available);
+		if (!available)
+		{
+			droppedQueries++;
+			continue;
+		}
+		GLuint64 nanoseconds = 0;
+		glGetQueryObjectui64v(query, GL_QUERY_RESULT, &nanoseconds);
+		//Can't have taken longer than it's been since it was issued, software renderers sometimes report garbage
+		double gpuMs = nanoseconds / 1.0e6;
+		section.gpuMs = gpuMs <= (now - section.startUs) / 1000.0 ? gpuMs : -1.0;
+	}
+	frame.pending = false;
+
+	updateAverages(frame);
+	if (captureFrames > 0)
+	{
+		capture(frame);
+		if (--captureFrames == 0)
+			StopCapture();
+	}
+}
+
+void Profiler::updateAverages(const FrameRecord &frame)
+{
+	int column = averagedFrames % AVERAGE_FRAMES;
+	averagedFrames++;
+
+	//Sections that didn't run this frame cost nothing on the CPU and have no GPU time
+	for (size_t t = 0; t < tracks.size(); t++)
+	{
+		tracks[t].cpuMs[column] = 0.0;
+		tracks[t].gpuMs[column] = -1.0;
+	}
+	tracks[0].cpuMs[column] = (frame.endUs - frame.startUs) / 1000.0;
+
+	bool gpuComplete = true;
+	double frameGpuMs = 0.0;
+	for (size_t i = 0; i < frame.sections.size(); i++)
+	{
+		const Section &section = frame.sections[i];
+		Track &track = tracks[section.track];
+		track.cpuMs[column] += (section.endUs - section.startUs) / 1000.0;
+		if (section.query < 0)
+			continue;
+		if (section.gpuMs < 0.0)
+		{
+			gpuComplete = false;
+			continue;
+		}
+		track.gpuMs[column] = (track.gpuMs[column] < 0.0 ? 0.0 : track.gpuMs[column]) + section.gpuMs;
+		frameGpuMs += section.gpuMs;
+	}
+	tracks[0].gpuMs[column] = gpuComplete ? frameGpuMs : -1.0;
+
+	for (size_t t = 0; t < tracks.size(); t++)
+	{
+		double cpuSum = 0.0, gpuSum = 0.0;
+		int cpuSamples = 0, gpuSamples = 0;
+		for (int i = 0; i < AVERAGE_FRAMES; i++)
+		{
+			if (tracks[t].cpuMs[i] >= 0.0)
+			{
+				cpuSum += tracks[t].cpuMs[i];
+				cpuSamples++;
+			}
+			if (tracks[t].gpuMs[i] >= 0.0)
+			{
+				gpuSum += tracks[t].gpuMs[i];
+				gpuSamples++;
+			}
+		}
+		averages[t].cpuMs = cpuSamples ? cpuSum / cpuSamples : 0.0;
+		averages[t].gpuMs = gpuSamples ? gpuSum / gpuSamples : -1.0;
+	}
+}
+#pragma endregion
+
+#pragma region Chrome trace
+void Profiler::StartCapture(const string &path, int frameCount)
+{
+	capturePath = path;
+	captureFrames = frameCount;
+	captureEvents.clear();
+}
+
+void Profiler::capture(const FrameRecord &frame)
+{
+	//"X" events are complete spans: start and duration in microseconds. Thread 1 is the CPU, thread 2 the GPU.
+	char event[256];
+	snprintf(event, sizeof(event), "%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":1,\"ts\":%lld,\"dur\":%lld}",
+		captureEvents.empty() ? "" : ",\n", tracks[0].name, (long long)frame.startUs, (long long)(frame.endUs - frame.startUs));
+	captureEvents += event;
+	for (size_t i = 0; i < frame.sections.size(); i++)
+	{
+		const Section &section = frame.sections[i];
+		const char *name = tracks[section.track].name;
+		snprintf(event, sizeof(event), ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":1,\"ts\":%lld,\"dur\":%lld}",
+			name, (long long)section.startUs, (long long)(section.endUs - section.startUs));
+		captureEvents += event;
+		if (section.gpuMs >= 0.0)
+		{
+			snprintf(event, sizeof(event), ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":2,\"ts\":%lld,\"dur\":%.3f}",
+				name, (long long)section.startUs, section.gpuMs * 1000.0);
+			captureEvents += event;
+		}
+	}
+}
+
+void Profiler::StopCapture()
+{
+	captureFrames = 0;
+	if (capturePath.empty())
+		return;
+
+	ofstream file(capturePath);
+	if (!file)
+		cout << "ERROR::PROFILER::COULD_NOT_WRITE " << capturePath << endl;
+	else
+	{
+		file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n"
+			<< "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":1,\"args\":{\"name\":\"CPU\"}},\n"
+			<< "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":2,\"args\":{\"name\":\"GPU\"}}"
+			<< (captureEvents.empty() ? "" : ",\n") << captureEvents << "\n]}\n";
+		cout << "PROFILER:: trace written to " << capturePath << endl;
+	}
+	capturePath.clear();
+	captureEvents.clear();
+}
+#pragma endregion
+
+void Profiler::Release()
+{
+	if (currentFrame >= 0)
+		EndFrame();
+	for (int i = 0; i < FRAME_LATENCY; i++)
+	{
+		if (!frames[i].queries.empty())
+			glDeleteQueries((GLsizei)frames[i].queries.size(), frames[i].queries.data());
+		frames[i].queries.clear();
+		frames[i].queriesUsed = 0;
+		frames[i].pending = false;
+	}
+}
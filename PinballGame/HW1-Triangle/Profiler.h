@@ -0,0 +1,131 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+using namespace std;
+
+/// <summary>
+/// Where a frame's time goes. Sections opened with Begin()/End() (or a ProfileScope) are timed on the CPU with the
+/// high resolution clock and, unless they sit inside another GPU timed section, on the GPU with a GL_TIME_ELAPSED query
+/// (those can't nest). Every frame has its own set of queries in a ring of FRAME_LATENCY frames and is only read back
+/// when its slot comes around again; a result that still isn't there is dropped instead of waited for, so profiling
+/// never stalls the pipeline. Finished frames feed rolling averages over AVERAGE_FRAMES frames, for ProfilerOverlay,
+/// and can be captured into a chrome://tracing JSON file.
+/// </summary>
+class Profiler
+{
+public:
+	static const int FRAME_LATENCY = 4;		// frames between issuing a query and reading it back
+	static const int AVERAGE_FRAMES = 60;	// window of the rolling averages
+
+	static Profiler& Shared();
+
+	//Brackets one frame, sections outside of them are ignored
+	void BeginFrame();
+	void EndFrame();
+
+	//Opens a section named by a string literal (the pointer is kept), returns the handle for End()
+	int Begin(const char *name, bool gpu = true);
+	void End(int section);
+
+	//Rolling average of one section over the last AVERAGE_FRAMES finished frames, sections of the same name summed per frame.
+	//The first entry is the whole frame, its GPU time is the sum of the outermost GPU timed sections.
+	struct Average
+	{
+		const char *name;
+		int depth;		// nesting level the section was first seen at
+		double cpuMs;
+		double gpuMs;	// -1 while no GPU time has come back
+	};
+	const vector<Average>& Averages() const { return averages; }
+
+	//Waits for the GPU and reads back every frame still in the ring, at shutdown so the last frames aren't lost
+	void Flush();
+
+	//Records the next frameCount finished frames and writes them to path as a chrome://tracing file.
+	//GPU sections are drawn on their own track, starting where the CPU issued them (GL_TIME_ELAPSED has no start time).
+	void StartCapture(const string &path, int frameCount);
+	bool Capturing() const { return captureFrames > 0; }
+	//Writes whatever was captured so far
+	void StopCapture();
+
+	//GPU results that weren't ready when their frame was read back
+	unsigned int DroppedQueries() const { return droppedQueries; }
+
+	//Deletes the queries, needs the context
+	void Release();
+
+private:
+	Profiler();
+	Profiler(const Profiler&) = delete;
+	Profiler& operator=(const Profiler&) = delete;
+
+	struct Section
+	{
+		int track;			// index into tracks
+		int depth;
+		int64_t startUs;	// since the profiler was created
+		int64_t endUs;
+		int query;			// index into the frame's queries, -1 if not GPU timed
+		double gpuMs;
+	};
+
+	struct FrameRecord
+	{
+		bool pending;		// issued, not read back yet
+		int64_t startUs;
+		int64_t endUs;
+		vector<Section> sections;
+		vector<GLuint> queries;	// grown on demand, reused every FRAME_LATENCY frames
+		size_t queriesUsed;
+	};
+
+	//Per section name history for the averages
+	struct Track
+	{
+		const char *name;
+		int depth;
+		double cpuMs[AVERAGE_FRAMES];
+		double gpuMs[AVERAGE_FRAMES];	// -1 for frames without a GPU time
+	};
+
+	int64_t nowUs() const;
+	int track(const char *name, int depth);
+	//Reads back the frame's queries without waiting and hands the frame to the averages and the capture
+	void resolve(FrameRecord &frame);
+	void updateAverages(const FrameRecord &frame);
+	void capture(const FrameRecord &frame);
+
+	chrono::high_resolution_clock::time_point origin;
+	FrameRecord frames[FRAME_LATENCY];
+	int currentFrame;			// slot of the frame being recorded, -1 outside BeginFrame/EndFrame
+	unsigned int frameCount;	// frames begun so far
+	vector<int> openSections;	// indices into the current frame's sections
+	int openGpuSection;			// the section holding the active GL_TIME_ELAPSED query, -1 if none
+
+	vector<Track> tracks;		// 0 is the whole frame
+	unsigned int averagedFrames;
+	vector<Average> averages;
+
+	string capturePath;
+	int captureFrames;			// frames still to capture
+	string captureEvents;		// trace events written so far, comma separated
+	unsigned int droppedQueries;
+};
+
+//Times the enclosing block as a Profiler section
+class ProfileScope
+{
+public:
+	explicit ProfileScope(const char *name, bool gpu = true) : section(Profiler::Shared().Begin(name, gpu)) {}
+	~ProfileScope() { Profiler::Shared().End(section); }
+
+private:
+	ProfileScope(const ProfileScope&) = delete;
+	ProfileScope& operator=(const ProfileScope&) = delete;
+
+	int section;
+};
@@ -0,0 +1,197 @@
+#include "ProfilerOverlay.h"
+
+#include <cctype>
+#include <cstdio>
+#include <cstring>
+#include "GeometryBuffer.h"
+
+namespace
+{
+	//Glyphs in atlas order, 7 rows of 5 bits each (bit 4 is the leftmost pixel)
+	const char FONT_CHARACTERS[] = " 0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ.:-/%()_";
+	const unsigned char FONT_ROWS[][7] = {
+		{ 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 },	// space
+		{ 0x0E, 0x11, 0x13, 0x15, 0x19, 0x11, 0x0E },	// 0
+		{ 0x04, 0x0C, 0x04, 0x04, 0x04, 0x04, 0x0E },	// 1
+		{ 0x0E, 0x11, 0x01, 0x02, 0x04, 0x08, 0x1F },	// 2
+		{ 0x1F, 0x02, 0x04, 0x02, 0x01, 0x11, 0x0E },	// 3
+		{ 0x02, 0x06, 0x0A, 0x12, 0x1F, 0x02, 0x02 },	// 4
+		{ 0x1F, 0x10, 0x1E, 0x01, 0x01, 0x11, 0x0E },	// 5
+		{ 0x06, 0x08, 0x10, 0x1E, 0x11, 0x11, 0x0E },	// 6
+		{ 0x1F, 0x01, 0x02, 0x04, 0x08, 0x08, 0x08 },	// 7
+		{ 0x0E, 0x11, 0x11, 0x0E, 0x11, 0x11, 0x0E },	// 8
+		{ 0x0E, 0x11, 0x11, 0x0F, 0x01, 0x02, 0x0C },	// 9
+		{ 0x0E, 0x11, 0x11, 0x11, 0x1F, 0x11, 0x11 },	// A
+		{ 0x1E, 0x11, 0x11, 0x1E, 0x11, 0x11, 0x1E },	// B
+		{ 0x0E, 0x11, 0x10, 0x10, 0x10, 0x11, 0x0E },	// C
+		{ 0x1C, 0x12, 0x11, 0x11, 0x11, 0x12, 0x1C },	// D
+		{ 0x1F, 0x10, 0x10, 0x1E, 0x10, 0x10, 0x1F },	// E
+		{ 0x1F, 0x10, 0x10, 0x1E, 0x10, 0x10, 0x10 },	// F
+		{ 0x0E, 0x11, 0x10, 0x17, 0x11, 0x11, 0x0F },	// G
+		{ 0x11, 0x11, 0x11, 0x1F, 0x11, 0x11, 0x11 },	// H
+		{ 0x0E, 0x04, 0x04, 0x04, 0x04, 0x04, 0x0E },	// I
+		{ 0x07, 0x02, 0x02, 0x02, 0x02, 0x12, 0x0C },	// J
+		{ 0x11, 0x12, 0x14, 0x18, 0x14, 0x12, 0x11 },	// K
+		{ 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x1F },	// L
+		{ 0x11, 0x1B, 0x15, 0x15, 0x11, 0x11, 0x11 },	// M
+		{ 0x11, 0x11, 0x19, 0x15, 0x13, 0x11, 0x11 },	// N
+		{ 0x0E, 0x11, 0x11, 0x11, 0x11, 0x11, 0x0E },	// O
+		{ 0x1E, 0x11, 0x11, 0x1E, 0x10, 0x10, 0x10 },	// P
+		{ 0x0E, 0x11, 0x11, 0x11, 0x15, 0x12, 0x0D },	// Q
+		{ 0x1E, 0x11, 0x11, 0x1E, 0x14, 0x12, 0x11 },	// R
+		{ 0x0F, 0x10, 0x10, 0x0E, 0x01, 0x01, 0x1E },	// S
+		{ 0x1F, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04 },	// T
+		{ 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x0E },	// U
+		{ 0x11, 0x11, 0x11, 0x11, 0x11, 0x0A, 0x04 },	// V
+		{ 0x11, 0x11, 0x11, 0x15, 0x15, 0x15, 0x0A },	// W
+		{ 0x11, 0x11, 0x0A, 0x04, 0x0A, 0x11, 0x11 },	// X
+		{ 0x11, 0x11, 0x11, 0x0A, 0x04, 0x04, 0x04 },	// Y
+		{ 0x1F, 0x01, 0x02, 0x04, 0x08, 0x10, 0x1F },	// Z
+		{ 0x00, 0x00, 0x00, 0x00, 0x00, 0x0C, 0x0C },	// .
+		{ 0x00, 0x0C, 0x0C, 0x00, 0x0C, 0x0C, 0x00 },	// :
+		{ 0x00, 0x00, 0x00, 0x1F, 0x00, 0x00, 0x00 },	// -
+		{ 0x00, 0x01, 0x02, 0x04, 0x08, 0x10, 0x00 },	// /
+		{ 0x18, 0x19, 0x02, 0x04, 0x08, 0x13, 0x03 },	// %
+		{ 0x02, 0x04, 0x08, 0x08, 0x08, 0x04, 0x02 },	// (
+		{ 0x08, 0x04, 0x02, 0x02, 0x02, 0x04, 0x08 },	// )
+		{ 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x1F },	// _
+	};
+	const int FONT_GLYPHS = sizeof(FONT_ROWS) / sizeof(FONT_ROWS[0]);
+	static_assert(sizeof(FONT_CHARACTERS) - 1 == sizeof(FONT_ROWS) / sizeof(FONT_ROWS[0]), "one bitmap per font character");
+
+	//Atlas cells are a pixel wider and taller than the glyphs, that's the spacing between characters and lines
+	const int CELL_WIDTH = 6;
+	const int CELL_HEIGHT = 8;
+	const float PIXEL_SCALE = 2.0f;
+	const float MARGIN = 8.0f;
+	const int FONT_TEXTURE_UNIT = 12;	// out of the way of the material (0-2) and light cluster (13-15) units
+
+	int glyphIndex(char character)
+	{
+		const char *found = strchr(FONT_CHARACTERS, toupper((unsigned char)character));
+		return found && character ? (int)(found - FONT_CHARACTERS) : 0;
+	}
+}
+
+ProfilerOverlay::ProfilerOverlay() : shader("ProfilerOverlay.vert", "ProfilerOverlay.frag")
+{
+	//Font atlas: every glyph in its own cell, side by side
+	int atlasWidth = FONT_GLYPHS * CELL_WIDTH;
+	vector<unsigned char> atlas((size_t)atlasWidth * CELL_HEIGHT, 0);
+	for (int glyph = 0; glyph < FONT_GLYPHS; glyph++)
+		for (int row = 0; row < 7; row++)
+			for (int column = 0; column < 5; column++)
+				if (FONT_ROWS[glyph][row] & (0x10 >> column))
+					atlas[(size_t)row * atlasWidth + glyph * CELL_WIDTH + column] = 255;
+
+	glGenTextures(1, &fontTexture);
+	glActiveTexture(GL_TEXTURE0 + FONT_TEXTURE_UNIT);
+	glBindTexture(GL_TEXTURE_2D, fontTexture);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, atlasWidth, CELL_HEIGHT, 0, GL_RED, GL_UNSIGNED_BYTE, atlas.data());
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glActiveTexture(GL_TEXTURE0);
+
+	glGenVertexArrays(1, &VAO);
+	glGenBuffers(1, &VBO);
+	BindVertexArray(VAO);
+	glBindBuffer(GL_ARRAY_BUFFER, VBO);
+	glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)0);
+	glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(2 * sizeof(float)));
+	glVertexAttribPointer(2, 4, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(4 * sizeof(float)));
+	glEnableVertexAttribArray(0);
+	glEnableVertexAttribArray(1);
+	glEnableVertexAttribArray(2);
+
+	shader.StartPipelineProgram();
+	shader.setInt("font", FONT_TEXTURE_UNIT);
+}
+
+void ProfilerOverlay::Draw(const Profiler &profiler, int width, int height)
+{
+	const vector<Profiler::Average> &averages = profiler.Averages();
+	vector<string> lines;
+	lines.push_back("SECTION           CPU MS  GPU MS");
+	char line[96];
+	for (size_t i = 0; i < averages.size(); i++)
+	{
+		const Profiler::Average &average = averages[i];
+		int indent = average.depth * 2;
+		char gpu[16];
+		if (average.gpuMs >= 0.0)
+			snprintf(gpu, sizeof(gpu), "%7.2f", average.gpuMs);
+		else
+			snprintf(gpu, sizeof(gpu), "%7s", "-");
+		snprintf(line, sizeof(line), "%*s%-*.*s %7.2f %s", indent, "", 16 - indent, 16 - indent, average.name, average.cpuMs, gpu);
+		lines.push_back(line);
+	}
+
+	//Dark panel behind the text, then the text itself
+	vertices.clear();
+	size_t columns = 0;
+	for (size_t i = 0; i < lines.size(); i++)
+		columns = lines[i].size() > columns ? lines[i].size() : columns;
+	float cellWidth = CELL_WIDTH * PIXEL_SCALE, cellHeight = CELL_HEIGHT * PIXEL_SCALE;
+	addQuad(MARGIN, MARGIN, MARGIN * 2.0f + columns * cellWidth, MARGIN * 2.0f + lines.size() * cellHeight, -1.0f, -1.0f,
+		glm::vec4(0.0f, 0.0f, 0.0f, 0.6f));
+	for (size_t i = 0; i < lines.size(); i++)
+		addText(lines[i], MARGIN * 1.5f, MARGIN * 1.5f + i * cellHeight, i == 0 ? glm::vec4(1.0f, 0.8f, 0.3f, 1.0f) : glm::vec4(1.0f));
+
+	BindVertexArray(VAO);
+	glBindBuffer(GL_ARRAY_BUFFER, VBO);
+	glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(float), vertices.data(), GL_STREAM_DRAW);
+	glActiveTexture(GL_TEXTURE0 + FONT_TEXTURE_UNIT);
+	glBindTexture(GL_TEXTURE_2D, fontTexture);
+	glActiveTexture(GL_TEXTURE0);
+
+	shader.StartPipelineProgram();
+	shader.setVec2("screenSize", glm::vec2((float)width, (float)height));
+	glDisable(GL_DEPTH_TEST);
+	glEnable(GL_BLEND);
+	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+	glDrawArrays(GL_TRIANGLES, 0, (GLsizei)(vertices.size() / 8));
+	glDisable(GL_BLEND);
+	glEnable(GL_DEPTH_TEST);
+}
+
+void ProfilerOverlay::addText(const string &text, float x, float y, const glm::vec4 &color)
+{
+	float cellWidth = CELL_WIDTH * PIXEL_SCALE, cellHeight = CELL_HEIGHT * PIXEL_SCALE;
+	for (size_t i = 0; i < text.size(); i++)
+	{
+		int glyph = glyphIndex(text[i]);
+		if (glyph == 0)
+			continue; //space or a character the font doesn't have
+		float u0 = (float)glyph / FONT_GLYPHS, u1 = (float)(glyph + 1) / FONT_GLYPHS;
+		float left = x + i * cellWidth;
+		addQuad(left, y, left + cellWidth, y + cellHeight, u0, u1, color);
+	}
+}
+
+void ProfilerOverlay::addQuad(float x0, float y0, float x1, float y1, float u0, float u1, const glm::vec4 &color)
+{
+	//Atlas row 0 is the top of the glyphs, so v runs down with y
+	const float corners[6][4] = {
+		{ x0, y0, u0, 0.0f }, { x1, y0, u1, 0.0f }, { x1, y1, u1, 1.0f },
+		{ x0, y0, u0, 0.0f }, { x1, y1, u1, 1.0f }, { x0, y1, u0, 1.0f } };
+	for (int c = 0; c < 6; c++)
+	{
+		vertices.insert(vertices.end(), corners[c], corners[c] + 4);
+		vertices.push_back(color.r);
+		vertices.push_back(color.g);
+		vertices.push_back(color.b);
+		vertices.push_back(color.a);
+	}
+}
+
+void ProfilerOverlay::Release()
+{
+	glDeleteTextures(1, &fontTexture);
+	glDeleteBuffers(1, &VBO);
+	glDeleteVertexArrays(1, &VAO);
+	glDeleteProgram(shader.ID);
+}
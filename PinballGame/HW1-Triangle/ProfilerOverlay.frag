@@ -0,0 +1,15 @@
+#version 330 core
+out vec4 FragColor;
+
+in vec2 TexCoords;
+in vec4 Color;
+
+// one channel glyph atlas, see ProfilerOverlay.cpp
+uniform sampler2D font;
+
+void main()
+{
+	// negative u marks the background panel, it has no glyph
+	float coverage = TexCoords.x < 0.0 ? 1.0 : texture(font, TexCoords).r;
+	FragColor = vec4(Color.rgb, Color.a * coverage);
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <string>
+#include <vector>
+#include "Profiler.h"
+#include "Shader.h"
+using namespace std;
+
+/// <summary>
+/// Draws the Profiler's rolling averages as text in the top left corner, one line per section indented by nesting.
+/// Text uses a built in 5x7 pixel font (upper case, digits and a little punctuation, lower case is drawn upper case),
+/// so there's no font file to ship. Draw() goes last in the frame: it turns off depth testing and blends over the image.
+/// </summary>
+class ProfilerOverlay
+{
+public:
+	ProfilerOverlay();
+
+	//Draws the current averages over a framebuffer of width x height pixels
+	void Draw(const Profiler &profiler, int width, int height);
+
+	//Deletes the GL objects, needs the context
+	void Release();
+
+private:
+	ProfilerOverlay(const ProfilerOverlay&) = delete;
+	ProfilerOverlay& operator=(const ProfilerOverlay&) = delete;
+
+	//Appends the quads of one line of text, top left corner at x, y in pixels
+	void addText(const string &text, float x, float y, const glm::vec4 &color);
+	void addQuad(float x0, float y0, float x1, float y1, float u0, float u1, const glm::vec4 &color);
+
+	Shader shader;
+	unsigned int VAO, VBO;
+	unsigned int fontTexture;
+	vector<float> vertices;		// x, y, u, v, r, g, b, a per vertex, rebuilt every Draw
+};
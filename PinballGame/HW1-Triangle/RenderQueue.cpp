@@ -0,0 +1,295 @@
+#include "RenderQueue.h"
+
+#include <cstring>
+#include "Profiler.h"
+
+namespace
+{
+	const unsigned int NO_MATERIAL = 0xFFFFFFFFu;
+	const uint64_t DEPTH_MAX = (1u << 24) - 1;
+}
+
+RenderQueue::RenderQueue() : cameraPosition(0.0f), farPlane(100.0f), depthPrepass(false), depthShader(nullptr), instancedDepthShader(nullptr),
+	boundShader(nullptr), boundNormalMatrix(false), boundMaterial(NO_MATERIAL)
+{
+	memset(&stats, 0, sizeof(stats));
+}
+
+void RenderQueue::SetDepthShaders(const Shader &shader, const Shader &instancedShader)
+{
+	depthShader = &shader;
+	instancedDepthShader = &instancedShader;
+}
+
+void RenderQueue::SetCamera(const glm::vec3 &position, float farPlane)
+{
+	cameraPosition = position;
+	this->farPlane = farPlane;
+}
+
+void RenderQueue::Submit(RenderPass pass, const Shader &shader, const GeometryBuffer &geometry, const GeometryRange &range,
+	unsigned int material, const Transform &transform)
+{
+	DrawPacket packet;
+	packet.shader = &shader;
+	packet.geometry = &geometry;
+	packet.range = range;
+	packet.material = material;
+	packet.model = transform.Model();
+	packet.normal = transform.Normal();
+	packet.instances = nullptr;
+	packet.firstInstance = 0;
+	packet.instanceCount = 1;
+
+	//Opaque draws go front to back within a state bucket, so early z rejects what's hidden
+	float depth = glm::length(glm::vec3(packet.model[3]) - cameraPosition) / farPlane;
+	packet.key = MakeKey(pass, shader.ID, material, geometry.VertexArray(), depth);
+	packets.push_back(packet);
+}
+
+void RenderQueue::SubmitInstanced(RenderPass pass, const Shader &shader, const GeometryBuffer &geometry, const GeometryRange &range,
+	unsigned int material, InstanceBuffer &instances, size_t first, size_t count)
+{
+	if (count == 0)
+		return;
+	DrawPacket packet;
+	packet.shader = &shader;
+	packet.geometry = &geometry;
+	packet.range = range;
+	packet.material = material;
+	packet.model = instances.Get(first).model;
+	packet.instances = &instances;
+	packet.firstInstance = first;
+	packet.instanceCount = count;
+
+	//The batch is spread out, the first instance stands in for its depth
+	float depth = glm::length(glm::vec3(packet.model[3]) - cameraPosition) / farPlane;
+	packet.key = MakeKey(pass, shader.ID, material, geometry.VertexArray(), depth);
+	packets.push_back(packet);
+}
+
+uint64_t RenderQueue::MakeKey(unsigned int pass, unsigned int program, unsigned int material, unsigned int vertexArray, float depth)
+{
+	depth = depth < 0.0f ? 0.0f : (depth > 1.0f ? 1.0f : depth);
+	uint64_t depthBits = (uint64_t)(depth * DEPTH_MAX);
+	return ((uint64_t)(pass & 0xF) << 60) |
+		((uint64_t)(program & 0xFF) << 52) |
+		((uint64_t)(material & 0xFFFF) << 36) |
+		((uint64_t)(vertexArray & 0xFFF) << 24) |
+		depthBits;
+}
+
+void RenderQueue::RadixSort(vector<SortItem> &items, vector<SortItem> &scratch)
+{
+	size_t count = items.size();
+	if (count < 2)
+		return;
+	scratch.resize(count);
+
+	//All eight histograms in one pass over the keys
+	size_t histograms[8][256];
+	memset(histograms, 0, sizeof(histograms));
+	for (size_t i = 0; i < count; i++)
+		for (int b = 0; b < 8; b++)
+			histograms[b][(items[i].key >> (b * 8)) & 0xFF]++;
+
+	SortItem *source = items.data();
+	SortItem *destination = scratch.data();
+	for (int b = 0; b < 8; b++)
+	{
+		size_t *histogram = histograms[b];
+		//Every key has the same byte here, this pass wouldn't move anything
+		if (histogram[(source[0].key >> (b * 8)) & 0xFF] == count)
+			continue;
+
+		size_t offset = 0;
+		for (int v = 0; v < 256; v++)
+		{
+			size_t bucket = histogram[v];
+			histogram[v] = offset;
+			offset += bucket;
+		}
+		for (size_t i = 0; i < count; i++)
+			destination[histogram[(source[i].key >> (b * 8)) & 0xFF]++] = source[i];
+		swap(source, destination);
+	}
+
+	if (source != items.data())
+		memcpy(items.data(), source, count * sizeof(SortItem));
+}
+
+void RenderQueue::Execute()
+{
+	memset(&stats, 0, sizeof(stats));
+	boundShader = nullptr;
+	boundMaterial = NO_MATERIAL;
+	boundTextures.assign(boundTextures.size(), 0);
+
+	sortItems.resize(packets.size());
+	for (size_t i = 0; i < packets.size(); i++)
+	{
+		sortItems[i].key = packets[i].key;
+		sortItems[i].packet = (uint32_t)i;
+	}
+	RadixSort(sortItems, sortScratch);
+
+	bool prepassed = DepthPrepass();
+	if (prepassed)
+		executeDepthPrepass();
+
+	unsigned int boundVertexArray = 0;
+	unsigned int pass = ~0u;
+	int passSection = -1;
+	for (size_t i = 0; i < sortItems.size(); i++)
+	{
+		const DrawPacket &packet = packets[sortItems[i].packet];
+
+		//Passes are the top bits of the key, so each one is a single run of packets
+		unsigned int packetPass = (unsigned int)(packet.key >> 60);
+		if (packetPass != pass)
+		{
+			Profiler::Shared().End(passSection);
+			pass = packetPass;
+			//The opaque pass only shades what the pre-pass found visible, everything after it tests and writes depth as usual
+			if (prepassed)
+			{
+				glDepthFunc(pass == PASS_OPAQUE ? GL_EQUAL : GL_LESS);
+				glDepthMask(pass == PASS_OPAQUE ? GL_FALSE : GL_TRUE);
+			}
+			passSection = Profiler::Shared().Begin(pass < sizeof(RENDER_PASS_NAMES) / sizeof(RENDER_PASS_NAMES[0]) ? RENDER_PASS_NAMES[pass] : "Pass");
+		}
+
+		if (packet.shader != boundShader)
+		{
+			glUseProgram(packet.shader->ID);
+			boundShader = packet.shader;
+			boundNormalMatrix = packet.shader->Location(NORMAL_MATRIX_UNIFORM) >= 0; //unlit programs have none
+			boundMaterial = NO_MATERIAL; //sampler units are per program, the shader keeps what it has set
+			stats.programBinds++;
+		}
+		if (packet.material != boundMaterial)
+			bindMaterial(*packet.shader, packet.material);
+
+		if (!packet.instances)
+		{
+			packet.shader->setMat4(MODEL_UNIFORM, packet.model);
+			stats.uniformUploads++;
+			if (boundNormalMatrix)
+			{
+				packet.shader->setMat3(NORMAL_MATRIX_UNIFORM, packet.normal);
+				stats.uniformUploads++;
+			}
+		}
+
+		if (packet.geometry->VertexArray() != boundVertexArray)
+		{
+			packet.geometry->Bind();
+			boundVertexArray = packet.geometry->VertexArray();
+			stats.vertexArrayBinds++;
+		}
+		if (packet.instances)
+			packet.instances->Draw(*packet.geometry, packet.range, packet.firstInstance, packet.instanceCount);
+		else
+			glDrawElementsBaseVertex(GL_TRIANGLES, packet.range.indexCount, packet.range.indexType, packet.range.Indices(), packet.range.baseVertex);
+		stats.draws++;
+		stats.instances += (unsigned int)packet.instanceCount;
+	}
+	Profiler::Shared().End(passSection);
+	if (prepassed)
+	{
+		glDepthFunc(GL_LESS);
+		glDepthMask(GL_TRUE);
+	}
+
+	packets.clear();
+}
+
+void RenderQueue::executeDepthPrepass()
+{
+	//Regular draws before instanced ones so the program changes once, then by VAO, front to back within one.
+	//The opaque packets' vertex array and depth bits are the low 36 bits of their keys.
+	const uint64_t LOW_BITS = (1ull << 36) - 1;
+	depthItems.clear();
+	for (size_t i = 0; i < packets.size(); i++)
+	{
+		if ((packets[i].key >> 60) != PASS_OPAQUE)
+			continue;
+		SortItem item;
+		item.key = ((uint64_t)(packets[i].instances ? 1 : 0) << 36) | (packets[i].key & LOW_BITS);
+		item.packet = (uint32_t)i;
+		depthItems.push_back(item);
+	}
+	if (depthItems.empty())
+		return;
+	RadixSort(depthItems, sortScratch);
+
+	ProfileScope section("Depth pre-pass");
+	glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+	glDepthFunc(GL_LESS);
+	glDepthMask(GL_TRUE);
+
+	const Shader *bound = nullptr;
+	unsigned int boundVertexArray = 0;
+	for (size_t i = 0; i < depthItems.size(); i++)
+	{
+		const DrawPacket &packet = packets[depthItems[i].packet];
+		const Shader *shader = packet.instances ? instancedDepthShader : depthShader;
+		if (shader != bound)
+		{
+			glUseProgram(shader->ID);
+			bound = shader;
+			stats.programBinds++;
+		}
+
+		if (packet.instances)
+		{
+			packet.instances->Draw(*packet.geometry, packet.range, packet.firstInstance, packet.instanceCount, true);
+			boundVertexArray = packet.geometry->PositionArray();
+		}
+		else
+		{
+			shader->setMat4(MODEL_UNIFORM, packet.model);
+			stats.uniformUploads++;
+			if (packet.geometry->PositionArray() != boundVertexArray)
+			{
+				packet.geometry->BindPositions();
+				boundVertexArray = packet.geometry->PositionArray();
+				stats.vertexArrayBinds++;
+			}
+			glDrawElementsBaseVertex(GL_TRIANGLES, packet.range.indexCount, packet.range.indexType, packet.range.Indices(), packet.range.baseVertex);
+		}
+		stats.depthDraws++;
+	}
+	glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+}
+
+void RenderQueue::PrintStats(ostream &out) const
+{
+	out << "RENDER QUEUE:: " << stats.draws << " draws, " << stats.programBinds << " program binds, "
+		<< stats.textureBinds << " texture binds, " << stats.vertexArrayBinds << " VAO binds, "
+		<< stats.uniformUploads << " uniform uploads, " << stats.instances << " objects drawn";
+	if (stats.depthDraws)
+		out << ", " << stats.depthDraws << " depth pre-pass draws";
+	out << endl;
+}
+
+void RenderQueue::bindMaterial(const Shader &shader, unsigned int material)
+{
+	const Material &textures = MaterialTable::Shared().Get(material);
+	if (boundTextures.size() < textures.textures.size())
+		boundTextures.resize(textures.textures.size(), 0);
+
+	for (size_t unit = 0; unit < textures.textures.size(); unit++)
+	{
+		if (shader.setSampler(textures.samplers[unit], (int)unit))
+			stats.uniformUploads++;
+		if (boundTextures[unit] == textures.textures[unit])
+			continue;
+		glActiveTexture(GL_TEXTURE0 + (GLenum)unit);
+		glBindTexture(GL_TEXTURE_2D, textures.textures[unit]);
+		boundTextures[unit] = textures.textures[unit];
+		stats.textureBinds++;
+	}
+	glActiveTexture(GL_TEXTURE0);
+	boundMaterial = material;
+}
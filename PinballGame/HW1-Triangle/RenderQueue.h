@@ -0,0 +1,127 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <cstdint>
+#include <ostream>
+#include <vector>
+#include "GeometryBuffer.h"
+#include "InstanceBuffer.h"
+#include "MaterialTable.h"
+#include "Shader.h"
+#include "Transform.h"
+using namespace std;
+
+//Passes run in this order
+enum RenderPass
+{
+	PASS_OPAQUE = 0,	// lit geometry
+	PASS_EMISSIVE = 1,	// lamps and other unlit geometry drawn over the lit pass
+};
+
+//Profiler section of each pass
+const char *const RENDER_PASS_NAMES[] = { "Lit objects", "Lamps" };
+
+//One draw call waiting in the queue
+struct DrawPacket
+{
+	uint64_t key;
+	const Shader *shader;
+	const GeometryBuffer *geometry;
+	GeometryRange range;
+	unsigned int material;		// MaterialTable id
+	glm::mat4 model;			// unused by instanced packets, their transforms are in the instance buffer
+	glm::mat3 normal;			// the model's normal matrix, computed when the transform changed
+	InstanceBuffer *instances;	// nullptr for a regular draw
+	size_t firstInstance;
+	size_t instanceCount;
+};
+
+/// <summary>
+/// Collects the frame's draw calls and executes them in an order that changes as little GL state as possible.
+/// Every packet gets a 64 bit sort key, from the most to the least significant bits:
+///   pass (4) | program (8) | material (16) | vertex array (12) | depth (24, front to back)
+/// Execute() radix sorts the keys and skips every program, texture and VAO bind that wouldn't change anything.
+/// With the depth pre-pass on, the opaque packets are first drawn front to back with positions only and a depth shader
+/// that writes no color, then the opaque pass tests GL_EQUAL without writing depth, so the expensive lit fragment shader
+/// runs once per covered pixel instead of once per overlapping triangle. Whether that pays for the extra vertex work
+/// depends on the table and the resolution, the pre-pass is its own Profiler section to compare against.
+/// </summary>
+class RenderQueue
+{
+public:
+	//What one Execute() did, binds versus draws
+	struct Stats
+	{
+		unsigned int draws;
+		unsigned int programBinds;
+		unsigned int textureBinds;
+		unsigned int vertexArrayBinds;
+		unsigned int uniformUploads;	// model and normal matrices, sampler units
+		unsigned int instances;			// objects drawn by instanced draws
+		unsigned int depthDraws;		// draws of the depth pre-pass, not counted in draws
+	};
+
+	RenderQueue();
+
+	//Depth in the sort key is the distance from position, farPlane maps to the largest value
+	void SetCamera(const glm::vec3 &position, float farPlane);
+
+	void Submit(RenderPass pass, const Shader &shader, const GeometryBuffer &geometry, const GeometryRange &range,
+		unsigned int material, const Transform &transform);
+
+	//Queues one draw of count instances from instances, which must be uploaded before Execute()
+	void SubmitInstanced(RenderPass pass, const Shader &shader, const GeometryBuffer &geometry, const GeometryRange &range,
+		unsigned int material, InstanceBuffer &instances, size_t first, size_t count);
+
+	//Sorts and draws everything submitted since the last Execute, then empties the queue. Each pass is a Profiler section.
+	void Execute();
+
+	//Programs of the depth pre-pass, built from DepthShader.vert with and without INSTANCED. They must outlive the queue.
+	void SetDepthShaders(const Shader &shader, const Shader &instancedShader);
+	//Off by default, does nothing until the depth shaders are set
+	void SetDepthPrepass(bool enabled) { depthPrepass = enabled; }
+	bool DepthPrepass() const { return depthPrepass && depthShader && instancedDepthShader; }
+
+	size_t Size() const { return packets.size(); }
+	const Stats& LastStats() const { return stats; }
+	void PrintStats(ostream &out) const;
+
+	//Packs the key fields, values that don't fit are masked
+	static uint64_t MakeKey(unsigned int pass, unsigned int program, unsigned int material, unsigned int vertexArray, float depth);
+
+	struct SortItem
+	{
+		uint64_t key;
+		uint32_t packet;
+	};
+
+	//Stable LSD radix sort by key, one pass per byte. Bytes that are the same in every key are skipped.
+	static void RadixSort(vector<SortItem> &items, vector<SortItem> &scratch);
+
+private:
+	RenderQueue(const RenderQueue&) = delete;
+	RenderQueue& operator=(const RenderQueue&) = delete;
+
+	void bindMaterial(const Shader &shader, unsigned int material);
+	//Lays down the depth of every opaque packet, colors masked
+	void executeDepthPrepass();
+
+	vector<DrawPacket> packets;
+	vector<SortItem> sortItems;
+	vector<SortItem> sortScratch;
+	glm::vec3 cameraPosition;
+	float farPlane;
+
+	bool depthPrepass;
+	const Shader *depthShader;
+	const Shader *instancedDepthShader;
+	vector<SortItem> depthItems;
+
+	Stats stats;
+	//GL state during Execute(), reset every time since other code binds things in between
+	const Shader *boundShader;
+	bool boundNormalMatrix;	// boundShader has a normalMatrix uniform
+	unsigned int boundMaterial;
+	vector<unsigned int> boundTextures;	// per texture unit
+};
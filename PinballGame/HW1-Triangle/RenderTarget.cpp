@@ -0,0 +1,74 @@
+#include "RenderTarget.h"
+
+#include <cstdio>
+#include <iostream>
+#include <vector>
+
+RenderTarget::RenderTarget() : framebuffer(0), color(0), depth(0), width(0), height(0)
+{
+}
+
+bool RenderTarget::Create(int width, int height)
+{
+	this->width = width;
+	this->height = height;
+
+	glGenFramebuffers(1, &framebuffer);
+	glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+
+	glGenRenderbuffers(1, &color);
+	glBindRenderbuffer(GL_RENDERBUFFER, color);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, color);
+
+	glGenRenderbuffers(1, &depth);
+	glBindRenderbuffer(GL_RENDERBUFFER, depth);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, width, height);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, depth);
+	glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+	GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+	if (status != GL_FRAMEBUFFER_COMPLETE)
+	{
+		cout << "ERROR::RENDER_TARGET::INCOMPLETE 0x" << hex << status << dec << endl;
+		return false;
+	}
+	glViewport(0, 0, width, height);
+	return true;
+}
+
+void RenderTarget::Bind() const
+{
+	glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+	glViewport(0, 0, width, height);
+}
+
+bool RenderTarget::SavePPM(const string &path) const
+{
+	vector<unsigned char> pixels((size_t)width * height * 4);
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer);
+	glPixelStorei(GL_PACK_ALIGNMENT, 1);
+	glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+
+	FILE *file = fopen(path.c_str(), "wb");
+	if (!file)
+	{
+		cout << "ERROR::RENDER_TARGET::COULD_NOT_WRITE " << path << endl;
+		return false;
+	}
+	fprintf(file, "P6\n%d %d\n255\n", width, height);
+	//GL rows start at the bottom
+	for (int y = height - 1; y >= 0; y--)
+		for (int x = 0; x < width; x++)
+			fwrite(&pixels[((size_t)y * width + x) * 4], 1, 3, file);
+	fclose(file);
+	return true;
+}
+
+void RenderTarget::Release()
+{
+	glDeleteRenderbuffers(1, &depth);
+	glDeleteRenderbuffers(1, &color);
+	glDeleteFramebuffers(1, &framebuffer);
+	framebuffer = color = depth = 0;
+}
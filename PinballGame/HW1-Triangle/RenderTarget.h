@@ -0,0 +1,39 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <string>
+using namespace std;
+
+/// <summary>
+/// Offscreen framebuffer with an RGBA8 color and a 24 bit depth/stencil renderbuffer.
+/// Headless runs draw the frame into one of these instead of the window's back buffer.
+/// </summary>
+class RenderTarget
+{
+public:
+	RenderTarget();
+
+	//Allocates the framebuffer, false (and an error) if the driver reports it incomplete
+	bool Create(int width, int height);
+
+	//Draws go here from now on, the viewport covers the whole target
+	void Bind() const;
+
+	//Writes the color buffer as a binary PPM, for eyeballing what a headless run drew
+	bool SavePPM(const string &path) const;
+
+	int Width() const { return width; }
+	int Height() const { return height; }
+
+	//Deletes the framebuffer and renderbuffers, needs the context
+	void Release();
+
+private:
+	RenderTarget(const RenderTarget&) = delete;
+	RenderTarget& operator=(const RenderTarget&) = delete;
+
+	GLuint framebuffer;
+	GLuint color;
+	GLuint depth;
+	int width, height;
+};
@@ -1,8 +1,68 @@
 #include "Shader.h"
 
+#include <chrono>
+#include <vector>
+#include "ShaderBatch.h"
+#include "ShaderCache.h"
+#include "Transform.h"
 
+Shader::UniformStats Shader::uniformStats = { 0, 0, 0 };
 
-Shader::Shader(const char* vertexPath, const char* fragmentPath)
+
+#pragma region ShaderDefines
+ShaderDefines& ShaderDefines::Define(const string &name, const string &value)
+{
+	vector<pair<string, string>>::iterator position = defines.begin();
+	while (position != defines.end() && position->first < name)
+		++position;
+	if (position != defines.end() && position->first == name)
+		position->second = value;
+	else
+		defines.insert(position, make_pair(name, value));
+	return *this;
+}
+
+string ShaderDefines::Source() const
+{
+	string source;
+	for (size_t i = 0; i < defines.size(); i++)
+		source += "#define " + defines[i].first + " " + defines[i].second + "\n";
+	return source;
+}
+
+string ShaderDefines::Inject(const string &source) const
+{
+	if (defines.empty())
+		return source;
+	//#version has to stay the first statement, so the defines go on the line after it
+	size_t version = source.find("#version");
+	if (version == string::npos)
+		return Source() + source;
+	size_t lineEnd = source.find('\n', version);
+	if (lineEnd == string::npos)
+		return source + "\n" + Source();
+	return source.substr(0, lineEnd + 1) + Source() + source.substr(lineEnd + 1);
+}
+#pragma endregion
+
+Shader::Shader(const char* vertexPath, const char* fragmentPath, const ShaderDefines &defines)
+	: pending(false), batch(NULL), vertex(0), fragment(0), cacheKey(0)
+{
+	if (submit(vertexPath, fragmentPath, defines))
+		resolve();
+}
+
+Shader::Shader(const char* vertexPath, const char* fragmentPath, ShaderBatch &batch, const ShaderDefines &defines)
+	: pending(false), batch(NULL), vertex(0), fragment(0), cacheKey(0)
+{
+	chrono::high_resolution_clock::time_point start = chrono::high_resolution_clock::now();
+	if (!submit(vertexPath, fragmentPath, defines))
+		return;
+	this->batch = &batch;
+	batch.add(*this, chrono::duration<double, milli>(chrono::high_resolution_clock::now() - start).count());
+}
+
+bool Shader::submit(const char* vertexPath, const char* fragmentPath, const ShaderDefines &defines)
 {
 	/*
 	 * Part 1!
@@ -33,9 +93,9 @@ Shader::Shader(const char* vertexPath, const char* fragmentPath)
 		vShaderFile.close();
 		fShaderFile.close();
 
-		//convert stream into string
-		vertexCode = vShaderStream.str();
-		fragmentCode = fShaderStream.str();
+		//convert stream into string, with this permutation's defines
+		vertexCode = defines.Inject(vShaderStream.str());
+		fragmentCode = defines.Inject(fShaderStream.str());
 	}
 	catch (ifstream::failure e)
 	{
@@ -45,20 +105,62 @@ Shader::Shader(const char* vertexPath, const char* fragmentPath)
 	const char* vShaderCode = vertexCode.c_str();
 	const char* fShaderCode = fragmentCode.c_str();
 
+	//Warm start: the same sources were linked by this driver before, no compiling at all
+	ID = glCreateProgram();
+	cacheKey = ShaderCache::Key(vertexCode, fragmentCode);
+	if (ShaderCache::Load(ID, cacheKey))
+	{
+		cacheUniformLocations();
+		return false;
+	}
+
 
 	/*
 	* Part 2!
-	* Compile shaders
+	* Compile shaders and link, without asking how it went: any status query makes the driver finish the work first.
+	* resolve() asks once the program is needed.
 	*/
-	unsigned int vertex, fragment;
-	int success;
-	char infoLog[512];
-
 	//Vertex shader
 	vertex = glCreateShader(GL_VERTEX_SHADER); //Create vertex shader on pipeline returning reference int
 	glShaderSource(vertex, 1, &vShaderCode, NULL);	//Replace the source code in a shader object with the one we wrote (Setting it)
 	glCompileShader(vertex); //Compiling the shader
 
+	//Fragment shader
+	fragment = glCreateShader(GL_FRAGMENT_SHADER);
+	glShaderSource(fragment, 1, &fShaderCode, NULL);
+	glCompileShader(fragment);
+
+	//Shader program
+	glAttachShader(ID, vertex);
+	glAttachShader(ID, fragment);
+	ShaderCache::MarkRetrievable(ID);
+	glLinkProgram(ID);
+	pending = true;
+	return true;
+}
+
+bool Shader::Ready() const
+{
+	if (!pending || !ShaderBatch::ParallelCompile())
+		return true;
+	GLint complete = GL_FALSE;
+	glGetProgramiv(ID, GL_COMPLETION_STATUS_KHR, &complete);
+	return complete == GL_TRUE;
+}
+
+void Shader::Wait() const
+{
+	if (pending)
+		resolve();
+}
+
+void Shader::resolve() const
+{
+	chrono::high_resolution_clock::time_point start = chrono::high_resolution_clock::now();
+	pending = false;
+	int success;
+	char infoLog[512];
+
 	//Print compile errors
 	glGetShaderiv(vertex, GL_COMPILE_STATUS, &success);
 	if (!success)
@@ -67,11 +169,6 @@ Shader::Shader(const char* vertexPath, const char* fragmentPath)
 		cout << "ERROR::SHADER::VERTEX::COMPILATION_FAILED\n" << infoLog << endl;
 	}
 
-	//Fragment shader
-	fragment = glCreateShader(GL_FRAGMENT_SHADER);
-	glShaderSource(fragment, 1, &fShaderCode, NULL);
-	glCompileShader(fragment);
-
 	glGetShaderiv(fragment, GL_COMPILE_STATUS, &success);
 	if (!success)
 	{
@@ -79,11 +176,6 @@ Shader::Shader(const char* vertexPath, const char* fragmentPath)
 		cout << "ERROR::SHADER::FRAGMENT::COMPILATION_FAILED\n" << infoLog << endl;
 	}
 
-	//Shader program
-	ID = glCreateProgram();
-	glAttachShader(ID, vertex);
-	glAttachShader(ID, fragment);
-	glLinkProgram(ID);
 	//Print Linking errors if any
 	glGetProgramiv(ID, GL_LINK_STATUS, &success);
 	if (!success)
@@ -91,59 +183,162 @@ Shader::Shader(const char* vertexPath, const char* fragmentPath)
 		glGetProgramInfoLog(ID, 512, NULL, infoLog);
 		cout << "ERROR::SHADER::PROGRAM::LINKING_FAILED\n" << infoLog << endl;
 	}
+	else
+	{
+		cacheUniformLocations();
+		ShaderCache::Save(ID, cacheKey);
+	}
 
 	//Delete the shaders as they're linked into our program now and no longer necessary
 	glDeleteShader(vertex);
 	glDeleteShader(fragment);
+
+	if (batch)
+	{
+		batch->resolved(chrono::duration<double, milli>(chrono::high_resolution_clock::now() - start).count());
+		batch = NULL;
+	}
 }
 
 void Shader::StartPipelineProgram()
 {
+	Wait();
 	glUseProgram(ID);
 
 }
 
-void Shader::StartPipelineProgram(glm::mat4 projection, glm::mat4 view, glm::mat4 model)
+void Shader::StartPipelineProgram(glm::mat4 model)
 {
+	Wait();
 	glUseProgram(ID);
-	setMat4("projection", projection);
-	setMat4("view", view);
-	setMat4("model", model);
+	setMat4(MODEL_UNIFORM, model);
+	if (Location(NORMAL_MATRIX_UNIFORM) >= 0)
+		setMat3(NORMAL_MATRIX_UNIFORM, Transform::NormalMatrix(model));
+}
+
+void Shader::setBool(UniformId name, bool value) const
+{
+	glUniform1i(Location(name), (int)value);
+}
+void Shader::setInt(UniformId name, int value) const
+{
+	glUniform1i(Location(name), value);
+
+}
+bool Shader::setSampler(UniformId name, int unit) const
+{
+	GLint location = Location(name);
+	if (location < 0)
+		return false;
+	pair<unordered_map<GLint, int>::iterator, bool> set = samplerUnits.insert(make_pair(location, unit));
+	if (!set.second && set.first->second == unit)
+		return false;
+	set.first->second = unit;
+	glUniform1i(location, unit);
+	return true;
+}
+void Shader::setFloat(UniformId name, float value) const
+{
+	glUniform1f(Location(name), value);
 }
 
-void Shader::setBool(const std::string &name, bool value) const
+void Shader::setVec2(UniformId name, glm::vec2 value) const
 {
-	glUniform1i(glGetUniformLocation(ID, name.c_str()), (int)value);
+	glUniform2f(Location(name), value.x, value.y);
 }
-void Shader::setInt(const std::string &name, int value) const
+
+void Shader::setVec3(UniformId name, glm::vec3 value) const
 {
-	glUniform1i(glGetUniformLocation(ID, name.c_str()), value);
+	glUniform3f(Location(name), value.x, value.y, value.z);
+}
 
+void Shader::setMat3(UniformId name, const glm::mat3 &value) const
+{
+	glUniformMatrix3fv(Location(name), 1, false, value_ptr(value));
 }
-void Shader::setFloat(const std::string &name, float value) const
+void Shader::setMat4(UniformId name, glm::mat4 value) const
 {
-	glUniform1f(glGetUniformLocation(ID, name.c_str()), value);
+	glUniformMatrix4fv(Location(name), 1, false, value_ptr(value));
 }
 
-void Shader::setVec3(const string &name, glm::vec3 value) const
+void Shader::setPointLight(const Shader::LightSettings &settings) const
 {
-	glUniform3f(glGetUniformLocation(ID, name.c_str()), value.x, value.y, value.z);
+	UniformId light(settings.name);
+	setVec3(light.Append(".position"), settings.position);
+	setVec3(light.Append(".ambient"), settings.ambient);
+	setVec3(light.Append(".diffuse"), settings.diffuse);
+	setVec3(light.Append(".specular"), settings.specular);
+	setFloat(light.Append(".constant"), settings.constant);
+	setFloat(light.Append(".linear"), settings.linear);
+	setFloat(light.Append(".quadratic"), settings.quadratic);
 }
 
-void Shader::setMat4(const string &name, glm::mat4 value) const
+GLint Shader::Location(UniformId name) const
 {
-	glUniformMatrix4fv(glGetUniformLocation(ID, name.c_str()), 1, false, value_ptr(value));
+	Wait();
+	uniformStats.lookups++;
+	unordered_map<uint32_t, GLint>::const_iterator found = uniformLocations.find(name.hash);
+	if (found == uniformLocations.end())
+	{
+		//glUniform* ignores location -1, same as for a name GL doesn't know
+		uniformStats.misses++;
+		return -1;
+	}
+	return found->second;
+}
+
+void Shader::ResetUniformStats()
+{
+	uniformStats.lookups = 0;
+	uniformStats.misses = 0;
+	uniformStats.glQueries = 0;
+}
+
+void Shader::cacheUniformLocations() const
+{
+	GLint count = 0, maxLength = 0;
+	glGetProgramiv(ID, GL_ACTIVE_UNIFORMS, &count);
+	glGetProgramiv(ID, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+	vector<char> buffer(maxLength > 0 ? maxLength : 1);
+	unordered_map<uint32_t, string> names;	// only to catch hash collisions
+
+	for (GLint i = 0; i < count; i++)
+	{
+		GLint size = 0;
+		GLenum type = 0;
+		GLsizei length = 0;
+		glGetActiveUniform(ID, (GLuint)i, (GLsizei)buffer.size(), &length, &size, &type, buffer.data());
+		string name(buffer.data(), length);
+		GLint location = glGetUniformLocation(ID, name.c_str());
+		uniformStats.glQueries++;
+		if (location < 0)
+			continue; //members of uniform blocks have no location
+		addUniformLocation(name, location, names);
+
+		//Arrays of basic types are reported once as "name[0]", make the bare name and every element resolvable too
+		if (name.size() > 3 && name.compare(name.size() - 3, 3, "[0]") == 0)
+		{
+			string base = name.substr(0, name.size() - 3);
+			addUniformLocation(base, location, names);
+			for (GLint element = 1; element < size; element++)
+			{
+				string elementName = base + "[" + to_string(element) + "]";
+				GLint elementLocation = glGetUniformLocation(ID, elementName.c_str());
+				uniformStats.glQueries++;
+				if (elementLocation >= 0)
+					addUniformLocation(elementName, elementLocation, names);
+			}
+		}
+	}
 }
 
-void Shader::setPointLight(Shader::LightSettings settings)
+void Shader::addUniformLocation(const string &name, GLint location, unordered_map<uint32_t, string> &names) const
 {
-	setVec3(settings.name + ".position", settings.position);
-	setVec3(settings.name + ".ambient", settings.ambient);
-	setVec3(settings.name + ".diffuse", settings.diffuse);
-	setVec3(settings.name + ".specular", settings.specular);
-	setFloat(settings.name + ".constant", settings.constant);
-	setFloat(settings.name + ".linear", settings.linear);
-	setFloat(settings.name + ".quadratic", settings.quadratic);
+	uint32_t hash = UniformId(name).hash;
+	pair<unordered_map<uint32_t, string>::iterator, bool> added = names.insert(make_pair(hash, name));
+	if (!added.second && added.first->second != name)
+		cout << "ERROR::SHADER::UNIFORM_HASH_COLLISION " << name << " / " << added.first->second << endl;
+	uniformLocations[hash] = location;
 }
 
 Shader::~Shader()
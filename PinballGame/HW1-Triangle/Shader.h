@@ -5,7 +5,11 @@
 
 #include <GLAD\glad.h>
 
+#include <cstdint>
 #include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
 #include <fstream>
 #include <sstream>
 #include <iostream>
@@ -14,6 +18,60 @@
 
 using namespace std;
 
+/// <summary>
+/// Name of a uniform as a 32 bit FNV-1a hash, a short loop over the characters, so setting a uniform is a table lookup
+/// instead of a glGetUniformLocation string query. The names set for every draw are constexpr constants below, hashed
+/// at compile time. Append() continues the hash: UniformId("pointLights[0]").Append(".position") is the same id as
+/// UniformId("pointLights[0].position"), without building the string.
+/// </summary>
+struct UniformId
+{
+	uint32_t hash;
+
+	constexpr UniformId(const char *name) : hash(Hash(name, FNV_OFFSET)) {}
+	UniformId(const string &name) : hash(Hash(name.c_str(), FNV_OFFSET)) {}
+
+	constexpr UniformId Append(const char *suffix) const { return UniformId(Hash(suffix, hash), 0); }
+	UniformId Append(const string &suffix) const { return Append(suffix.c_str()); }
+
+	bool operator==(const UniformId &other) const { return hash == other.hash; }
+
+private:
+	static const uint32_t FNV_OFFSET = 2166136261u;
+	static const uint32_t FNV_PRIME = 16777619u;
+
+	constexpr UniformId(uint32_t hash, int) : hash(hash) {}
+	static constexpr uint32_t Hash(const char *name, uint32_t hash)
+	{
+		return *name ? Hash(name + 1, (hash ^ (uint8_t)*name) * FNV_PRIME) : hash;
+	}
+};
+
+//Set for every draw
+constexpr UniformId MODEL_UNIFORM("model");
+constexpr UniformId NORMAL_MATRIX_UNIFORM("normalMatrix");
+
+/// <summary>
+/// Preprocessor defines for one permutation of a shader, injected right after the #version line of both stages.
+/// Kept sorted by name, so the same set always produces the same source (and the same program cache entry).
+/// </summary>
+class ShaderDefines
+{
+public:
+	ShaderDefines& Define(const string &name, const string &value = "1");
+	ShaderDefines& Define(const string &name, int value) { return Define(name, to_string(value)); }
+
+	//The #define lines
+	string Source() const;
+
+	//Inserts Source() after the #version line of source
+	string Inject(const string &source) const;
+
+private:
+	vector<pair<string, string>> defines;
+};
+
+class ShaderBatch;
 
 class Shader
 {
@@ -21,8 +79,17 @@ public:
 	//Program ID
 	unsigned int ID;
 
-	//Constructor reads and builds the shader
-	Shader(const GLchar* vertexPath, const GLchar* fragmentPath);
+	//Constructor reads and builds the shader, with defines selecting the permutation.
+	//A program linked by an earlier run is loaded from the ShaderCache instead of compiled.
+	Shader(const GLchar* vertexPath, const GLchar* fragmentPath, const ShaderDefines &defines = ShaderDefines());
+	//Same, but only hands the sources to the driver: errors are reported and uniforms looked up at first use, see ShaderBatch
+	Shader(const GLchar* vertexPath, const GLchar* fragmentPath, ShaderBatch &batch, const ShaderDefines &defines = ShaderDefines());
+
+	//True once using the program won't wait for the compiler. Without GL_KHR_parallel_shader_compile this can't be
+	//asked without waiting, so it's always true and the wait happens at first use.
+	bool Ready() const;
+	//Blocks until the program is linked, reports errors and builds the uniform table. Every use does this first.
+	void Wait() const;
 	
 	/// <summary>
 	/// Name, Position, Ambient, Diffuse, Specular, Constant, Linear, Quadratic
@@ -42,18 +109,61 @@ public:
 
 	//Use|Activate the shader
 	void StartPipelineProgram();
-	void StartPipelineProgram(glm::mat4 projection, glm::mat4 view, glm::mat4 model);
+	//Projection and view come from the shared Camera block, see FrameUniforms. Also sets normalMatrix if the program has one.
+	void StartPipelineProgram(glm::mat4 model);
 
 	//Utility uniform functions (Const is used at the end to make sure the object (*this) isn't modified when called or by the methods))
-	void setBool(const string &name, bool value) const;
-	void setInt(const string &name, int value) const;
-	void setFloat(const string &name, float value) const;
-	void setVec3(const string &name, glm::vec3 value) const;
-	void setMat4(const string &name, glm::mat4 value) const;
-	void setPointLight(LightSettings settings);
+	//Names are looked up in the location table built at link time, string literals are hashed by the compiler
+	void setBool(UniformId name, bool value) const;
+	void setInt(UniformId name, int value) const;
+	void setFloat(UniformId name, float value) const;
+	void setVec2(UniformId name, glm::vec2 value) const;
+	void setVec3(UniformId name, glm::vec3 value) const;
+	void setMat3(UniformId name, const glm::mat3 &value) const;
+	void setMat4(UniformId name, glm::mat4 value) const;
+	void setPointLight(const LightSettings &settings) const;
+	//setInt for a sampler's texture unit, but only uploaded when it differs from what this did last on the program.
+	//Returns whether it was uploaded.
+	bool setSampler(UniformId name, int unit) const;
+
+	//Location of an active uniform, -1 if the program doesn't have it (like glGetUniformLocation, but no GL call)
+	GLint Location(UniformId name) const;
+
+	/// <summary>
+	/// Uniform location lookups since the last ResetUniformStats(), over all shaders.
+	/// glQueries only goes up while programs link, any other frame should show 0.
+	/// </summary>
+	struct UniformStats
+	{
+		unsigned int lookups;	// set* calls resolved through the location table
+		unsigned int misses;	// names the program has no active uniform for, the value is dropped
+		unsigned int glQueries;	// glGetUniformLocation calls
+	};
+	static const UniformStats& FrameUniformStats() { return uniformStats; }
+	static void ResetUniformStats();
 
 	
 	~Shader();
+
+private:
+	//Reads the sources, then loads the program from the cache (false) or starts compiling and linking it (true)
+	bool submit(const GLchar* vertexPath, const GLchar* fragmentPath, const ShaderDefines &defines);
+	//Compile and link results of a submitted program, on first use
+	void resolve() const;
+
+	//Fills uniformLocations from the program's active uniforms, right after link
+	void cacheUniformLocations() const;
+	void addUniformLocation(const string &name, GLint location, unordered_map<uint32_t, string> &names) const;
+
+	//Filled in lazily by the first use of a batched program, so const users can trigger it too
+	mutable unordered_map<uint32_t, GLint> uniformLocations;	// UniformId hash -> location
+	mutable unordered_map<GLint, int> samplerUnits;			// location -> unit last set by setSampler
+	mutable bool pending;			// submitted, status not asked for yet
+	mutable ShaderBatch *batch;		// told about the wait when pending resolves
+	unsigned int vertex, fragment;	// stages, deleted once linked
+	uint64_t cacheKey;
+
+	static UniformStats uniformStats;
 };
 
 #endif 
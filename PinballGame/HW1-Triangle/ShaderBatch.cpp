@@ -0,0 +1,117 @@
+#include "ShaderBatch.h"
+
+#include <chrono>
+#include <cstring>
+#include <memory>
+#include "ShaderCache.h"
+
+namespace
+{
+	typedef void (APIENTRYP PFNGLMAXSHADERCOMPILERTHREADSKHRPROC)(GLuint count);
+
+	bool parallelCompile = false;
+
+	bool hasExtension(const char *name)
+	{
+		GLint count = 0;
+		glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+		for (GLint i = 0; i < count; i++)
+		{
+			const GLubyte *extension = glGetStringi(GL_EXTENSIONS, (GLuint)i);
+			if (extension && strcmp((const char*)extension, name) == 0)
+				return true;
+		}
+		return false;
+	}
+
+	double elapsedMs(chrono::high_resolution_clock::time_point start)
+	{
+		return chrono::duration<double, milli>(chrono::high_resolution_clock::now() - start).count();
+	}
+}
+
+void ShaderBatch::LoadExtensions(GLADloadproc load)
+{
+	PFNGLMAXSHADERCOMPILERTHREADSKHRPROC maxShaderCompilerThreads = NULL;
+	if (hasExtension("GL_KHR_parallel_shader_compile"))
+		maxShaderCompilerThreads = (PFNGLMAXSHADERCOMPILERTHREADSKHRPROC)load("glMaxShaderCompilerThreadsKHR");
+	else if (hasExtension("GL_ARB_parallel_shader_compile"))
+		maxShaderCompilerThreads = (PFNGLMAXSHADERCOMPILERTHREADSKHRPROC)load("glMaxShaderCompilerThreadsARB");
+
+	parallelCompile = maxShaderCompilerThreads != NULL;
+	//0xFFFFFFFF leaves the thread count up to the driver
+	if (parallelCompile)
+		maxShaderCompilerThreads(0xFFFFFFFF);
+}
+
+bool ShaderBatch::ParallelCompile()
+{
+	return parallelCompile;
+}
+
+ShaderBatch::ShaderBatch()
+{
+	stats.programs = stats.resolved = 0;
+	stats.submitMs = stats.stallMs = 0.0;
+}
+
+void ShaderBatch::Finish()
+{
+	//Finished ones first, so a slow program doesn't hold up checking the others
+	for (size_t i = 0; i < shaders.size(); i++)
+		if (shaders[i]->Ready())
+			shaders[i]->Wait();
+	for (size_t i = 0; i < shaders.size(); i++)
+		shaders[i]->Wait();
+	shaders.clear();
+}
+
+void ShaderBatch::add(const Shader &shader, double submitMs)
+{
+	shaders.push_back(&shader);
+	stats.programs++;
+	stats.submitMs += submitMs;
+}
+
+void ShaderBatch::resolved(double stallMs)
+{
+	stats.resolved++;
+	stats.stallMs += stallMs;
+}
+
+void ShaderBatch::Benchmark(const vector<ShaderPermutation> &permutations, ostream &out)
+{
+	ShaderCache::SetEnabled(false);
+	//Drivers keep their own shader caches too, an unused define makes every run's sources new to them
+	int run = (int)(chrono::high_resolution_clock::now().time_since_epoch().count() & 0x7FFFFFFF);
+
+	vector<unique_ptr<Shader>> programs;
+	chrono::high_resolution_clock::time_point start = chrono::high_resolution_clock::now();
+	for (size_t i = 0; i < permutations.size(); i++)
+	{
+		const ShaderPermutation &permutation = permutations[i];
+		programs.emplace_back(new Shader(permutation.vertexPath, permutation.fragmentPath,
+			ShaderDefines(permutation.defines).Define("COMPILE_BENCHMARK_RUN", run)));
+	}
+	double serialMs = elapsedMs(start);
+
+	ShaderBatch batch;
+	start = chrono::high_resolution_clock::now();
+	for (size_t i = 0; i < permutations.size(); i++)
+	{
+		const ShaderPermutation &permutation = permutations[i];
+		programs.emplace_back(new Shader(permutation.vertexPath, permutation.fragmentPath, batch,
+			ShaderDefines(permutation.defines).Define("COMPILE_BENCHMARK_RUN", run + 1)));
+	}
+	batch.Finish();
+	double batchMs = elapsedMs(start);
+
+	for (size_t i = 0; i < programs.size(); i++)
+		glDeleteProgram(programs[i]->ID);
+	ShaderCache::SetEnabled(true);
+
+	out << "SHADER COMPILE:: " << permutations.size() << " programs, parallel compile " << (parallelCompile ? "on" : "off") << endl;
+	out << "  serial:  " << serialMs << " ms" << endl;
+	out << "  batched: " << batchMs << " ms (" << batch.GetStats().submitMs << " ms submitting, " << batch.GetStats().stallMs
+		<< " ms waiting), " << (batchMs > 0.0 ? serialMs / batchMs : 0.0) << "x" << endl;
+}
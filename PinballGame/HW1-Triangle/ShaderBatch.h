@@ -0,0 +1,68 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <ostream>
+#include <string>
+#include <vector>
+#include "Shader.h"
+using namespace std;
+
+//GL_KHR_parallel_shader_compile (same values as the ARB version), glad is generated without extensions
+#ifndef GL_MAX_SHADER_COMPILER_THREADS_KHR
+#define GL_MAX_SHADER_COMPILER_THREADS_KHR 0x91B0
+#endif
+#ifndef GL_COMPLETION_STATUS_KHR
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+#endif
+
+//Sources and defines of one program, for building a list of programs up front
+struct ShaderPermutation
+{
+	const char *vertexPath;
+	const char *fragmentPath;
+	ShaderDefines defines;
+};
+
+/// <summary>
+/// Compiles many programs without waiting on each one. Every Shader constructed with a batch submits its compile and link
+/// and returns; compile and link status are only asked for when the program is first used (Shader::Wait), so the driver
+/// can work on all of them at once, on its own threads when GL_KHR_parallel_shader_compile is there, while we do other
+/// startup work. The batch must outlive the first use of its shaders.
+/// </summary>
+class ShaderBatch
+{
+public:
+	//Picks up GL_KHR_parallel_shader_compile (or the ARB version) and lets the driver use as many threads as it likes.
+	//Call once after gladLoadGLLoader with the same loader.
+	static void LoadExtensions(GLADloadproc load);
+	static bool ParallelCompile();
+
+	ShaderBatch();
+
+	//Waits for every program that hasn't been used yet
+	void Finish();
+
+	struct Stats
+	{
+		unsigned int programs;	// submitted to the compiler, cache hits don't count
+		unsigned int resolved;	// status checked so far
+		double submitMs;		// spent in the Shader constructors handing sources over
+		double stallMs;			// spent waiting for results at first use
+	};
+	const Stats& GetStats() const { return stats; }
+
+	//Compiles every permutation once one by one, checking each right away like a plain Shader constructor, and once as a batch.
+	//The program cache is switched off and every run gets unique sources, so neither the cache nor the driver's own can help.
+	static void Benchmark(const vector<ShaderPermutation> &permutations, ostream &out);
+
+private:
+	friend class Shader;
+	ShaderBatch(const ShaderBatch&) = delete;
+	ShaderBatch& operator=(const ShaderBatch&) = delete;
+
+	void add(const Shader &shader, double submitMs);
+	void resolved(double stallMs);
+
+	vector<const Shader*> shaders;
+	Stats stats;
+};
@@ -0,0 +1,164 @@
+#include "ShaderCache.h"
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <vector>
+#include "CacheFile.h"
+#include "MeshCache.h"
+
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
+
+namespace
+{
+	const char SHADER_CACHE_MAGIC[4] = { 'P', 'B', 'S', 'C' };
+
+	ShaderCache::Stats stats = { 0, 0, 0 };
+	bool enabled = true;
+
+	uint64_t HashText(const string &text, uint64_t hash)
+	{
+		//Terminator, so "ab" + "c" and "a" + "bc" differ
+		const unsigned char terminator = 0xFF;
+		return Fnv1a(&terminator, 1, Fnv1a(text.data(), text.size(), hash));
+	}
+
+	string GlString(GLenum name)
+	{
+		const GLubyte *value = glGetString(name);
+		return value ? string((const char*)value) : string();
+	}
+
+	void MakeDirectory(const char *path)
+	{
+#ifdef _WIN32
+		_mkdir(path);
+#else
+		mkdir(path, 0755);
+#endif
+	}
+}
+
+bool ShaderCache::Available()
+{
+	static int available = -1;
+	if (available < 0)
+	{
+		GLint formats = 0;
+		if (glGetProgramBinary && glProgramBinary && glProgramParameteri)
+			glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+		available = formats > 0 ? 1 : 0;
+	}
+	return enabled && available == 1;
+}
+
+void ShaderCache::SetEnabled(bool on)
+{
+	enabled = on;
+}
+
+uint64_t ShaderCache::Key(const string &vertexSource, const string &fragmentSource)
+{
+	uint64_t hash = FNV1A_OFFSET_BASIS;
+	hash = HashText(vertexSource, hash);
+	hash = HashText(fragmentSource, hash);
+	//A binary is only good for the driver that made it
+	hash = HashText(GlString(GL_VENDOR), hash);
+	hash = HashText(GlString(GL_RENDERER), hash);
+	hash = HashText(GlString(GL_VERSION), hash);
+	return hash;
+}
+
+string ShaderCache::CachePath(uint64_t key)
+{
+	char name[32];
+	snprintf(name, sizeof(name), "%016llx.glprog", (unsigned long long)key);
+	return string(SHADER_CACHE_DIRECTORY) + "/" + name;
+}
+
+bool ShaderCache::Load(GLuint program, uint64_t key)
+{
+	if (!Available())
+	{
+		stats.misses++;
+		return false;
+	}
+
+	MappedFile file;
+	ShaderCacheHeader header;
+	if (!file.Open(CachePath(key)) || file.Size() < sizeof(header))
+	{
+		stats.misses++;
+		return false;
+	}
+	memcpy(&header, file.Data(), sizeof(header));
+	if (memcmp(header.magic, SHADER_CACHE_MAGIC, sizeof(header.magic)) != 0 ||
+		header.version != SHADER_CACHE_VERSION ||
+		header.key != key ||
+		header.length > file.Size() - sizeof(header))
+	{
+		stats.misses++;
+		return false;
+	}
+
+	//The driver may still refuse it (format no longer supported), which shows up as a failed link
+	glProgramBinary(program, header.binaryFormat, file.Data() + sizeof(header), header.length);
+	GLint linked = 0;
+	glGetProgramiv(program, GL_LINK_STATUS, &linked);
+	if (!linked)
+	{
+		stats.misses++;
+		return false;
+	}
+	stats.hits++;
+	return true;
+}
+
+void ShaderCache::MarkRetrievable(GLuint program)
+{
+	if (Available())
+		glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+}
+
+bool ShaderCache::Save(GLuint program, uint64_t key)
+{
+	if (!Available())
+		return false;
+
+	GLint length = 0;
+	glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+	if (length <= 0)
+		return false;
+	vector<unsigned char> binary(length);
+	GLenum format = 0;
+	glGetProgramBinary(program, length, &length, &format, binary.data());
+
+	ShaderCacheHeader header;
+	memcpy(header.magic, SHADER_CACHE_MAGIC, sizeof(header.magic));
+	header.version = SHADER_CACHE_VERSION;
+	header.key = key;
+	header.binaryFormat = format;
+	header.length = (uint32_t)length;
+
+	//Temporary file first, so a crash can't leave a truncated binary behind
+	MakeDirectory(SHADER_CACHE_DIRECTORY);
+	bool written = WriteCacheFile(CachePath(key), "SHADERCACHE", [&](ostream &out)
+	{
+		out.write((const char*)&header, sizeof(header));
+		out.write((const char*)binary.data(), length);
+	});
+	if (!written)
+		return false;
+	stats.saved++;
+	return true;
+}
+
+const ShaderCache::Stats& ShaderCache::GetStats()
+{
+	return stats;
+}
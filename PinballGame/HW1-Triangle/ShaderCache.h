@@ -0,0 +1,63 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <cstdint>
+#include <string>
+using namespace std;
+
+/*
+ * Linked program cache
+ *
+ * Compiling and linking GLSL is most of the startup time once there are several permutations, so every program
+ * that links is saved with glGetProgramBinary and later runs load it back with glProgramBinary, skipping the
+ * compiler entirely. Files live in SHADER_CACHE_DIRECTORY, named after a hash of both sources (with their injected
+ * defines) and the driver's vendor/renderer/version strings, so any edit or driver update simply misses.
+ * Needs GL 4.1 (or ARB_get_program_binary) and a driver that offers at least one binary format; otherwise every
+ * call is a miss and the shaders compile as before.
+ *
+ * Layout: ShaderCacheHeader, then the driver's binary blob.
+ */
+const uint32_t SHADER_CACHE_VERSION = 1;
+const char SHADER_CACHE_DIRECTORY[] = "shadercache";
+
+struct ShaderCacheHeader
+{
+	char magic[4];			// "PBSC"
+	uint32_t version;		// SHADER_CACHE_VERSION
+	uint64_t key;			// ShaderCache::Key() of the program
+	uint32_t binaryFormat;	// as returned by glGetProgramBinary
+	uint32_t length;		// bytes of binary following the header
+};
+
+namespace ShaderCache
+{
+	//Loads and saves since startup
+	struct Stats
+	{
+		unsigned int hits;		// programs loaded from a binary
+		unsigned int misses;	// programs that had to be compiled
+		unsigned int saved;		// binaries written
+	};
+
+	//True if the driver can hand out program binaries at all and the cache isn't switched off
+	bool Available();
+
+	//Off makes every Load a miss and Save a no-op, for timing the compiler itself
+	void SetEnabled(bool on);
+
+	//Hash of both final sources and the driver strings
+	uint64_t Key(const string &vertexSource, const string &fragmentSource);
+
+	string CachePath(uint64_t key);
+
+	//Loads the binary for key into program, true if it is now linked. Failing is normal, compile the sources then.
+	bool Load(GLuint program, uint64_t key);
+
+	//Call before linking a program that should be saved afterwards
+	void MarkRetrievable(GLuint program);
+
+	//Writes the linked program's binary for key
+	bool Save(GLuint program, uint64_t key);
+
+	const Stats& GetStats();
+}
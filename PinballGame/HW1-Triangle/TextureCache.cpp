@@ -0,0 +1,139 @@
+#include "TextureCache.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <functional>
+#include <iomanip>
+#include "TextureStreamer.h"
+
+TextureCache::TextureCache()
+{
+	TextureStreamer::Shared().SetUploadCallback([this](unsigned int texture, int width, int height, GLenum internalFormat)
+	{
+		OnUploaded(texture, width, height, internalFormat);
+	});
+}
+
+unsigned int TextureCache::Acquire(const string &path, const TextureParams &params)
+{
+	Key key;
+	key.path = CanonicalPath(path);
+	key.params = params;
+
+	unordered_map<Key, Entry, KeyHash>::iterator found = entries.find(key);
+	if (found != entries.end())
+	{
+		found->second.referenceCount++;
+		return found->second.texture;
+	}
+
+	Entry entry;
+	entry.path = key.path;
+	entry.params = params;
+	entry.texture = TextureStreamer::Shared().Request(path, params);
+	entry.referenceCount = 1;
+	entry.width = 0;
+	entry.height = 0;
+	entry.internalFormat = GL_RGBA8;
+	entry.gpuBytes = TextureMemorySize(1, 1, GL_RGBA8, false); //the placeholder
+
+	entries[key] = entry;
+	byTexture[entry.texture] = key;
+	return entry.texture;
+}
+
+void TextureCache::Release(unsigned int texture)
+{
+	unordered_map<unsigned int, Key>::iterator found = byTexture.find(texture);
+	if (found == byTexture.end())
+		return;
+
+	unordered_map<Key, Entry, KeyHash>::iterator entry = entries.find(found->second);
+	if (--entry->second.referenceCount > 0)
+		return;
+
+	TextureStreamer::Shared().Cancel(texture);
+	glDeleteTextures(1, &texture);
+	entries.erase(entry);
+	byTexture.erase(found);
+}
+
+const TextureCache::Entry* TextureCache::Find(unsigned int texture) const
+{
+	unordered_map<unsigned int, Key>::const_iterator found = byTexture.find(texture);
+	if (found == byTexture.end())
+		return nullptr;
+	return &entries.find(found->second)->second;
+}
+
+size_t TextureCache::TotalGpuBytes() const
+{
+	size_t total = 0;
+	for (unordered_map<Key, Entry, KeyHash>::const_iterator it = entries.begin(); it != entries.end(); ++it)
+		total += it->second.gpuBytes;
+	return total;
+}
+
+void TextureCache::Report(ostream &out) const
+{
+	//Biggest first, that's what anyone reading this is looking for
+	vector<const Entry*> sorted;
+	for (unordered_map<Key, Entry, KeyHash>::const_iterator it = entries.begin(); it != entries.end(); ++it)
+		sorted.push_back(&it->second);
+	sort(sorted.begin(), sorted.end(), [](const Entry *a, const Entry *b) { return a->gpuBytes > b->gpuBytes; });
+
+	out << "TEXTURE CACHE:: " << sorted.size() << " textures, " << fixed << setprecision(2)
+		<< TotalGpuBytes() / (1024.0 * 1024.0) << " MB" << endl;
+	for (size_t i = 0; i < sorted.size(); i++)
+	{
+		const Entry &entry = *sorted[i];
+		out << "  " << setw(8) << entry.gpuBytes / 1024.0 << " KB  " << entry.width << "x" << entry.height
+			<< "  refs " << entry.referenceCount << (entry.params.gamma ? "  srgb" : "") << "  " << entry.path << endl;
+	}
+}
+
+TextureCache& TextureCache::Shared()
+{
+	static TextureCache cache;
+	return cache;
+}
+
+string TextureCache::CanonicalPath(const string &path)
+{
+	string canonical = path;
+#ifdef _WIN32
+	char resolved[_MAX_PATH];
+	if (_fullpath(resolved, path.c_str(), _MAX_PATH))
+		canonical = resolved;
+	//Windows paths are case insensitive
+	transform(canonical.begin(), canonical.end(), canonical.begin(), [](char c) { return (char)tolower((unsigned char)c); });
+#else
+	char *resolved = realpath(path.c_str(), nullptr);
+	if (resolved)
+	{
+		canonical = resolved;
+		free(resolved);
+	}
+#endif
+	replace(canonical.begin(), canonical.end(), '\\', '/');
+	return canonical;
+}
+
+size_t TextureCache::KeyHash::operator()(const Key &key) const
+{
+	size_t flags = (key.params.flipVertically ? 1 : 0) | (key.params.mipmaps ? 2 : 0) | (key.params.gamma ? 4 : 0) | ((size_t)key.params.components << 3);
+	return hash<string>()(key.path) ^ (flags * (size_t)0x9E3779B9);
+}
+
+void TextureCache::OnUploaded(unsigned int texture, int width, int height, GLenum internalFormat)
+{
+	unordered_map<unsigned int, Key>::iterator found = byTexture.find(texture);
+	if (found == byTexture.end())
+		return;
+
+	Entry &entry = entries.find(found->second)->second;
+	entry.width = width;
+	entry.height = height;
+	entry.internalFormat = internalFormat;
+	entry.gpuBytes = TextureMemorySize(width, height, internalFormat, entry.params.mipmaps);
+}
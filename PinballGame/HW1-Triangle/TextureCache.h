@@ -0,0 +1,71 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include "TextureLoader.h"
+using namespace std;
+
+/// <summary>
+/// Process wide, reference counted cache of file textures.
+/// Entries are keyed by the canonical path of the file plus the parameters it was loaded with, so the same image
+/// shared by the frame, flippers and bumpers is decoded and uploaded exactly once.
+/// </summary>
+class TextureCache
+{
+public:
+	struct Entry
+	{
+		string path;			// canonical path
+		TextureParams params;
+		unsigned int texture;
+		int referenceCount;
+		int width;				// 0 while the texture is still streaming in
+		int height;
+		GLenum internalFormat;
+		size_t gpuBytes;		// estimated video memory, including mipmaps
+	};
+
+	TextureCache();
+
+	//Returns the texture for path loaded with params and takes a reference on it. Loads (streams) it on a miss.
+	unsigned int Acquire(const string &path, const TextureParams &params = TextureParams());
+
+	//Drops a reference taken by Acquire, the texture is deleted with the last one
+	void Release(unsigned int texture);
+
+	//Looks up the entry of a texture handed out by Acquire, nullptr if it isn't cached
+	const Entry* Find(unsigned int texture) const;
+
+	size_t Count() const { return byTexture.size(); }
+	size_t TotalGpuBytes() const;
+
+	//Prints one line per entry with its size and reference count
+	void Report(ostream &out) const;
+
+	static TextureCache& Shared();
+
+	//Resolves . and .. and symlinks so different spellings of the same file share one entry
+	static string CanonicalPath(const string &path);
+
+private:
+	TextureCache(const TextureCache&) = delete;
+	TextureCache& operator=(const TextureCache&) = delete;
+
+	struct Key
+	{
+		string path;
+		TextureParams params;
+		bool operator==(const Key &other) const { return path == other.path && params == other.params; }
+	};
+	struct KeyHash
+	{
+		size_t operator()(const Key &key) const;
+	};
+
+	void OnUploaded(unsigned int texture, int width, int height, GLenum internalFormat);
+
+	unordered_map<Key, Entry, KeyHash> entries;
+	unordered_map<unsigned int, Key> byTexture;
+};
@@ -0,0 +1,92 @@
+#include "TextureLoader.h"
+
+#include <cstring>
+#include <iostream>
+#include <vector>
+#include "stb_image.h"
+#include "TextureCache.h"
+
+GLenum DecodedImage::Format() const
+{
+	if (components == 1)
+		return GL_RED;
+	else if (components == 3)
+		return GL_RGB;
+	else if (components == 4)
+		return GL_RGBA;
+	return GL_RG;
+}
+
+void DecodedImage::Free()
+{
+	stbi_image_free(pixels);
+	pixels = nullptr;
+}
+
+DecodedImage DecodeImage(const string &filename, bool flipVertically, int components)
+{
+	DecodedImage image;
+	image.pixels = stbi_load(filename.c_str(), &image.width, &image.height, &image.components, components);
+	if (components != 0)
+		image.components = components; //stb reports the file's channel count, not the one it converted to
+	if (image.pixels && flipVertically)
+	{
+		//Swap rows from the outside in
+		size_t rowSize = (size_t)image.width * image.components;
+		vector<unsigned char> row(rowSize);
+		for (int y = 0; y < image.height / 2; y++)
+		{
+			unsigned char *top = image.pixels + y * rowSize;
+			unsigned char *bottom = image.pixels + (image.height - 1 - y) * rowSize;
+			memcpy(row.data(), top, rowSize);
+			memcpy(top, bottom, rowSize);
+			memcpy(bottom, row.data(), rowSize);
+		}
+	}
+	return image;
+}
+
+GLenum InternalFormat(const DecodedImage &image, const TextureParams &params)
+{
+	if (params.gamma && image.components == 3)
+		return GL_SRGB8;
+	if (params.gamma && image.components == 4)
+		return GL_SRGB8_ALPHA8;
+	if (image.components == 1)
+		return GL_R8;
+	if (image.components == 2)
+		return GL_RG8;
+	if (image.components == 3)
+		return GL_RGB8;
+	return GL_RGBA8;
+}
+
+size_t TextureMemorySize(int width, int height, GLenum internalFormat, bool mipmaps)
+{
+	//Drivers pad 3 channel formats out to 4 bytes per texel
+	size_t texelSize = 4;
+	if (internalFormat == GL_R8)
+		texelSize = 1;
+	else if (internalFormat == GL_RG8)
+		texelSize = 2;
+
+	size_t size = (size_t)width * height * texelSize;
+	//A full mip chain adds another third
+	return mipmaps ? size + size / 3 : size;
+}
+
+void ApplyTextureParams(const TextureParams &params)
+{
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, params.mipmaps ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+}
+
+unsigned int TextureFromFile(const char *path, const string &directory, bool gamma)
+{
+	string filename = string(path);
+	filename = directory + '/' + filename;
+
+	return TextureCache::Shared().Acquire(filename, TextureParams(false, true, gamma));
+}
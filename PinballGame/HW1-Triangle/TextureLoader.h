@@ -0,0 +1,59 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <string>
+using namespace std;
+
+/// <summary>
+/// Pixels of an image decoded on the CPU, ready to be handed to glTexImage2D.
+/// Decoding touches no GL state, so it can run on any thread.
+/// </summary>
+struct DecodedImage
+{
+	unsigned char *pixels;
+	int width;
+	int height;
+	int components;
+
+	DecodedImage() : pixels(nullptr), width(0), height(0), components(0) {}
+	bool Valid() const { return pixels != nullptr; }
+	GLenum Format() const;
+	size_t ByteSize() const { return (size_t)width * height * components; }
+	void Free();
+};
+
+/// <summary>
+/// How a texture file is turned into a GL texture
+/// </summary>
+struct TextureParams
+{
+	bool flipVertically;	// flip rows on load, for images authored with the origin at the top
+	bool mipmaps;			// generate mipmaps and filter with them
+	bool gamma;				// the image is sRGB encoded, store it in an sRGB format so sampling returns linear values
+	int components;			// channels to decode to (1-4), 0 keeps whatever the file has
+
+	TextureParams(bool flipVertically = false, bool mipmaps = true, bool gamma = false, int components = 0)
+		: flipVertically(flipVertically), mipmaps(mipmaps), gamma(gamma), components(components) {}
+
+	bool operator==(const TextureParams &other) const
+	{
+		return flipVertically == other.flipVertically && mipmaps == other.mipmaps && gamma == other.gamma && components == other.components;
+	}
+};
+
+//Decodes an image file with stb_image. flipVertically is handled here instead of through stb's global flag so decodes can run in parallel.
+//components forces the number of channels, 0 keeps the file's own.
+DecodedImage DecodeImage(const string &filename, bool flipVertically = false, int components = 0);
+
+//Internal format a decoded image is stored in on the GPU
+GLenum InternalFormat(const DecodedImage &image, const TextureParams &params);
+
+//Approximate video memory of a texture, including its mip chain
+size_t TextureMemorySize(int width, int height, GLenum internalFormat, bool mipmaps);
+
+//Sets wrapping/filtering of the currently bound 2D texture
+void ApplyTextureParams(const TextureParams &params);
+
+//Loads a texture that sits next to a model through the shared TextureCache, the caller owns one reference.
+//The texture streams in asynchronously, see TextureStreamer.
+unsigned int TextureFromFile(const char *path, const string &directory, bool gamma = false);
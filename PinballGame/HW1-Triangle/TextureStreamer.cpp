@@ -0,0 +1,177 @@
+#include "TextureStreamer.h"
+
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <thread>
+
+TextureStreamer::TextureStreamer(ThreadPool &pool, size_t uploadBytesPerFrame)
+	: pool(pool), uploadBytesPerFrame(uploadBytesPerFrame), decoded(make_shared<DecodedQueue>())
+{
+}
+
+TextureStreamer::~TextureStreamer()
+{
+	//Decode jobs that are still running only hold on to the queue, free whatever made it through
+	lock_guard<mutex> lock(decoded->lock);
+	for (size_t i = 0; i < decoded->jobs.size(); i++)
+		decoded->jobs[i]->image.Free();
+	for (size_t i = 0; i < uploading.size(); i++)
+		uploading[i]->image.Free();
+}
+
+unsigned int TextureStreamer::Request(const string &filename, const TextureParams &params)
+{
+	shared_ptr<Job> job = make_shared<Job>();
+	job->filename = filename;
+	job->params = params;
+	job->pixelBuffer = 0;
+	job->bytesStaged = 0;
+	job->cancelled = false;
+
+	//The placeholder is what gets sampled until the real image is in
+	static const unsigned char placeholder[4] = { 128, 128, 128, 255 };
+	glGenTextures(1, &job->texture);
+	glBindTexture(GL_TEXTURE_2D, job->texture);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, placeholder);
+	TextureParams placeholderParams = params;
+	placeholderParams.mipmaps = false;
+	ApplyTextureParams(placeholderParams);
+
+	shared_ptr<DecodedQueue> queue = decoded;
+	pool.Submit([job, queue]()
+	{
+		job->image = DecodeImage(job->filename, job->params.flipVertically, job->params.components);
+		lock_guard<mutex> lock(queue->lock);
+		queue->jobs.push_back(job);
+	});
+
+	pending[job->texture] = job;
+	return job->texture;
+}
+
+void TextureStreamer::Update()
+{
+	{
+		lock_guard<mutex> lock(decoded->lock);
+		while (!decoded->jobs.empty())
+		{
+			uploading.push_back(decoded->jobs.front());
+			decoded->jobs.pop_front();
+		}
+	}
+
+	size_t budget = uploadBytesPerFrame;
+	while (!uploading.empty() && budget > 0)
+	{
+		Job &job = *uploading.front();
+		if (job.cancelled)
+		{
+			//The texture was deleted while it was still streaming
+			if (job.pixelBuffer != 0)
+				glDeleteBuffers(1, &job.pixelBuffer);
+			job.image.Free();
+		}
+		else if (!job.image.Valid())
+		{
+			//Keep showing the placeholder, there is nothing better to show
+			cout << "Texture failed to load at path: " << job.filename << endl;
+		}
+		else
+		{
+			budget -= StageJob(job, budget);
+			if (job.bytesStaged < job.image.ByteSize())
+				break;
+			FinishJob(job);
+		}
+		if (!job.cancelled)
+			pending.erase(job.texture);
+		uploading.pop_front();
+	}
+}
+
+void TextureStreamer::Cancel(unsigned int texture)
+{
+	//The job may still be decoding, so just flag it and drop it when it comes through
+	unordered_map<unsigned int, shared_ptr<Job>>::iterator found = pending.find(texture);
+	if (found == pending.end())
+		return;
+	found->second->cancelled = true;
+	pending.erase(found);
+}
+
+void TextureStreamer::Flush()
+{
+	while (!pending.empty())
+	{
+		size_t budget = uploadBytesPerFrame;
+		uploadBytesPerFrame = (size_t)-1;
+		Update();
+		uploadBytesPerFrame = budget;
+		if (!pending.empty())
+			this_thread::sleep_for(chrono::milliseconds(1));
+	}
+}
+
+TextureStreamer& TextureStreamer::Shared()
+{
+	static TextureStreamer streamer;
+	return streamer;
+}
+
+size_t TextureStreamer::StageJob(Job &job, size_t budget)
+{
+	size_t total = job.image.ByteSize();
+	if (job.pixelBuffer == 0)
+	{
+		glGenBuffers(1, &job.pixelBuffer);
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, job.pixelBuffer);
+		glBufferData(GL_PIXEL_UNPACK_BUFFER, total, nullptr, GL_STREAM_DRAW);
+	}
+	else
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, job.pixelBuffer);
+
+	//The GPU never reads a range before it is complete, so the mapping doesn't need to synchronize
+	size_t count = total - job.bytesStaged < budget ? total - job.bytesStaged : budget;
+	void *destination = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, job.bytesStaged, count,
+		GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+	if (destination)
+	{
+		memcpy(destination, job.image.pixels + job.bytesStaged, count);
+		glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+	}
+	else
+	{
+		//Mapping can fail on odd drivers, fall back to a plain copy
+		glBufferSubData(GL_PIXEL_UNPACK_BUFFER, job.bytesStaged, count, job.image.pixels + job.bytesStaged);
+	}
+	job.bytesStaged += count;
+
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+	return count;
+}
+
+void TextureStreamer::FinishJob(Job &job)
+{
+	//With a PBO bound the data pointer is an offset into it, so the driver can DMA the pixels without stalling us
+	GLenum format = job.image.Format();
+	GLenum internalFormat = InternalFormat(job.image, job.params);
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, job.pixelBuffer);
+	glBindTexture(GL_TEXTURE_2D, job.texture);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1); //rows of 1 and 3 component images aren't 4 byte aligned
+	glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, job.image.width, job.image.height, 0, format, GL_UNSIGNED_BYTE, (void*)0);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+	if (job.params.mipmaps)
+		glGenerateMipmap(GL_TEXTURE_2D);
+	ApplyTextureParams(job.params);
+
+	//GL keeps the buffer alive until the copy out of it is done
+	glDeleteBuffers(1, &job.pixelBuffer);
+	job.pixelBuffer = 0;
+
+	if (uploadCallback)
+		uploadCallback(job.texture, job.image.width, job.image.height, internalFormat);
+	job.image.Free();
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include "TextureLoader.h"
+#include "ThreadPool.h"
+using namespace std;
+
+/// <summary>
+/// Loads textures without blocking the render thread.
+/// Request() hands out a texture name right away that shows a neutral 1x1 placeholder. The file is decoded on the
+/// worker pool, and Update() copies the decoded pixels into a pixel buffer object a few megabytes per frame.
+/// Once a texture's buffer is complete its real image replaces the placeholder under the same texture name,
+/// so meshes never have to know whether their textures are ready yet.
+/// </summary>
+class TextureStreamer
+{
+public:
+	explicit TextureStreamer(ThreadPool &pool = ThreadPool::Shared(), size_t uploadBytesPerFrame = 4 * 1024 * 1024);
+	~TextureStreamer();
+
+	//Creates the texture with a placeholder and starts decoding filename in the background. GL thread only.
+	unsigned int Request(const string &filename, const TextureParams &params);
+
+	//Streams decoded pixels to the GPU within the per frame budget. Call once per frame on the GL thread, before textures are bound for drawing.
+	void Update();
+
+	//Stops streaming into a texture that is about to be deleted, does nothing if it already finished. GL thread only.
+	void Cancel(unsigned int texture);
+
+	//Blocks until every requested texture has been uploaded (or failed), e.g. for screenshots or benchmarks
+	void Flush();
+
+	//Called on the GL thread whenever a texture's real image has replaced its placeholder
+	typedef function<void(unsigned int texture, int width, int height, GLenum internalFormat)> UploadCallback;
+	void SetUploadCallback(UploadCallback callback) { uploadCallback = callback; }
+
+	//Number of textures that are still decoding or uploading
+	size_t PendingCount() const { return pending.size(); }
+
+	//Process wide streamer behind the TextureCache
+	static TextureStreamer& Shared();
+
+private:
+	TextureStreamer(const TextureStreamer&) = delete;
+	TextureStreamer& operator=(const TextureStreamer&) = delete;
+
+	struct Job
+	{
+		unsigned int texture;
+		string filename;
+		TextureParams params;
+		DecodedImage image;
+		unsigned int pixelBuffer;	// PBO the pixels are staged in, 0 until the upload starts
+		size_t bytesStaged;
+		bool cancelled;				// the texture was deleted before it finished, only touched on the GL thread
+	};
+
+	//Filled by the decode jobs, drained by Update(). Shared so jobs still running at shutdown don't touch a dead streamer.
+	struct DecodedQueue
+	{
+		mutex lock;
+		deque<shared_ptr<Job>> jobs;
+	};
+
+	//Copies up to budget bytes of job into its PBO, returns the bytes copied. Finishes the texture when everything is staged.
+	size_t StageJob(Job &job, size_t budget);
+	void FinishJob(Job &job);
+
+	ThreadPool &pool;
+	size_t uploadBytesPerFrame;
+	shared_ptr<DecodedQueue> decoded;
+	deque<shared_ptr<Job>> uploading;
+	unordered_map<unsigned int, shared_ptr<Job>> pending;	// textures still showing their placeholder
+	UploadCallback uploadCallback;
+};
@@ -0,0 +1,119 @@
+#include "ThreadPool.h"
+
+#include <atomic>
+#include <exception>
+#include <memory>
+
+ThreadPool::ThreadPool(unsigned int threadCount) : stopping(false)
+{
+	if (threadCount == 0)
+		threadCount = thread::hardware_concurrency();
+	if (threadCount == 0)
+		threadCount = 2; //hardware_concurrency is allowed to return 0 when it can't tell
+
+	for (unsigned int i = 0; i < threadCount; i++)
+		workers.emplace_back(&ThreadPool::WorkerLoop, this);
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		lock_guard<mutex> lock(queueMutex);
+		stopping = true;
+	}
+	jobAvailable.notify_all();
+	for (size_t i = 0; i < workers.size(); i++)
+		workers[i].join();
+}
+
+future<void> ThreadPool::Submit(function<void()> job)
+{
+	packaged_task<void()> task(move(job));
+	future<void> result = task.get_future();
+	{
+		lock_guard<mutex> lock(queueMutex);
+		jobs.push_back(move(task));
+	}
+	jobAvailable.notify_one();
+	return result;
+}
+
+void ThreadPool::ParallelFor(size_t count, const function<void(size_t)> &job)
+{
+	if (count == 0)
+		return;
+
+	//Shared between the caller and the helpers. Helpers that only get to run after the caller returned
+	//find nothing left to do, so the caller never has to wait for them (this keeps nested calls from deadlocking).
+	struct Batch
+	{
+		atomic<size_t> next;
+		atomic<size_t> finished;
+		size_t count;
+		function<void(size_t)> job;
+		exception_ptr error;
+		mutex lock;
+		condition_variable done;
+	};
+	shared_ptr<Batch> batch = make_shared<Batch>();
+	batch->next = 0;
+	batch->finished = 0;
+	batch->count = count;
+	batch->job = job;
+
+	//Every participant keeps grabbing the next index until they're used up, so uneven jobs balance out
+	auto drain = [batch]()
+	{
+		for (size_t i = batch->next++; i < batch->count; i = batch->next++)
+		{
+			try
+			{
+				batch->job(i);
+			}
+			catch (...)
+			{
+				lock_guard<mutex> lock(batch->lock);
+				if (!batch->error)
+					batch->error = current_exception();
+			}
+			if (++batch->finished == batch->count)
+			{
+				lock_guard<mutex> lock(batch->lock);
+				batch->done.notify_all();
+			}
+		}
+	};
+
+	size_t helperCount = count - 1 < workers.size() ? count - 1 : workers.size();
+	for (size_t i = 0; i < helperCount; i++)
+		Submit(drain);
+
+	drain();
+	unique_lock<mutex> lock(batch->lock);
+	batch->done.wait(lock, [&batch]() { return batch->finished == batch->count; });
+	if (batch->error)
+		rethrow_exception(batch->error);
+}
+
+ThreadPool& ThreadPool::Shared()
+{
+	static ThreadPool pool;
+	return pool;
+}
+
+void ThreadPool::WorkerLoop()
+{
+	for (;;)
+	{
+		packaged_task<void()> task;
+		{
+			unique_lock<mutex> lock(queueMutex);
+			jobAvailable.wait(lock, [this]() { return stopping || !jobs.empty(); });
+			if (stopping && jobs.empty())
+				return;
+			task = move(jobs.front());
+			jobs.pop_front();
+		}
+		task();
+	}
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <thread>
+#include <vector>
+using namespace std;
+
+/// <summary>
+/// A fixed set of worker threads pulling jobs from one shared queue.
+/// Jobs must not touch OpenGL, the context only lives on the main thread.
+/// </summary>
+class ThreadPool
+{
+public:
+	//Creates threadCount workers, 0 means one per hardware thread
+	explicit ThreadPool(unsigned int threadCount = 0);
+	~ThreadPool();
+
+	//Queues a job and returns a future that becomes ready once it has run
+	future<void> Submit(function<void()> job);
+
+	//Runs job(i) for every i in [0, count) spread over the workers and the calling thread, returns when all are done
+	void ParallelFor(size_t count, const function<void(size_t)> &job);
+
+	unsigned int ThreadCount() const { return (unsigned int)workers.size(); }
+
+	//Process wide pool shared by the loaders
+	static ThreadPool& Shared();
+
+private:
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+
+	void WorkerLoop();
+
+	vector<thread> workers;
+	deque<packaged_task<void()>> jobs;
+	mutex queueMutex;
+	condition_variable jobAvailable;
+	bool stopping;
+};
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_inverse.hpp>
+
+/// <summary>
+/// A model matrix with its normal matrix (the inverse transpose of the upper 3x3).
+/// The normal matrix is only recomputed when Set() gets a different model, shaders receive both and only multiply.
+/// </summary>
+class Transform
+{
+public:
+	Transform() : model(1.0f), normal(1.0f) {}
+	explicit Transform(const glm::mat4 &model) : model(model), normal(NormalMatrix(model)) {}
+
+	//Returns true if the model changed and the normal matrix was rebuilt
+	bool Set(const glm::mat4 &model)
+	{
+		if (model == this->model)
+			return false;
+		this->model = model;
+		normal = NormalMatrix(model);
+		return true;
+	}
+
+	const glm::mat4& Model() const { return model; }
+	const glm::mat3& Normal() const { return normal; }
+
+	static glm::mat3 NormalMatrix(const glm::mat4 &model) { return glm::inverseTranspose(glm::mat3(model)); }
+
+private:
+	glm::mat4 model;
+	glm::mat3 normal;
+};
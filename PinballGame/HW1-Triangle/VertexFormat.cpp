@@ -0,0 +1,146 @@
+#include "VertexFormat.h"
+
+#include <cstring>
+#include <glm/gtc/packing.hpp>
+#include "Mesh.h"
+
+bool VertexLayout::quantizeByDefault = true;
+
+namespace
+{
+	//Unit vectors only need 10 bits per component, the 2 bit w is left 0
+	uint32_t PackDirection(const glm::vec3 &direction)
+	{
+		return glm::packSnorm3x10_1x2(glm::vec4(glm::clamp(direction, -1.0f, 1.0f), 0.0f));
+	}
+
+	//Float layout without the tangent frame, the first three members of Vertex
+	const size_t FLOAT_BASE_SIZE = offsetof(Vertex, Tangent);
+	//Tangent and bitangent, they follow each other in Vertex
+	const size_t FLOAT_TANGENT_FRAME_SIZE = offsetof(Vertex, LightmapCoords) - offsetof(Vertex, Tangent);
+}
+
+GLsizei VertexLayout::Stride() const
+{
+	return (GLsizei)(lightmapOffset() + (lightmapped ? (quantized ? sizeof(PackedLightmapCoords) : sizeof(glm::vec2)) : 0));
+}
+
+size_t VertexLayout::lightmapOffset() const
+{
+	if (quantized)
+		return sizeof(PackedVertex) + (tangentFrame ? sizeof(PackedTangentFrame) : 0);
+	return FLOAT_BASE_SIZE + (tangentFrame ? FLOAT_TANGENT_FRAME_SIZE : 0);
+}
+
+void VertexLayout::Pack(const Vertex *vertices, size_t count, unsigned char *destination) const
+{
+	size_t stride = Stride();
+	if (!quantized)
+	{
+		//Vertex already is the full float layout, the smaller layouts leave out the parts they don't need
+		if (tangentFrame && lightmapped)
+		{
+			memcpy(destination, vertices, count * sizeof(Vertex));
+			return;
+		}
+		for (size_t i = 0; i < count; i++)
+		{
+			memcpy(destination + i * stride, &vertices[i], FLOAT_BASE_SIZE);
+			if (tangentFrame)
+				memcpy(destination + i * stride + FLOAT_BASE_SIZE, &vertices[i].Tangent, FLOAT_TANGENT_FRAME_SIZE);
+			if (lightmapped)
+				memcpy(destination + i * stride + lightmapOffset(), &vertices[i].LightmapCoords, sizeof(glm::vec2));
+		}
+		return;
+	}
+
+	for (size_t i = 0; i < count; i++)
+	{
+		const Vertex &vertex = vertices[i];
+		PackedVertex packed;
+		packed.Position = vertex.Position;
+		packed.Normal = PackDirection(vertex.Normal);
+		uint32_t texCoords = glm::packHalf2x16(vertex.TexCoords);
+		memcpy(packed.TexCoords, &texCoords, sizeof(texCoords));
+		memcpy(destination + i * stride, &packed, sizeof(packed));
+
+		if (tangentFrame)
+		{
+			PackedTangentFrame frame;
+			frame.Tangent = PackDirection(vertex.Tangent);
+			frame.Bitangent = PackDirection(vertex.Bitangent);
+			memcpy(destination + i * stride + sizeof(PackedVertex), &frame, sizeof(frame));
+		}
+		if (lightmapped)
+		{
+			PackedLightmapCoords coords;
+			uint32_t lightmapCoords = glm::packUnorm2x16(vertex.LightmapCoords);
+			memcpy(coords.LightmapCoords, &lightmapCoords, sizeof(lightmapCoords));
+			memcpy(destination + i * stride + lightmapOffset(), &coords, sizeof(coords));
+		}
+	}
+}
+
+void VertexLayout::Apply(size_t offset) const
+{
+	GLsizei stride = Stride();
+	if (quantized)
+	{
+		// vertex positions
+		glEnableVertexAttribArray(0);
+		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, (void*)(offset + offsetof(PackedVertex, Position)));
+		// vertex normals, normalized so the shader sees -1..1
+		glEnableVertexAttribArray(1);
+		glVertexAttribPointer(1, 4, GL_INT_2_10_10_10_REV, GL_TRUE, stride, (void*)(offset + offsetof(PackedVertex, Normal)));
+		// vertex texture coords
+		glEnableVertexAttribArray(2);
+		glVertexAttribPointer(2, 2, GL_HALF_FLOAT, GL_FALSE, stride, (void*)(offset + offsetof(PackedVertex, TexCoords)));
+		if (tangentFrame)
+		{
+			glEnableVertexAttribArray(3);
+			glVertexAttribPointer(3, 4, GL_INT_2_10_10_10_REV, GL_TRUE, stride, (void*)(offset + sizeof(PackedVertex) + offsetof(PackedTangentFrame, Tangent)));
+			glEnableVertexAttribArray(4);
+			glVertexAttribPointer(4, 4, GL_INT_2_10_10_10_REV, GL_TRUE, stride, (void*)(offset + sizeof(PackedVertex) + offsetof(PackedTangentFrame, Bitangent)));
+		}
+	}
+	else
+	{
+		glEnableVertexAttribArray(0);
+		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, (void*)(offset + offsetof(Vertex, Position)));
+		glEnableVertexAttribArray(1);
+		glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, stride, (void*)(offset + offsetof(Vertex, Normal)));
+		glEnableVertexAttribArray(2);
+		glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, stride, (void*)(offset + offsetof(Vertex, TexCoords)));
+		if (tangentFrame)
+		{
+			glEnableVertexAttribArray(3);
+			glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, stride, (void*)(offset + FLOAT_BASE_SIZE));
+			glEnableVertexAttribArray(4);
+			glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, stride, (void*)(offset + FLOAT_BASE_SIZE + sizeof(glm::vec3)));
+		}
+	}
+	if (!tangentFrame)
+	{
+		glDisableVertexAttribArray(3);
+		glDisableVertexAttribArray(4);
+	}
+	if (lightmapped)
+	{
+		glEnableVertexAttribArray(LIGHTMAP_ATTRIBUTE);
+		if (quantized)
+			glVertexAttribPointer(LIGHTMAP_ATTRIBUTE, 2, GL_UNSIGNED_SHORT, GL_TRUE, stride, (void*)(offset + lightmapOffset()));
+		else
+			glVertexAttribPointer(LIGHTMAP_ATTRIBUTE, 2, GL_FLOAT, GL_FALSE, stride, (void*)(offset + lightmapOffset()));
+	}
+	else
+		glDisableVertexAttribArray(LIGHTMAP_ATTRIBUTE);
+}
+
+VertexLayout VertexLayout::ForTextures(const vector<Texture> &textures)
+{
+	bool normalMapped = false;
+	for (size_t i = 0; i < textures.size(); i++)
+		if (textures[i].type == "texture_normal")
+			normalMapped = true;
+	return VertexLayout(quantizeByDefault, normalMapped);
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <cstdint>
+#include <vector>
+using namespace std;
+
+struct Vertex;
+struct Texture;
+
+/// <summary>
+/// Describes how a mesh's vertices are stored in its vertex buffer.
+/// Import always produces full float Vertex structs, the layout decides what actually goes to the GPU:
+///   quantized:    position as floats, normal/tangent/bitangent as 10_10_10_2 snorm, texture coords as half floats
+///   tangentFrame: tangent and bitangent are only stored when a material needs them (normal maps)
+///   lightmapped:  the second uv set into the object's lightmap atlas is only stored for baked objects (Lightmap),
+///                 quantized as 16 bit unorm since it always lies in 0..1
+/// Attribute locations: 0 position, 1 normal, 2 texture coords, 3 tangent, 4 bitangent, 14 lightmap coords
+/// (5-13 are taken by the InstanceBuffer).
+/// </summary>
+struct VertexLayout
+{
+	static const GLuint LIGHTMAP_ATTRIBUTE = 14;
+
+	bool quantized;
+	bool tangentFrame;
+	bool lightmapped;
+
+	VertexLayout(bool quantized = true, bool tangentFrame = false, bool lightmapped = false)
+		: quantized(quantized), tangentFrame(tangentFrame), lightmapped(lightmapped) {}
+
+	//Bytes per vertex
+	GLsizei Stride() const;
+
+	//Writes count vertices into destination, which must hold count * Stride() bytes
+	void Pack(const Vertex *vertices, size_t count, unsigned char *destination) const;
+
+	//Points the vertex attributes at the currently bound GL_ARRAY_BUFFER, starting at byte offset
+	void Apply(size_t offset = 0) const;
+
+	bool operator==(const VertexLayout &other) const
+	{
+		return quantized == other.quantized && tangentFrame == other.tangentFrame && lightmapped == other.lightmapped;
+	}
+	bool operator!=(const VertexLayout &other) const { return !(*this == other); }
+
+	//Picks the smallest layout that has everything the material's textures need
+	static VertexLayout ForTextures(const vector<Texture> &textures);
+
+	//Whether ForTextures quantizes, turn off to compare against full float vertices
+	static bool quantizeByDefault;
+
+private:
+	//Byte offset of the lightmap coords inside one vertex, they always come last
+	size_t lightmapOffset() const;
+};
+
+//Vertex as stored by the quantized layout, 20 bytes (28 with the tangent frame appended, 4 more with lightmap coords)
+struct PackedVertex
+{
+	glm::vec3 Position;
+	uint32_t Normal;		// GL_INT_2_10_10_10_REV
+	uint16_t TexCoords[2];	// GL_HALF_FLOAT
+};
+
+struct PackedTangentFrame
+{
+	uint32_t Tangent;		// GL_INT_2_10_10_10_REV
+	uint32_t Bitangent;		// GL_INT_2_10_10_10_REV
+};
+
+struct PackedLightmapCoords
+{
+	uint16_t LightmapCoords[2];	// GL_UNSIGNED_SHORT, normalized
+};
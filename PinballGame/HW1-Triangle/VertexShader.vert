@@ -1,20 +1,81 @@
 #version 330 core
+// permutations, see ShaderDefines:
+//   INSTANCED              transform, tint and emissive come per instance from the InstanceBuffer
+//   NORMAL_MAP             passes the tangent frame on to FragmentShader.frag
+//   INVERSE_NORMAL_MATRIX  the old per vertex inverse(model), only for NormalMatrixBenchmark
+//   LIGHTMAP               passes the second uv set of baked objects on to FragmentShader.frag
 layout (location = 0) in vec3 aPos;
 layout (location = 1) in vec3 aNormal;
 layout (location = 2) in vec2 aTexCoords;
+#ifdef NORMAL_MAP
+layout (location = 3) in vec3 aTangent;
+layout (location = 4) in vec3 aBitangent;
+#endif
+#ifdef LIGHTMAP
+layout (location = 14) in vec2 aLightmapCoords;
+#endif
+#ifdef INSTANCED
+// per instance (InstanceBuffer), the model matrix takes locations 5-8, the normal matrix 11-13
+layout (location = 5) in mat4 aModel;
+layout (location = 9) in vec4 aTint;
+layout (location = 10) in float aEmissive;
+layout (location = 11) in mat3 aNormalMatrix;
+#endif
 
+// per frame camera, shared by every program (FrameUniforms)
+layout (std140) uniform Camera
+{
+	mat4 projection;
+	mat4 view;
+	vec3 viewPos;
+};
+
+#ifndef INSTANCED
 uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+// inverse transpose of model's upper 3x3, computed on the CPU whenever model changes (Transform)
+uniform mat3 normalMatrix;
+#endif
+
+// DepthShader.vert computes the same position for the depth pre-pass, the opaque pass then tests GL_EQUAL against it
+invariant gl_Position;
 
 out vec3 FragPos;
 out vec3 Normal;
 out vec2 TexCoords;
+out vec4 Tint;
+out float Emissive;
+#ifdef NORMAL_MAP
+out mat3 TBN;
+#endif
+#ifdef LIGHTMAP
+out vec2 LightmapCoords;
+#endif
 
 void main()
 {
-    gl_Position = projection * view * model * vec4(aPos, 1.0);
-	FragPos = vec3(model * vec4(aPos,1.0));
-	Normal = mat3(transpose(inverse(model))) * aNormal;
+#ifdef INSTANCED
+	mat4 world = aModel;
+	mat3 normals = aNormalMatrix;
+	Tint = aTint;
+	Emissive = aEmissive;
+#else
+	mat4 world = model;
+	mat3 normals = normalMatrix;
+	Tint = vec4(1.0);
+	Emissive = 0.0;
+#endif
+#ifdef INVERSE_NORMAL_MATRIX
+	normals = mat3(transpose(inverse(world)));
+#endif
+
+    gl_Position = projection * view * world * vec4(aPos, 1.0);
+	FragPos = vec3(world * vec4(aPos,1.0));
+	Normal = normals * aNormal;
 	TexCoords = aTexCoords;
-} 
\ No newline at end of file
+#ifdef NORMAL_MAP
+	TBN = mat3(normalize(normals * aTangent), normalize(normals * aBitangent), normalize(Normal));
+#endif
+#ifdef LIGHTMAP
+	LightmapCoords = aLightmapCoords;
+#endif
+}
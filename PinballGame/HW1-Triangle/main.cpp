@@ -5,11 +5,34 @@
 #include <GLM/gtc/matrix_transform.hpp>
 #include <GLM/gtc/type_ptr.hpp>
 #include <glm/gtc/random.hpp>
+#include <cstdlib>
 #include <iostream>
 #include "Shader.h"
 #include "stb_image.h"
 #include "Camera.h"
+#include "CameraPath.h"
+#include "FrameTimings.h"
+#include "FrameUniforms.h"
+#include "Frustum.h"
+#include "GeometryBuffer.h"
+#include "HeadlessContext.h"
+#include "InstanceBuffer.h"
+#include "LightClusters.h"
+#include "Lightmap.h"
 #include "Object.h"
+#include "ModelLoader.h"
+#include "NormalMatrixBenchmark.h"
+#include "FixedTimestep.h"
+#include "PhysicsWorld.h"
+#include "Profiler.h"
+#include "ProfilerOverlay.h"
+#include "RenderQueue.h"
+#include "RenderTarget.h"
+#include "ShaderBatch.h"
+#include "ShaderCache.h"
+#include "TextureCache.h"
+#include "TextureLoader.h"
+#include "TextureStreamer.h"
 using namespace std;
 using namespace glm;
 
@@ -20,6 +43,7 @@ void mouse_callback(GLFWwindow* window, double xpos, double ypos);
 void scroll_callback(GLFWwindow* window, double xoffset, double yoffset);
 void processInput(GLFWwindow *window);
 unsigned int LoadTexture(string path);
+Mesh CreateSphere(int segments, int rings);
 const int WINDOW_WIDTH = 800;
 const int WINDOW_HEIGHT = 1080;
 typedef Shader::LightSettings lightsettings;
@@ -36,43 +60,144 @@ float lastFrame = 0.0f;
 
 //Lighting
 vec3 lightPos(1.2f, 1.0f, 2.0f);
+
+//Instancing stress test, toggled with I: a grid of extra top bumpers that costs one draw per mesh
+bool showInstanceGrid = false;
+const int INSTANCE_GRID_SIZE = 16;
+
+//Camera flashlight, toggled with F: switches to the SPOT_LIGHT permutation of the lit shaders
+bool flashlightOn = false;
+
+//Lighting stress test, toggled with L: small insert lamps spread over the table, binned by LightClusters
+bool showInsertLamps = false;
+const int INSERT_LAMP_COUNT = 120;
+
+//Baked lighting on the table frame, toggled with B: off shades every light per fragment again
+bool useLightmap = true;
+const int LIGHTMAP_TEXTURE_UNIT = 11;
+
+//Depth pre-pass of the opaque objects, toggled with Z: compare "Depth pre-pass" plus "Lit objects" in the profiler with and without
+bool depthPrepass = false;
+
+//Headless benchmark runs step time by a fixed amount per frame, so every run renders the same frames
+const int HEADLESS_DEFAULT_FRAMES = 600;
+const float HEADLESS_FRAME_TIME = 1.0f / 60.0f;
+
+//Physics runs at a fixed rate of its own, rendering interpolates between its last two steps.
+//A frame never takes more than PHYSICS_MAX_STEPS steps, longer frames slow the game down instead.
+//The flippers are on the shift keys, headless runs flip both for HEADLESS_FLIP_TIME out of every second.
+const double PHYSICS_RATE = 1000.0;
+const int PHYSICS_MAX_STEPS = 100;
+const float HEADLESS_FLIP_TIME = 0.2f;
+//The models aren't in meters, the frame's length stands for a standard playfield's
+const float PLAYFIELD_LENGTH = 1.07f;
+const float BALL_RADIUS = 0.0135f;		// meters
+const float BALL_MAX_SPEED = 20.0f;		// meters per second
+//Broadphase of the ball sweeps, cycled with G to compare them on the same table
+Broadphase broadphase = BROADPHASE_BVH;
+//Multiball: DEFAULT_BALLS on the table at the start, -balls N for stress runs, N drops one more
+const int DEFAULT_BALLS = 6;
+const vec4 BALL_TINT(0.9f, 0.9f, 0.95f, 1.0f);
+int ballsToDrop = 0;
+
+//Profiler averages on screen, toggled with O. T captures the next frames into a chrome://tracing file.
+bool showProfiler = true;
+const int PROFILE_CAPTURE_FRAMES = 300;
+const char PROFILE_TRACE_PATH[] = "profile_trace.json";
 #pragma endregion
 
-int main()
+int main(int argc, char *argv[])
 {
+#pragma region Command line
+	//-headless: no window, render offscreen along a camera path for a fixed number of frames and write the frame timings
+	//  -frames N				frames to render (default HEADLESS_DEFAULT_FRAMES)
+	//  -timings file			per frame CPU/GPU times, CSV or .json (default frametimes.csv)
+	//  -camerapath file		keyframes for CameraPath::Load instead of CameraPath::Default
+	//  -screenshot file.ppm	the last frame
+	//-trace file: Profiler capture of the headless run, or of the first PROFILE_CAPTURE_FRAMES frames in a window
+	//-depthprepass: start with the depth pre-pass on, so headless runs can be compared with and without
+	//-broadphase bvh|grid|none: what ball sweeps go through, G cycles it at runtime
+	//-balls N: balls on the table at the start (default DEFAULT_BALLS)
+	bool headless = false;
+	int ballCount = DEFAULT_BALLS;
+	int headlessFrames = HEADLESS_DEFAULT_FRAMES;
+	string timingsPath = "frametimes.csv";
+	string cameraPathFile;
+	string screenshotPath;
+	string tracePath;
+	for (int i = 1; i < argc; i++)
+	{
+		string arg(argv[i]);
+		if (arg == "-headless")
+			headless = true;
+		else if (arg == "-frames" && i + 1 < argc)
+			headlessFrames = atoi(argv[++i]);
+		else if (arg == "-timings" && i + 1 < argc)
+			timingsPath = argv[++i];
+		else if (arg == "-camerapath" && i + 1 < argc)
+			cameraPathFile = argv[++i];
+		else if (arg == "-screenshot" && i + 1 < argc)
+			screenshotPath = argv[++i];
+		else if (arg == "-trace" && i + 1 < argc)
+			tracePath = argv[++i];
+		else if (arg == "-depthprepass")
+			depthPrepass = true;
+		else if (arg == "-broadphase" && i + 1 < argc)
+		{
+			string name(argv[++i]);
+			broadphase = name == "grid" ? BROADPHASE_GRID : (name == "none" ? BROADPHASE_NONE : BROADPHASE_BVH);
+		}
+		else if (arg == "-balls" && i + 1 < argc)
+			ballCount = std::max(0, atoi(argv[++i]));
+	}
+#pragma endregion
+
 #pragma region Window and GLAD initialization
-	//====Initialize glfw====
-	glfwInit();
-	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3); //Setting the GLFW version to 3
-	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
-	glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE); //Telling glfw to use core which alots a smaller subset of OpenGL features
-
-	GLFWwindow* window = glfwCreateWindow(WINDOW_WIDTH, WINDOW_HEIGHT, "Barry's Engine", NULL, NULL); //Window object creation
-	if (window == NULL) //Check if the window was created correctly
+	GLFWwindow* window = NULL;
+	HeadlessContext headlessContext;
+	GLADloadproc loader = (GLADloadproc)glfwGetProcAddress;
+	if (headless)
 	{
-		cout << "Failed to create GLFW window" << endl;
-		glfwTerminate();
-		return -1;
+		if (!headlessContext.Create())
+			return -1;
+		loader = HeadlessContext::Loader();
 	}
+	else
+	{
+		//====Initialize glfw====
+		glfwInit();
+		glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3); //Setting the GLFW version to 3
+		glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+		glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE); //Telling glfw to use core which alots a smaller subset of OpenGL features
+
+		window = glfwCreateWindow(WINDOW_WIDTH, WINDOW_HEIGHT, "Barry's Engine", NULL, NULL); //Window object creation
+		if (window == NULL) //Check if the window was created correctly
+		{
+			cout << "Failed to create GLFW window" << endl;
+			glfwTerminate();
+			return -1;
+		}
 
-	//====Create Viewport====
-	//Call back if window is resized
-	glfwMakeContextCurrent(window);
-	glfwSetFramebufferSizeCallback(window, framebuffer_size_callback); //Tells GLFW we want to call this function on every window resize
-	glfwSetCursorPosCallback(window, mouse_callback);
-	glfwSetScrollCallback(window, scroll_callback);
+		//====Create Viewport====
+		//Call back if window is resized
+		glfwMakeContextCurrent(window);
+		glfwSetFramebufferSizeCallback(window, framebuffer_size_callback); //Tells GLFW we want to call this function on every window resize
+		glfwSetCursorPosCallback(window, mouse_callback);
+		glfwSetScrollCallback(window, scroll_callback);
 
-	// tell GLFW to capture our mouse
-	glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
+		// tell GLFW to capture our mouse
+		glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
+	}
 
 	//====Initialize glad====
 	//important because glad is used to manage function pointers for opengl
 	//it needs to be initialized before using any of the opengl functions
-	if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress)) //Loading the correct OpenGL function pointer location to GLAD (specific to os)
+	if (!gladLoadGLLoader(loader)) //Loading the correct OpenGL function pointer location to GLAD (specific to os)
 	{
 		cout << "Failed to initialize GLAD" << endl;
 		return -1;
 	}
+	ShaderBatch::LoadExtensions(loader);
 
 #pragma endregion
 
@@ -83,8 +208,27 @@ int main()
 	glEnable(GL_DEPTH_TEST);
 
 	//Build and compile shader
-	Shader lightingShader("VertexShader.vert", "FragmentShader.frag");
-	Shader lampShader("LampShader.vert", "LampShader.frag");
+	//Permutations are picked with defines, linked programs come from the ShaderCache after the first run.
+	//All of them are submitted as one batch and compile while the models and textures load, see ShaderBatch.
+	ShaderDefines instanced = ShaderDefines().Define("INSTANCED");
+	ShaderDefines flashlight = ShaderDefines().Define("SPOT_LIGHT");
+	ShaderBatch shaderBatch;
+	Shader lightingShader("VertexShader.vert", "FragmentShader.frag", shaderBatch);
+	Shader lampShader("LampShader.vert", "LampShader.frag", shaderBatch);
+	//Same shading, transform/tint/emissive come from the instance buffer
+	Shader instancedLightingShader("VertexShader.vert", "FragmentShader.frag", shaderBatch, instanced);
+	Shader instancedLampShader("LampShader.vert", "LampShader.frag", shaderBatch, instanced);
+	//Both lit programs again with the flashlight compiled in
+	Shader flashlightShader("VertexShader.vert", "FragmentShader.frag", shaderBatch, flashlight);
+	Shader instancedFlashlightShader("VertexShader.vert", "FragmentShader.frag", shaderBatch, ShaderDefines(flashlight).Define("INSTANCED"));
+	//The frame's static lights come from its lightmap, with and without the flashlight
+	Shader lightmappedShader("VertexShader.vert", "FragmentShader.frag", shaderBatch, ShaderDefines().Define("LIGHTMAP"));
+	Shader lightmappedFlashlightShader("VertexShader.vert", "FragmentShader.frag", shaderBatch, ShaderDefines(flashlight).Define("LIGHTMAP"));
+	//Depth only, for the RenderQueue's pre-pass
+	Shader depthShader("DepthShader.vert", "DepthShader.frag", shaderBatch);
+	Shader instancedDepthShader("DepthShader.vert", "DepthShader.frag", shaderBatch, instanced);
+	Shader *litShaders[] = { &lightingShader, &instancedLightingShader, &flashlightShader, &instancedFlashlightShader,
+		&lightmappedShader, &lightmappedFlashlightShader };
 
 
 	float testSquareVerts[] = {
@@ -139,21 +283,47 @@ int main()
 	glm::vec3(0.0f,  0.0f, -3.0f)
 	};
 
-	Object M_Frame("resources/Frame.obj");
-	Object M_Paddle_L("resources/Paddle_Left.obj");
-	Object M_Paddle_R("resources/Paddle_Right.obj");
-	Object M_Bumper_BL("resources/Bumper_BotLeft.obj");
-	Object M_Bumper_BR("resources/Bumper_BotRight.obj");
-	Object M_Bumper_T("resources/Bumper_Top.obj");
-	Object objectList[] =
+	//The sun, the bumper lights and the fixed lamp never move. The frame gets their diffuse and ambient light baked into
+	//a lightmap, and every frame they go into the light clusters first, so the LIGHTMAP shaders can skip them by index.
+	StaticLights staticLights;
+	staticLights.sun = { vec3(-0.2f, -1.0f, -0.3f), vec3(0.05f, 0.05f, 0.05f), vec3(0.4f, 0.4f, 0.4f), vec3(0.5f, 0.5f, 0.5f) };
+
+	//Import all table objects at once on the worker pool, only the GL uploads happen on this thread
+	vector<Object> objectList = LoadModels(
 	{
-		M_Frame,
-		M_Paddle_L,
-		M_Paddle_R,
-		M_Bumper_BL,
-		M_Bumper_BR,
-		M_Bumper_T
-	};
+		"resources/Frame.obj",				//M_Frame
+		"resources/Paddle_Left.obj",		//M_Paddle_L
+		"resources/Paddle_Right.obj",		//M_Paddle_R
+		"resources/Bumper_BotLeft.obj",		//M_Bumper_BL
+		"resources/Bumper_BotRight.obj",	//M_Bumper_BR
+		"resources/Bumper_Top.obj"			//M_Bumper_T
+	}, ThreadPool::Shared(), [&staticLights, &pointLightPositions](vector<Object> &objects)
+	{
+		// bumper light 1
+		lightsettings settings = { "bumperLight", objects[3].position, vec3(0.5f, 0.5f, 0.5f),
+					vec3(.2f, 0.0f, 0.0f), vec3(1.0f, 1.0f, 1.0f), 1.0f, 0.09f, 0.032f };
+		staticLights.points.push_back(settings);
+
+		// bumper light 2
+		settings.ambient = vec3(0.0f, 0.0f, .2f);
+		settings.specular = vec3(1.0f, 1.0f, 1.f);
+		settings.position = objects[4].position;
+		staticLights.points.push_back(settings);
+
+		// bumper light 3
+		settings.ambient = vec3(0.0f, .2f, 0.0f);
+		settings.position = objects[5].position;
+		staticLights.points.push_back(settings);
+
+		// fixed lamp
+		settings.name = "lamp";
+		settings.ambient = vec3(0.0f, 0.0f, 0.0f);
+		settings.position = pointLightPositions[3];
+		staticLights.points.push_back(settings);
+
+		//Before the upload, the unwrap splits vertices. Cached next to the model after the first run.
+		objects[0].BakeLightmap(staticLights);
+	});
 	
 
 	//Setup Cube VAO and VBO
@@ -164,7 +334,7 @@ int main()
 	glBindBuffer(GL_ARRAY_BUFFER, VBO);
 	glBufferData(GL_ARRAY_BUFFER, sizeof(testSquareVerts), testSquareVerts, GL_STATIC_DRAW);
 
-	glBindVertexArray(cubeVAO);
+	BindVertexArray(cubeVAO);
 	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)0);
 	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(3 * sizeof(float)));
 	glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(6 * sizeof(float)));
@@ -175,7 +345,7 @@ int main()
 
 	unsigned int lampVAO;
 	glGenVertexArrays(1, &lampVAO);
-	glBindVertexArray(lampVAO);
+	BindVertexArray(lampVAO);
 
 	glBindBuffer(GL_ARRAY_BUFFER, VBO);
 	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)0);
@@ -191,25 +361,211 @@ int main()
 
 #pragma endregion
 
+	//Camera and light state shared by all programs, updated once per frame. Attaching is the first use of the programs.
+	FrameUniforms frameUniforms;
+	for (Shader *shader : litShaders)
+		frameUniforms.Attach(*shader);
+	frameUniforms.Attach(lampShader);
+	frameUniforms.Attach(instancedLampShader);
+	frameUniforms.Attach(depthShader);
+	frameUniforms.Attach(instancedDepthShader);
+	//Point lights are binned into clusters every frame, only the lit programs read them
+	LightClusters lightClusters;
+	for (Shader *shader : litShaders)
+		lightClusters.Attach(*shader);
+	shaderBatch.Finish();
+
+	const ShaderCache::Stats &shaderCache = ShaderCache::GetStats();
+	const ShaderBatch::Stats &shaderCompile = shaderBatch.GetStats();
+	cout << "SHADER CACHE:: " << shaderCache.hits << " programs loaded, " << shaderCache.misses << " compiled" << endl;
+	cout << "SHADER COMPILE:: " << shaderCompile.programs << " programs submitted in " << shaderCompile.submitMs << " ms, "
+		<< shaderCompile.stallMs << " ms waiting at first use (parallel compile " << (ShaderBatch::ParallelCompile() ? "on" : "off") << ")" << endl;
+
+	//The paddle models come with no pivot, the outer top corner of their bounds stands in for it.
+	//The table lies in the xy plane facing +z, so the flippers swing about z.
+	PhysicsWorld physicsWorld;
+	size_t flippers[2];
+	for (int i = 0; i < 2; i++)
+	{
+		const BoundingBox &paddle = objectList[1 + i].bounds.box;
+		vec3 extent = paddle.Empty() ? vec3(0.0f) : paddle.max - paddle.min;
+		float inset = 0.15f * std::min(extent.x, extent.y);
+		vec3 pivot = paddle.Empty() ? vec3(0.0f) : vec3(i == 0 ? paddle.min.x + inset : paddle.max.x - inset,
+			paddle.max.y - inset, (paddle.min.z + paddle.max.z) * 0.5f);
+		flippers[i] = physicsWorld.AddFlipper(pivot, vec3(0.0f, 0.0f, 1.0f), i == 0 ? radians(60.0f) : -radians(60.0f));
+	}
+	//The frame and the bumpers are the static collision geometry, the ball sweeps against their triangles
+	for (int i : { 0, 3, 4, 5 })
+		physicsWorld.StaticGeometry().Add(objectList[i].meshes, objectList[i].transform.Model());
+	for (int i = 0; i < 2; i++)
+		physicsWorld.FlipperGeometry(flippers[i]).Add(objectList[1 + i].meshes, objectList[1 + i].transform.Model());
+	cout << "COLLISION:: " << physicsWorld.StaticGeometry().TriangleCount() << " static triangles" << endl;
+	physicsWorld.BuildCollision("resources/Frame.obj.bvh");
+	physicsWorld.StaticBvh().PrintStats(cout);
+	physicsWorld.StaticGrid().PrintStats(cout);
+	physicsWorld.SetBroadphase(broadphase);
+	const BoundingBox &frameBox = objectList[0].bounds.box;
+	float unitsPerMeter = frameBox.Empty() ? 1.0f : (frameBox.max.y - frameBox.min.y) / PLAYFIELD_LENGTH;
+	physicsWorld.ballSettings.gravity *= unitsPerMeter;
+	physicsWorld.ballSettings.restingSpeed *= unitsPerMeter;
+	FixedTimestep physicsClock(PHYSICS_RATE, PHYSICS_MAX_STEPS);
+	//Every ball is the same unit sphere, scaled per instance
+	Mesh ballMesh = CreateSphere(24, 12);
+
+	//-benchnormals: time the per vertex inverse() against the CPU normal matrix before starting
+	//-benchshaders: compile the permutations the game builds one by one and as a batch, without any caches
+	//-benchcollision: ball sweeps through each broadphase against the loop over every triangle
+	//-benchballs: physics steps with more and more balls on the table, the cost per ball should stay flat
+	for (int i = 1; i < argc; i++)
+	{
+		if (string(argv[i]) == "-benchnormals")
+			NormalMatrixBenchmark::Print(NormalMatrixBenchmark::Run(objectList, frameUniforms, lightClusters), cout);
+		if (string(argv[i]) == "-benchcollision")
+			physicsWorld.BenchmarkCollision(BALL_RADIUS * unitsPerMeter, BALL_MAX_SPEED / (float)PHYSICS_RATE * unitsPerMeter, cout);
+		if (string(argv[i]) == "-benchballs")
+			physicsWorld.BenchmarkBalls({ 1, 6, 25, 100, 250, 500, 1000, 2500, 5000 }, BALL_RADIUS * unitsPerMeter, cout);
+		if (string(argv[i]) == "-benchshaders")
+			ShaderBatch::Benchmark(
+			{
+				{ "VertexShader.vert", "FragmentShader.frag", ShaderDefines() },
+				{ "VertexShader.vert", "FragmentShader.frag", instanced },
+				{ "VertexShader.vert", "FragmentShader.frag", flashlight },
+				{ "VertexShader.vert", "FragmentShader.frag", ShaderDefines(flashlight).Define("INSTANCED") },
+				{ "VertexShader.vert", "FragmentShader.frag", ShaderDefines().Define("LIGHTMAP") },
+				{ "VertexShader.vert", "FragmentShader.frag", ShaderDefines(flashlight).Define("LIGHTMAP") },
+				{ "LampShader.vert", "LampShader.frag", ShaderDefines() },
+				{ "LampShader.vert", "LampShader.frag", instanced },
+				{ "DepthShader.vert", "DepthShader.frag", ShaderDefines() },
+				{ "DepthShader.vert", "DepthShader.frag", instanced }
+			}, cout);
+	}
+
+	physicsWorld.SpawnBalls(ballCount, BALL_RADIUS * unitsPerMeter);
+
 #pragma region Game Loop
-	lightingShader.StartPipelineProgram();
-	lightingShader.setInt("material.diffuse", 2); // or with shader class
-	lightingShader.setInt("material.specular", 1);
+	for (Shader *shader : litShaders)
+	{
+		shader->StartPipelineProgram();
+		shader->setInt("material.diffuse", 2); // or with shader class
+		shader->setInt("material.specular", 1);
+	}
+	for (Shader *shader : { &lightmappedShader, &lightmappedFlashlightShader })
+	{
+		shader->StartPipelineProgram();
+		shader->setInt("lightmap", LIGHTMAP_TEXTURE_UNIT);
+		shader->setInt("bakedPointLights", (int)staticLights.points.size());
+	}
+
+	bool textureReportPrinted = false;
+	bool uniformReportPrinted = false;
+	RenderQueue renderQueue;
+	renderQueue.SetDepthShaders(depthShader, instancedDepthShader);
+	InstanceBuffer instanceBuffer;
+	FrustumCuller frustumCuller;
+
+	//Copies of the top bumper across a plane in front of the table, tinted by position.
+	//They never move, so their normal matrices are computed once here.
+	vector<InstanceData> grid;
+	for (int y = 0; y < INSTANCE_GRID_SIZE; y++)
+		for (int x = 0; x < INSTANCE_GRID_SIZE; x++)
+		{
+			vec2 cell = vec2(x, y) / float(INSTANCE_GRID_SIZE - 1);
+			mat4 transform = translate(mat4(1.0f), vec3(cell.x * 4.0f - 2.0f, cell.y * 4.0f - 2.0f, -3.0f));
+			transform = scale(transform, vec3(0.15f));
+			grid.push_back(InstanceData(transform, vec4(cell.x, cell.y, 1.0f - cell.x, 1.0f), (x + y) % 4 == 0 ? 0.5f : 0.0f));
+		}
+	//Insert lamps in a jittered grid over the front of the frame, each in its own color
+	vector<lightsettings> insertLamps;
+	const BoundingBox &table = objectList[0].bounds.box;
+	for (int i = 0; i < INSERT_LAMP_COUNT; i++)
+	{
+		vec2 cell = vec2(i % 10, i / 10) / vec2(9.0f, INSERT_LAMP_COUNT / 10 - 1.0f);
+		vec3 position = table.Empty() ? vec3(cell * 2.0f - 1.0f, 0.1f) :
+			vec3(mix(table.min.x, table.max.x, cell.x), mix(table.min.y, table.max.y, cell.y), table.max.z + 0.05f);
+		position += vec3(linearRand(vec2(-0.02f), vec2(0.02f)), 0.0f);
+		vec3 color = clamp(abs(mod(vec3(0.0f, 4.0f, 2.0f) + i * 0.37f, 6.0f) - 3.0f) - 1.0f, 0.0f, 1.0f);
+		insertLamps.push_back({ "insertLamp", position, color * 0.05f, color * 0.6f, color * 0.3f, 1.0f, 10.0f, 200.0f });
+	}
+
+	//Headless runs draw into their own framebuffer, with every texture in place before the first measured frame
+	RenderTarget renderTarget;
+	CameraPath cameraPath = CameraPath::Default();
+	FrameTimings frameTimings;
+	int headlessFrame = 0;
+	if (headless)
+	{
+		if (!renderTarget.Create(WINDOW_WIDTH, WINDOW_HEIGHT))
+			return -1;
+		if (!cameraPathFile.empty() && !cameraPath.Load(cameraPathFile))
+			return -1;
+		TextureStreamer::Shared().Flush();
+	}
+	ProfilerOverlay profilerOverlay;
+	if (!tracePath.empty())
+		Profiler::Shared().StartCapture(tracePath, headless ? headlessFrames : PROFILE_CAPTURE_FRAMES);
+	Shader::ResetUniformStats(); //the programs are linked, from here on every frame should do 0 GL location queries
+	physicsClock.Reset();
+	if (!headless)
+		lastFrame = glfwGetTime(); //loading isn't simulation time
 
 	//====Game loop====
-	while (!glfwWindowShouldClose(window)) //Check if the window is supposed to close
+	while (headless ? headlessFrame < headlessFrames : !glfwWindowShouldClose(window)) //Check if the window is supposed to close
 	{
-		//per-frame time logic
-		float currentFrame = glfwGetTime();
-		deltaTime = currentFrame - lastFrame;
-		lastFrame = currentFrame;
+		if (headless)
+		{
+			//Scripted camera instead of input, looping if there are more frames than path
+			deltaTime = HEADLESS_FRAME_TIME;
+			float pathTime = headlessFrame * HEADLESS_FRAME_TIME;
+			if (cameraPath.Duration() > 0.0f)
+				pathTime = fmod(pathTime, cameraPath.Duration());
+			cameraPath.Apply(camera, pathTime);
+			bool flip = fmod(headlessFrame * HEADLESS_FRAME_TIME, 1.0f) < HEADLESS_FLIP_TIME;
+			physicsWorld.SetFlipper(flippers[0], flip);
+			physicsWorld.SetFlipper(flippers[1], flip);
+			frameTimings.BeginFrame();
+			renderTarget.Bind();
+		}
+		else
+		{
+			//per-frame time logic
+			float currentFrame = glfwGetTime();
+			deltaTime = currentFrame - lastFrame;
+			lastFrame = currentFrame;
+
+			//Input commands
+			processInput(window);
+			physicsWorld.SetBroadphase(broadphase);
+			physicsWorld.SetFlipper(flippers[0], glfwGetKey(window, GLFW_KEY_LEFT_SHIFT) == GLFW_PRESS);
+			physicsWorld.SetFlipper(flippers[1], glfwGetKey(window, GLFW_KEY_RIGHT_SHIFT) == GLFW_PRESS);
+			physicsWorld.SpawnBalls(ballsToDrop, BALL_RADIUS * unitsPerMeter);
+			ballsToDrop = 0;
+		}
+		Profiler::Shared().BeginFrame();
+
+		//As many fixed steps as fit into the frame's time, the rest carries over to the next frame
+		{
+			ProfileScope scope("Physics", false);
+			physicsWorld.Simulate(physicsClock.Advance(deltaTime), (float)physicsClock.StepTime());
+		}
+		float physicsAlpha = physicsClock.Alpha();
 
-		//Input commands
-		processInput(window);
+		//Stream in any textures that finished decoding
+		{
+			ProfileScope scope("Textures");
+			TextureStreamer::Shared().Update();
+		}
+		if (!textureReportPrinted && TextureStreamer::Shared().PendingCount() == 0)
+		{
+			TextureCache::Shared().Report(cout);
+			textureReportPrinted = true;
+		}
     
 		//Rendering commands
-		glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
-		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+		{
+			ProfileScope scope("Clear");
+			glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+			glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+		}
 
 		//Bind textures
 		glActiveTexture(GL_TEXTURE0);
@@ -218,75 +574,130 @@ int main()
 		glBindTexture(GL_TEXTURE_2D, crate_specular);
 		glActiveTexture(GL_TEXTURE2);
 		glBindTexture(GL_TEXTURE_2D, pinball_diffuse);
+		glActiveTexture(GL_TEXTURE0 + LIGHTMAP_TEXTURE_UNIT);
+		glBindTexture(GL_TEXTURE_2D, objectList[0].lightmap.Texture());
+		glActiveTexture(GL_TEXTURE0);
 
 		//View/Projection/world transform
 		mat4 projection = perspective(glm::radians(camera.Zoom), (float)WINDOW_WIDTH / (float)WINDOW_HEIGHT, 0.1f, 100.0f);
 		mat4 view = camera.GetViewMatrix();
 		mat4 model = mat4(1.0f);
-		lightingShader.StartPipelineProgram(projection, view, model);
-		lightingShader.setVec3("viewPos", camera.Position);
-		lightingShader.setFloat("material.shininess", 32.0f);
+		frameUniforms.SetCamera(projection, view, camera.Position);
+		Shader &litShader = flashlightOn ? flashlightShader : lightingShader;
+		Shader &instancedLitShader = flashlightOn ? instancedFlashlightShader : instancedLightingShader;
+		Shader &frameShader = useLightmap && objectList[0].lightmap.Baked() ?
+			(flashlightOn ? lightmappedFlashlightShader : lightmappedShader) : litShader;
+		frameShader.StartPipelineProgram(model);
+		frameShader.setFloat("material.shininess", 32.0f);
+		litShader.StartPipelineProgram(model);
+		litShader.setFloat("material.shininess", 32.0f);
+		instancedLitShader.StartPipelineProgram();
+		instancedLitShader.setFloat("material.shininess", 32.0f);
 
 		//####Lighting shader######
 		#pragma region Lighting shader
 		lightsettings settings;
 
 		// directional light
-		lightingShader.setVec3("dirLight.direction", vec3(-0.2f, -1.0f, -0.3f));
-		lightingShader.setVec3("dirLight.ambient", vec3(0.05f, 0.05f, 0.05f));
-		lightingShader.setVec3("dirLight.diffuse", vec3(0.4f, 0.4f, 0.4f));
-		lightingShader.setVec3("dirLight.specular", vec3(0.5f, 0.5f, 0.5f));
-		// point light 1
-		settings = { "pointLights[0]", objectList[3].position, vec3(0.5f, 0.5f, 0.5f),
-					vec3(.2f, 0.0f, 0.0f), vec3(1.0f, 1.0f, 1.0f), 1.0f, 0.09f, 0.032f };
-		lightingShader.setPointLight(settings);
-
-		// point light 2
-		settings.name = "pointLights[1]";
-		settings.ambient = vec3(0.0f, 0.0f, .2f);
-		settings.specular = vec3(1.0f, 1.0f, 1.f);
-
-		settings.position = objectList[4].position;
-		lightingShader.setPointLight(settings);
-
-		// point light 3
-		settings.name = "pointLights[2]";
-		settings.ambient = vec3(0.0f, .2f, 0.0f);
-		settings.position = objectList[5].position;
-		lightingShader.setPointLight(settings);
-
-		// point light 4
-		settings.name = "pointLights[3]";
-		settings.ambient = vec3(0.0f, 0.0f, 0.0f);
-		settings.position = pointLightPositions[3];
-		lightingShader.setPointLight(settings);
+		const DirectionalLight &sun = staticLights.sun;
+		frameUniforms.SetDirLight(sun.direction, sun.ambient, sun.diffuse, sun.specular);
+		// point lights, all of them go through the cluster grid. The static ones first, their index marks them as baked
+		lightClusters.Clear();
+		for (size_t i = 0; i < staticLights.points.size(); i++)
+			lightClusters.Add(staticLights.points[i]);
+
+		// insert lamps
+		if (showInsertLamps)
+			for (size_t i = 0; i < insertLamps.size(); i++)
+				lightClusters.Add(insertLamps[i]);
+
+		int framebufferWidth = renderTarget.Width(), framebufferHeight = renderTarget.Height();
+		if (!headless)
+			glfwGetFramebufferSize(window, &framebufferWidth, &framebufferHeight);
+		{
+			ProfileScope scope("Light clusters");
+			lightClusters.Build(projection, view, 0.1f, 100.0f, framebufferWidth, framebufferHeight);
+			lightClusters.Upload();
+		}
+		frameUniforms.SetClusters(lightClusters.Block());
 		//spotLight
-		lightingShader.setPointLight(settings);
-		lightingShader.setVec3("spotLight.position", camera.Position);
-		lightingShader.setVec3("spotLight.direction", camera.Front);
-		lightingShader.setVec3("spotLight.ambient", vec3(0.0f, 0.0f, 0.0f));
-		lightingShader.setVec3("spotLight.diffuse", vec3(1.0f, 1.0f, 1.0f));
-		lightingShader.setVec3("spotLight.specular", vec3(1.0f, 1.0f, 1.0f));
-		lightingShader.setFloat("spotLight.constant", 1.0f);
-		lightingShader.setFloat("spotLight.linear", 0.09);
-		lightingShader.setFloat("spotLight.quadratic", 0.032);
-		lightingShader.setFloat("spotLight.cutOff", glm::cos(glm::radians(12.5f)));
-		lightingShader.setFloat("spotLight.outerCutOff", glm::cos(glm::radians(15.0f)));
+		settings = { "spotLight", camera.Position, vec3(0.0f, 0.0f, 0.0f),
+					vec3(1.0f, 1.0f, 1.0f), vec3(1.0f, 1.0f, 1.0f), 1.0f, 0.09f, 0.032f };
+		frameUniforms.SetSpotLight(settings, camera.Front, glm::cos(glm::radians(12.5f)), glm::cos(glm::radians(15.0f)));
+
+		//One buffer update for the whole frame's camera and lights
+		frameUniforms.Upload();
 		#pragma endregion
 
 		//Render the test cube
-		glBindVertexArray(cubeVAO);
+		BindVertexArray(cubeVAO);
 		model = scale(model, glm::vec3(1.2f, 1.4f, 1.2f));
-		lightingShader.setMat4("model", model);
+		litShader.setMat4(MODEL_UNIFORM, model);
 		//glDrawArrays(GL_TRIANGLES, 0, 36);
 
 		model = mat4(1.0f);
-		lightingShader.setMat4("model", model);
+		litShader.setMat4(MODEL_UNIFORM, model);
 
-		//Draw our Objects
+		//Cull against this frame's view first, everything after only queues what's visible
+		int cullingSection = Profiler::Shared().Begin("Culling", false);
+		frustumCuller.Begin(Frustum(projection * view));
+		size_t objectBounds[6];
 		for (int i = 0; i < 6; i++)
 		{
-			objectList[i].Draw(lightingShader);
+			//Only rebuilds the normal matrix if the model actually changed, the flippers between their last two steps
+			objectList[i].transform.Set(i == 1 || i == 2 ? physicsWorld.FlipperTransform(flippers[i - 1], physicsAlpha) : model);
+			objectBounds[i] = objectList[i].AddBounds(frustumCuller);
+		}
+		size_t gridBounds = 0;
+		if (showInstanceGrid)
+		{
+			gridBounds = frustumCuller.Count();
+			for (size_t i = 0; i < grid.size(); i++)
+				frustumCuller.Add(objectList[5].bounds.box.Transformed(grid[i].model));
+		}
+		frustumCuller.Cull();
+		Profiler::Shared().End(cullingSection);
+
+		//Queue our Objects, the render queue sorts them by state once everything is in
+		renderQueue.SetCamera(camera.Position, 100.0f);
+		renderQueue.SetDepthPrepass(depthPrepass);
+		for (int i = 0; i < 3; i++)
+		{
+			objectList[i].Submit(renderQueue, PASS_OPAQUE, i == 0 ? frameShader : litShader, frustumCuller, objectBounds[i]);
+		}
+
+		//The bumpers go through the instancing path, each one is a batch of its own model
+		instanceBuffer.Clear();
+		size_t bumperInstances[3];
+		for (int i = 3; i < 6; i++)
+		{
+			if (!frustumCuller.Visible(objectBounds[i]))
+				continue;
+			InstanceData bumper(objectList[i].transform);
+			bumperInstances[i - 3] = instanceBuffer.Add(&bumper, 1);
+			objectList[i].SubmitInstanced(renderQueue, PASS_OPAQUE, instancedLitShader, instanceBuffer, bumperInstances[i - 3], 1);
+		}
+		if (showInstanceGrid)
+		{
+			//Only the visible copies go into the instance buffer
+			size_t gridFirst = instanceBuffer.Count();
+			for (size_t i = 0; i < grid.size(); i++)
+				if (frustumCuller.Visible(gridBounds + i))
+					instanceBuffer.Add(&grid[i], 1);
+			objectList[5].SubmitInstanced(renderQueue, PASS_OPAQUE, instancedLitShader, instanceBuffer, gridFirst, instanceBuffer.Count() - gridFirst);
+		}
+		//All the balls in one instanced draw, between their last two physics steps
+		const BallSystem &balls = physicsWorld.Balls();
+		if (balls.Count() > 0)
+		{
+			size_t ballFirst = instanceBuffer.Count();
+			for (size_t i = 0; i < balls.Count(); i++)
+			{
+				InstanceData ball(scale(translate(mat4(1.0f), balls.Interpolated(i, physicsAlpha)), vec3(balls.Radius(i))), BALL_TINT);
+				instanceBuffer.Add(&ball, 1);
+			}
+			renderQueue.SubmitInstanced(PASS_OPAQUE, instancedLitShader, ballMesh.Geometry(), ballMesh.range, ballMesh.material,
+				instanceBuffer, ballFirst, balls.Count());
 		}
 		
 
@@ -294,9 +705,9 @@ int main()
 		model = mat4(1.0f);
 		model = translate(model, lightPos);
 		model = scale(model, vec3(0.2f));
-		lampShader.StartPipelineProgram(projection, view, model);
+		lampShader.StartPipelineProgram(model);
 
-		glBindVertexArray(lampVAO);
+		BindVertexArray(lampVAO);
 		/*for (unsigned int i = 0; i < 4; i++)
 		{
 			switch (i)
@@ -317,26 +728,102 @@ int main()
 			model = mat4(1.0f);
 			model = translate(model, pointLightPositions[i]);
 			model = scale(model, vec3(0.2f));
-			lampShader.setMat4("model", model);
+			lampShader.setMat4(MODEL_UNIFORM, model);
 			glDrawArrays(GL_TRIANGLES, 0, 36);
 		}*/
 
 		lampShader.setVec3("color", vec3(0.0, 0.0, 1.0));
 		model = mat4(1.0f);
-		lampShader.setMat4("model", model);
-		for (int i = 2; i < 6; i++)
+		lampShader.setMat4(MODEL_UNIFORM, model);
+		objectList[2].Submit(renderQueue, PASS_EMISSIVE, lampShader, frustumCuller, objectBounds[2]);
+		instancedLampShader.StartPipelineProgram();
+		instancedLampShader.setVec3("color", vec3(0.0, 0.0, 1.0));
+		for (int i = 3; i < 6; i++)
+		{
+			if (!frustumCuller.Visible(objectBounds[i]))
+				continue;
+			objectList[i].SubmitInstanced(renderQueue, PASS_EMISSIVE, instancedLampShader, instanceBuffer, bumperInstances[i - 3], 1);
+		}
+
+		//Draw everything queued this frame, all instances go up in one buffer update
+		instanceBuffer.Upload();
+		renderQueue.Execute();
+
+		//Averages of the frames read back so far, over everything else
+		if (showProfiler && !headless)
+		{
+			ProfileScope scope("Overlay");
+			profilerOverlay.Draw(Profiler::Shared(), framebufferWidth, framebufferHeight);
+		}
+
+		//Uniform location lookups of one frame, so regressions show up
+		if (!uniformReportPrinted)
+		{
+			const Shader::UniformStats &uniforms = Shader::FrameUniformStats();
+			cout << "UNIFORMS:: " << uniforms.lookups << " lookups, " << uniforms.misses << " misses, "
+				<< uniforms.glQueries << " GL location queries per frame" << endl;
+			renderQueue.PrintStats(cout);
+			const FrustumCuller::Stats &culling = frustumCuller.LastStats();
+			cout << "CULLING:: " << culling.tested << " boxes tested, " << culling.visible << " visible, "
+				<< culling.culled << " culled" << endl;
+			const LightClusters::Stats &clusters = lightClusters.LastStats();
+			cout << "LIGHT CLUSTERS:: " << clusters.lights << " lights, " << clusters.indices << " cluster entries, "
+				<< clusters.occupiedClusters << " lit clusters, at most " << clusters.maxPerCluster << " lights in one" << endl;
+			uniformReportPrinted = true;
+		}
+		Shader::ResetUniformStats();
+
+		if (headless)
 		{
-			objectList[i].Draw(lampShader);
+			frameTimings.EndFrame();
+			Profiler::Shared().EndFrame();
+			headlessFrame++;
+			continue;
 		}
 
 		//Check and call events | Buffer swapping
-		glfwSwapBuffers(window);
+		{
+			ProfileScope scope("Swap");
+			glfwSwapBuffers(window);
+		}
+		Profiler::Shared().EndFrame();
 		glfwPollEvents(); //Checks for events triggerd (Ex: keyboard or mouse input)
 	}
 
+	//The last frames' GPU times are still in flight
+	Profiler::Shared().Flush();
+	if (Profiler::Shared().Capturing())
+		Profiler::Shared().StopCapture();
+
+	if (headless)
+	{
+		frameTimings.Finish();
+		frameTimings.PrintSummary(cout);
+		physicsClock.PrintStats(cout);
+		physicsWorld.PrintStats(cout);
+		if (frameTimings.Write(timingsPath))
+			cout << "FRAME TIMINGS:: written to " << timingsPath << endl;
+		if (!screenshotPath.empty())
+			renderTarget.SavePPM(screenshotPath);
+	}
+
 	glDeleteVertexArrays(1, &lampVAO);
 	glDeleteVertexArrays(1, &cubeVAO);
 	glDeleteBuffers(1, &VBO);
+	TextureCache::Shared().Release(crate_diffuse);
+	TextureCache::Shared().Release(crate_specular);
+	TextureCache::Shared().Release(pinball_diffuse);
+	for (size_t i = 0; i < objectList.size(); i++)
+		objectList[i].ReleaseTextures();
+	GeometryBuffer::ReleaseAll();
+	frameUniforms.Release();
+	instanceBuffer.Release();
+	lightClusters.Release();
+	renderTarget.Release();
+	frameTimings.Release();
+	profilerOverlay.Release();
+	Profiler::Shared().Release();
+	headlessContext.Release();
 	//After exiting the main loop we need to clean/delet all resources
 	glfwTerminate();
 #pragma endregion
@@ -368,47 +855,103 @@ void processInput(GLFWwindow *window)
 		camera.ProcessKeyboard(DOWN, deltaTime);
 	if (glfwGetKey(window, GLFW_KEY_R) == GLFW_PRESS)
 		camera.Position = vec3(0.0f, 0.0f, 3.0f);
+
+	//Toggle on press, not every frame the key is held
+	static bool instanceKeyDown = false;
+	bool instanceKey = glfwGetKey(window, GLFW_KEY_I) == GLFW_PRESS;
+	if (instanceKey && !instanceKeyDown)
+		showInstanceGrid = !showInstanceGrid;
+	instanceKeyDown = instanceKey;
+
+	static bool lampKeyDown = false;
+	bool lampKey = glfwGetKey(window, GLFW_KEY_L) == GLFW_PRESS;
+	if (lampKey && !lampKeyDown)
+		showInsertLamps = !showInsertLamps;
+	lampKeyDown = lampKey;
+
+	static bool flashlightKeyDown = false;
+	bool flashlightKey = glfwGetKey(window, GLFW_KEY_F) == GLFW_PRESS;
+	if (flashlightKey && !flashlightKeyDown)
+		flashlightOn = !flashlightOn;
+	flashlightKeyDown = flashlightKey;
+
+	static bool lightmapKeyDown = false;
+	bool lightmapKey = glfwGetKey(window, GLFW_KEY_B) == GLFW_PRESS;
+	if (lightmapKey && !lightmapKeyDown)
+		useLightmap = !useLightmap;
+	lightmapKeyDown = lightmapKey;
+
+	static bool depthKeyDown = false;
+	bool depthKey = glfwGetKey(window, GLFW_KEY_Z) == GLFW_PRESS;
+	if (depthKey && !depthKeyDown)
+		depthPrepass = !depthPrepass;
+	depthKeyDown = depthKey;
+
+	static bool broadphaseKeyDown = false;
+	bool broadphaseKey = glfwGetKey(window, GLFW_KEY_G) == GLFW_PRESS;
+	if (broadphaseKey && !broadphaseKeyDown)
+	{
+		broadphase = (Broadphase)((broadphase + 1) % BROADPHASE_COUNT);
+		cout << "PHYSICS:: broadphase " << BROADPHASE_NAMES[broadphase] << endl;
+	}
+	broadphaseKeyDown = broadphaseKey;
+
+	static bool ballKeyDown = false;
+	bool ballKey = glfwGetKey(window, GLFW_KEY_N) == GLFW_PRESS;
+	if (ballKey && !ballKeyDown)
+		ballsToDrop++;
+	ballKeyDown = ballKey;
+
+	static bool profilerKeyDown = false;
+	bool profilerKey = glfwGetKey(window, GLFW_KEY_O) == GLFW_PRESS;
+	if (profilerKey && !profilerKeyDown)
+		showProfiler = !showProfiler;
+	profilerKeyDown = profilerKey;
+
+	static bool captureKeyDown = false;
+	bool captureKey = glfwGetKey(window, GLFW_KEY_T) == GLFW_PRESS;
+	if (captureKey && !captureKeyDown && !Profiler::Shared().Capturing())
+		Profiler::Shared().StartCapture(PROFILE_TRACE_PATH, PROFILE_CAPTURE_FRAMES);
+	captureKeyDown = captureKey;
 }
 
 unsigned int LoadTexture(string path)
 {
-	//Loading in Texture
-	unsigned int textureID;
-	// texture 1
-	// ---------
-	glGenTextures(1, &textureID);
-	glBindTexture(GL_TEXTURE_2D, textureID);
-
-	// load image, create texture and generate mipmaps
-	int width, height, nrComponents;
-	stbi_set_flip_vertically_on_load(true); // tell stb_image.h to flip loaded texture's on the y-axis.
-											// The FileSystem::getPath(...) is part of the GitHub repository so we can find files on any IDE/platform; replace it with your own image path.
-	unsigned char *data = stbi_load(path.c_str(), &width, &height, &nrComponents, 0);
-	if (data)
-	{
-		GLenum format;
-		if (nrComponents == 1)
-			format = GL_RED;
-		else if (nrComponents == 3)
-			format = GL_RGB;
-		else if (nrComponents == 4)
-			format = GL_RGBA;
-
-		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, format, GL_UNSIGNED_BYTE, data);
-		glGenerateMipmap(GL_TEXTURE_2D);
-
-		// set the texture wrapping parameters & filtering parameters
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);	// set texture wrapping to GL_REPEAT (default wrapping method)
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR); //Filtering parameters
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-		stbi_image_free(data);
-	}
-	else
+	//Shared with every other user of the same file through the texture cache.
+	//The texture shows a placeholder until the streamer has decoded and uploaded it
+	return TextureCache::Shared().Acquire(path, TextureParams(true, false)); // flip loaded texture's on the y-axis.
+}
+
+/*
+* Unit sphere around the origin, segments around z and rings from pole to pole
+*/
+Mesh CreateSphere(int segments, int rings)
+{
+	vector<Vertex> vertices;
+	vector<unsigned int> indices;
+	for (int ring = 0; ring <= rings; ring++)
 	{
-		std::cout << "Failed to load texture" << std::endl;
+		float polar = pi<float>() * ring / rings;
+		for (int segment = 0; segment <= segments; segment++)
+		{
+			float azimuth = two_pi<float>() * segment / segments;
+			Vertex vertex = {};
+			vertex.Normal = vec3(sin(polar) * cos(azimuth), sin(polar) * sin(azimuth), cos(polar));
+			vertex.Position = vertex.Normal;
+			vertex.TexCoords = vec2((float)segment / segments, 1.0f - (float)ring / rings);
+			vertex.Tangent = vec3(-sin(azimuth), cos(azimuth), 0.0f);
+			vertex.Bitangent = cross(vertex.Normal, vertex.Tangent);
+			vertices.push_back(vertex);
+		}
 	}
-	return textureID;
+	for (int ring = 0; ring < rings; ring++)
+		for (int segment = 0; segment < segments; segment++)
+		{
+			unsigned int top = ring * (segments + 1) + segment, bottom = top + segments + 1;
+			unsigned int quad[] = { top, bottom, top + 1, top + 1, bottom, bottom + 1 };
+			indices.insert(indices.end(), quad, quad + 6);
+		}
+	return Mesh(move(vertices), move(indices), vector<Texture>());
 }
 #pragma endregion
 